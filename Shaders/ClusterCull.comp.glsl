@@ -0,0 +1,357 @@
+#version 450
+
+// Cluster culling for the vertex pipeline, on devices without mesh shaders.
+// One workgroup per task command of `DrawCommand.comp` (TASK = 1): the meshlets are culled like in `SimpleMesh.task`, the triangles
+// of the accepted ones like in `SimpleMesh.mesh`, then the surviving triangles are appended to a compacted index buffer with one
+// indirect draw per meshlet. `SimpleMesh.vert` draws them unchanged, the draw commands carry the draw ids.
+
+#define CULL 1
+
+#extension GL_GOOGLE_include_directive	: require
+#include "MeshCommon.h"
+
+#define GROUP_SIZE TASK_GROUP_SIZE
+
+// Free bindings of the mesh pipeline layout, after the view and debug uniforms
+#define DESC_CLUSTER_DRAW_COMMAND_BUFFER 9
+#define DESC_CLUSTER_INDEX_BUFFER 10
+#define DESC_CLUSTER_COUNT_BUFFER 11
+
+// Meshlet and triangle counters of `CullStats.h`
+layout (constant_id = 6) const uint CULL_STATS = 0;
+
+layout (push_constant) uniform PushConstants
+{
+	uint pass;
+} _States;
+
+
+layout (std430, binding = DESC_VERTEX_BUFFER) readonly buffer Vertices
+{
+	Vertex vertices[];
+};
+
+layout (std430, binding = DESC_VERTEX_BUFFER) readonly buffer PackedVertices
+{
+	PackedVertex packedVertices[];
+};
+
+layout (std430, binding = DESC_MESH_BOUNDS_BUFFER) readonly buffer Meshes
+{
+	Mesh meshes[];
+};
+
+layout (std430, binding = DESC_DRAW_DATA_BUFFER) readonly buffer Draws
+{
+	MeshDraw draws[];
+};
+
+layout (std430, binding = DESC_DRAW_DATA_BUFFER) readonly buffer PackedDraws
+{
+	PackedMeshDraw packedDraws[];
+};
+
+layout (std430, binding = DESC_DRAW_COMMAND_BUFFER) readonly buffer TaskCommands
+{
+	MeshTaskCommand taskCommands[];
+};
+
+layout (std430, binding = DESC_MESHLET_BUFFER) readonly buffer Meshlets
+{
+	Meshlet meshlets[];
+};
+
+layout (std430, binding = DESC_MESHLET_BUFFER) readonly buffer PackedMeshlets
+{
+	PackedMeshlet packedMeshlets[];
+};
+
+layout (std430, binding = DESC_MESHLET_DATA_BUFFER) readonly buffer MeshletData
+{
+	uint meshletData[];
+};
+
+layout (std430, binding = DESC_MESHLET_VISIBILITY_BUFFER) buffer MeshletVisibilities
+{
+	uint meshletVisibilities[];
+};
+
+layout (binding = DESC_DEPTH_PYRAMID) uniform sampler2D depthPyramid;
+
+layout (std430, binding = DESC_CLUSTER_DRAW_COMMAND_BUFFER) writeonly buffer ClusterDrawCommands
+{
+	MeshDrawCommand clusterDrawCommands[];
+};
+
+layout (std430, binding = DESC_CLUSTER_INDEX_BUFFER) writeonly buffer ClusterIndices
+{
+	uint clusterIndices[];
+};
+
+layout (std430, binding = DESC_CLUSTER_COUNT_BUFFER) buffer ClusterCounts
+{
+	uint clusterDrawCount;
+	uint clusterIndexCount;
+};
+
+layout (std430, binding = DESC_CULL_STATS_BUFFER) buffer CullStats
+{
+	uint cullStats[];
+};
+
+#include "CullStats.h"
+
+
+shared uint sh_MeshletCount;
+shared uint sh_MeshletIndices[GROUP_SIZE];
+
+shared vec3 sh_VertexClip[MAX_VERTICES];
+shared uint sh_TriangleCount;
+shared uint sh_Triangles[MAX_PRIMITIVES]; // 3 x 8 bit meshlet vertex indices
+shared uint sh_IndexOffset;
+
+
+layout (local_size_x = GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+void main()
+{
+	const uint groupId = gl_WorkGroupID.x;
+	const uint localThreadId = gl_LocalInvocationID.x;
+
+	const MeshTaskCommand taskCommand = taskCommands[groupId];
+	const uint drawId = taskCommand.drawId;
+	const MeshDraw meshDraw = LOAD_MESH_DRAW(drawId);
+
+	const mat4 worldMatrix = BuildWorldMatrix(meshDraw.worldMatRow0, meshDraw.worldMatRow1, meshDraw.worldMatRow2);
+
+	const uint meshletIndex = taskCommand.taskOffset + localThreadId;
+	const uint drawVisibility = taskCommand.meshletVisibilityData & 1;
+	const uint meshletVisibilityIndex = localThreadId + (taskCommand.meshletVisibilityData >> 1);
+
+	const bool valid = localThreadId < taskCommand.taskCount;
+	const uint pass = _States.pass;
+
+	if (localThreadId == 0)
+		sh_MeshletCount = 0;
+
+	barrier();
+
+	uint meshletCullStage = CULL_STATS_NONE;
+	bool bEmitted = false;
+
+	// Meshlets, same as `SimpleMesh.task`
+	if (valid)
+	{
+		const uint meshletVisibility = (meshletVisibilities[meshletVisibilityIndex >> 5]) & (1u << (meshletVisibilityIndex & 31));
+
+		bool accept = _DebugParams.meshletOcclusionCulling == 0 || pass > 0 || meshletVisibility > 0;
+		bool skip = pass > 0 && drawVisibility > 0 && meshletVisibility > 0;
+		meshletCullStage = GetCullStage(meshletCullStage, !accept, CULL_STATS_MESHLETS_OCCLUSION_CULLED);
+
+	#if CULL
+		vec3 scale = GetScaleFromWorldMatrix(worldMatrix);
+
+		vec4 cone = LOAD_MESHLET_CONE(meshletIndex);
+		cone.xyz = normalize(mat3(worldMatrix) * cone.xyz);
+
+		vec4 boundingSphere = LOAD_MESHLET_SPHERE(meshletIndex, meshes[meshDraw.meshIndex].boundingSphere);
+		boundingSphere.xyz = (worldMatrix * vec4(boundingSphere.xyz, 1.0)).xyz;
+		boundingSphere.w *= scale.x; // just uniform scale
+
+		if (_DebugParams.meshletConeCulling > 0)
+			accept = accept && !ConeCull_BoundingSphere(cone, boundingSphere, _View.camPos);
+		meshletCullStage = GetCullStage(meshletCullStage, !accept, CULL_STATS_MESHLETS_CONE_CULLED);
+
+		boundingSphere.xyz = (_View.viewMatrix * vec4(boundingSphere.xyz, 1.0f)).xyz;
+
+		if (_DebugParams.meshletFrustumCulling > 0)
+			accept = accept && !FrustumCull(boundingSphere);
+		meshletCullStage = GetCullStage(meshletCullStage, !accept, CULL_STATS_MESHLETS_FRUSTUM_CULLED);
+
+		if (_DebugParams.meshletOcclusionCulling > 0 && pass > 0)
+			accept = accept && !OcclusionCull(depthPyramid, boundingSphere);
+		meshletCullStage = GetCullStage(meshletCullStage, !accept, CULL_STATS_MESHLETS_OCCLUSION_CULLED);
+	#endif
+
+		bEmitted = accept && !skip;
+		if (bEmitted)
+		{
+			uint index = atomicAdd(sh_MeshletCount, 1);
+			sh_MeshletIndices[index] = meshletIndex;
+		}
+
+		if (pass > 0)
+		{
+			uint meshletVisibilityUInt = 1u << (meshletVisibilityIndex & 31);
+			if (accept)
+				atomicOr (meshletVisibilities[(meshletVisibilityIndex >> 5)],  meshletVisibilityUInt);
+			else
+				atomicAnd(meshletVisibilities[(meshletVisibilityIndex >> 5)], ~meshletVisibilityUInt);
+		}
+	}
+
+	AddMeshletCullStats(pass, valid, meshletCullStage, bEmitted);
+
+	barrier();
+
+	const uint meshletCount = sh_MeshletCount;
+	const bool triangleCulling = CULL > 0 && (_DebugParams.triBackfaceCulling > 0 || _DebugParams.triSmallCulling > 0);
+
+	// Triangles of the invocation for the stats
+	uint testedTriangleCount = 0;
+	uint backfaceTriangleCount = 0;
+	uint smallTriangleCount = 0;
+
+	// Triangles of the accepted meshlets, same as `SimpleMesh.mesh`
+	for (uint m = 0; m < meshletCount; ++m)
+	{
+		const uint acceptedMeshletIndex = sh_MeshletIndices[m];
+
+		const uint vertexCount = LOAD_MESHLET_VERTEX_COUNT(acceptedMeshletIndex);
+		const uint triangleCount = LOAD_MESHLET_TRIANGLE_COUNT(acceptedMeshletIndex);
+		const uint vertexOffset = LOAD_MESHLET_VERTEX_OFFSET(acceptedMeshletIndex);
+		const uint indexOffset = vertexOffset + vertexCount;
+
+		if (localThreadId == 0)
+			sh_TriangleCount = 0;
+
+		if (triangleCulling)
+		{
+			for (uint i = localThreadId; i < vertexCount; i += GROUP_SIZE)
+			{
+				uint vi = meshletData[vertexOffset + i] + meshDraw.vertexOffset;
+
+				vec3 posOS = LOAD_VERTEX_POSITION(vi, meshes[meshDraw.meshIndex]);
+				vec4 position = _View.viewProjMatrix * worldMatrix * vec4(posOS, 1.0);
+
+				sh_VertexClip[i] = vec3(position.xy / position.w, position.w);
+			}
+		}
+
+		barrier();
+
+		for (uint i = localThreadId; i < triangleCount; i += GROUP_SIZE)
+		{
+			uint indices = meshletData[indexOffset + i];
+
+			bool culled = false;
+			uint cullStage = CULL_STATS_NONE;
+
+			if (triangleCulling)
+			{
+				uint i0 = indices & 0xFF, i1 = (indices >>  8) & 0xFF, i2 = (indices >> 16) & 0xFF;
+				vec3 p0 = sh_VertexClip[i0], p1 = sh_VertexClip[i1], p2 = sh_VertexClip[i2];
+
+				vec2 c0 = p0.xy, c1 = p1.xy, c2 = p2.xy;
+
+				// Backface culling
+				if (_DebugParams.triBackfaceCulling > 0)
+				{
+					vec2 c01 = c1 - c0, c02 = c2 - c0;
+					float area = (c01.x * c02.y - c01.y * c02.x);
+
+					culled = culled || area <= 0;
+					cullStage = GetCullStage(cullStage, culled, CULL_STATS_TRIANGLES_BACKFACE_CULLED);
+				}
+
+				// Small primitive culling
+				if (_DebugParams.triSmallCulling > 0)
+				{
+					vec2 bmin = min(c0, min(c1, c2));
+					vec2 bmax = max(c0, max(c1, c2));
+
+					bmin = (bmin * 0.5 + 0.5) * _View.viewportRect.zw;
+					bmax = (bmax * 0.5 + 0.5) * _View.viewportRect.zw;
+
+					const float subpixelPrec = 1.0 / 256.0;
+
+					culled = culled || (round(bmin.x - subpixelPrec) == round(bmax.x) || round(bmin.y) == round(bmax.y + subpixelPrec));
+					cullStage = GetCullStage(cullStage, culled, CULL_STATS_TRIANGLES_SMALL_CULLED);
+				}
+
+				// The computations above are only valid if all vertices are in front of perspective plane
+				culled = culled && (p0.z > 0 && p1.z > 0 && p2.z > 0);
+			}
+
+			if (!culled)
+			{
+				uint index = atomicAdd(sh_TriangleCount, 1);
+				sh_Triangles[index] = indices;
+			}
+
+			++testedTriangleCount;
+			backfaceTriangleCount += culled && cullStage == CULL_STATS_TRIANGLES_BACKFACE_CULLED ? 1 : 0;
+			smallTriangleCount += culled && cullStage == CULL_STATS_TRIANGLES_SMALL_CULLED ? 1 : 0;
+		}
+
+		barrier();
+
+		const uint survivingTriangleCount = sh_TriangleCount;
+
+		// One draw per meshlet, dropped when the cluster buffers are full
+		if (localThreadId == 0)
+		{
+			uint clusterIndexOffset = ~0u;
+
+			if (survivingTriangleCount > 0)
+			{
+				clusterIndexOffset = atomicAdd(clusterIndexCount, survivingTriangleCount * 3);
+				uint clusterDrawIndex = atomicAdd(clusterDrawCount, 1);
+
+				if (clusterIndexOffset + survivingTriangleCount * 3 <= clusterIndices.length() && clusterDrawIndex < clusterDrawCommands.length())
+				{
+					MeshDrawCommand drawCommand;
+
+					drawCommand.drawId = drawId;
+
+					drawCommand.indexCount = survivingTriangleCount * 3;
+					drawCommand.instanceCount = 1;
+					drawCommand.firstIndex = clusterIndexOffset;
+					drawCommand.vertexOffset = 0; // the cluster indices are global vertex indices
+					drawCommand.firstInstance = 0;
+
+					drawCommand.drawVisibility = drawVisibility;
+					drawCommand.meshletVisibilityOffset = meshDraw.meshletVisibilityOffset;
+
+					drawCommand.taskOffset = acceptedMeshletIndex;
+					drawCommand.taskCount = 1;
+					drawCommand.groupCountX = 0;
+					drawCommand.groupCountY = 0;
+					drawCommand.groupCountZ = 0;
+
+					clusterDrawCommands[clusterDrawIndex] = drawCommand;
+				}
+				else
+				{
+					// The draw count is clamped by the indirect draw, its slot stays empty
+					if (clusterDrawIndex < clusterDrawCommands.length())
+						clusterDrawCommands[clusterDrawIndex].indexCount = 0;
+
+					clusterIndexOffset = ~0u;
+				}
+			}
+
+			sh_IndexOffset = clusterIndexOffset;
+		}
+
+		barrier();
+
+		const uint clusterIndexOffset = sh_IndexOffset;
+
+		if (clusterIndexOffset != ~0u)
+		{
+			for (uint i = localThreadId; i < survivingTriangleCount; i += GROUP_SIZE)
+			{
+				uint indices = sh_Triangles[i];
+
+				clusterIndices[clusterIndexOffset + i * 3 + 0] = meshletData[vertexOffset + ( indices        & 0xFF)] + meshDraw.vertexOffset;
+				clusterIndices[clusterIndexOffset + i * 3 + 1] = meshletData[vertexOffset + ((indices >>  8) & 0xFF)] + meshDraw.vertexOffset;
+				clusterIndices[clusterIndexOffset + i * 3 + 2] = meshletData[vertexOffset + ((indices >> 16) & 0xFF)] + meshDraw.vertexOffset;
+			}
+		}
+
+		// The shared triangles are reused by the next meshlet
+		barrier();
+	}
+
+	AddTriangleCullStats(pass, testedTriangleCount, backfaceTriangleCount, smallTriangleCount);
+}
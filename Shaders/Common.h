@@ -18,6 +18,8 @@ layout (set = 0, binding = DESC_VIEW_UNIFORMS) uniform ViewUniformBufferParamete
     vec4 debugValue;
     vec3 camPos;
     uint drawCount;
+    vec4 lodParams; // x - error threshold in pixels, y - hysteresis, z - pixels per unit of error at distance 1, w - not used
+    uint commandCapacity; // task or draw commands the draw args buffer holds, the culling drops the ones past it
 } _View;
 
 #ifndef EPS 
@@ -0,0 +1,207 @@
+#version 450
+
+// Stable compaction of the draw culling commands, after `DrawCommand.comp` with STABLE_COMPACTION.
+// Two level scan of the per draw command counts: stage 0 scans the workgroup counts of the culling in a single workgroup,
+// stage 1 scans the draws of each workgroup and writes their commands at the scanned offsets. The commands are in draw order,
+// like the CPU culling, whatever the scheduling of the workgroups.
+
+#define GROUP_SIZE 64
+
+#extension GL_GOOGLE_include_directive	: require
+#include "MeshCommon.h"
+
+
+layout (constant_id = 0) const uint TASK = 0;
+
+layout (push_constant) uniform PushConstants
+{
+	uint stage;
+} _States;
+
+
+layout (binding = 0) readonly buffer Meshes
+{
+	Mesh meshes[];
+};
+
+layout (binding = 1) readonly buffer Draws
+{
+	MeshDraw draws[];
+};
+
+layout (binding = 1) readonly buffer PackedDraws
+{
+	PackedMeshDraw packedDraws[];
+};
+
+layout (binding = 2) writeonly buffer DrawCommands
+{
+	MeshDrawCommand drawCommands[];
+};
+
+layout (binding = 2) writeonly buffer TaskCommands
+{
+	MeshTaskCommand taskCommands[];
+};
+
+// `DrawCommandCounts` of `DrawCommandCapacity.h`
+layout (binding = 3) buffer DrawCommandCount
+{
+	uint drawCommandCount; // clamped to `GetCommandCapacity()`
+	uint dispatchY;
+	uint dispatchZ;
+	uint requestedCommandCount;
+	uint peakCommandCount;
+	uint overflowCommandCount;
+};
+
+layout (binding = 6) readonly buffer DrawCommandInfos
+{
+	uint drawCommandInfos[];
+};
+
+// Command counts of the culling workgroups, replaced by their exclusive prefix sums in stage 0
+layout (binding = 9) buffer GroupCommandCounts
+{
+	uint groupCommandCounts[];
+};
+
+
+// Commands the bound draw args buffer holds. A frame in flight may still bind the smaller buffer retired by a resize
+// while the shared view uniforms already hold the capacity of its replacement.
+uint GetCommandCapacity()
+{
+	return min(_View.commandCapacity, TASK > 0 ? uint(taskCommands.length()) : uint(drawCommands.length()));
+}
+
+shared uint sh_Scan[GROUP_SIZE];
+
+// Inclusive scan of one value per thread, fixed order of the additions
+uint WorkgroupInclusiveScan(uint value, uint localThreadId)
+{
+	sh_Scan[localThreadId] = value;
+	barrier();
+
+	for (uint offset = 1; offset < GROUP_SIZE; offset <<= 1)
+	{
+		uint sum = sh_Scan[localThreadId] + (localThreadId >= offset ? sh_Scan[localThreadId - offset] : 0);
+		barrier();
+		sh_Scan[localThreadId] = sum;
+		barrier();
+	}
+
+	return sh_Scan[localThreadId];
+}
+
+// `commandCount` - commands of the draw under the capacity
+void WriteCommands(uint drawId, uint commandInfo, uint commandOffset, uint commandCount)
+{
+	const MeshDraw meshDraw = LOAD_MESH_DRAW(drawId);
+	const Mesh mesh = meshes[meshDraw.meshIndex];
+	const MeshLod meshLod = mesh.lods[GetDrawCommandLod(commandInfo)];
+	const uint drawVisibility = GetDrawCommandVisibility(commandInfo);
+
+	// Same commands as the atomic path of `DrawCommand.comp`
+	if (TASK > 0)
+	{
+		const uint taskGroups = commandCount;
+		const uint meshletVisibilityData = (meshDraw.meshletVisibilityOffset << 1) | drawVisibility;
+
+		for (uint i = 0; i < taskGroups; ++i)
+		{
+			uint groupStart = i * TASK_GROUP_SIZE;
+
+			MeshTaskCommand taskCommand;
+
+			taskCommand.drawId = drawId;
+			taskCommand.taskOffset = meshLod.meshletOffset + groupStart;
+			taskCommand.taskCount  = min(meshLod.meshletCount - groupStart, TASK_GROUP_SIZE);
+			taskCommand.meshletVisibilityData = meshletVisibilityData + (groupStart << 1);
+
+			taskCommands[commandOffset + i] = taskCommand;
+		}
+	}
+	else
+	{
+		MeshDrawCommand drawCommand;
+
+		drawCommand.drawId = drawId;
+
+		drawCommand.indexCount = meshLod.indexCount;
+		drawCommand.instanceCount = 1;
+		drawCommand.firstIndex = meshLod.indexOffset;
+		drawCommand.vertexOffset = mesh.vertexOffset;
+		drawCommand.firstInstance = 0;
+
+		drawCommand.drawVisibility = drawVisibility;
+		drawCommand.meshletVisibilityOffset = meshDraw.meshletVisibilityOffset;
+
+		drawCommand.taskOffset  = meshLod.meshletOffset;
+		drawCommand.taskCount 	= meshLod.meshletCount;
+		drawCommand.groupCountX = (meshLod.meshletCount + TASK_GROUP_SIZE-1) / TASK_GROUP_SIZE;
+		drawCommand.groupCountY = 1;
+		drawCommand.groupCountZ = 1;
+
+		drawCommands[commandOffset] = drawCommand;
+	}
+}
+
+
+layout (local_size_x = GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+void main()
+{
+	const uint localThreadId = gl_LocalInvocationID.x;
+
+	const uint groupCount = (_View.drawCount + GROUP_SIZE - 1) / GROUP_SIZE;
+
+	if (_States.stage == 0)
+	{
+		// Each thread sums a contiguous chunk of the group counts, the chunk sums are scanned, then each chunk is scanned serially
+		const uint chunkSize = (groupCount + GROUP_SIZE - 1) / GROUP_SIZE;
+		const uint chunkBegin = min(localThreadId * chunkSize, groupCount);
+		const uint chunkEnd = min(chunkBegin + chunkSize, groupCount);
+
+		uint chunkSum = 0;
+		for (uint i = chunkBegin; i < chunkEnd; ++i)
+			chunkSum += groupCommandCounts[i];
+
+		const uint chunkInclusiveSum = WorkgroupInclusiveScan(chunkSum, localThreadId);
+
+		uint offset = chunkInclusiveSum - chunkSum;
+		for (uint i = chunkBegin; i < chunkEnd; ++i)
+		{
+			uint count = groupCommandCounts[i];
+			groupCommandCounts[i] = offset;
+			offset += count;
+		}
+
+		// Indirect count, or dispatch X groups of the task commands, clamped to the capacity. Stage 1 drops the commands past it.
+		if (localThreadId == GROUP_SIZE - 1)
+		{
+			const uint capacity = GetCommandCapacity();
+
+			drawCommandCount = min(chunkInclusiveSum, capacity);
+			requestedCommandCount = chunkInclusiveSum;
+			peakCommandCount = max(peakCommandCount, chunkInclusiveSum);
+			if (chunkInclusiveSum > capacity)
+				overflowCommandCount += chunkInclusiveSum - capacity;
+		}
+	}
+	else
+	{
+		// The workgroups match the ones of the culling
+		const uint groupId = gl_WorkGroupID.x;
+		const uint drawId = gl_GlobalInvocationID.x;
+
+		const uint commandInfo = drawId < _View.drawCount ? drawCommandInfos[drawId] : 0;
+		const uint commandCount = GetDrawCommandCount(commandInfo);
+
+		const uint inclusiveSum = WorkgroupInclusiveScan(commandCount, localThreadId);
+
+		const uint commandOffset = groupCommandCounts[groupId] + inclusiveSum - commandCount;
+		const uint capacity = GetCommandCapacity();
+
+		if (commandCount > 0 && commandOffset < capacity)
+			WriteCommands(drawId, commandInfo, commandOffset, min(commandCount, capacity - commandOffset));
+	}
+}
@@ -7,6 +7,10 @@
 
 %VULKAN_BIN%\glslangValidator DrawCommand.comp.glsl -V --target-env vulkan1.3 -o ../Src/CompiledShaders/DrawCommand.comp.spv
 %VULKAN_BIN%\glslangValidator HiZBuild.comp.glsl -V --target-env vulkan1.3 -o ../Src/CompiledShaders/HiZBuild.comp.spv
+%VULKAN_BIN%\glslangValidator HiZBuildSinglePass.comp.glsl -V --target-env vulkan1.3 -o ../Src/CompiledShaders/HiZBuildSinglePass.comp.spv
+%VULKAN_BIN%\glslangValidator ScatterDraws.comp.glsl -V --target-env vulkan1.3 -o ../Src/CompiledShaders/ScatterDraws.comp.spv
+%VULKAN_BIN%\glslangValidator ClusterCull.comp.glsl -V --target-env vulkan1.3 -o ../Src/CompiledShaders/ClusterCull.comp.spv
+%VULKAN_BIN%\glslangValidator CompactCommands.comp.glsl -V --target-env vulkan1.3 -o ../Src/CompiledShaders/CompactCommands.comp.spv
 
 %VULKAN_BIN%\glslangValidator SimpleMesh.vert.glsl -V --target-env vulkan1.3 -o ../Src/CompiledShaders/SimpleMesh.vert.spv
 %VULKAN_BIN%\glslangValidator SimpleMesh.task.glsl -V --target-env vulkan1.3 -o ../Src/CompiledShaders/SimpleMesh.task.spv
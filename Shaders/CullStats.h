@@ -0,0 +1,114 @@
+#ifndef CULL_STATS_INCLUDED
+#define CULL_STATS_INCLUDED
+
+// Culling statistics, counters per cull pass (0 - early, 1 - late) of the cull stats buffer, cleared per frame and read back by the host.
+// Each stage counts the items it rejects, an item is only counted by the first stage that rejects it, so the culled and visible counts
+// of a level add up to its tested count. The early pass only tests what was visible last frame, the rest is counted as occlusion culled.
+// Meshlets of the late pass already drawn in the early pass are tested but neither culled nor visible.
+// Shared by the shaders and the C++ side (`CullStats.h` of the sources, inside a namespace using glm). The shaders declare `CULL_STATS`
+// and `cullStats[]` before including it.
+
+#ifdef __cplusplus
+#define CULL_STATS_FUNC inline
+#else
+#define CULL_STATS_FUNC
+#endif
+
+// `DrawCommand.comp`
+#define CULL_STATS_DRAWS_TESTED 0
+#define CULL_STATS_DRAWS_FRUSTUM_CULLED 1
+#define CULL_STATS_DRAWS_OCCLUSION_CULLED 2
+#define CULL_STATS_DRAWS_VISIBLE 3
+// `SimpleMesh.task` or `ClusterCull.comp`, visible - emitted
+#define CULL_STATS_MESHLETS_TESTED 4
+#define CULL_STATS_MESHLETS_CONE_CULLED 5
+#define CULL_STATS_MESHLETS_FRUSTUM_CULLED 6
+#define CULL_STATS_MESHLETS_OCCLUSION_CULLED 7
+#define CULL_STATS_MESHLETS_VISIBLE 8
+// `SimpleMesh.mesh` or `ClusterCull.comp`, triangles behind the near plane aren't culled
+#define CULL_STATS_TRIANGLES_TESTED 9
+#define CULL_STATS_TRIANGLES_BACKFACE_CULLED 10
+#define CULL_STATS_TRIANGLES_SMALL_CULLED 11
+// Draws with commands per selected lod, one bin per lod (MAX_LODS)
+#define CULL_STATS_DRAW_LOD_0 12
+#define CULL_STATS_LOD_BINS 8
+
+#define CULL_STATS_COUNTER_COUNT 20
+#define CULL_STATS_PASS_COUNT 2
+
+// Not culled (yet)
+#define CULL_STATS_NONE 0xFFFFFFFFu
+
+CULL_STATS_FUNC uint GetCullStatIndex(uint pass, uint counter)
+{
+	return pass * CULL_STATS_COUNTER_COUNT + counter;
+}
+
+// Keeps the first stage that culled the item
+CULL_STATS_FUNC uint GetCullStage(uint stage, bool bCulled, uint counter)
+{
+	return stage == CULL_STATS_NONE && bCulled ? counter : stage;
+}
+
+#ifndef __cplusplus
+
+// One atomic per subgroup and counter, with the atomic of each invocation as fallback where the stage has no subgroup arithmetic
+#ifndef CULL_STATS_USE_SUBGROUP
+#define CULL_STATS_USE_SUBGROUP 1
+#endif
+
+#if CULL_STATS_USE_SUBGROUP
+#extension GL_KHR_shader_subgroup_basic		: require
+#extension GL_KHR_shader_subgroup_arithmetic	: require
+#endif
+
+// Called by all the invocations, in uniform control flow
+void AddCullStat(uint pass, uint counter, uint value)
+{
+	if (CULL_STATS == 0)
+		return;
+
+#if CULL_STATS_USE_SUBGROUP
+	const uint subgroupValue = subgroupAdd(value);
+	if (subgroupElect() && subgroupValue > 0)
+		atomicAdd(cullStats[GetCullStatIndex(pass, counter)], subgroupValue);
+#else
+	if (value > 0)
+		atomicAdd(cullStats[GetCullStatIndex(pass, counter)], value);
+#endif
+}
+
+// `bTested` - not a free slot, `cullStage` - first stage culling the draw, `commandInfo` - DRAW_COMMAND_INFO_* of the draw
+void AddDrawCullStats(uint pass, bool bTested, uint cullStage, uint commandInfo)
+{
+	AddCullStat(pass, CULL_STATS_DRAWS_TESTED, bTested ? 1 : 0);
+	AddCullStat(pass, CULL_STATS_DRAWS_FRUSTUM_CULLED, cullStage == CULL_STATS_DRAWS_FRUSTUM_CULLED ? 1 : 0);
+	AddCullStat(pass, CULL_STATS_DRAWS_OCCLUSION_CULLED, cullStage == CULL_STATS_DRAWS_OCCLUSION_CULLED ? 1 : 0);
+	AddCullStat(pass, CULL_STATS_DRAWS_VISIBLE, bTested && cullStage == CULL_STATS_NONE ? 1 : 0);
+
+	const uint commandLod = commandInfo != 0 ? GetDrawCommandLod(commandInfo) : CULL_STATS_LOD_BINS;
+	for (uint lodIndex = 0; lodIndex < CULL_STATS_LOD_BINS; ++lodIndex)
+		AddCullStat(pass, CULL_STATS_DRAW_LOD_0 + lodIndex, commandLod == lodIndex ? 1 : 0);
+}
+
+// `bEmitted` - passed to the mesh shader or the cluster draws
+void AddMeshletCullStats(uint pass, bool bTested, uint cullStage, bool bEmitted)
+{
+	AddCullStat(pass, CULL_STATS_MESHLETS_TESTED, bTested ? 1 : 0);
+	AddCullStat(pass, CULL_STATS_MESHLETS_CONE_CULLED, cullStage == CULL_STATS_MESHLETS_CONE_CULLED ? 1 : 0);
+	AddCullStat(pass, CULL_STATS_MESHLETS_FRUSTUM_CULLED, cullStage == CULL_STATS_MESHLETS_FRUSTUM_CULLED ? 1 : 0);
+	AddCullStat(pass, CULL_STATS_MESHLETS_OCCLUSION_CULLED, cullStage == CULL_STATS_MESHLETS_OCCLUSION_CULLED ? 1 : 0);
+	AddCullStat(pass, CULL_STATS_MESHLETS_VISIBLE, bEmitted ? 1 : 0);
+}
+
+// Triangle counts of the invocation
+void AddTriangleCullStats(uint pass, uint testedCount, uint backfaceCount, uint smallCount)
+{
+	AddCullStat(pass, CULL_STATS_TRIANGLES_TESTED, testedCount);
+	AddCullStat(pass, CULL_STATS_TRIANGLES_BACKFACE_CULLED, backfaceCount);
+	AddCullStat(pass, CULL_STATS_TRIANGLES_SMALL_CULLED, smallCount);
+}
+
+#endif // !__cplusplus
+
+#endif // CULL_STATS_INCLUDED
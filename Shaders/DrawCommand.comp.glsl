@@ -9,10 +9,17 @@
 
 #if USE_SUBGROUP
 #extension GL_KHR_shader_subgroup_ballot	: require
+#extension GL_KHR_shader_subgroup_clustered	: require
 #endif
 
 
 layout (constant_id = 0) const uint TASK = 0;
+// The commands are written in draw order by `CompactCommands.comp`, this pass only writes the per draw command infos
+layout (constant_id = 2) const uint STABLE_COMPACTION = 0;
+// Draws visible in the last late passes skip the occlusion test (`IsDrawVisibilityStable`), 0 disables it
+layout (constant_id = 5) const uint VISIBILITY_HISTORY_FRAMES = 0;
+// Draw counters of `CullStats.h`
+layout (constant_id = 6) const uint CULL_STATS = 0;
 
 layout (push_constant) uniform PushConstants
 {
@@ -30,6 +37,11 @@ layout (binding = 1) readonly buffer Draws
 	MeshDraw draws[];
 };
 
+layout (binding = 1) readonly buffer PackedDraws
+{
+	PackedMeshDraw packedDraws[];
+};
+
 layout (binding = 2) writeonly buffer DrawCommands
 {
 	MeshDrawCommand drawCommands[];
@@ -40,11 +52,18 @@ layout (binding = 2) writeonly buffer TaskCommands
 	MeshTaskCommand taskCommands[];
 };
 
+// `DrawCommandCounts` of `DrawCommandCapacity.h`
 layout (binding = 3) buffer DrawCommandCount
 {
-	uint drawCommandCount;
+	uint drawCommandCount; // clamped to `GetCommandCapacity()`
+	uint dispatchY;
+	uint dispatchZ;
+	uint requestedCommandCount;
+	uint peakCommandCount;
+	uint overflowCommandCount;
 };
 
+// `VisibilityPacking.h` states, 4 draws per word
 layout (binding = 4) buffer DrawVisibilities
 {
 	uint drawVisibilities[];
@@ -52,24 +71,82 @@ layout (binding = 4) buffer DrawVisibilities
 
 layout (binding = 5) uniform sampler2D depthPyramid;
 
+layout (binding = 6) writeonly buffer DrawCommandInfos
+{
+	uint drawCommandInfos[];
+};
 
-layout (local_size_x = GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
-void main()
+// Command count of each workgroup, scanned by `CompactCommands.comp`
+layout (binding = 9) writeonly buffer GroupCommandCounts
 {
-	const uint localThreadId = gl_LocalInvocationID.x;
-	const uint globalThreadId = gl_GlobalInvocationID.x;
+	uint groupCommandCounts[];
+};
 
-	if (globalThreadId >= _View.drawCount)
-		return;
+layout (binding = DESC_CULL_STATS_BUFFER) buffer CullStats
+{
+	uint cullStats[];
+};
 
+#include "CullStats.h"
+
+
+shared uint sh_GroupCommandCount;
+
+// Commands the bound draw args buffer holds. A frame in flight may still bind the smaller buffer retired by a resize
+// while the shared view uniforms already hold the capacity of its replacement.
+uint GetCommandCapacity()
+{
+	return min(_View.commandCapacity, TASK > 0 ? uint(taskCommands.length()) : uint(drawCommands.length()));
+}
+
+// Returns the first of `count` commands. The count read by the draws and the dispatches is clamped to the capacity, the commands past it
+// aren't written and are counted as overflow, the requested count is kept for the host to grow the buffer.
+uint AllocateCommands(uint count)
+{
+	const uint commandIndex = atomicAdd(requestedCommandCount, count);
+	const uint commandEnd = commandIndex + count;
+	const uint capacity = GetCommandCapacity();
+
+	// The allocations are contiguous from 0, the max of their clamped ends is the clamped total
+	atomicMax(drawCommandCount, min(commandEnd, capacity));
+	atomicMax(peakCommandCount, commandEnd);
+	if (commandEnd > capacity)
+		atomicAdd(overflowCommandCount, commandEnd - max(commandIndex, capacity));
+
+	return commandIndex;
+}
+
+// Returns the command info of the draw (DRAW_COMMAND_INFO_*), the commands are appended here without stable compaction.
+// `visibilityXor` - change of the visibility state of the draw, in its bits of the visibility word.
+// `bTested`, `cullStage` - for the stats, the draw isn't a free slot and the first test culling it (CULL_STATS_NONE if visible).
+uint CullDraw(uint globalThreadId, out uint visibilityXor, out bool bTested, out uint cullStage)
+{
 	const uint pass = _States.pass;
-	const uint drawVisibility = drawVisibilities[globalThreadId];
+	const uint drawVisibilityState = GetDrawVisibilityState(drawVisibilities[GetDrawVisibilityWordIndex(globalThreadId)], globalThreadId);
+	const uint drawVisibility = GetDrawVisibility(drawVisibilityState);
+	uint lodIndex = GetDrawVisibilityLod(drawVisibilityState);
+
+	visibilityXor = 0;
+	bTested = false;
+	cullStage = CULL_STATS_NONE;
 
 	// In early pass, dont't process draws that were not visible last frame
 	if (pass == 0 && drawVisibility == 0)
-		return;
+	{
+		// Culled by the occlusion of last frame, the draw is only loaded by the stats to leave out the free slots
+		bTested = CULL_STATS > 0 && LOAD_MESH_DRAW(globalThreadId).meshIndex != INVALID_MESH_INDEX;
+		cullStage = bTested ? CULL_STATS_DRAWS_OCCLUSION_CULLED : CULL_STATS_NONE;
+		return 0;
+	}
+
+	const MeshDraw meshDraw = LOAD_MESH_DRAW(globalThreadId);
+
+	// Free slot of the instance manager
+	if (meshDraw.meshIndex == INVALID_MESH_INDEX)
+		return 0;
+
+	bTested = true;
 
-	const MeshDraw meshDraw = draws[globalThreadId];
 	const mat4 worldMatrix = BuildWorldMatrix(meshDraw.worldMatRow0, meshDraw.worldMatRow1, meshDraw.worldMatRow2);
 
 	const Mesh mesh = meshes[meshDraw.meshIndex];
@@ -84,21 +161,23 @@ void main()
 	// Frustum cull
 	if (_DebugParams.drawFrustumCulling > 0)
 		bVisible = bVisible && !FrustumCull(boundingSphere);
+	cullStage = GetCullStage(cullStage, !bVisible, CULL_STATS_DRAWS_FRUSTUM_CULLED);
 
-	// Only doing oc in late pass
-	if (_DebugParams.drawOcclusionCulling > 0 && pass > 0)
+	// Only doing oc in late pass, not on the draws stable in the visibility history
+	if (_DebugParams.drawOcclusionCulling > 0 && pass > 0 && !IsDrawVisibilityStable(drawVisibilityState, VISIBILITY_HISTORY_FRAMES))
 		bVisible = bVisible && !OcclusionCull(depthPyramid, boundingSphere);
+	cullStage = GetCullStage(cullStage, !bVisible, CULL_STATS_DRAWS_OCCLUSION_CULLED);
 
 #if USE_SUBGROUP
 	uvec4 ballot = subgroupBallot(bVisible);
 	uint visibleCount = subgroupBallotBitCount(ballot);
 	if (visibleCount == 0)
-		return;
+		return 0;
 
 	uint drawIndex = 0;
 	if (gl_SubgroupInvocationID == 0)
 	{
-		drawIndex = atomicAdd(drawCommandCount, visibleCount);	
+		drawIndex = AllocateCommands(visibleCount);
 	}
 	drawIndex = subgroupBroadcastFirst(drawIndex);
 	uint subgroupIndex = subgroupBallotExclusiveBitCount(ballot);
@@ -107,23 +186,30 @@ void main()
 
 	bool meshletOcclusionCulling = _DebugParams.meshShading > 0 && _DebugParams.meshletOcclusionCulling > 0;
 
+	uint commandInfo = 0;
+
 	// When meshlet occlusion culling is enabled, we actually *do* need to append the draw command if `drawVisibility`==1
 	// in late pass, so we can correctly render now visible previously invisible meshlets. We also will need to pass
 	// `drawVisibility` along to task shader so that it can *reject* clusters that we *did* draw in the early pass.
 	if (bVisible && (pass == 0 || meshletOcclusionCulling || drawVisibility == 0))
 	{
 		// Choose one lod
-		float lodDistance = log2(max(1, length(boundingSphere.xyz) - boundingSphere.w));
-		uint lodIndex = clamp(int(lodDistance), 0, int(mesh.lodCount) - 1);
+		lodIndex = SelectLod(mesh, length(boundingSphere.xyz) - boundingSphere.w, scale.x, lodIndex);
 
 		MeshLod meshLod = mesh.lods[lodIndex];
 		// DEBUG::
 		// meshLod = mesh.lods[max(0, int(mesh.lodCount) - 1)];
 
-		if (TASK > 0)
+		const uint commandCount = TASK > 0 ? (meshLod.meshletCount + TASK_GROUP_SIZE-1) / TASK_GROUP_SIZE : 1;
+		commandInfo = PackDrawCommandInfo(commandCount, lodIndex, drawVisibility);
+
+		// With stable compaction `CompactCommands.comp` writes the commands from the infos
+		if (STABLE_COMPACTION == 0 && TASK > 0)
 		{
-			uint taskGroups = (meshLod.meshletCount + TASK_GROUP_SIZE-1) / TASK_GROUP_SIZE;
-			uint taskIndex = atomicAdd(drawCommandCount, taskGroups);
+			uint taskIndex = AllocateCommands(commandCount);
+			// Groups under the capacity
+			const uint capacity = GetCommandCapacity();
+			uint taskGroups = min(commandCount, capacity - min(taskIndex, capacity));
 
 			uint meshletVisibilityData = (meshDraw.meshletVisibilityOffset << 1) | drawVisibility;
 
@@ -141,10 +227,10 @@ void main()
 				taskCommands[taskIndex + i] = taskCommand;	
 			}			
 		}
-		else
+		else if (STABLE_COMPACTION == 0)
 		{
 	#if !USE_SUBGROUP
-			uint drawIndex = atomicAdd(drawCommandCount, 1);
+			uint drawIndex = AllocateCommands(1);
 	#endif
 
 			MeshDrawCommand drawCommand;
@@ -173,11 +259,78 @@ void main()
 			drawCommand.groupCountZ = 1;
 		#endif
 
-		    drawCommands[drawIndex] = drawCommand;
+		    if (drawIndex < GetCommandCapacity())
+		    	drawCommands[drawIndex] = drawCommand;
 		}
 	}
 
-	// Update draw visibilities in late pass
+	// Update draw visibilities in late pass, the lod of the early pass is kept for the late pass and the next frame
+	uint newDrawVisibilityState = drawVisibilityState;
 	if (pass > 0)
-		drawVisibilities[globalThreadId] = bVisible ? 1 : 0;
+		newDrawVisibilityState = PackDrawVisibility(bVisible ? 1 : 0, lodIndex, GetNextDrawVisibilityHistory(drawVisibilityState, bVisible, VISIBILITY_HISTORY_FRAMES));
+	else if (commandInfo != 0)
+		newDrawVisibilityState = PackDrawVisibility(drawVisibility, lodIndex, GetDrawVisibilityHistory(drawVisibilityState));
+
+	visibilityXor = (newDrawVisibilityState ^ drawVisibilityState) << GetDrawVisibilityShift(globalThreadId);
+
+	return commandInfo;
+}
+
+// Called by all the threads, the changes only touch the bits of their draws
+void UpdateDrawVisibility(uint globalThreadId, uint visibilityXor)
+{
+#if USE_SUBGROUP
+	// The draws of a word are in consecutive invocations, one atomic per word
+	visibilityXor = subgroupClusteredOr(visibilityXor, DRAW_VISIBILITY_STATES_PER_WORD);
+	if ((gl_SubgroupInvocationID % DRAW_VISIBILITY_STATES_PER_WORD) != 0)
+		return;
+#endif
+
+	if (visibilityXor != 0)
+		atomicXor(drawVisibilities[GetDrawVisibilityWordIndex(globalThreadId)], visibilityXor);
+}
+
+
+layout (local_size_x = GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+void main()
+{
+	const uint localThreadId = gl_LocalInvocationID.x;
+	const uint globalThreadId = gl_GlobalInvocationID.x;
+
+	uint visibilityXor = 0;
+	bool bTested = false;
+	uint cullStage = CULL_STATS_NONE;
+
+	if (STABLE_COMPACTION == 0)
+	{
+		uint commandInfo = 0;
+		if (globalThreadId < _View.drawCount)
+			commandInfo = CullDraw(globalThreadId, visibilityXor, bTested, cullStage);
+
+		UpdateDrawVisibility(globalThreadId, visibilityXor);
+		AddDrawCullStats(_States.pass, bTested, cullStage, commandInfo);
+		return;
+	}
+
+	if (localThreadId == 0)
+		sh_GroupCommandCount = 0;
+
+	barrier();
+
+	// The infos of all the dispatched threads are written, the compaction reads whole workgroups
+	const uint commandInfo = globalThreadId < _View.drawCount ? CullDraw(globalThreadId, visibilityXor, bTested, cullStage) : 0;
+	drawCommandInfos[globalThreadId] = commandInfo;
+
+	UpdateDrawVisibility(globalThreadId, visibilityXor);
+	AddDrawCullStats(_States.pass, bTested, cullStage, commandInfo);
+
+	// The sum doesn't depend on the order of the atomics
+	const uint commandCount = GetDrawCommandCount(commandInfo);
+	if (commandCount > 0)
+		atomicAdd(sh_GroupCommandCount, commandCount);
+
+	barrier();
+
+	if (localThreadId == 0)
+		groupCommandCounts[gl_WorkGroupID.x] = sh_GroupCommandCount;
 }
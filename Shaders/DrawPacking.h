@@ -0,0 +1,86 @@
+#ifndef DRAW_PACKING_INCLUDED
+#define DRAW_PACKING_INCLUDED
+
+// Compact `MeshDraw` encoding, 32 bytes instead of 64: a position in a grid cell, a quantized quaternion and a uniform scale.
+// Shared by the shaders and the C++ side (`Geometry.h`, inside a namespace using glm), only the common subset of GLSL and glm is used here.
+
+#ifdef __cplusplus
+#define DRAW_PACKING_FUNC inline
+#else
+#define DRAW_PACKING_FUNC
+#endif
+
+#define DRAW_CELL_SIZE 64.0f
+// 10 bits per axis, cells [-512, 511]
+#define DRAW_CELL_BITS 10
+#define DRAW_CELL_MASK 0x3FFu
+#define DRAW_CELL_BIAS 512
+// Scales [2^-16, 2^16] in log2
+#define DRAW_SCALE_LOG2_RANGE 32.0f
+
+struct PackedMeshDraw
+{
+	uint cell; // 3 x 10 bit biased cell coordinates
+	uint positionXY; // 2 x unorm16, in the cell
+	uint positionZScale; // unorm16 position z, unorm16 log2 scale
+	uint orientationXY; // 4 x snorm16 quaternion
+	uint orientationZW;
+
+	uint meshIndex;
+	int  vertexOffset;
+	uint meshletVisibilityOffset;
+};
+
+DRAW_PACKING_FUNC float UnpackDrawUnorm16(uint value)
+{
+	return float(value & 0xFFFFu) * (1.0f / 65535.0f);
+}
+
+// Low 16 bits
+DRAW_PACKING_FUNC float UnpackDrawSnorm16(uint value)
+{
+	return max(float(int(value << 16u) >> 16) * (1.0f / 32767.0f), -1.0f);
+}
+
+DRAW_PACKING_FUNC vec3 UnpackDrawPosition(PackedMeshDraw draw)
+{
+	const vec3 cell = vec3(
+		float(int(draw.cell & DRAW_CELL_MASK) - DRAW_CELL_BIAS),
+		float(int((draw.cell >> DRAW_CELL_BITS) & DRAW_CELL_MASK) - DRAW_CELL_BIAS),
+		float(int((draw.cell >> (2 * DRAW_CELL_BITS)) & DRAW_CELL_MASK) - DRAW_CELL_BIAS));
+	const vec3 local = vec3(UnpackDrawUnorm16(draw.positionXY), UnpackDrawUnorm16(draw.positionXY >> 16u), UnpackDrawUnorm16(draw.positionZScale));
+
+	return (cell + local) * DRAW_CELL_SIZE;
+}
+
+// xyz - vector part, w - scalar part
+DRAW_PACKING_FUNC vec4 UnpackDrawOrientation(PackedMeshDraw draw)
+{
+	const vec4 q = vec4(UnpackDrawSnorm16(draw.orientationXY), UnpackDrawSnorm16(draw.orientationXY >> 16u), UnpackDrawSnorm16(draw.orientationZW), UnpackDrawSnorm16(draw.orientationZW >> 16u));
+	return normalize(q);
+}
+
+DRAW_PACKING_FUNC float UnpackDrawScale(PackedMeshDraw draw)
+{
+	return exp2(UnpackDrawUnorm16(draw.positionZScale >> 16u) * DRAW_SCALE_LOG2_RANGE - DRAW_SCALE_LOG2_RANGE * 0.5f);
+}
+
+// `mat4_cast(orientation)` times the scale, plus the translation. The matrix `BuildWorldMatrix` returns for an unpacked `MeshDraw`.
+DRAW_PACKING_FUNC mat4 UnpackDrawWorldMatrix(PackedMeshDraw draw)
+{
+	const vec3 p = UnpackDrawPosition(draw);
+	const vec4 q = UnpackDrawOrientation(draw);
+	const float s = UnpackDrawScale(draw);
+
+	const float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+	const float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+	const float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+	return mat4(
+		vec4(1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy), 0.0f) * s,
+		vec4(2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx), 0.0f) * s,
+		vec4(2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy), 0.0f) * s,
+		vec4(p.x, p.y, p.z, 1.0f));
+}
+
+#endif // DRAW_PACKING_INCLUDED
@@ -2,10 +2,11 @@
 
 #extension GL_GOOGLE_include_directive	: require
 
-#define USE_REVERSED_Z 1
-
 #define GROUP_SIZE 8
 
+// Reversed Z, the furthest depth is the min. 0 for forward Z, the max.
+layout (constant_id = 0) const uint REVERSED_Z = 1;
+
 
 /**
  * layout (push_constant) uniform BlockName {
@@ -17,7 +18,6 @@
 layout (push_constant) uniform Constants
 {
 	vec4 srcSize;
-	vec2 viewportMaxBoundUV;
 } _Constants;
 
 // Combined image sampler
@@ -28,29 +28,32 @@ layout (binding = 1) uniform writeonly image2D outputImage;
 
 float GetFurthestDepth(vec4 depths)
 {
-#if USE_REVERSED_Z
-	return min(min(depths.x, depths.y), min(depths.z, depths.w));
-#else
-	return max(max(depths.x, depths.y), max(depths.z, depths.w));
-#endif
+	if (REVERSED_Z != 0)
+		return min(min(depths.x, depths.y), min(depths.z, depths.w));
+	else
+		return max(max(depths.x, depths.y), max(depths.z, depths.w));
 }
 
 float GetClosestDepth(vec4 depths)
 {
-#if USE_REVERSED_Z
-	return max(max(depths.x, depths.y), max(depths.z, depths.w));
-#else
-	return min(min(depths.x, depths.y), min(depths.z, depths.w));
-#endif
+	if (REVERSED_Z != 0)
+		return max(max(depths.x, depths.y), max(depths.z, depths.w));
+	else
+		return min(min(depths.x, depths.y), min(depths.z, depths.w));
 }
 
-vec4 Gather4(sampler2D texSampler, vec2 bufferUV)
+// The 2x2 texels of the source under `texel`, each clamped to the last row / column like in `HiZBuildSinglePass.comp`.
+// A gather past the edge would read the border color of the sampler instead.
+vec4 Fetch4(sampler2D texSampler, uvec2 texel)
 {
-	vec2 uv = min(bufferUV + vec2(-0.25f) * _Constants.srcSize.zw, _Constants.viewportMaxBoundUV.xy - _Constants.srcSize.zw);
-
-	vec4 depths = textureGather(texSampler, uv, 0);
-
-	return depths;
+	const uvec2 maxTexel = uvec2(_Constants.srcSize.xy) - 1;
+	const uvec2 q = texel * 2;
+
+	return vec4(
+		texelFetch(texSampler, ivec2(min(q, maxTexel)), 0).x,
+		texelFetch(texSampler, ivec2(min(q + uvec2(1, 0), maxTexel)), 0).x,
+		texelFetch(texSampler, ivec2(min(q + uvec2(0, 1), maxTexel)), 0).x,
+		texelFetch(texSampler, ivec2(min(q + uvec2(1, 1), maxTexel)), 0).x);
 }
 
 
@@ -68,8 +71,7 @@ void main()
 	const uvec2 globalThreadId = gl_GlobalInvocationID.xy;
 #endif
 
-	vec2 bufferUV = (globalThreadId + 0.5f) * 2 * _Constants.srcSize.zw;
-	vec4 depths = Gather4(inputImage, bufferUV);
+	vec4 depths = Fetch4(inputImage, globalThreadId);
 	float zFurthest = GetFurthestDepth(depths);
 
 	imageStore(outputImage, ivec2(gl_GlobalInvocationID.xy), vec4(zFurthest, 0, 0, 0));
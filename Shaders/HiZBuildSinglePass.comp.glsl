@@ -0,0 +1,248 @@
+#version 450
+
+// Single dispatch depth pyramid, in the style of AMD FidelityFX SPD. Replaces the per mip dispatches of `HiZBuild.comp`.
+// Each workgroup reduces a 64x64 tile of the depth buffer to the first 6 mips of the pyramid (32x32 down to 1x1) in shared memory.
+// The last workgroup to finish, found with a global atomic counter, reduces mip 5 to the remaining mips.
+// Same texels as `HiZBuild.comp` and `BuildDepthPyramidReference`: the furthest depth of the 2x2 texels under it, each clamped to the
+// last row / column of the mip above.
+
+#define GROUP_SIZE 256
+// Mips reduced by every workgroup, from a 32x32 tile of mip 0
+#define GROUP_MIP_COUNT 6
+#define TILE_SIZE 32
+// One binding per mip after the depth buffer, the pyramid is up to 4096x4096. Same as `DEPTH_PYRAMID_MAX_SINGLE_PASS_MIPS` in `DepthPyramid.h`.
+#define MAX_MIP_COUNT 12
+
+// Reversed Z, the furthest depth is the min. 0 for forward Z, the max.
+layout (constant_id = 0) const uint REVERSED_Z = 1;
+
+
+layout (push_constant) uniform Constants
+{
+	uvec2 depthSize;
+	uvec2 pyramidSize; // mip 0
+	uint mipCount;
+	uint groupCount;
+} _Constants;
+
+layout (binding = 0) uniform sampler2D depthImage;
+
+layout (binding = 1, r32f) uniform writeonly image2D outputMip0;
+layout (binding = 2, r32f) uniform writeonly image2D outputMip1;
+layout (binding = 3, r32f) uniform writeonly image2D outputMip2;
+layout (binding = 4, r32f) uniform writeonly image2D outputMip3;
+layout (binding = 5, r32f) uniform writeonly image2D outputMip4;
+// Read back by the last workgroup
+layout (binding = 6, r32f) uniform coherent image2D outputMip5;
+layout (binding = 7, r32f) uniform writeonly image2D outputMip6;
+layout (binding = 8, r32f) uniform writeonly image2D outputMip7;
+layout (binding = 9, r32f) uniform writeonly image2D outputMip8;
+layout (binding = 10, r32f) uniform writeonly image2D outputMip9;
+layout (binding = 11, r32f) uniform writeonly image2D outputMip10;
+layout (binding = 12, r32f) uniform writeonly image2D outputMip11;
+
+// Finished workgroups, reset by the last one for the next frame
+layout (binding = 13) coherent buffer GroupCounter
+{
+	uint groupCounter;
+};
+
+
+shared float sh_Depth[TILE_SIZE * TILE_SIZE];
+shared uint sh_IsLastGroup;
+
+
+float GetFurthestDepth(vec4 depths)
+{
+	if (REVERSED_Z != 0)
+		return min(min(depths.x, depths.y), min(depths.z, depths.w));
+	else
+		return max(max(depths.x, depths.y), max(depths.z, depths.w));
+}
+
+uvec2 GetMipSize(uint mip)
+{
+	return max(_Constants.pyramidSize >> mip, uvec2(1));
+}
+
+void StoreMip(uint mip, uvec2 texel, float depth)
+{
+	if (any(greaterThanEqual(texel, GetMipSize(mip))))
+		return;
+
+	const ivec2 p = ivec2(texel);
+	const vec4 value = vec4(depth, 0, 0, 0);
+
+	switch (mip)
+	{
+	case 0: imageStore(outputMip0, p, value); break;
+	case 1: imageStore(outputMip1, p, value); break;
+	case 2: imageStore(outputMip2, p, value); break;
+	case 3: imageStore(outputMip3, p, value); break;
+	case 4: imageStore(outputMip4, p, value); break;
+	case 5: imageStore(outputMip5, p, value); break;
+	case 6: imageStore(outputMip6, p, value); break;
+	case 7: imageStore(outputMip7, p, value); break;
+	case 8: imageStore(outputMip8, p, value); break;
+	case 9: imageStore(outputMip9, p, value); break;
+	case 10: imageStore(outputMip10, p, value); break;
+	case 11: imageStore(outputMip11, p, value); break;
+	}
+}
+
+// Texel `texel` of mip 0, from the depth buffer
+float ReduceDepthBuffer(uvec2 texel)
+{
+	const uvec2 maxTexel = _Constants.depthSize - 1;
+	const uvec2 q = texel * 2;
+
+	return GetFurthestDepth(vec4(
+		texelFetch(depthImage, ivec2(min(q, maxTexel)), 0).x,
+		texelFetch(depthImage, ivec2(min(q + uvec2(1, 0), maxTexel)), 0).x,
+		texelFetch(depthImage, ivec2(min(q + uvec2(0, 1), maxTexel)), 0).x,
+		texelFetch(depthImage, ivec2(min(q + uvec2(1, 1), maxTexel)), 0).x));
+}
+
+// Texel `texel` of a mip, from the tile of the mip above in shared memory. `srcOrigin` - first texel of the tile, `srcStride` - its width.
+float ReduceShared(uvec2 texel, uvec2 srcSize, uvec2 srcOrigin, uint srcStride)
+{
+	const uvec2 maxTexel = srcSize - 1;
+	const uvec2 q = texel * 2;
+
+	const uvec2 q0 = min(q, maxTexel) - srcOrigin;
+	const uvec2 q1 = min(q + uvec2(1, 0), maxTexel) - srcOrigin;
+	const uvec2 q2 = min(q + uvec2(0, 1), maxTexel) - srcOrigin;
+	const uvec2 q3 = min(q + uvec2(1, 1), maxTexel) - srcOrigin;
+
+	return GetFurthestDepth(vec4(sh_Depth[q0.y * srcStride + q0.x], sh_Depth[q1.y * srcStride + q1.x], sh_Depth[q2.y * srcStride + q2.x], sh_Depth[q3.y * srcStride + q3.x]));
+}
+
+// Texel `texel` of mip 6, from mip 5 written by all the workgroups
+float ReduceMip5(uvec2 texel)
+{
+	const uvec2 maxTexel = GetMipSize(GROUP_MIP_COUNT - 1) - 1;
+	const uvec2 q = texel * 2;
+
+	return GetFurthestDepth(vec4(
+		imageLoad(outputMip5, ivec2(min(q, maxTexel))).x,
+		imageLoad(outputMip5, ivec2(min(q + uvec2(1, 0), maxTexel))).x,
+		imageLoad(outputMip5, ivec2(min(q + uvec2(0, 1), maxTexel))).x,
+		imageLoad(outputMip5, ivec2(min(q + uvec2(1, 1), maxTexel))).x));
+}
+
+
+layout (local_size_x = GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+void main()
+{
+	const uvec2 groupId = gl_WorkGroupID.xy;
+	const uint localThreadIndex = gl_LocalInvocationIndex;
+
+	// Mip 0, 4 texels per thread
+	for (uint i = localThreadIndex; i < TILE_SIZE * TILE_SIZE; i += GROUP_SIZE)
+	{
+		const uvec2 texel = groupId * TILE_SIZE + uvec2(i % TILE_SIZE, i / TILE_SIZE);
+		const float depth = ReduceDepthBuffer(texel);
+
+		sh_Depth[i] = depth;
+		StoreMip(0, texel, depth);
+	}
+
+	barrier();
+
+	// Mips 1 to 5 of the tile
+	const uint groupMipCount = min(_Constants.mipCount, GROUP_MIP_COUNT);
+	for (uint mip = 1; mip < groupMipCount; ++mip)
+	{
+		const uint srcTileSize = TILE_SIZE >> (mip - 1);
+		const uint tileSize = srcTileSize >> 1;
+
+		const bool valid = localThreadIndex < tileSize * tileSize;
+		const uvec2 texel = groupId * tileSize + uvec2(localThreadIndex % tileSize, localThreadIndex / tileSize);
+
+		float depth = 0.0f;
+		if (valid)
+			depth = ReduceShared(texel, GetMipSize(mip - 1), groupId * srcTileSize, srcTileSize);
+
+		barrier();
+
+		if (valid)
+		{
+			sh_Depth[localThreadIndex] = depth;
+			StoreMip(mip, texel, depth);
+		}
+
+		barrier();
+	}
+
+	if (_Constants.mipCount <= GROUP_MIP_COUNT)
+		return;
+
+	// Mip 5 of this tile is visible to the last workgroup before it's counted
+	memoryBarrierImage();
+	barrier();
+
+	if (localThreadIndex == 0)
+		sh_IsLastGroup = atomicAdd(groupCounter, 1) == _Constants.groupCount - 1 ? 1 : 0;
+
+	barrier();
+
+	if (sh_IsLastGroup == 0)
+		return;
+
+	if (localThreadIndex == 0)
+		groupCounter = 0;
+
+	// Mips 6 and 7 from mip 5, each thread reduces the 2x2 texels of mip 6 under a texel of mip 7. Mip 7 is at most 32x32.
+	const uvec2 mip6Size = GetMipSize(GROUP_MIP_COUNT);
+	const uvec2 mip7Size = (mip6Size + 1) / 2;
+
+	for (uint i = localThreadIndex; i < mip7Size.x * mip7Size.y; i += GROUP_SIZE)
+	{
+		const uvec2 texel = uvec2(i % mip7Size.x, i / mip7Size.x);
+
+		vec4 depths;
+		for (uint j = 0; j < 4; ++j)
+		{
+			const uvec2 q = texel * 2 + uvec2(j & 1, j >> 1);
+			const uvec2 mip6Texel = min(q, mip6Size - 1);
+
+			depths[j] = ReduceMip5(mip6Texel);
+
+			// The clamped texels are stored by their own thread
+			if (mip6Texel == q)
+				StoreMip(GROUP_MIP_COUNT, mip6Texel, depths[j]);
+		}
+
+		const float depth = GetFurthestDepth(depths);
+
+		sh_Depth[i] = depth;
+		if (_Constants.mipCount > GROUP_MIP_COUNT + 1)
+			StoreMip(GROUP_MIP_COUNT + 1, texel, depth);
+	}
+
+	barrier();
+
+	// Remaining mips in shared memory, at most 16x16
+	for (uint mip = GROUP_MIP_COUNT + 2; mip < _Constants.mipCount; ++mip)
+	{
+		const uvec2 srcSize = GetMipSize(mip - 1);
+		const uvec2 size = GetMipSize(mip);
+
+		const bool valid = localThreadIndex < size.x * size.y;
+		const uvec2 texel = uvec2(localThreadIndex % size.x, localThreadIndex / size.x);
+
+		float depth = 0.0f;
+		if (valid)
+			depth = ReduceShared(texel, srcSize, uvec2(0), srcSize.x);
+
+		barrier();
+
+		if (valid)
+		{
+			sh_Depth[localThreadIndex] = depth;
+			StoreMip(mip, texel, depth);
+		}
+
+		barrier();
+	}
+}
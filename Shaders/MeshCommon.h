@@ -33,6 +33,10 @@
 #define DESC_MESHLET_DATA_BUFFER 5
 #define DESC_MESHLET_VISIBILITY_BUFFER 1
 #define DESC_DEPTH_PYRAMID 6
+// Meshes for the spheres of the packed meshlets and the positions of the packed vertices, after the cluster culling outputs
+#define DESC_MESH_BOUNDS_BUFFER 12
+// Counters of `CullStats.h`, bound to the culling passes and the task / mesh shaders
+#define DESC_CULL_STATS_BUFFER 13
 
 
 struct Vertex
@@ -57,6 +61,8 @@ struct Meshlet
 	uint vertexOffset;
 	uint8_t vertexCount;
 	uint8_t triangleCount;
+	int8_t coneAxisS8[3];
+	int8_t coneCutoffS8;
 };
 
 struct MeshLod
@@ -65,15 +71,20 @@ struct MeshLod
 	uint indexCount;
 	uint meshletOffset;
 	uint meshletCount;
+	float error; // max distance to the lod 0 surface in mesh units
 };
 
 struct Mesh
 {
 	vec4 boundingSphere;
+	vec4 positionOffset; // decoding of the packed vertex positions, xyz - bounding box min
+	vec4 positionScale; // xyz - bounding box extent / 65535
 	int  vertexOffset;
 	uint vertexCount;
 	uint lodCount;
 	MeshLod lods[MAX_LODS];
+	uint clusterOffset; // cluster LOD DAG, `clusterCount` clusters
+	uint clusterCount;
 };
 
 struct MeshDraw
@@ -87,6 +98,59 @@ struct MeshDraw
 	uint meshletVisibilityOffset;
 };
 
+#include "VertexPacking.h"
+
+// The vertex buffer holds `PackedVertex`s instead of `Vertex`s, set at pipeline creation
+layout (constant_id = 4) const uint PACKED_VERTICES = 0;
+
+// Shaders declare both `vertices` and `packedVertices` on the vertex buffer binding. The packed positions need the `Mesh` of the vertex.
+#if USE_8BIT_16BIT_EXTENSIONS
+#define LOAD_FULL_VERTEX_NORMAL(vertexIndex) (vec3(uint(vertices[vertexIndex].nx), uint(vertices[vertexIndex].ny), uint(vertices[vertexIndex].nz)) / 127.0 - 1.0)
+#else
+#define LOAD_FULL_VERTEX_NORMAL(vertexIndex) vec3(vertices[vertexIndex].nx, vertices[vertexIndex].ny, vertices[vertexIndex].nz)
+#endif
+#define LOAD_VERTEX_POSITION(vertexIndex, mesh) (PACKED_VERTICES > 0 ? UnpackVertexPosition(packedVertices[vertexIndex], (mesh).positionOffset, (mesh).positionScale) : vec3(vertices[vertexIndex].px, vertices[vertexIndex].py, vertices[vertexIndex].pz))
+#define LOAD_VERTEX_NORMAL(vertexIndex) (PACKED_VERTICES > 0 ? UnpackVertexNormal(packedVertices[vertexIndex]) : LOAD_FULL_VERTEX_NORMAL(vertexIndex))
+#define LOAD_VERTEX_UV(vertexIndex) (PACKED_VERTICES > 0 ? UnpackVertexUv(packedVertices[vertexIndex]) : vec2(vertices[vertexIndex].s, vertices[vertexIndex].t))
+
+// Mesh index of the empty draws in the free slots of the draw buffer, same as in `Geometry.h`
+#define INVALID_MESH_INDEX 0xFFFFFFFFu
+
+#include "DrawPacking.h"
+
+// The draw buffer holds `PackedMeshDraw`s instead of `MeshDraw`s, set at pipeline creation
+layout (constant_id = 1) const uint PACKED_DRAWS = 0;
+
+MeshDraw UnpackMeshDraw(PackedMeshDraw packedDraw)
+{
+	const mat4 worldMatrix = UnpackDrawWorldMatrix(packedDraw);
+
+	MeshDraw meshDraw;
+	meshDraw.worldMatRow0 = vec4(worldMatrix[0][0], worldMatrix[1][0], worldMatrix[2][0], worldMatrix[3][0]);
+	meshDraw.worldMatRow1 = vec4(worldMatrix[0][1], worldMatrix[1][1], worldMatrix[2][1], worldMatrix[3][1]);
+	meshDraw.worldMatRow2 = vec4(worldMatrix[0][2], worldMatrix[1][2], worldMatrix[2][2], worldMatrix[3][2]);
+	meshDraw.vertexOffset = packedDraw.vertexOffset;
+	meshDraw.meshIndex = packedDraw.meshIndex;
+	meshDraw.meshletVisibilityOffset = packedDraw.meshletVisibilityOffset;
+
+	return meshDraw;
+}
+
+// Shaders declare both `draws` and `packedDraws` on the draw buffer binding
+#define LOAD_MESH_DRAW(drawId) (PACKED_DRAWS > 0 ? UnpackMeshDraw(packedDraws[drawId]) : draws[drawId])
+
+#include "MeshletPacking.h"
+
+// The meshlet buffer holds `PackedMeshlet`s instead of `Meshlet`s, set at pipeline creation
+layout (constant_id = 3) const uint PACKED_MESHLETS = 0;
+
+// Shaders declare both `meshlets` and `packedMeshlets` on the meshlet buffer binding. The packed spheres need the sphere of the mesh.
+#define LOAD_MESHLET_SPHERE(meshletIndex, meshSphere) (PACKED_MESHLETS > 0 ? UnpackMeshletSphere(packedMeshlets[meshletIndex], meshSphere) : meshlets[meshletIndex].boundingSphere)
+#define LOAD_MESHLET_CONE(meshletIndex) (PACKED_MESHLETS > 0 ? UnpackMeshletCone(packedMeshlets[meshletIndex]) : meshlets[meshletIndex].cone)
+#define LOAD_MESHLET_VERTEX_OFFSET(meshletIndex) (PACKED_MESHLETS > 0 ? packedMeshlets[meshletIndex].vertexOffset : meshlets[meshletIndex].vertexOffset)
+#define LOAD_MESHLET_VERTEX_COUNT(meshletIndex) (PACKED_MESHLETS > 0 ? UnpackMeshletVertexCount(packedMeshlets[meshletIndex]) : uint(meshlets[meshletIndex].vertexCount))
+#define LOAD_MESHLET_TRIANGLE_COUNT(meshletIndex) (PACKED_MESHLETS > 0 ? UnpackMeshletTriangleCount(packedMeshlets[meshletIndex]) : uint(meshlets[meshletIndex].triangleCount))
+
 struct MeshDrawCommand
 {
 	uint drawId;
@@ -125,6 +189,59 @@ struct MeshTaskCommand
     uint meshletVisibilityData; // low bit: draw visibility, higher 31 bit: meshVisibilityOffset
 };
 
+// Per draw output of the draw culling with stable compaction: command count (0 - culled), lod index and draw visibility
+#define DRAW_COMMAND_INFO_COUNT_MASK 0xFFFFFFu
+#define DRAW_COMMAND_INFO_LOD_SHIFT 24
+#define DRAW_COMMAND_INFO_VISIBILITY_BIT 0x80000000u
+
+uint PackDrawCommandInfo(uint commandCount, uint lodIndex, uint drawVisibility)
+{
+	return commandCount | (lodIndex << DRAW_COMMAND_INFO_LOD_SHIFT) | (drawVisibility > 0 ? DRAW_COMMAND_INFO_VISIBILITY_BIT : 0);
+}
+
+uint GetDrawCommandCount(uint commandInfo)
+{
+	return commandInfo & DRAW_COMMAND_INFO_COUNT_MASK;
+}
+
+uint GetDrawCommandLod(uint commandInfo)
+{
+	return (commandInfo >> DRAW_COMMAND_INFO_LOD_SHIFT) & (MAX_LODS - 1);
+}
+
+uint GetDrawCommandVisibility(uint commandInfo)
+{
+	return (commandInfo & DRAW_COMMAND_INFO_VISIBILITY_BIT) != 0 ? 1 : 0;
+}
+
+#include "VisibilityPacking.h"
+
+// Coarsest lod whose error projected to the screen stays under `_View.lodParams.x` pixels. Coarser lods than the last one are only
+// taken under the threshold scaled down by the hysteresis, so the draws don't flip between two lods at the switch distance.
+// `distance` is the view space distance to the bounding sphere, `scale` the uniform scale of the draw.
+uint SelectLod(Mesh mesh, float distance, float scale, uint lastLodIndex)
+{
+	// Error of 1 pixel at the distance, in mesh units
+	const float pixelError = max(distance, _View.zNearFar.x) / (max(_View.lodParams.z, EPS) * scale);
+	const float threshold = _View.lodParams.x * pixelError;
+	const float hysteresisThreshold = threshold * (1.0 - _View.lodParams.y);
+
+	uint lodIndex = 0;
+	uint hysteresisLodIndex = 0;
+	for (uint i = 1; i < mesh.lodCount; ++i)
+	{
+		if (mesh.lods[i].error <= threshold)
+			lodIndex = i;
+		if (mesh.lods[i].error <= hysteresisThreshold)
+			hysteresisLodIndex = i;
+	}
+
+	if (lodIndex > lastLodIndex)
+		lodIndex = max(hysteresisLodIndex, lastLodIndex);
+
+	return lodIndex;
+}
+
 struct TaskPayload
 {
 	uint drawId;
@@ -0,0 +1,66 @@
+#ifndef MESHLET_PACKING_INCLUDED
+#define MESHLET_PACKING_INCLUDED
+
+// Compact `Meshlet` header, 16 bytes instead of 64: the bounding sphere quantized in the bounding sphere of its mesh, and the 8 bit cone
+// of `meshopt_Bounds`. Both only grow by the quantization, so the culling with them is conservative. Shared by the shaders and the
+// C++ side (`Geometry.h`, inside a namespace using glm), only the common subset of GLSL and glm is used here.
+
+#ifdef __cplusplus
+#define MESHLET_PACKING_FUNC inline
+#else
+#define MESHLET_PACKING_FUNC
+#endif
+
+// 10 bits per axis, unorm in the bounding box of the mesh sphere
+#define MESHLET_CENTER_BITS 10
+#define MESHLET_CENTER_MASK 0x3FFu
+// Radii [0, 4] x mesh radius in unorm16, the top code is a sphere that is never culled for the radii out of the range
+#define MESHLET_RADIUS_RANGE 4.0f
+#define MESHLET_RADIUS_UNBOUNDED 0xFFFFu
+// Large enough to never cull, small enough that the scaled radius stays finite
+#define MESHLET_UNBOUNDED_RADIUS 1e18f
+
+struct PackedMeshlet
+{
+	uint vertexOffset;
+	uint center; // 3 x unorm10
+	uint radiusCounts; // unorm16 radius, 8 bit vertex count, 8 bit triangle count
+	uint cone; // 3 x snorm8 axis, snorm8 cutoff
+};
+
+// xyz - center, w - radius, in mesh units. `meshSphere` is the bounding sphere of the mesh the meshlet belongs to.
+MESHLET_PACKING_FUNC vec4 UnpackMeshletSphere(PackedMeshlet meshlet, vec4 meshSphere)
+{
+	const vec3 t = vec3(
+		float(meshlet.center & MESHLET_CENTER_MASK),
+		float((meshlet.center >> MESHLET_CENTER_BITS) & MESHLET_CENTER_MASK),
+		float((meshlet.center >> (2 * MESHLET_CENTER_BITS)) & MESHLET_CENTER_MASK)) * (1.0f / 1023.0f);
+	const vec3 center = vec3(meshSphere.x, meshSphere.y, meshSphere.z) + (t * 2.0f - 1.0f) * meshSphere.w;
+	const uint radiusBits = meshlet.radiusCounts & 0xFFFFu;
+	const float radius = radiusBits == MESHLET_RADIUS_UNBOUNDED ? MESHLET_UNBOUNDED_RADIUS : float(radiusBits) * (MESHLET_RADIUS_RANGE / 65534.0f) * meshSphere.w;
+
+	return vec4(center, radius);
+}
+
+// xyz - cone axis, not normalized, w - cutoff. The shaders normalize the axis after the world transform, like the full cone, the
+// cutoff covers the quantization of the axis.
+MESHLET_PACKING_FUNC vec4 UnpackMeshletCone(PackedMeshlet meshlet)
+{
+	return vec4(
+		float(int(meshlet.cone << 24u) >> 24),
+		float(int(meshlet.cone << 16u) >> 24),
+		float(int(meshlet.cone <<  8u) >> 24),
+		float(int(meshlet.cone) >> 24)) * (1.0f / 127.0f);
+}
+
+MESHLET_PACKING_FUNC uint UnpackMeshletVertexCount(PackedMeshlet meshlet)
+{
+	return (meshlet.radiusCounts >> 16u) & 0xFFu;
+}
+
+MESHLET_PACKING_FUNC uint UnpackMeshletTriangleCount(PackedMeshlet meshlet)
+{
+	return meshlet.radiusCounts >> 24u;
+}
+
+#endif // MESHLET_PACKING_INCLUDED
@@ -0,0 +1,86 @@
+#version 450
+
+#define GROUP_SIZE 64
+
+#extension GL_GOOGLE_include_directive	: require
+#include "VisibilityPacking.h"
+
+// Scatter record flags, same as in `InstanceManager.h`
+#define DRAW_SCATTER_RESET_DRAW_VISIBILITY 1
+#define DRAW_SCATTER_RESET_MESHLET_VISIBILITY 2
+
+// Words of the scatter record header: draw index, flags, meshlet visibility offset and count
+#define DRAW_SCATTER_HEADER_WORDS 4
+
+
+// The draw buffer holds `PackedMeshDraw`s, same as in `MeshCommon.h`
+layout (constant_id = 1) const uint PACKED_DRAWS = 0;
+
+layout (push_constant) uniform PushConstants
+{
+	uint scatterCount;
+} _States;
+
+
+// Scatter records, a header followed by the draw, written by `InstanceManager::GatherScatters`
+layout (binding = 0) readonly buffer DrawScatters
+{
+	uint scatterWords[];
+};
+
+layout (binding = 1) writeonly buffer DrawWords
+{
+	uint drawWords[];
+};
+
+// `VisibilityPacking.h` states, 4 draws per word
+layout (binding = 2) buffer DrawVisibilities
+{
+	uint drawVisibilities[];
+};
+
+layout (binding = 3) buffer MeshletVisibilities
+{
+	uint meshletVisibilities[];
+};
+
+
+layout (local_size_x = GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+void main()
+{
+	const uint scatterIndex = gl_GlobalInvocationID.x;
+
+	if (scatterIndex >= _States.scatterCount)
+		return;
+
+	const uint drawWordCount = PACKED_DRAWS > 0 ? 8 : 16; // sizeof(PackedMeshDraw) or sizeof(MeshDraw)
+	const uint scatterOffset = scatterIndex * (DRAW_SCATTER_HEADER_WORDS + drawWordCount);
+
+	const uint drawIndex = scatterWords[scatterOffset + 0];
+	const uint flags = scatterWords[scatterOffset + 1];
+	const uint meshletVisibilityOffset = scatterWords[scatterOffset + 2];
+	const uint meshletVisibilityCount = scatterWords[scatterOffset + 3];
+
+	for (uint i = 0; i < drawWordCount; ++i)
+		drawWords[drawIndex * drawWordCount + i] = scatterWords[scatterOffset + DRAW_SCATTER_HEADER_WORDS + i];
+
+	// Draws of other scatter records share the word
+	if ((flags & DRAW_SCATTER_RESET_DRAW_VISIBILITY) != 0)
+		atomicAnd(drawVisibilities[GetDrawVisibilityWordIndex(drawIndex)], ~(DRAW_VISIBILITY_STATE_MASK << GetDrawVisibilityShift(drawIndex)));
+
+	// Ranges share their first and last words with other draws
+	if ((flags & DRAW_SCATTER_RESET_MESHLET_VISIBILITY) != 0 && meshletVisibilityCount > 0)
+	{
+		const uint begin = meshletVisibilityOffset;
+		const uint end = meshletVisibilityOffset + meshletVisibilityCount;
+
+		for (uint word = begin >> 5; word <= ((end - 1) >> 5); ++word)
+		{
+			const uint firstBit = max(begin, word << 5) - (word << 5);
+			const uint bitCount = min(end, (word + 1) << 5) - (word << 5) - firstBit;
+			const uint mask = bitCount == 32 ? ~0u : ((1u << bitCount) - 1u) << firstBit;
+
+			atomicAnd(meshletVisibilities[word], ~mask);
+		}
+	}
+}
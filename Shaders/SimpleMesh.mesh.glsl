@@ -33,16 +33,40 @@
 #endif
 
 
+// Triangle counters of `CullStats.h`
+layout (constant_id = 6) const uint CULL_STATS = 0;
+
+layout (push_constant) uniform PushConstants
+{
+	uint pass;
+} _States;
+
+
 layout (std430, binding = DESC_VERTEX_BUFFER) readonly buffer Vertices
 {
 	Vertex vertices[];
 };
 
+layout (std430, binding = DESC_VERTEX_BUFFER) readonly buffer PackedVertices
+{
+	PackedVertex packedVertices[];
+};
+
+layout (std430, binding = DESC_MESH_BOUNDS_BUFFER) readonly buffer Meshes
+{
+	Mesh meshes[];
+};
+
 layout (std430, binding = DESC_DRAW_DATA_BUFFER) readonly buffer Draws
 {
 	MeshDraw draws[];
 };
 
+layout (std430, binding = DESC_DRAW_DATA_BUFFER) readonly buffer PackedDraws
+{
+	PackedMeshDraw packedDraws[];
+};
+
 layout (std430, binding = DESC_DRAW_COMMAND_BUFFER) readonly buffer DrawCommands
 {
 	MeshDrawCommand drawCommands[];
@@ -53,11 +77,23 @@ layout (std430, binding = DESC_MESHLET_BUFFER) readonly buffer Meshlets
 	Meshlet meshlets[];
 };
 
+layout (std430, binding = DESC_MESHLET_BUFFER) readonly buffer PackedMeshlets
+{
+	PackedMeshlet packedMeshlets[];
+};
+
 layout (std430, binding = DESC_MESHLET_DATA_BUFFER) readonly buffer MeshletData
 {
 	uint meshletData[];
 };
 
+layout (std430, binding = DESC_CULL_STATS_BUFFER) buffer CullStats
+{
+	uint cullStats[];
+};
+
+#include "CullStats.h"
+
 layout (location = 0) out Interpolant
 {
 	vec3 outNormal;
@@ -170,18 +206,18 @@ void main()
 
 #if 0
 	const MeshDrawCommand meshDrawCommand = drawCommands[gl_DrawIDARB];
-	const MeshDraw meshDraw = draws[meshDrawCommand.drawId];
+	const MeshDraw meshDraw = LOAD_MESH_DRAW(meshDrawCommand.drawId);
 #else
-	const MeshDraw meshDraw = draws[payload.drawId];
+	const MeshDraw meshDraw = LOAD_MESH_DRAW(payload.drawId);
 #endif
 
 	const mat4 worldMat = BuildWorldMatrix(meshDraw.worldMatRow0, meshDraw.worldMatRow1, meshDraw.worldMatRow2);
 
-	const uint vertexCount = uint(meshlets[meshletIndex].vertexCount);
-	const uint triangleCount = uint(meshlets[meshletIndex].triangleCount);
+	const uint vertexCount = LOAD_MESHLET_VERTEX_COUNT(meshletIndex);
+	const uint triangleCount = LOAD_MESHLET_TRIANGLE_COUNT(meshletIndex);
 	const uint indexCount = triangleCount * 3;
 
-	const uint vertexOffset = meshlets[meshletIndex].vertexOffset;
+	const uint vertexOffset = LOAD_MESHLET_VERTEX_OFFSET(meshletIndex);
 	const uint indexOffset = vertexOffset + vertexCount;
 
 #if DEBUG
@@ -195,12 +231,12 @@ void main()
 	{
 		uint vi = meshletData[vertexOffset + i] + meshDraw.vertexOffset;
 
-		vec3 posOS = vec3(vertices[vi].px, vertices[vi].py, vertices[vi].pz);
+		vec3 posOS = LOAD_VERTEX_POSITION(vi, meshes[meshDraw.meshIndex]);
 
 		// position.z = position.z * 0.5 + 0.5;
 		vec4 position = _View.viewProjMatrix * worldMat * vec4(posOS, 1.0);
-		vec3 normal = vec3(uint(vertices[vi].nx), uint(vertices[vi].ny), uint(vertices[vi].nz)) / 127.0 - 1.0;
-		vec2 texcoord = vec2(vertices[vi].s, vertices[vi].t);
+		vec3 normal = LOAD_VERTEX_NORMAL(vi);
+		vec2 texcoord = LOAD_VERTEX_UV(vi);
 
 		gl_MeshVerticesEXT[i].gl_Position = position;
 	#if !DEBUG
@@ -219,6 +255,11 @@ void main()
 	barrier(); // memoryBarrierShared();
 #endif
 
+	// Triangles of the invocation for the stats
+	uint testedTriangleCount = 0;
+	uint backfaceTriangleCount = 0;
+	uint smallTriangleCount = 0;
+
 	// Primitives
 	for (uint i = localThreadIndex; i < triangleCount; i += MESH_GROUP_SIZE)
 	{
@@ -228,6 +269,7 @@ void main()
 
 	#if CULL
 		bool culled = false;
+		uint cullStage = CULL_STATS_NONE;
 
 		vec3 p0 = sh_VertexClip[i0], p1 = sh_VertexClip[i1], p2 = sh_VertexClip[i2];
 
@@ -240,6 +282,7 @@ void main()
 			float area = (c01.x * c02.y - c01.y * c02.x);
 			
 			culled = culled || area <= 0; // 1e-5;
+			cullStage = GetCullStage(cullStage, culled, CULL_STATS_TRIANGLES_BACKFACE_CULLED);
 		}
 
 		// Small primitive culling
@@ -261,6 +304,7 @@ void main()
 			// https://github.com/zeux/niagara.git # e9f3a890af764d765efd544e243452c380b08d50
 			culled = culled || (round(bmin.x - subpixelPrec) == round(bmax.x) || round(bmin.y) == round(bmax.y + subpixelPrec));
 		#endif
+			cullStage = GetCullStage(cullStage, culled, CULL_STATS_TRIANGLES_SMALL_CULLED);
 		}
 
 		// culled = culled || (p0.z < 0 && p1.z < 0 && p2.z < 0);
@@ -270,9 +314,15 @@ void main()
 
 		// TODO: Requires fragment shading rate ??? 
 		gl_MeshPrimitivesEXT[i].gl_CullPrimitiveEXT = culled;
+
+		backfaceTriangleCount += culled && cullStage == CULL_STATS_TRIANGLES_BACKFACE_CULLED ? 1 : 0;
+		smallTriangleCount += culled && cullStage == CULL_STATS_TRIANGLES_SMALL_CULLED ? 1 : 0;
 	#endif
+		++testedTriangleCount;
 	}
 
+	AddTriangleCullStats(_States.pass, testedTriangleCount, backfaceTriangleCount, smallTriangleCount);
+
 #if USE_PER_PRIMITIVE
 	for (uint i = localThreadId; i < triangleCount; i += MESH_GROUP_SIZE)
 	{
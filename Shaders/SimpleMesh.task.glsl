@@ -28,6 +28,8 @@
 
 
 layout (constant_id = 0) const uint TASK = 0;
+// Meshlet counters of `CullStats.h`
+layout (constant_id = 6) const uint CULL_STATS = 0;
 
 layout (push_constant) uniform PushConstants
 {
@@ -40,7 +42,7 @@ layout (std430, binding = DESC_VERTEX_BUFFER) readonly buffer Vertices
 	Vertex vertices[];
 };
 
-layout (std430, binding = DESC_MESH_BUFFER) readonly buffer Meshes
+layout (std430, binding = DESC_MESH_BOUNDS_BUFFER) readonly buffer Meshes
 {
 	Mesh meshes[];
 };
@@ -50,6 +52,11 @@ layout (std430, binding = DESC_DRAW_DATA_BUFFER) readonly buffer Draws
 	MeshDraw draws[];
 };
 
+layout (std430, binding = DESC_DRAW_DATA_BUFFER) readonly buffer PackedDraws
+{
+	PackedMeshDraw packedDraws[];
+};
+
 layout (std430, binding = DESC_DRAW_COMMAND_BUFFER) readonly buffer DrawCommands
 {
 	MeshDrawCommand drawCommands[];
@@ -65,6 +72,11 @@ layout (std430, binding = DESC_MESHLET_BUFFER) readonly buffer Meshlets
 	Meshlet meshlets[];
 };
 
+layout (std430, binding = DESC_MESHLET_BUFFER) readonly buffer PackedMeshlets
+{
+	PackedMeshlet packedMeshlets[];
+};
+
 layout (std430, binding = DESC_MESHLET_VISIBILITY_BUFFER) buffer MeshletVisibilities
 {
 	uint meshletVisibilities[];
@@ -72,6 +84,13 @@ layout (std430, binding = DESC_MESHLET_VISIBILITY_BUFFER) buffer MeshletVisibili
 
 layout (binding = DESC_DEPTH_PYRAMID) uniform sampler2D depthPyramid;
 
+layout (std430, binding = DESC_CULL_STATS_BUFFER) buffer CullStats
+{
+	uint cullStats[];
+};
+
+#include "CullStats.h"
+
 taskPayloadSharedEXT TaskPayload payload;
 
 
@@ -127,7 +146,7 @@ void main()
 	{
 		MeshTaskCommand meshTaskCommand = taskCommands[groupId];
 		drawId = meshTaskCommand.drawId;
-		meshDraw = draws[drawId];
+		meshDraw = LOAD_MESH_DRAW(drawId);
 		
 		meshletOffset = meshTaskCommand.taskOffset;
 		meshletCount = meshTaskCommand.taskCount;
@@ -142,7 +161,7 @@ void main()
 	{
 		MeshDrawCommand meshDrawCommand = drawCommands[gl_DrawIDARB];
 		drawId = meshDrawCommand.drawId;
-		meshDraw = draws[drawId];
+		meshDraw = LOAD_MESH_DRAW(drawId);
 		
 		meshletOffset = meshDrawCommand.taskOffset;
 		meshletCount = meshDrawCommand.taskCount;
@@ -229,30 +248,37 @@ void main()
 
 	bool skip = pass > 0 && drawVisibility > 0 && meshletVisibility > 0 /* && _DebugParams.meshletOcclusionCulling > 0 */;
 
+	// First test culling the meshlet, for the stats. Not visible last frame in the early pass is the occlusion of last frame.
+	uint cullStage = GetCullStage(CULL_STATS_NONE, valid && !accept, CULL_STATS_MESHLETS_OCCLUSION_CULLED);
+
 	// Culling
 	{
 		// TODO: View space cone culling ?
 		// World space cone culling
-		vec4 cone = meshlets[meshletIndex].cone;
-		cone = vec4(normalize(mat3(worldMatrix) * cone.xyz), cone.w);
+		vec3 scale = GetScaleFromWorldMatrix(worldMatrix);
 
-		vec4 boundingSphere = meshlets[meshletIndex].boundingSphere;
+		vec4 cone = LOAD_MESHLET_CONE(meshletIndex);
+		cone.xyz = normalize(mat3(worldMatrix) * cone.xyz);
+
+		vec4 boundingSphere = LOAD_MESHLET_SPHERE(meshletIndex, meshes[meshDraw.meshIndex].boundingSphere);
 		boundingSphere.xyz = (worldMatrix * vec4(boundingSphere.xyz, 1.0)).xyz;
-		vec3 scale = GetScaleFromWorldMatrix(worldMatrix);
 		boundingSphere.w *= scale.x; // just uniform scale
 
 		if (_DebugParams.meshletConeCulling > 0)
 			accept = accept && !ConeCull_BoundingSphere(cone, boundingSphere, _View.camPos);
+		cullStage = GetCullStage(cullStage, valid && !accept, CULL_STATS_MESHLETS_CONE_CULLED);
 
 		boundingSphere.xyz = (_View.viewMatrix * vec4(boundingSphere.xyz, 1.0f)).xyz;
 		
 		// View space frustum culling
 		if (_DebugParams.meshletFrustumCulling > 0)
 			accept = accept && !FrustumCull(boundingSphere);
+		cullStage = GetCullStage(cullStage, valid && !accept, CULL_STATS_MESHLETS_FRUSTUM_CULLED);
 
 		// View space occlusion culling
 		if (_DebugParams.meshletOcclusionCulling > 0 && pass > 0)
 			accept = accept && !OcclusionCull(depthPyramid, boundingSphere);
+		cullStage = GetCullStage(cullStage, valid && !accept, CULL_STATS_MESHLETS_OCCLUSION_CULLED);
 	}
 
 	if (accept && !skip)
@@ -273,6 +299,8 @@ void main()
 			atomicAnd(meshletVisibilities[(meshletVisibilityIndex >> 5)], ~meshletVisibilityUInt);
 	#endif
 	}
+
+	AddMeshletCullStats(pass, valid, cullStage, accept && !skip);
 	
 	// Sync
 	barrier(); // memoryBarrierShared();
@@ -43,11 +43,26 @@ layout (std430, binding = DESC_VERTEX_BUFFER) readonly buffer Vertices
     Vertex vertices[];
 };
 
+layout (std430, binding = DESC_VERTEX_BUFFER) readonly buffer PackedVertices
+{
+    PackedVertex packedVertices[];
+};
+
+layout (std430, binding = DESC_MESH_BOUNDS_BUFFER) readonly buffer Meshes
+{
+    Mesh meshes[];
+};
+
 layout (std430, binding = DESC_DRAW_DATA_BUFFER) readonly buffer Draws
 {
     MeshDraw draws[];
 };
 
+layout (std430, binding = DESC_DRAW_DATA_BUFFER) readonly buffer PackedDraws
+{
+    PackedMeshDraw packedDraws[];
+};
+
 layout (std430, binding = DESC_DRAW_COMMAND_BUFFER) readonly buffer DrawCommands
 {
     MeshDrawCommand drawCommands[];
@@ -80,7 +95,7 @@ void main()
     // Vertex v = vertices[gl_VertexIndex];
 
     MeshDrawCommand meshDrawCommand = drawCommands[gl_DrawIDARB];
-    MeshDraw meshDraw = draws[meshDrawCommand.drawId];
+    MeshDraw meshDraw = LOAD_MESH_DRAW(meshDrawCommand.drawId);
 
 #if !VERTEX_ALIGNMENT
     // NOT USED NOW
@@ -93,13 +108,9 @@ void main()
     vec2 texcoord0 = v.texcoord0;
 
 #else // VERTEX_ALIGNMENT
-    vec3 posOS = vec3(vertices[gl_VertexIndex].px, vertices[gl_VertexIndex].py, vertices[gl_VertexIndex].pz);
-#if USE_8BIT_16BIT_EXTENSIONS
-    vec3 normalOS = vec3(int(vertices[gl_VertexIndex].nx), int(vertices[gl_VertexIndex].ny), int(vertices[gl_VertexIndex].nz)) / 127.0f - 1.0f;
-#else // USE_8BIT_16BIT_EXTENSIONS
-    vec3 normalOS = vec3(vertices[gl_VertexIndex].nx, vertices[gl_VertexIndex].ny, vertices[gl_VertexIndex].nz);
-#endif // USE_8BIT_16BIT_EXTENSIONS
-    vec2 texcoord0 = vec2(vertices[gl_VertexIndex].s, vertices[gl_VertexIndex].t);
+    vec3 posOS = LOAD_VERTEX_POSITION(gl_VertexIndex, meshes[meshDraw.meshIndex]);
+    vec3 normalOS = LOAD_VERTEX_NORMAL(gl_VertexIndex);
+    vec2 texcoord0 = LOAD_VERTEX_UV(gl_VertexIndex);
 #endif // VERTEX_ALIGNMENT
 
 #else // VERTEX_INPUT_MODE
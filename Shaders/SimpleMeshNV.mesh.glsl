@@ -33,6 +33,11 @@ layout (std430, binding = DESC_DRAW_DATA_BUFFER) readonly buffer Draws
 	MeshDraw draws[];
 };
 
+layout (std430, binding = DESC_DRAW_DATA_BUFFER) readonly buffer PackedDraws
+{
+	PackedMeshDraw packedDraws[];
+};
+
 layout (std430, binding = DESC_DRAW_COMMAND_BUFFER) readonly buffer DrawCommands
 {
 	MeshDrawCommand drawCommands[];
@@ -138,7 +143,7 @@ void main()
 	const uint localThreadId = gl_LocalInvocationID.x;
 
 	const MeshDrawCommand meshDrawCommand = drawCommands[gl_DrawIDARB];
-	const MeshDraw meshDraw = draws[meshDrawCommand.drawId];
+	const MeshDraw meshDraw = LOAD_MESH_DRAW(meshDrawCommand.drawId);
 
 	const mat4 worldMat = BuildWorldMatrix(meshDraw.worldMatRow0, meshDraw.worldMatRow1, meshDraw.worldMatRow2);
 
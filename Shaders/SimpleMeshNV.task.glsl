@@ -37,6 +37,11 @@ layout (std430, binding = DESC_DRAW_DATA_BUFFER) readonly buffer Draws
 	MeshDraw draws[];
 };
 
+layout (std430, binding = DESC_DRAW_DATA_BUFFER) readonly buffer PackedDraws
+{
+	PackedMeshDraw packedDraws[];
+};
+
 layout (std430, binding = DESC_DRAW_COMMAND_BUFFER) readonly buffer DrawCommands
 {
 	MeshDrawCommand drawCommands[];
@@ -105,7 +110,7 @@ void main()
 	const uint localThreadIdStart = groupId * GROUP_SIZE;
 
 	const MeshDrawCommand meshDrawCommand = drawCommands[gl_DrawIDARB];
-	const MeshDraw meshDraw = draws[meshDrawCommand.drawId];
+	const MeshDraw meshDraw = LOAD_MESH_DRAW(meshDrawCommand.drawId);
 	
 	const uint meshletIndex = localThreadIdStart + localThreadId;
 
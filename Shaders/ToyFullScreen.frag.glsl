@@ -15,6 +15,11 @@ layout (binding = 1) readonly buffer Draws
 	MeshDraw draws[];
 };
 
+layout (binding = 1) readonly buffer PackedDraws
+{
+	PackedMeshDraw packedDraws[];
+};
+
 layout (binding = 3) readonly buffer DrawCommandCount
 {
 	uint drawCounts[];
@@ -75,7 +80,7 @@ void main()
 #if 0
 	for(uint i = 0; i < MaxDrawCount; ++i)
 	{
-		const MeshDraw meshDraw = draws[i];
+		const MeshDraw meshDraw = LOAD_MESH_DRAW(i);
 		const mat4 worldMatrix = BuildWorldMatrix(meshDraw.worldMatRow0, meshDraw.worldMatRow1, meshDraw.worldMatRow2);
 
 		const Mesh mesh = meshes[meshDraw.meshIndex];
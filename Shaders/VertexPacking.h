@@ -0,0 +1,47 @@
+#ifndef VERTEX_PACKING_INCLUDED
+#define VERTEX_PACKING_INCLUDED
+
+// Compact `Vertex` encoding, 12 bytes instead of 20: unorm16 positions in the bounding box of the mesh, decoded with the position
+// offset and scale of its `Mesh`, an octahedral snorm8 normal and half uvs.
+// Shared by the shaders and the C++ side (`Geometry.h`, inside a namespace using glm), only the common subset of GLSL and glm is used here.
+
+#ifdef __cplusplus
+#define VERTEX_PACKING_FUNC inline
+#else
+#define VERTEX_PACKING_FUNC
+#endif
+
+struct PackedVertex
+{
+	uint positionXY; // 2 x unorm16
+	uint positionZNormal; // unorm16 position z, 2 x snorm8 octahedral normal
+	uint uv; // 2 x half
+};
+
+// `positionOffset` and `positionScale` of the mesh, xyz - bounding box min and extent / 65535
+VERTEX_PACKING_FUNC vec3 UnpackVertexPosition(PackedVertex vertex, vec4 positionOffset, vec4 positionScale)
+{
+	const vec3 q = vec3(float(vertex.positionXY & 0xFFFFu), float(vertex.positionXY >> 16u), float(vertex.positionZNormal & 0xFFFFu));
+	return vec3(positionOffset) + q * vec3(positionScale);
+}
+
+// Octahedron folded over the lower hemisphere
+VERTEX_PACKING_FUNC vec3 UnpackVertexNormal(PackedVertex vertex)
+{
+	const float ex = max(float(int(vertex.positionZNormal << 8u) >> 24) * (1.0f / 127.0f), -1.0f);
+	const float ey = max(float(int(vertex.positionZNormal) >> 24) * (1.0f / 127.0f), -1.0f);
+
+	vec3 n = vec3(ex, ey, 1.0f - abs(ex) - abs(ey));
+	const float t = max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+
+	return normalize(n);
+}
+
+VERTEX_PACKING_FUNC vec2 UnpackVertexUv(PackedVertex vertex)
+{
+	return unpackHalf2x16(vertex.uv);
+}
+
+#endif // VERTEX_PACKING_INCLUDED
@@ -0,0 +1,77 @@
+#ifndef VISIBILITY_PACKING_INCLUDED
+#define VISIBILITY_PACKING_INCLUDED
+
+// Draw visibility states, 8 bits per draw and 4 draws per word of the draw visibility buffer: bit 0 - visible last frame, bits 1-3 - lod
+// of the last frame (kept for the hysteresis), bits 4-7 - late passes the draw has been visible in a row.
+// A draw only changes its own bits, the changes of the draws sharing a word are merged with an atomic xor.
+// Shared by the shaders and the C++ side (`CpuCulling.h`, inside a namespace using glm), only the common subset of GLSL and glm is used here.
+
+#ifdef __cplusplus
+#define VISIBILITY_PACKING_FUNC inline
+#else
+#define VISIBILITY_PACKING_FUNC
+#endif
+
+#define DRAW_VISIBILITY_BIT 1u
+#define DRAW_VISIBILITY_LOD_SHIFT 1
+#define DRAW_VISIBILITY_LOD_MASK 0x7u
+#define DRAW_VISIBILITY_HISTORY_SHIFT 4
+#define DRAW_VISIBILITY_HISTORY_MAX 15u
+#define DRAW_VISIBILITY_STATE_BITS 8
+#define DRAW_VISIBILITY_STATE_MASK 0xFFu
+#define DRAW_VISIBILITY_STATES_PER_WORD 4
+
+VISIBILITY_PACKING_FUNC uint GetDrawVisibilityWordIndex(uint drawIndex)
+{
+	return drawIndex / DRAW_VISIBILITY_STATES_PER_WORD;
+}
+
+VISIBILITY_PACKING_FUNC uint GetDrawVisibilityShift(uint drawIndex)
+{
+	return (drawIndex % DRAW_VISIBILITY_STATES_PER_WORD) * DRAW_VISIBILITY_STATE_BITS;
+}
+
+// State of the draw in its word
+VISIBILITY_PACKING_FUNC uint GetDrawVisibilityState(uint word, uint drawIndex)
+{
+	return (word >> GetDrawVisibilityShift(drawIndex)) & DRAW_VISIBILITY_STATE_MASK;
+}
+
+VISIBILITY_PACKING_FUNC uint PackDrawVisibility(uint drawVisibility, uint lodIndex, uint history)
+{
+	return (drawVisibility & DRAW_VISIBILITY_BIT) | ((lodIndex & DRAW_VISIBILITY_LOD_MASK) << DRAW_VISIBILITY_LOD_SHIFT) | (history << DRAW_VISIBILITY_HISTORY_SHIFT);
+}
+
+VISIBILITY_PACKING_FUNC uint GetDrawVisibility(uint state)
+{
+	return state & DRAW_VISIBILITY_BIT;
+}
+
+VISIBILITY_PACKING_FUNC uint GetDrawVisibilityLod(uint state)
+{
+	return (state >> DRAW_VISIBILITY_LOD_SHIFT) & DRAW_VISIBILITY_LOD_MASK;
+}
+
+VISIBILITY_PACKING_FUNC uint GetDrawVisibilityHistory(uint state)
+{
+	return state >> DRAW_VISIBILITY_HISTORY_SHIFT;
+}
+
+// Draws visible in the last `historyFrames` late passes skip the occlusion test of the late pass, `historyFrames` in [1, 14], 0 disables it.
+// The history keeps counting while the test is skipped, the draw is tested again once it reaches the max.
+VISIBILITY_PACKING_FUNC bool IsDrawVisibilityStable(uint state, uint historyFrames)
+{
+	const uint history = GetDrawVisibilityHistory(state);
+	return historyFrames > 0 && GetDrawVisibility(state) != 0 && history >= historyFrames && history < DRAW_VISIBILITY_HISTORY_MAX;
+}
+
+// History after a late pass, a tested draw visible again starts over stable
+VISIBILITY_PACKING_FUNC uint GetNextDrawVisibilityHistory(uint state, bool bVisible, uint historyFrames)
+{
+	const uint history = GetDrawVisibilityHistory(state);
+	if (!bVisible)
+		return 0;
+	return history < DRAW_VISIBILITY_HISTORY_MAX ? history + 1 : historyFrames;
+}
+
+#endif // VISIBILITY_PACKING_INCLUDED
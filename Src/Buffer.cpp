@@ -2,6 +2,7 @@
 #include "Device.h"
 #include "CommandManager.h"
 #include "Renderer.h"
+#include "StagingUploader.h"
 
 
 namespace Niagara
@@ -82,7 +83,7 @@ namespace Niagara
 			mappedData = reinterpret_cast<uint8_t*>(allocInfo.pMappedData);
 
 		if (pInitData != nullptr)
-			Update(pInitData, initSize);
+			UpdateDeferred(pInitData, initSize);
 
 		if (name != "")
 			g_AccessMgr.AddResourceAccess(name);
@@ -101,6 +102,18 @@ namespace Niagara
 	}
 
 	void Buffer::Update(const void* data, size_t size, size_t offset)
+	{
+		if (!persistent && g_StagingUploader.IsInited())
+		{
+			g_StagingUploader.Upload(buffer, offset, data, size);
+			g_StagingUploader.Wait(g_StagingUploader.Flush());
+			return;
+		}
+
+		UpdateDeferred(data, size, offset);
+	}
+
+	void Buffer::UpdateDeferred(const void* data, size_t size, size_t offset)
 	{
 		const Device& device = *g_Device;
 
@@ -110,6 +123,11 @@ namespace Niagara
 			memcpy_s(mappedData + offset, size, data, size);
 			Flush(device);
 		}
+		else if (g_StagingUploader.IsInited())
+		{
+			// Batched, the copy is submitted by the next flush of the uploader
+			g_StagingUploader.Upload(buffer, offset, data, size);
+		}
 		else
 		{
 			Buffer stagingBuffer;
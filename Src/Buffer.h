@@ -38,7 +38,10 @@ namespace Niagara
 		void Init(const Device& device, VkDeviceSize size, VkBufferUsageFlags bufferUsage, VmaMemoryUsage memoryUsage = VMA_MEMORY_USAGE_AUTO, VmaAllocationCreateFlags allocFlags = 0, const void* pInitData = nullptr, size_t initSize = 0);
 		void Destroy(const Device& device);
 
+		// The data is in the buffer on return
 		void Update(const void* data, size_t size, size_t offset = 0);
+		// Batches the upload of a buffer that isn't in use, the copy is submitted by the next flush of the staging uploader
+		void UpdateDeferred(const void* data, size_t size, size_t offset = 0);
 
 		// Maps Vulkan memory if it hasn't already mapped to an host visible address
 		uint8_t* Map(const Device &device);
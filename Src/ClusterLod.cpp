@@ -0,0 +1,476 @@
+#include "ClusterLod.h"
+
+#include "JobSystem.h"
+
+#include "meshoptimizer.h"
+
+#if USE_METIS
+#include <metis.h>
+#endif
+
+#include <map>
+
+
+namespace Niagara
+{
+	static const uint32_t g_InvalidIndex = ~0u;
+
+	static ClusterLodBounds GetClusterBounds(const std::vector<Vertex>& vertices, const uint32_t* indices, size_t indexCount)
+	{
+		meshopt_Bounds bounds = meshopt_computeClusterBounds(indices, indexCount, &vertices[0].p.x, vertices.size(), sizeof(Vertex));
+
+		ClusterLodBounds result{};
+		result.center = glm::vec3(bounds.center[0], bounds.center[1], bounds.center[2]);
+		result.radius = bounds.radius;
+		return result;
+	}
+
+	// Sphere containing all the children spheres, with the max error so that errors never decrease towards the roots
+	static ClusterLodBounds MergeBounds(const std::vector<ClusterLodBounds>& children)
+	{
+		glm::vec3 minBounds{ FLT_MAX }, maxBounds{ -FLT_MAX };
+		for (const auto& child : children)
+		{
+			minBounds = glm::min(minBounds, child.center - glm::vec3(child.radius));
+			maxBounds = glm::max(maxBounds, child.center + glm::vec3(child.radius));
+		}
+
+		ClusterLodBounds result{};
+		result.center = (minBounds + maxBounds) * 0.5f;
+		for (const auto& child : children)
+		{
+			result.radius = std::max(result.radius, glm::length(child.center - result.center) + child.radius);
+			result.error = std::max(result.error, child.error);
+		}
+		// Stay conservative with float rounding, a parent must contain its children
+		result.radius *= 1.0f + 1e-5f;
+
+		return result;
+	}
+
+	// Splits a triangle list into clusters of at most MESHLET_MAX_VERTICES / MESHLET_MAX_PRIMITIVES, appended to `result.indices`
+	static void SplitClusters(ClusterLod& result, std::vector<uint32_t>& newClusters, const std::vector<Vertex>& vertices, const uint32_t* indices, size_t indexCount,
+		const ClusterLodBounds& selfBounds, uint32_t level, uint32_t group)
+	{
+		static const float ConeWeight = 0.0f;
+
+		size_t maxMeshletCount = meshopt_buildMeshletsBound(indexCount, MESHLET_MAX_VERTICES, MESHLET_MAX_PRIMITIVES);
+		std::vector<meshopt_Meshlet> optMeshlets(maxMeshletCount);
+		std::vector<uint32_t> meshletVertices(maxMeshletCount * MESHLET_MAX_VERTICES);
+		std::vector<uint8_t> meshletTriangles(maxMeshletCount * MESHLET_MAX_PRIMITIVES * 3);
+
+		size_t meshletCount = meshopt_buildMeshlets(optMeshlets.data(), meshletVertices.data(), meshletTriangles.data(), indices, indexCount,
+			&vertices[0].p.x, vertices.size(), sizeof(Vertex), MESHLET_MAX_VERTICES, MESHLET_MAX_PRIMITIVES, ConeWeight);
+
+		for (size_t i = 0; i < meshletCount; ++i)
+		{
+			const auto& optMeshlet = optMeshlets[i];
+
+			ClusterLodCluster cluster{};
+			cluster.indexOffset = static_cast<uint32_t>(result.indices.size());
+			cluster.indexCount = optMeshlet.triangle_count * 3;
+			cluster.level = level;
+			cluster.group = group;
+			cluster.parent.error = FLT_MAX;
+
+			for (uint32_t j = 0; j < optMeshlet.triangle_count * 3; ++j)
+				result.indices.push_back(meshletVertices[optMeshlet.vertex_offset + meshletTriangles[optMeshlet.triangle_offset + j]]);
+
+			// Level 0 clusters are their own bounds, the others share the bounds of their group so that they switch together
+			cluster.self = level == 0 ? GetClusterBounds(vertices, &result.indices[cluster.indexOffset], cluster.indexCount) : selfBounds;
+
+			newClusters.push_back(static_cast<uint32_t>(result.clusters.size()));
+			result.clusters.push_back(cluster);
+		}
+	}
+
+	// Adjacency of the pending clusters, weighted by the number of shared vertices. Vertices are matched by position,
+	// so that attribute seams don't disconnect clusters.
+	static void BuildClusterAdjacency(std::vector<std::map<uint32_t, uint32_t>>& adjacency, const ClusterLod& clusterLod, const std::vector<uint32_t>& pending,
+		const std::vector<uint32_t>& positionRemap)
+	{
+		std::vector<std::pair<uint32_t, uint32_t>> vertexClusters; // (vertex, pending cluster)
+		for (uint32_t i = 0; i < static_cast<uint32_t>(pending.size()); ++i)
+		{
+			const auto& cluster = clusterLod.clusters[pending[i]];
+			for (uint32_t j = 0; j < cluster.indexCount; ++j)
+				vertexClusters.emplace_back(positionRemap[clusterLod.indices[cluster.indexOffset + j]], i);
+		}
+
+		std::sort(vertexClusters.begin(), vertexClusters.end());
+		vertexClusters.erase(std::unique(vertexClusters.begin(), vertexClusters.end()), vertexClusters.end());
+
+		adjacency.assign(pending.size(), {});
+		for (size_t begin = 0; begin < vertexClusters.size(); )
+		{
+			size_t end = begin + 1;
+			while (end < vertexClusters.size() && vertexClusters[end].first == vertexClusters[begin].first)
+				++end;
+
+			for (size_t a = begin; a < end; ++a)
+			{
+				for (size_t b = a + 1; b < end; ++b)
+				{
+					adjacency[vertexClusters[a].second][vertexClusters[b].second]++;
+					adjacency[vertexClusters[b].second][vertexClusters[a].second]++;
+				}
+			}
+
+			begin = end;
+		}
+	}
+
+#if USE_METIS
+	// Partitions the adjacency graph into groups of about `groupSize` clusters, minimizing the shared vertices cut. Returns false if METIS fails.
+	static bool PartitionClustersMetis(std::vector<std::vector<uint32_t>>& groups, const std::vector<std::map<uint32_t, uint32_t>>& adjacency, uint32_t groupSize)
+	{
+		std::vector<idx_t> xadj, adjncy, adjwgt;
+		xadj.reserve(adjacency.size() + 1);
+		xadj.push_back(0);
+		for (const auto& neighbours : adjacency)
+		{
+			for (const auto& neighbour : neighbours)
+			{
+				adjncy.push_back(static_cast<idx_t>(neighbour.first));
+				adjwgt.push_back(static_cast<idx_t>(neighbour.second));
+			}
+			xadj.push_back(static_cast<idx_t>(adjncy.size()));
+		}
+
+		idx_t vertexCount = static_cast<idx_t>(adjacency.size());
+		idx_t constraintCount = 1;
+		idx_t partCount = static_cast<idx_t>(DivideAndRoundUp(static_cast<uint32_t>(adjacency.size()), groupSize));
+		idx_t edgeCut = 0;
+		std::vector<idx_t> parts(adjacency.size(), 0);
+
+		idx_t options[METIS_NOPTIONS];
+		METIS_SetDefaultOptions(options);
+		options[METIS_OPTION_SEED] = 42; // deterministic builds
+		options[METIS_OPTION_UFACTOR] = 100;
+
+		int ret = partCount > 8 ?
+			METIS_PartGraphKway(&vertexCount, &constraintCount, xadj.data(), adjncy.data(), nullptr, nullptr, adjwgt.data(), &partCount, nullptr, nullptr, options, &edgeCut, parts.data()) :
+			METIS_PartGraphRecursive(&vertexCount, &constraintCount, xadj.data(), adjncy.data(), nullptr, nullptr, adjwgt.data(), &partCount, nullptr, nullptr, options, &edgeCut, parts.data());
+		if (ret != METIS_OK)
+			return false;
+
+		groups.assign(partCount, {});
+		for (uint32_t i = 0; i < static_cast<uint32_t>(parts.size()); ++i)
+			groups[parts[i]].push_back(i);
+
+		groups.erase(std::remove_if(groups.begin(), groups.end(), [](const auto& group) { return group.empty(); }), groups.end());
+		return true;
+	}
+#endif
+
+	// Grows each group greedily towards its most connected neighbour, the fallback without METIS
+	static void PartitionClustersGreedy(std::vector<std::vector<uint32_t>>& groups, const std::vector<std::map<uint32_t, uint32_t>>& adjacency, uint32_t groupSize)
+	{
+		std::vector<bool> grouped(adjacency.size(), false);
+		groups.clear();
+
+		for (uint32_t seed = 0; seed < static_cast<uint32_t>(adjacency.size()); ++seed)
+		{
+			if (grouped[seed])
+				continue;
+
+			std::vector<uint32_t> group{ seed };
+			grouped[seed] = true;
+
+			while (group.size() < groupSize)
+			{
+				std::map<uint32_t, uint32_t> candidates;
+				for (uint32_t member : group)
+				{
+					for (const auto& neighbour : adjacency[member])
+					{
+						if (!grouped[neighbour.first])
+							candidates[neighbour.first] += neighbour.second;
+					}
+				}
+
+				if (candidates.empty())
+					break;
+
+				auto best = std::max_element(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a.second < b.second; });
+				group.push_back(best->first);
+				grouped[best->first] = true;
+			}
+
+			groups.push_back(std::move(group));
+		}
+	}
+
+	static void PartitionClusters(std::vector<std::vector<uint32_t>>& groups, const std::vector<std::map<uint32_t, uint32_t>>& adjacency, uint32_t groupSize)
+	{
+#if USE_METIS
+		if (PartitionClustersMetis(groups, adjacency, groupSize))
+			return;
+#endif
+		PartitionClustersGreedy(groups, adjacency, groupSize);
+	}
+
+	void BuildClusterLod(ClusterLod& result, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const ClusterLodSettings& settings)
+	{
+		result = {};
+
+		if (indices.empty())
+			return;
+
+		// Position only remap for the adjacency
+		std::vector<uint32_t> positionRemap(vertices.size());
+		meshopt_Stream positionStream{ &vertices[0].p, sizeof(glm::vec3), sizeof(Vertex) };
+		meshopt_generateVertexRemapMulti(positionRemap.data(), nullptr, vertices.size(), vertices.size(), &positionStream, 1);
+
+		// Simplification errors are relative to the mesh extents
+		const float errorScale = meshopt_simplifyScale(&vertices[0].p.x, vertices.size(), sizeof(Vertex));
+
+		std::vector<uint32_t> pending;
+		SplitClusters(result, pending, vertices, indices.data(), indices.size(), {}, 0, g_InvalidIndex);
+		result.levelCount = 1;
+
+		std::vector<std::map<uint32_t, uint32_t>> adjacency;
+		std::vector<std::vector<uint32_t>> groups;
+		std::vector<uint32_t> groupIndices, simplifiedIndices;
+		std::vector<ClusterLodBounds> childBounds;
+
+		while (pending.size() > 1)
+		{
+			if (pending.size() > settings.groupSize)
+			{
+				BuildClusterAdjacency(adjacency, result, pending, positionRemap);
+				PartitionClusters(groups, adjacency, settings.groupSize);
+			}
+			else
+			{
+				groups.assign(1, std::vector<uint32_t>(pending.size()));
+				for (uint32_t i = 0; i < static_cast<uint32_t>(pending.size()); ++i)
+					groups[0][i] = i;
+			}
+
+			std::vector<uint32_t> nextPending;
+
+			for (const auto& group : groups)
+			{
+				// Merge
+				groupIndices.clear();
+				childBounds.clear();
+				for (uint32_t i : group)
+				{
+					const auto& cluster = result.clusters[pending[i]];
+					groupIndices.insert(groupIndices.end(), result.indices.begin() + cluster.indexOffset, result.indices.begin() + cluster.indexOffset + cluster.indexCount);
+					childBounds.push_back(cluster.self);
+				}
+
+				// Simplify, the group border is locked so the neighbour groups still match
+				size_t targetIndexCount = static_cast<size_t>(groupIndices.size() / 3 * settings.simplifyRatio) * 3;
+				float simplifyError = 0.0f;
+
+				simplifiedIndices.resize(groupIndices.size());
+				size_t simplifiedCount = meshopt_simplify(simplifiedIndices.data(), groupIndices.data(), groupIndices.size(), &vertices[0].p.x, vertices.size(), sizeof(Vertex),
+					targetIndexCount, 1.0f, meshopt_SimplifyLockBorder, &simplifyError);
+				simplifiedIndices.resize(simplifiedCount);
+
+				// Stuck, these clusters stay roots
+				if (simplifiedCount == 0 || simplifiedCount > groupIndices.size() * settings.maxSimplifyRatio)
+					continue;
+
+				ClusterLodBounds groupBounds = MergeBounds(childBounds);
+				groupBounds.error = std::max(groupBounds.error, simplifyError * errorScale);
+
+				const uint32_t groupIndex = static_cast<uint32_t>(result.groups.size());
+
+				ClusterLodGroup lodGroup{};
+				lodGroup.bounds = groupBounds;
+				lodGroup.childOffset = static_cast<uint32_t>(result.groupChildren.size());
+				lodGroup.childCount = static_cast<uint32_t>(group.size());
+				for (uint32_t i : group)
+				{
+					result.clusters[pending[i]].parent = groupBounds;
+					result.groupChildren.push_back(pending[i]);
+				}
+
+				// Split
+				lodGroup.clusterOffset = static_cast<uint32_t>(result.clusters.size());
+				SplitClusters(result, nextPending, vertices, simplifiedIndices.data(), simplifiedIndices.size(), groupBounds, result.levelCount, groupIndex);
+				lodGroup.clusterCount = static_cast<uint32_t>(result.clusters.size()) - lodGroup.clusterOffset;
+
+				result.groups.push_back(lodGroup);
+			}
+
+			if (nextPending.empty())
+				break;
+
+			pending.swap(nextPending);
+			result.levelCount++;
+		}
+	}
+
+	uint32_t BuildClusterLodMeshlets(Geometry& result, const std::vector<Vertex>& vertices, const ClusterLod& clusterLod)
+	{
+		const uint32_t firstMeshlet = static_cast<uint32_t>(result.meshlets.size());
+
+		std::vector<uint32_t> meshletVertices;
+		std::vector<uint8_t> meshletTriangles;
+		std::map<uint32_t, uint8_t> localIndices;
+
+		for (const auto& cluster : clusterLod.clusters)
+		{
+			meshletVertices.clear();
+			meshletTriangles.clear();
+			localIndices.clear();
+
+			for (uint32_t i = 0; i < cluster.indexCount; ++i)
+			{
+				uint32_t vertex = clusterLod.indices[cluster.indexOffset + i];
+
+				auto it = localIndices.find(vertex);
+				if (it == localIndices.end())
+				{
+					it = localIndices.emplace(vertex, static_cast<uint8_t>(meshletVertices.size())).first;
+					meshletVertices.push_back(vertex);
+				}
+				meshletTriangles.push_back(it->second);
+			}
+			assert(meshletVertices.size() <= MESHLET_MAX_VERTICES);
+
+			// Packed primitive indices read whole 4 bytes groups
+			meshletTriangles.resize((meshletTriangles.size() + 3) & ~size_t(3), 0);
+
+			AppendMeshlet(result, vertices, meshletVertices.data(), static_cast<uint32_t>(meshletVertices.size()), meshletTriangles.data(), cluster.indexCount / 3);
+		}
+
+		return firstMeshlet;
+	}
+
+	static MeshCluster GetMeshCluster(const ClusterLodCluster& cluster, uint32_t meshletIndex)
+	{
+		MeshCluster result{};
+		result.selfSphere = glm::vec4(cluster.self.center, cluster.self.radius);
+		result.parentSphere = glm::vec4(cluster.parent.center, cluster.parent.radius);
+		result.selfError = cluster.self.error;
+		result.parentError = cluster.parent.error;
+		result.meshletIndex = meshletIndex;
+		result.level = cluster.level;
+
+		return result;
+	}
+
+	void BuildMeshClusterLods(Geometry& result, const ClusterLodSettings& settings)
+	{
+		const uint32_t meshCount = static_cast<uint32_t>(result.meshes.size());
+
+		// Meshlets of each mesh in their own geometry, merged in order like `LoadMeshes`
+		std::vector<ClusterLod> clusterLods(meshCount);
+		std::vector<Geometry> clusterMeshlets(meshCount);
+
+		auto Build = [&](uint32_t i)
+		{
+			const Mesh& mesh = result.meshes[i];
+			if (mesh.clusterCount > 0 || mesh.lodCount == 0)
+				return;
+
+			const MeshLod& lod = mesh.lods[0];
+			std::vector<Vertex> vertices(result.vertices.begin() + mesh.vertexOffset, result.vertices.begin() + mesh.vertexOffset + mesh.vertexCount);
+			std::vector<uint32_t> indices(result.indices.begin() + lod.indexOffset, result.indices.begin() + lod.indexOffset + lod.indexCount);
+
+			BuildClusterLod(clusterLods[i], vertices, indices, settings);
+			BuildClusterLodMeshlets(clusterMeshlets[i], vertices, clusterLods[i]);
+		};
+
+		if (g_JobSystem.IsInited())
+		{
+			JobCounter counter;
+			g_JobSystem.ParallelFor(counter, meshCount, 1, Build);
+			g_JobSystem.Wait(counter);
+		}
+		else
+		{
+			for (uint32_t i = 0; i < meshCount; ++i)
+				Build(i);
+		}
+
+		for (uint32_t i = 0; i < meshCount; ++i)
+		{
+			const auto& clusterLod = clusterLods[i];
+			const auto& meshlets = clusterMeshlets[i];
+			if (clusterLod.clusters.empty())
+				continue;
+
+			Mesh& mesh = result.meshes[i];
+			mesh.clusterOffset = static_cast<uint32_t>(result.clusters.size());
+			mesh.clusterCount = static_cast<uint32_t>(clusterLod.clusters.size());
+
+			const uint32_t meshletOffset = static_cast<uint32_t>(result.meshlets.size());
+			const uint32_t meshletDataOffset = static_cast<uint32_t>(result.meshletData.size());
+
+			result.meshletData.insert(result.meshletData.end(), meshlets.meshletData.begin(), meshlets.meshletData.end());
+			for (auto meshlet : meshlets.meshlets)
+			{
+				meshlet.vertexOffset += meshletDataOffset;
+				result.meshlets.push_back(meshlet);
+			}
+
+			for (uint32_t j = 0; j < mesh.clusterCount; ++j)
+				result.clusters.push_back(GetMeshCluster(clusterLod.clusters[j], meshletOffset + j));
+
+			// Same padding as the lod meshlets
+			size_t meshletCount = result.meshlets.size();
+			if (meshletCount % TASK_GROUP_SIZE != 0)
+				result.meshlets.insert(result.meshlets.end(), TASK_GROUP_SIZE - meshletCount % TASK_GROUP_SIZE, {});
+
+			clusterMeshlets[i] = {};
+		}
+	}
+
+	void SelectClusterLod(std::vector<uint32_t>& selected, const ClusterLod& clusterLod, const glm::vec3& cameraPos, float projScale, float errorThreshold)
+	{
+		selected.clear();
+
+		for (uint32_t i = 0; i < static_cast<uint32_t>(clusterLod.clusters.size()); ++i)
+		{
+			if (IsClusterLodSelected(clusterLod.clusters[i], cameraPos, projScale, errorThreshold))
+				selected.push_back(i);
+		}
+	}
+
+	void TraverseClusterLod(std::vector<uint32_t>& selected, const ClusterLod& clusterLod, const glm::vec3& cameraPos, float projScale, float errorThreshold)
+	{
+		selected.clear();
+
+		std::vector<bool> visitedGroups(clusterLod.groups.size(), false);
+		std::vector<uint32_t> stack;
+
+		// Roots
+		for (uint32_t i = 0; i < static_cast<uint32_t>(clusterLod.clusters.size()); ++i)
+		{
+			if (clusterLod.clusters[i].parent.error == FLT_MAX)
+				stack.push_back(i);
+		}
+
+		while (!stack.empty())
+		{
+			uint32_t clusterIndex = stack.back();
+			stack.pop_back();
+
+			const auto& cluster = clusterLod.clusters[clusterIndex];
+			if (ProjectClusterLodError(cluster.self, cameraPos, projScale) <= errorThreshold)
+			{
+				selected.push_back(clusterIndex);
+				continue;
+			}
+
+			// Too coarse, refine into the clusters this one was built from. They're shared by all the clusters of the group.
+			if (cluster.group == g_InvalidIndex || visitedGroups[cluster.group])
+				continue;
+
+			visitedGroups[cluster.group] = true;
+
+			const auto& group = clusterLod.groups[cluster.group];
+			for (uint32_t i = 0; i < group.childCount; ++i)
+				stack.push_back(clusterLod.groupChildren[group.childOffset + i]);
+		}
+
+		std::sort(selected.begin(), selected.end());
+	}
+}
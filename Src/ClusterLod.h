@@ -0,0 +1,111 @@
+#pragma once
+
+#include "pch.h"
+#include "Config.h"
+#include "Utilities.h"
+#include "Geometry.h"
+#include <cfloat>
+
+
+namespace Niagara
+{
+	/**
+	* Cluster LOD
+	* A Nanite style hierarchy of clusters. Level 0 clusters are the meshlets of the full detail mesh. Each next level partitions the
+	* clusters into groups of neighbours (METIS, or a greedy grouping without it), simplifies every group with its border locked and
+	* splits the result back into clusters. Locked borders keep adjacent groups watertight whichever level each of them is drawn at.
+	* A cluster stores the bounds and error of the group it was built from (`self`), and of the group it was merged into (`parent`).
+	* Errors and bounds grow monotonically towards the roots, so a cluster is drawn iff its own error is small enough and its parent's
+	* isn't. Every cluster can be tested on its own, which lets the GPU pick the detail per cluster instead of per mesh.
+	*/
+	struct ClusterLodBounds
+	{
+		glm::vec3 center{ 0.0f };
+		float radius = 0.0f;
+		// Object space simplification error, FLT_MAX for the parent of the roots
+		float error = 0.0f;
+	};
+
+	struct ClusterLodCluster
+	{
+		ClusterLodBounds self;
+		ClusterLodBounds parent;
+
+		// Triangle list in `ClusterLod::indices`, mesh vertex indices
+		uint32_t indexOffset;
+		uint32_t indexCount;
+
+		uint32_t level;
+		// The group this cluster was built from, ~0u for level 0 clusters
+		uint32_t group;
+	};
+
+	struct ClusterLodGroup
+	{
+		ClusterLodBounds bounds;
+
+		// Clusters merged into this group, in `ClusterLod::groupChildren`
+		uint32_t childOffset;
+		uint32_t childCount;
+		// Clusters built from this group
+		uint32_t clusterOffset;
+		uint32_t clusterCount;
+	};
+
+	struct ClusterLod
+	{
+		std::vector<ClusterLodCluster> clusters;
+		std::vector<ClusterLodGroup> groups;
+		std::vector<uint32_t> groupChildren;
+		std::vector<uint32_t> indices;
+
+		uint32_t levelCount = 0;
+	};
+
+	struct ClusterLodSettings
+	{
+		uint32_t groupSize = 4;
+		float simplifyRatio = 0.5f;
+		// Groups that keep more triangles than this ratio are not simplified further, their clusters become roots
+		float maxSimplifyRatio = 0.85f;
+	};
+
+	void BuildClusterLod(ClusterLod& result, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const ClusterLodSettings& settings = {});
+	// Appends a meshlet per cluster, in cluster order, returns the index of the first one
+	uint32_t BuildClusterLodMeshlets(Geometry& result, const std::vector<Vertex>& vertices, const ClusterLod& clusterLod);
+	// Builds the cluster LOD of lod 0 of the meshes of `result` that have none, in parallel on `g_JobSystem` if it's inited. The clusters
+	// of a mesh are appended to `result.clusters` in the order of `ClusterLod::clusters`, and their meshlets after the other ones.
+	void BuildMeshClusterLods(Geometry& result, const ClusterLodSettings& settings = {});
+
+	/// CPU reference traversal
+
+	// Projected error in pixels, `projScale` = viewport height / (2 * tan(fovY / 2)). A camera inside the bounds never accepts the error.
+	inline float ProjectClusterLodError(const ClusterLodBounds& bounds, const glm::vec3& cameraPos, float projScale)
+	{
+		if (bounds.error == 0.0f || bounds.error == FLT_MAX)
+			return bounds.error;
+
+		float distance = glm::length(bounds.center - cameraPos) - bounds.radius;
+		return distance > EPS ? bounds.error / distance * projScale : FLT_MAX;
+	}
+
+	inline bool IsClusterLodSelected(const ClusterLodCluster& cluster, const glm::vec3& cameraPos, float projScale, float errorThreshold)
+	{
+		return ProjectClusterLodError(cluster.self, cameraPos, projScale) <= errorThreshold &&
+			ProjectClusterLodError(cluster.parent, cameraPos, projScale) > errorThreshold;
+	}
+
+	inline bool IsClusterLodSelected(const MeshCluster& cluster, const glm::vec3& cameraPos, float projScale, float errorThreshold)
+	{
+		const ClusterLodBounds self{ glm::vec3(cluster.selfSphere), cluster.selfSphere.w, cluster.selfError };
+		const ClusterLodBounds parent{ glm::vec3(cluster.parentSphere), cluster.parentSphere.w, cluster.parentError };
+
+		return ProjectClusterLodError(self, cameraPos, projScale) <= errorThreshold && ProjectClusterLodError(parent, cameraPos, projScale) > errorThreshold;
+	}
+
+	// Tests each cluster independently, like the GPU does. `cameraPos` is in the mesh space.
+	void SelectClusterLod(std::vector<uint32_t>& selected, const ClusterLod& clusterLod, const glm::vec3& cameraPos, float projScale, float errorThreshold);
+	// Walks the DAG from the roots, refining groups whose error is too large. Selects the same clusters as `SelectClusterLod`,
+	// a mismatch means the hierarchy is broken.
+	void TraverseClusterLod(std::vector<uint32_t>& selected, const ClusterLod& clusterLod, const glm::vec3& cameraPos, float projScale, float errorThreshold);
+}
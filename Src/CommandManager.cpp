@@ -10,7 +10,7 @@ namespace Niagara
 	/// Globals variables
 
 	CommandManager g_CommandMgr{};
-	CommandContext g_CommandContext{};
+	thread_local CommandContext g_CommandContext{};
 
 
 	/// Global functions
@@ -832,7 +832,8 @@ namespace Niagara
 		barrier2.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	}
 
-	void CommandContext::ImageBarrier2(VkImage image, const VkImageSubresourceRange& subresourceRange, VkImageLayout oldLayout, VkImageLayout newLayout, VkPipelineStageFlags2 srcStageMask, VkPipelineStageFlags2 dstStageMask, VkAccessFlags2 srcAccessMask, VkAccessFlags2 dstAccessMask)
+	void CommandContext::ImageBarrier2(VkImage image, const VkImageSubresourceRange& subresourceRange, VkImageLayout oldLayout, VkImageLayout newLayout, VkPipelineStageFlags2 srcStageMask, VkPipelineStageFlags2 dstStageMask, VkAccessFlags2 srcAccessMask, VkAccessFlags2 dstAccessMask,
+		uint32_t srcQueueFamily, uint32_t dstQueueFamily)
 	{
 		assert(activeImageMemoryBarriers2 < s_MaxBarrierNum);
 
@@ -846,8 +847,8 @@ namespace Niagara
 		barrier2.dstAccessMask = dstAccessMask;
 		barrier2.srcStageMask = srcStageMask;
 		barrier2.dstStageMask = dstStageMask;
-		barrier2.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		barrier2.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier2.srcQueueFamilyIndex = srcQueueFamily;
+		barrier2.dstQueueFamilyIndex = dstQueueFamily;
 	}
 
 	void CommandContext::ImageBarrier2_Deprecated(Image &image, VkImageLayout newLayout, VkPipelineStageFlags2 srcStageMask, VkPipelineStageFlags2 dstStageMask, VkAccessFlags2 srcAccessMask, VkAccessFlags2 dstAccessMask)
@@ -895,7 +896,8 @@ namespace Niagara
 		barrier2.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	}
 
-	void CommandContext::BufferBarrier2(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, VkPipelineStageFlags2 srcStageMask, VkPipelineStageFlags2 dstStageMask, VkAccessFlags2 srcAccessMask, VkAccessFlags2 dstAccessMask)
+	void CommandContext::BufferBarrier2(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, VkPipelineStageFlags2 srcStageMask, VkPipelineStageFlags2 dstStageMask, VkAccessFlags2 srcAccessMask, VkAccessFlags2 dstAccessMask,
+		uint32_t srcQueueFamily, uint32_t dstQueueFamily)
 	{
 		assert(activeBufferMemoryBarriers2 < s_MaxBarrierNum);
 
@@ -908,8 +910,8 @@ namespace Niagara
 		barrier2.dstAccessMask = dstAccessMask;
 		barrier2.srcStageMask = srcStageMask;
 		barrier2.dstStageMask = dstStageMask;
-		barrier2.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		barrier2.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier2.srcQueueFamilyIndex = srcQueueFamily;
+		barrier2.dstQueueFamilyIndex = dstQueueFamily;
 	}
 
 	void CommandContext::BufferBarrier2(Buffer& buffer, VkPipelineStageFlags2 dstStageMask, VkAccessFlags2 dstAccessMask)
@@ -305,9 +305,11 @@ namespace Niagara
 			VkPipelineStageFlags2 srcStageMask, VkPipelineStageFlags2 dstStageMask,
 			VkAccessFlags2 srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT, VkAccessFlags2 dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT);
 
+		// Queue family ownership transfer if the queue families differ
 		void ImageBarrier2(VkImage image, const VkImageSubresourceRange& subresourceRange, VkImageLayout oldLayout, VkImageLayout newLayout,
 			VkPipelineStageFlags2 srcStageMask, VkPipelineStageFlags2 dstStageMask,
-			VkAccessFlags2 srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT, VkAccessFlags2 dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT);
+			VkAccessFlags2 srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT, VkAccessFlags2 dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT,
+			uint32_t srcQueueFamily = VK_QUEUE_FAMILY_IGNORED, uint32_t dstQueueFamily = VK_QUEUE_FAMILY_IGNORED);
 
 		// Deprecated
 		void ImageBarrier2_Deprecated(Image &image, VkImageLayout newLayout,
@@ -318,7 +320,8 @@ namespace Niagara
 
 		void BufferBarrier2(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size,
 			VkPipelineStageFlags2 srcStageMask, VkPipelineStageFlags2 dstStageMask,
-			VkAccessFlags2 srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT, VkAccessFlags2 dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT);
+			VkAccessFlags2 srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT, VkAccessFlags2 dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT,
+			uint32_t srcQueueFamily = VK_QUEUE_FAMILY_IGNORED, uint32_t dstQueueFamily = VK_QUEUE_FAMILY_IGNORED);
 
 		void BufferBarrier2(Buffer &buffer, VkPipelineStageFlags2 dstStageMask, VkAccessFlags2 dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT);
 
@@ -329,5 +332,6 @@ namespace Niagara
 		void Blit(VkCommandBuffer cmd, VkImage srcImage, VkImage dstImage, VkRect2D srcRegion, VkRect2D dstRegion, uint32_t srcMipLevel = 0, uint32_t dstMipLevel = 0);
 
 	};
-	extern CommandContext g_CommandContext;
+	// Per thread, the render graph records passes on the job system
+	extern thread_local CommandContext g_CommandContext;
 }
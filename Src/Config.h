@@ -18,6 +18,53 @@
 #define USE_PACKED_PRIMITIVE_INDICES_NV 0
 // Mesh shader needs the 8bit_16bit_extension
 
+// Meshlets and triangles are culled by a compute pass into a compacted index buffer drawn by the vertex pipeline, VK_EXT_mesh_shader
+// isn't required then. Needs USE_MESHLETS.
+#define USE_COMPUTE_CLUSTER_CULLING 0
+
+// Cluster LOD groups are partitioned with METIS, built from External/METIS by CMake, otherwise with a greedy grouping
+#ifndef USE_METIS
+#define USE_METIS 0
+#endif
+
+// Meshes also get a cluster LOD DAG (ClusterLod.h) in the geometry and its cache, no pass draws it yet. Needs USE_MESHLETS.
+#define USE_CLUSTER_LOD 0
+
+// Staging uploads are submitted on the dedicated transfer queue family if there's one, the graphics queue acquires the buffers
+#define USE_TRANSFER_QUEUE_UPLOADS 0
+
+// The geometry cache stores meshoptimizer encoded streams (lossy positions and normals), decoded in parallel at load time
+#define USE_GEOMETRY_COMPRESSION 0
+
+// The culling writes its draw and task commands in draw order through a two level scan instead of appending them with atomics
+#define USE_STABLE_COMMAND_COMPACTION 1
+
+// Draws are uploaded as 32 byte `PackedMeshDraw`s instead of 64 byte `MeshDraw`s, --packed-draws or --full-draws override it at startup
+#define USE_PACKED_DRAWS 0
+
+// Meshlet headers are uploaded as 16 byte `PackedMeshlet`s instead of 64 byte `Meshlet`s, --packed-meshlets or --full-meshlets override it at startup
+#define USE_PACKED_MESHLETS 0
+
+// Vertices are uploaded as 12 byte `PackedVertex`s instead of 20 byte `Vertex`s, --packed-vertices or --full-vertices override it at startup
+#define USE_PACKED_VERTICES 0
+
+// The depth pyramid is built in a single dispatch (`HiZBuildSinglePass.comp`) instead of one per mip, --single-pass-depth-pyramid or
+// --multi-pass-depth-pyramid override it at startup
+#define USE_SINGLE_PASS_DEPTH_PYRAMID 1
+
+// Transient render graph resources with disjoint lifetimes share memory
+#define USE_RG_TRANSIENT_ALIASING 1
+// Async compute passes of the render graph run on the dedicated compute queue family if there's one
+#define USE_RG_ASYNC_COMPUTE 1
+// Long render graph batches are split and recorded on the job system into secondary command buffers
+#define USE_RG_PARALLEL_RECORDING 1
+// Passes recorded per job, batches with fewer passes are recorded in place
+#define RG_PASSES_PER_RECORD_JOB 16
+// Times render graph compiles against the pass count at startup
+#define RG_COMPILE_BENCHMARK 0
+// Prints the transient memory and the queue schedule of each render graph compile
+#define RG_LOG_COMPILE 0
+
 #define DRAW_METABALLS 0
 
 namespace Niagara
@@ -31,8 +78,51 @@ namespace Niagara
 	constexpr uint32_t MESHLET_MAX_PRIMITIVES = 84;
 
 	constexpr uint32_t MESH_MAX_LODS = 8;
+	// Each lod targets this fraction of the triangles of the previous one, the chain stops at LOD_MIN_TRIANGLES
+	constexpr float LOD_TRIANGLE_RATIO = 0.5f;
+	constexpr uint32_t LOD_MIN_TRIANGLES = 64;
+	// Fraction of the target reduction a round has to reach before the sloppy simplification is tried
+	constexpr float LOD_MIN_PROGRESS = 0.5f;
+	// Normal and uv weights of the attribute aware simplification, relative to the position error
+	constexpr float LOD_NORMAL_WEIGHT = 0.5f;
+	constexpr float LOD_UV_WEIGHT = 0.5f;
+	// Screen space error of the selected lods in pixels, --lod-error <pixels> overrides it at startup, [ and ] at runtime
+	constexpr float LOD_ERROR_THRESHOLD = 1.0f;
+	// Fraction of the threshold a lod has to be under to replace a finer lod of the last frame, 0 - no hysteresis
+	constexpr float LOD_HYSTERESIS = 0.2f;
 
 	constexpr uint32_t TASK_GROUP_SIZE = 64;
+
+	// Ring buffer of the staging uploader, larger uploads are split or get a dedicated staging buffer
+	constexpr uint64_t STAGING_BUFFER_SIZE = 64ull * 1024 * 1024;
+
+	// Draws and task commands culled per job by the CPU culling
+	constexpr uint32_t CPU_CULL_DRAWS_PER_JOB = 4096;
+	constexpr uint32_t CPU_CULL_COMMANDS_PER_JOB = 256;
+	// Max draws per leaf of the instance BVH
+	constexpr uint32_t INSTANCE_BVH_LEAF_SIZE = 32;
+	// Draws visible in this many late passes in a row skip the late pass occlusion test until their history wraps, [1, 14], 0 - off.
+	// --visibility-history <frames> overrides it at startup
+	constexpr uint32_t DRAW_VISIBILITY_HISTORY_FRAMES = 0;
+	// Draw args buffer, in commands: smallest capacity, and frames its peak command count must stay under a quarter of the capacity
+	// before it shrinks (`DrawCommandCapacity.h`)
+	constexpr uint32_t DRAW_COMMAND_MIN_CAPACITY = 4096;
+	constexpr uint32_t DRAW_COMMAND_SHRINK_FRAMES = 120;
+	// Profiler: scopes per frame, two timestamps each, and frames of samples the min, avg and p99 of a scope are taken over
+	constexpr uint32_t PROFILER_MAX_SCOPES = 512;
+	constexpr uint32_t PROFILER_HISTORY_FRAMES = 256;
+
+	// Capacities of the compute cluster culling, the meshlets past them aren't drawn
+	constexpr uint32_t CLUSTER_CULL_MAX_DRAWS = 1024 * 1024;
+	constexpr uint32_t CLUSTER_CULL_MAX_TRIANGLES = 16 * 1024 * 1024;
+
+	// The instance manager compacts the draw buffer once this fraction of its slots are free
+	constexpr float INSTANCE_COMPACTION_FREE_RATIO = 0.25f;
+	// Dirty instances scattered into the draw buffer per frame, the others wait for the next frames
+	constexpr uint32_t INSTANCE_SCATTERS_PER_FRAME = 64 * 1024;
+	// Instances removed, added and moved each frame to exercise the dynamic scene, 0 - static scene
+	constexpr uint32_t INSTANCE_CHURN_PER_FRAME = 0;
+
 #if 1
 	constexpr uint32_t DRAW_COUNT = 1'000'000;
 	constexpr float SCENE_RADIUS = 300.0f;
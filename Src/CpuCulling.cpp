@@ -0,0 +1,970 @@
+#include "CpuCulling.h"
+#include "DepthPyramid.h"
+#include "JobSystem.h"
+#include <cfloat>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CULL_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#else
+#define CULL_X86 0
+#endif
+
+
+namespace Niagara
+{
+	// Widest kernel, the SoA arrays are padded so that a full batch can be loaded past the last element
+	static const uint32_t s_CullMaxWidth = 8;
+
+	/// Helpers
+
+	struct CullKernelContext
+	{
+		const CullView* view;
+		const CullSettings* settings;
+		uint32_t pass;
+		const CullDepthPyramid* pDepthPyramid;
+
+		const Mesh* meshes;
+		const MeshDraw* draws;
+		// Draw of each SoA slot, null if in draw order
+		const uint32_t* drawOrder;
+
+		const float* drawCenterX;
+		const float* drawCenterY;
+		const float* drawCenterZ;
+		const float* drawRadius;
+
+		const float* meshletCenterX;
+		const float* meshletCenterY;
+		const float* meshletCenterZ;
+		const float* meshletRadius;
+		const float* meshletConeX;
+		const float* meshletConeY;
+		const float* meshletConeZ;
+		const float* meshletConeCutoff;
+
+		uint8_t* drawVisibilities;
+		std::atomic<uint32_t>* meshletVisibilities;
+
+		// Input of the meshlet culling
+		const MeshDrawCommand* drawCommands;
+		const MeshTaskCommand* taskCommands;
+	};
+
+	// Meshlets of a task workgroup (TASK) or of a draw command
+	struct CullTask
+	{
+		uint32_t drawId;
+		uint32_t meshletOffset;
+		uint32_t meshletCount;
+		uint32_t drawVisibility;
+		// Meshlet visibility bit of the first meshlet
+		uint32_t visibilityOffset;
+	};
+
+	// `GetScaleFromWorldMatrix(worldMatrix).x`
+	static float GetDrawScale(const MeshDraw& draw)
+	{
+		return sqrtf(draw.worldMatRow0.x * draw.worldMatRow0.x + draw.worldMatRow1.x * draw.worldMatRow1.x + draw.worldMatRow2.x * draw.worldMatRow2.x);
+	}
+
+	// `OcclusionCull` and `GetAxisAlignedBoundingBox` of Common.h, on a view space sphere
+	static bool OcclusionCulled(const CullKernelContext& ctx, const glm::vec4& sphere)
+	{
+		if (ctx.pDepthPyramid == nullptr)
+			return false;
+
+		const CullView& view = *ctx.view;
+
+		const float nearZ = -view.zNearFar.x;
+		if (sphere.z + sphere.w > nearZ)
+			return false;
+
+		const float p00 = view.projMatrix[0][0], p11 = view.projMatrix[1][1];
+
+		const glm::vec3 c{ sphere.x, sphere.y, sphere.z };
+		const float r = sphere.w;
+
+		const float z2_r2 = c.z * c.z - r * r;
+		const glm::vec3 cr = c * r;
+
+		const float vx = sqrtf(c.x * c.x + z2_r2);
+		const float minx = (vx * c.x + cr.z) / fabsf(-cr.x + vx * c.z);
+		const float maxx = (vx * c.x - cr.z) / fabsf(+cr.x + vx * c.z);
+
+		const float vy = sqrtf(c.y * c.y + z2_r2);
+		const float miny = (vy * c.y + cr.z) / fabsf(-cr.y + vy * c.z);
+		const float maxy = (vy * c.y - cr.z) / fabsf(+cr.y + vy * c.z);
+
+		// aabb.xwzy * vec4(0.5f, -0.5f, 0.5f, -0.5f) + 0.5f
+		const glm::vec4 aabb{ minx * p00 * 0.5f + 0.5f, maxy * p11 * -0.5f + 0.5f, maxx * p00 * 0.5f + 0.5f, miny * p11 * -0.5f + 0.5f };
+
+		const float w = (aabb.z - aabb.x) * view.depthPyramidSize.x;
+		const float h = (aabb.w - aabb.y) * view.depthPyramidSize.y;
+		const float u = (aabb.x + aabb.z) * 0.5f * (view.depthPyramidSize.x / std::max(1.0f, view.depthPyramidSize.z));
+		const float v = (aabb.y + aabb.w) * 0.5f * (view.depthPyramidSize.y / std::max(1.0f, view.depthPyramidSize.w));
+
+		const float level = floorf(log2f(std::max(w, h)));
+
+		const float depth = ctx.pDepthPyramid->Sample(u, v, level);
+		// ConvertToDeviceZ
+		const float sphereDepth = -view.projMatrix[2][2] - view.projMatrix[3][2] / (sphere.z + sphere.w);
+
+		return depth > sphereDepth;
+	}
+
+	// The rest of `DrawCommand.comp` for a draw, after its frustum test
+	static void CullDraw(CullResult& result, const CullKernelContext& ctx, uint32_t drawIndex, const glm::vec4& sphere, bool bVisible)
+	{
+		const CullSettings& settings = *ctx.settings;
+		const uint32_t pass = ctx.pass;
+		const uint32_t drawVisibilityState = ctx.drawVisibilities[drawIndex];
+		const uint32_t drawVisibility = GetDrawVisibility(drawVisibilityState);
+		uint32_t lodIndex = GetDrawVisibilityLod(drawVisibilityState);
+
+		// In early pass, dont't process draws that were not visible last frame
+		if (pass == 0 && drawVisibility == 0)
+			return;
+
+		// Free slot of the instance manager
+		if (ctx.draws[drawIndex].meshIndex == INVALID_MESH_INDEX)
+			return;
+
+		++result.drawsTested;
+
+		// Only doing oc in late pass, not on the draws stable in the visibility history
+		if (bVisible && settings.bDrawOcclusionCulling && pass > 0)
+		{
+			if (IsDrawVisibilityStable(drawVisibilityState, settings.visibilityHistoryFrames))
+				++result.drawsOcclusionSkipped;
+			else
+				bVisible = !OcclusionCulled(ctx, sphere);
+		}
+
+		const bool bMeshletOcclusionCulling = settings.bMeshShading && settings.bMeshletOcclusionCulling;
+		bool bLodSelected = false;
+
+		if (bVisible && (pass == 0 || bMeshletOcclusionCulling || drawVisibility == 0))
+		{
+			const MeshDraw& draw = ctx.draws[drawIndex];
+			const Mesh& mesh = ctx.meshes[draw.meshIndex];
+
+			// Choose one lod
+			const float distance = sqrtf(sphere.x * sphere.x + sphere.y * sphere.y + sphere.z * sphere.z) - sphere.w;
+			lodIndex = SelectMeshLod(mesh, ctx.view->lodParams, ctx.view->zNearFar.x, distance, GetDrawScale(draw), lodIndex);
+			bLodSelected = true;
+
+			const MeshLod& meshLod = mesh.lods[lodIndex];
+			const uint32_t taskGroups = DivideAndRoundUp(meshLod.meshletCount, TASK_GROUP_SIZE);
+
+			if (settings.bTaskCommands)
+			{
+				const uint32_t meshletVisibilityData = (draw.meshletVisibilityOffset << 1) | drawVisibility;
+
+				for (uint32_t i = 0; i < taskGroups; ++i)
+				{
+					const uint32_t groupStart = i * TASK_GROUP_SIZE;
+
+					MeshTaskCommand taskCommand;
+					taskCommand.drawId = drawIndex;
+					taskCommand.taskOffset = meshLod.meshletOffset + groupStart;
+					taskCommand.taskCount = std::min(meshLod.meshletCount - groupStart, TASK_GROUP_SIZE);
+					taskCommand.meshletVisibilityData = meshletVisibilityData + (groupStart << 1);
+					result.taskCommands.push_back(taskCommand);
+				}
+			}
+			else
+			{
+				MeshDrawCommand drawCommand;
+				drawCommand.drawId = drawIndex;
+				drawCommand.drawIndexedIndirectCommand.indexCount = meshLod.indexCount;
+				drawCommand.drawIndexedIndirectCommand.instanceCount = 1;
+				drawCommand.drawIndexedIndirectCommand.firstIndex = meshLod.indexOffset;
+				drawCommand.drawIndexedIndirectCommand.vertexOffset = static_cast<int32_t>(mesh.vertexOffset);
+				drawCommand.drawIndexedIndirectCommand.firstInstance = 0;
+				drawCommand.drawVisibility = drawVisibility;
+				drawCommand.meshletVisibilityOffset = draw.meshletVisibilityOffset;
+				drawCommand.taskOffset = meshLod.meshletOffset;
+				drawCommand.taskCount = meshLod.meshletCount;
+				drawCommand.drawMeshTaskIndirectCommand.groupCountX = taskGroups;
+				drawCommand.drawMeshTaskIndirectCommand.groupCountY = 1;
+				drawCommand.drawMeshTaskIndirectCommand.groupCountZ = 1;
+				result.drawCommands.push_back(drawCommand);
+			}
+		}
+
+		if (bVisible)
+			++result.drawsVisible;
+
+		// Update draw visibilities in late pass, the lod of the early pass is kept for the late pass and the next frame
+		uint32_t newDrawVisibilityState = drawVisibilityState;
+		if (pass > 0)
+			newDrawVisibilityState = PackDrawVisibility(bVisible ? 1 : 0, lodIndex, GetNextDrawVisibilityHistory(drawVisibilityState, bVisible, settings.visibilityHistoryFrames));
+		else if (bLodSelected)
+			newDrawVisibilityState = PackDrawVisibility(drawVisibility, lodIndex, GetDrawVisibilityHistory(drawVisibilityState));
+
+		if (newDrawVisibilityState != drawVisibilityState)
+		{
+			ctx.drawVisibilities[drawIndex] = static_cast<uint8_t>(newDrawVisibilityState);
+			++result.drawVisibilityChanges;
+		}
+	}
+
+	static CullTask GetCullTask(const CullKernelContext& ctx, uint32_t commandIndex)
+	{
+		CullTask task;
+
+		if (ctx.settings->bTaskCommands)
+		{
+			const MeshTaskCommand& command = ctx.taskCommands[commandIndex];
+			task.drawId = command.drawId;
+			task.meshletOffset = command.taskOffset;
+			task.meshletCount = command.taskCount;
+			task.drawVisibility = command.meshletVisibilityData & 1;
+			task.visibilityOffset = command.meshletVisibilityData >> 1;
+		}
+		else
+		{
+			const MeshDrawCommand& command = ctx.drawCommands[commandIndex];
+			task.drawId = command.drawId;
+			task.meshletOffset = command.taskOffset;
+			task.meshletCount = command.taskCount;
+			task.drawVisibility = command.drawVisibility;
+			task.visibilityOffset = ctx.draws[command.drawId].meshletVisibilityOffset;
+		}
+
+		return task;
+	}
+
+	// The rest of the task shader for the i-th meshlet of a task, after its cone and frustum tests
+	static void CullMeshlet(CullResult& result, const CullKernelContext& ctx, const CullTask& task, uint32_t i, const glm::vec4& sphere, bool bVisible)
+	{
+		const CullSettings& settings = *ctx.settings;
+		const uint32_t pass = ctx.pass;
+
+		const uint32_t visibilityIndex = task.visibilityOffset + i;
+		const uint32_t visibilityBit = 1u << (visibilityIndex & 31);
+		std::atomic<uint32_t>& visibilityWord = ctx.meshletVisibilities[visibilityIndex >> 5];
+		const bool bMeshletVisible = (visibilityWord.load(std::memory_order_relaxed) & visibilityBit) != 0;
+
+		bool bAccept = !settings.bMeshletOcclusionCulling || pass > 0 || bMeshletVisible;
+		const bool bSkip = pass > 0 && task.drawVisibility > 0 && bMeshletVisible;
+
+		bAccept = bAccept && bVisible;
+		if (bAccept && settings.bMeshletOcclusionCulling && pass > 0)
+			bAccept = !OcclusionCulled(ctx, sphere);
+
+		++result.meshletsTested;
+		if (bAccept && !bSkip)
+		{
+			result.meshlets.push_back({ task.drawId, task.meshletOffset + i, task.drawVisibility });
+			++result.meshletsAccepted;
+		}
+
+		if (pass > 0)
+		{
+			if (bAccept)
+				visibilityWord.fetch_or(visibilityBit, std::memory_order_relaxed);
+			else
+				visibilityWord.fetch_and(~visibilityBit, std::memory_order_relaxed);
+		}
+	}
+}
+
+/// Kernels
+
+namespace Niagara
+{
+	namespace CullScalar
+	{
+		using V = float;
+		using M = bool;
+		constexpr uint32_t W = 1;
+
+		inline V Load(const float* p) { return *p; }
+		inline void Store(float* p, V a) { *p = a; }
+		inline V Set1(float x) { return x; }
+		inline V Add(V a, V b) { return a + b; }
+		inline V Sub(V a, V b) { return a - b; }
+		inline V Mul(V a, V b) { return a * b; }
+		inline V Div(V a, V b) { return a / b; }
+		inline V Sqrt(V a) { return sqrtf(a); }
+		inline V Abs(V a) { return fabsf(a); }
+		inline V Neg(V a) { return -a; }
+		inline M CmpGt(V a, V b) { return a > b; }
+		inline M CmpGe(V a, V b) { return a >= b; }
+		inline M CmpLt(V a, V b) { return a < b; }
+		inline M Or(M a, M b) { return a || b; }
+		inline uint32_t MoveMask(M m) { return m ? 1u : 0u; }
+
+#include "CpuCullingKernels.inl"
+	}
+
+#if CULL_X86
+	namespace CullSse
+	{
+		using V = __m128;
+		using M = __m128;
+		constexpr uint32_t W = 4;
+
+		inline V Load(const float* p) { return _mm_loadu_ps(p); }
+		inline void Store(float* p, V a) { _mm_storeu_ps(p, a); }
+		inline V Set1(float x) { return _mm_set1_ps(x); }
+		inline V Add(V a, V b) { return _mm_add_ps(a, b); }
+		inline V Sub(V a, V b) { return _mm_sub_ps(a, b); }
+		inline V Mul(V a, V b) { return _mm_mul_ps(a, b); }
+		inline V Div(V a, V b) { return _mm_div_ps(a, b); }
+		inline V Sqrt(V a) { return _mm_sqrt_ps(a); }
+		inline V Abs(V a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+		inline V Neg(V a) { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+		inline M CmpGt(V a, V b) { return _mm_cmpgt_ps(a, b); }
+		inline M CmpGe(V a, V b) { return _mm_cmpge_ps(a, b); }
+		inline M CmpLt(V a, V b) { return _mm_cmplt_ps(a, b); }
+		inline M Or(M a, M b) { return _mm_or_ps(a, b); }
+		inline uint32_t MoveMask(M m) { return static_cast<uint32_t>(_mm_movemask_ps(m)); }
+
+#include "CpuCullingKernels.inl"
+	}
+
+	// Compiled for AVX2 without enabling it for the whole file, only called when the CPU supports it
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+	namespace CullAvx2
+	{
+		using V = __m256;
+		using M = __m256;
+		constexpr uint32_t W = 8;
+
+		inline V Load(const float* p) { return _mm256_loadu_ps(p); }
+		inline void Store(float* p, V a) { _mm256_storeu_ps(p, a); }
+		inline V Set1(float x) { return _mm256_set1_ps(x); }
+		inline V Add(V a, V b) { return _mm256_add_ps(a, b); }
+		inline V Sub(V a, V b) { return _mm256_sub_ps(a, b); }
+		inline V Mul(V a, V b) { return _mm256_mul_ps(a, b); }
+		inline V Div(V a, V b) { return _mm256_div_ps(a, b); }
+		inline V Sqrt(V a) { return _mm256_sqrt_ps(a); }
+		inline V Abs(V a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+		inline V Neg(V a) { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+		inline M CmpGt(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+		inline M CmpGe(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+		inline M CmpLt(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+		inline M Or(M a, M b) { return _mm256_or_ps(a, b); }
+		inline uint32_t MoveMask(M m) { return static_cast<uint32_t>(_mm256_movemask_ps(m)); }
+
+#include "CpuCullingKernels.inl"
+	}
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+#endif // CULL_X86
+}
+
+namespace Niagara
+{
+	using CullRangeFunc = void (*)(CullResult& result, const CullKernelContext& ctx, uint32_t begin, uint32_t end);
+	using CullDrawRangeFunc = void (*)(CullResult& result, const CullKernelContext& ctx, uint32_t begin, uint32_t end, bool bFrustumCulling);
+
+	struct CullKernelFuncs
+	{
+		CullDrawRangeFunc cullDraws;
+		CullRangeFunc cullMeshlets;
+	};
+
+	static const CullKernelFuncs s_CullKernels[] =
+	{
+		{ CullScalar::CullDrawRange, CullScalar::CullMeshletRange },
+#if CULL_X86
+		{ CullSse::CullDrawRange, CullSse::CullMeshletRange },
+		{ CullAvx2::CullDrawRange, CullAvx2::CullMeshletRange },
+#else
+		{ CullScalar::CullDrawRange, CullScalar::CullMeshletRange },
+		{ CullScalar::CullDrawRange, CullScalar::CullMeshletRange },
+#endif
+	};
+	static_assert(sizeof(s_CullKernels) / sizeof(s_CullKernels[0]) == static_cast<size_t>(ECullKernel::Count), "One entry per kernel");
+
+	ECullKernel GetBestCullKernel()
+	{
+#if CULL_X86
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] >= 7)
+		{
+			__cpuid(info, 1);
+			const bool bOsAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+			__cpuidex(info, 7, 0);
+			if (bOsAvx && (info[1] & (1 << 5)) != 0)
+				return ECullKernel::AVX2;
+		}
+#else
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			return ECullKernel::AVX2;
+#endif
+		// Part of x86-64
+		return ECullKernel::SSE;
+#else
+		return ECullKernel::Scalar;
+#endif
+	}
+
+	const char* GetCullKernelName(ECullKernel kernel)
+	{
+		switch (kernel)
+		{
+		case ECullKernel::Scalar:	return "scalar";
+		case ECullKernel::SSE:		return "sse";
+		case ECullKernel::AVX2:		return "avx2";
+		default:					return "unknown";
+		}
+	}
+
+	/// CullView
+
+	CullView CullView::Create(const glm::mat4& viewMatrix, const glm::mat4& projMatrix, const glm::vec3& camPos, float zNear, float zFar, const glm::vec4& depthPyramidSize,
+		const glm::vec4& lodParams)
+	{
+		glm::vec4 frustumPlanes[6];
+		GetFrustumPlanes(frustumPlanes, projMatrix, /* reversedZ = */ true, /* needZPlanes = */ false);
+
+		CullView view;
+		view.viewMatrix = viewMatrix;
+		view.projMatrix = projMatrix;
+		view.camPos = camPos;
+		view.frustumValues = glm::vec4(frustumPlanes[0].x, frustumPlanes[0].z, frustumPlanes[2].y, frustumPlanes[2].z);
+		view.zNearFar = glm::vec4(zNear, zFar, 0.0f, 0.0f);
+		view.depthPyramidSize = depthPyramidSize;
+		view.lodParams = lodParams;
+
+		return view;
+	}
+
+	void GetDrawBoundingSpheres(std::vector<glm::vec4>& spheres, const std::vector<Mesh>& meshes, const std::vector<MeshDraw>& draws)
+	{
+		spheres.resize(draws.size());
+
+		for (size_t i = 0; i < draws.size(); ++i)
+		{
+			const MeshDraw& draw = draws[i];
+			if (draw.meshIndex == INVALID_MESH_INDEX)
+			{
+				spheres[i] = glm::vec4(0.0f);
+				continue;
+			}
+
+			const glm::vec4& sphere = meshes[draw.meshIndex].boundingSphere;
+
+			spheres[i].x = draw.worldMatRow0.x * sphere.x + draw.worldMatRow0.y * sphere.y + draw.worldMatRow0.z * sphere.z + draw.worldMatRow0.w;
+			spheres[i].y = draw.worldMatRow1.x * sphere.x + draw.worldMatRow1.y * sphere.y + draw.worldMatRow1.z * sphere.z + draw.worldMatRow1.w;
+			spheres[i].z = draw.worldMatRow2.x * sphere.x + draw.worldMatRow2.y * sphere.y + draw.worldMatRow2.z * sphere.z + draw.worldMatRow2.w;
+			spheres[i].w = sphere.w * GetDrawScale(draw);
+		}
+	}
+
+	/// CullDepthPyramid
+
+	void CullDepthPyramid::Build(const float* depth, uint32_t depthWidth, uint32_t depthHeight)
+	{
+		viewportWidth = std::max(1u, depthWidth >> 1);
+		viewportHeight = std::max(1u, depthHeight >> 1);
+
+		const glm::uvec2 pyramidSize = GetDepthPyramidSize(depthWidth, depthHeight);
+		width = pyramidSize.x;
+		height = pyramidSize.y;
+
+		// Same texels as the GPU builds, the 2x2 texels are clamped to the edges of their source
+		BuildDepthPyramidReference(levels, depth, depthWidth, depthHeight, pyramidSize, GetDepthPyramidMipCount(pyramidSize), /* bReversedZ = */ true);
+	}
+
+	float CullDepthPyramid::Sample(float u, float v, float level) const
+	{
+		if (levels.empty())
+			return 0.0f;
+
+		// Negative levels are clamped by the sampler
+		const uint32_t levelIndex = level > 0.0f ? static_cast<uint32_t>(std::min(level, float(levels.size() - 1))) : 0;
+		const uint32_t w = std::max(1u, width >> levelIndex);
+		const uint32_t h = std::max(1u, height >> levelIndex);
+		const auto& texels = levels[levelIndex];
+
+		// Bilinear footprint, texels outside of the level are the (0) border
+		const float x = floorf(u * w - 0.5f);
+		const float y = floorf(v * h - 0.5f);
+
+		float depth = FLT_MAX;
+		for (int j = 0; j < 2; ++j)
+		{
+			for (int i = 0; i < 2; ++i)
+			{
+				const float tx = x + i, ty = y + j;
+				if (tx < 0.0f || ty < 0.0f || tx >= float(w) || ty >= float(h))
+					return 0.0f;
+
+				depth = std::min(depth, texels[size_t(ty) * w + size_t(tx)]);
+			}
+		}
+
+		return depth;
+	}
+
+	/// CullResult
+
+	void CullResult::Clear()
+	{
+		drawCommands.clear();
+		taskCommands.clear();
+		meshlets.clear();
+		clusterDrawCommands.clear();
+		clusterIndices.clear();
+
+		drawsTested = 0;
+		drawsVisible = 0;
+		meshletsTested = 0;
+		meshletsAccepted = 0;
+		trianglesTested = 0;
+		nodesVisited = 0;
+		drawsOcclusionSkipped = 0;
+		drawVisibilityChanges = 0;
+	}
+
+	// Splits [0, count) into chunks culled on the job system, each chunk into its own result
+	template <typename Func>
+	static void RunCullJobs(std::vector<CullResult>& chunks, uint32_t count, uint32_t countPerJob, const Func& func)
+	{
+		const uint32_t chunkCount = DivideAndRoundUp(count, countPerJob);
+
+		chunks.resize(chunkCount);
+		for (auto& chunk : chunks)
+			chunk.Clear();
+
+		auto cullChunk = [&](uint32_t chunkIndex)
+		{
+			const uint32_t begin = chunkIndex * countPerJob;
+			func(chunks[chunkIndex], begin, std::min(count, begin + countPerJob));
+		};
+
+		if (g_JobSystem.IsInited() && chunkCount > 1)
+		{
+			JobCounter counter;
+			g_JobSystem.ParallelFor(counter, chunkCount, 1, cullChunk);
+			g_JobSystem.Wait(counter);
+		}
+		else
+		{
+			for (uint32_t i = 0; i < chunkCount; ++i)
+				cullChunk(i);
+		}
+	}
+
+	/// CpuCuller
+
+	void CpuCuller::Init(const std::vector<Mesh>& meshes, const std::vector<Meshlet>& meshlets, const std::vector<MeshDraw>& draws)
+	{
+		m_Meshes = meshes.data();
+		m_Meshlets = meshlets.data();
+		m_Draws = draws.data();
+		m_DrawCount = static_cast<uint32_t>(draws.size());
+
+		m_pInstanceBvh = nullptr;
+		GetDrawBoundingSpheres(m_DrawSpheres, meshes, draws);
+		BuildDrawSoA();
+
+		m_MeshletVisibilityCount = 0;
+		for (const auto& draw : draws)
+		{
+			if (draw.meshIndex != INVALID_MESH_INDEX)
+				m_MeshletVisibilityCount = std::max(m_MeshletVisibilityCount, draw.meshletVisibilityOffset + meshes[draw.meshIndex].lods[0].meshletCount);
+		}
+
+		const size_t meshletSize = meshlets.size() + s_CullMaxWidth;
+		m_MeshletCenterX.assign(meshletSize, 0.0f);
+		m_MeshletCenterY.assign(meshletSize, 0.0f);
+		m_MeshletCenterZ.assign(meshletSize, 0.0f);
+		m_MeshletRadius.assign(meshletSize, 0.0f);
+		m_MeshletConeX.assign(meshletSize, 0.0f);
+		m_MeshletConeY.assign(meshletSize, 0.0f);
+		m_MeshletConeZ.assign(meshletSize, 0.0f);
+		m_MeshletConeCutoff.assign(meshletSize, 1.0f);
+
+		for (size_t i = 0; i < meshlets.size(); ++i)
+		{
+			const Meshlet& meshlet = meshlets[i];
+
+			m_MeshletCenterX[i] = meshlet.boundingSphere.x;
+			m_MeshletCenterY[i] = meshlet.boundingSphere.y;
+			m_MeshletCenterZ[i] = meshlet.boundingSphere.z;
+			m_MeshletRadius[i] = meshlet.boundingSphere.w;
+			m_MeshletConeX[i] = meshlet.cone.x;
+			m_MeshletConeY[i] = meshlet.cone.y;
+			m_MeshletConeZ[i] = meshlet.cone.z;
+			m_MeshletConeCutoff[i] = meshlet.cone.w;
+		}
+
+		m_DrawVisibilities.assign(m_DrawCount, 0);
+		m_MeshletVisibilities.reset(new std::atomic<uint32_t>[DivideAndRoundUp(m_MeshletVisibilityCount, 32) + 1]);
+		ResetVisibilities();
+
+		m_Kernel = GetBestCullKernel();
+	}
+
+	void CpuCuller::Destroy()
+	{
+		m_Meshes = nullptr;
+		m_Meshlets = nullptr;
+		m_Draws = nullptr;
+		m_DrawCount = 0;
+
+		for (auto* pArray : { &m_DrawCenterX, &m_DrawCenterY, &m_DrawCenterZ, &m_DrawRadius, &m_MeshletCenterX, &m_MeshletCenterY, &m_MeshletCenterZ, &m_MeshletRadius,
+			&m_MeshletConeX, &m_MeshletConeY, &m_MeshletConeZ, &m_MeshletConeCutoff })
+		{
+			pArray->clear();
+			pArray->shrink_to_fit();
+		}
+
+		m_DrawVisibilities.clear();
+		m_MeshletVisibilities.reset();
+		m_MeshletVisibilityCount = 0;
+		m_Chunks.clear();
+
+		m_DrawSpheres.clear();
+		m_DrawSpheres.shrink_to_fit();
+		m_pInstanceBvh = nullptr;
+		m_BvhRanges.clear();
+		m_BvhJobRanges.clear();
+		m_BvhJobOffsets.clear();
+	}
+
+	void CpuCuller::ResetVisibilities()
+	{
+		std::fill(m_DrawVisibilities.begin(), m_DrawVisibilities.end(), 0);
+
+		if (m_MeshletVisibilities)
+		{
+			const uint32_t wordCount = DivideAndRoundUp(m_MeshletVisibilityCount, 32) + 1;
+			for (uint32_t i = 0; i < wordCount; ++i)
+				m_MeshletVisibilities[i].store(0, std::memory_order_relaxed);
+		}
+	}
+
+	void CpuCuller::SetInstanceBvh(const InstanceBvh* pBvh)
+	{
+		assert(pBvh == nullptr || pBvh->drawIndices.size() == m_DrawCount);
+
+		m_pInstanceBvh = pBvh;
+		BuildDrawSoA();
+	}
+
+	void CpuCuller::BuildDrawSoA()
+	{
+		const size_t drawSize = size_t(m_DrawCount) + s_CullMaxWidth;
+		m_DrawCenterX.assign(drawSize, 0.0f);
+		m_DrawCenterY.assign(drawSize, 0.0f);
+		m_DrawCenterZ.assign(drawSize, 0.0f);
+		m_DrawRadius.assign(drawSize, 0.0f);
+
+		for (uint32_t i = 0; i < m_DrawCount; ++i)
+		{
+			const glm::vec4& sphere = m_DrawSpheres[m_pInstanceBvh ? m_pInstanceBvh->drawIndices[i] : i];
+
+			m_DrawCenterX[i] = sphere.x;
+			m_DrawCenterY[i] = sphere.y;
+			m_DrawCenterZ[i] = sphere.z;
+			m_DrawRadius[i] = sphere.w;
+		}
+	}
+
+	void CpuCuller::SetKernel(ECullKernel kernel)
+	{
+		// Kernels are ordered by width, fall back to the widest supported one
+		m_Kernel = std::min(kernel, GetBestCullKernel());
+	}
+
+	void CpuCuller::GetMeshletVisibilities(std::vector<uint32_t>& words) const
+	{
+		words.resize(DivideAndRoundUp(m_MeshletVisibilityCount, 32));
+		for (size_t i = 0; i < words.size(); ++i)
+			words[i] = m_MeshletVisibilities[i].load(std::memory_order_relaxed);
+	}
+
+	CullKernelContext CpuCuller::GetKernelContext(const CullView& view, const CullSettings& settings, uint32_t pass, const CullDepthPyramid* pDepthPyramid)
+	{
+		CullKernelContext ctx{};
+		ctx.view = &view;
+		ctx.settings = &settings;
+		ctx.pass = pass;
+		ctx.pDepthPyramid = pDepthPyramid;
+
+		ctx.meshes = m_Meshes;
+		ctx.draws = m_Draws;
+		ctx.drawOrder = m_pInstanceBvh ? m_pInstanceBvh->drawIndices.data() : nullptr;
+
+		ctx.drawCenterX = m_DrawCenterX.data();
+		ctx.drawCenterY = m_DrawCenterY.data();
+		ctx.drawCenterZ = m_DrawCenterZ.data();
+		ctx.drawRadius = m_DrawRadius.data();
+
+		ctx.meshletCenterX = m_MeshletCenterX.data();
+		ctx.meshletCenterY = m_MeshletCenterY.data();
+		ctx.meshletCenterZ = m_MeshletCenterZ.data();
+		ctx.meshletRadius = m_MeshletRadius.data();
+		ctx.meshletConeX = m_MeshletConeX.data();
+		ctx.meshletConeY = m_MeshletConeY.data();
+		ctx.meshletConeZ = m_MeshletConeZ.data();
+		ctx.meshletConeCutoff = m_MeshletConeCutoff.data();
+
+		ctx.drawVisibilities = m_DrawVisibilities.data();
+		ctx.meshletVisibilities = m_MeshletVisibilities.get();
+
+		return ctx;
+	}
+
+	void CpuCuller::CullDraws(CullResult& result, const CullView& view, const CullSettings& settings, uint32_t pass, const CullDepthPyramid* pDepthPyramid)
+	{
+		result.Clear();
+
+		const CullKernelContext ctx = GetKernelContext(view, settings, pass, pDepthPyramid);
+
+		if (m_pInstanceBvh != nullptr && settings.bDrawFrustumCulling)
+		{
+			m_BvhRanges.clear();
+			result.nodesVisited = CullInstanceBvh(m_BvhRanges, *m_pInstanceBvh, view);
+			CullDrawsBvh(ctx);
+		}
+		else
+		{
+			const CullDrawRangeFunc cullDraws = s_CullKernels[static_cast<uint32_t>(m_Kernel)].cullDraws;
+
+			RunCullJobs(m_Chunks, m_DrawCount, CPU_CULL_DRAWS_PER_JOB, [&](CullResult& chunk, uint32_t begin, uint32_t end)
+				{
+					cullDraws(chunk, ctx, begin, end, settings.bDrawFrustumCulling);
+				});
+		}
+
+		// In draw (or BVH) order
+		for (const auto& chunk : m_Chunks)
+		{
+			result.drawCommands.insert(result.drawCommands.end(), chunk.drawCommands.begin(), chunk.drawCommands.end());
+			result.taskCommands.insert(result.taskCommands.end(), chunk.taskCommands.begin(), chunk.taskCommands.end());
+			result.drawsTested += chunk.drawsTested;
+			result.drawsVisible += chunk.drawsVisible;
+			result.drawsOcclusionSkipped += chunk.drawsOcclusionSkipped;
+			result.drawVisibilityChanges += chunk.drawVisibilityChanges;
+		}
+	}
+
+	void CpuCuller::CullDrawsBvh(const CullKernelContext& ctx)
+	{
+		const CullDrawRangeFunc cullDraws = s_CullKernels[static_cast<uint32_t>(m_Kernel)].cullDraws;
+		const uint32_t pass = ctx.pass;
+
+		// Ranges of about `CPU_CULL_DRAWS_PER_JOB` draws per job. Culled draws are not tested, only the late pass has to clear their visibility.
+		m_BvhJobRanges.clear();
+		m_BvhJobOffsets.clear();
+
+		uint32_t jobDrawCount = CPU_CULL_DRAWS_PER_JOB;
+		for (const auto& range : m_BvhRanges)
+		{
+			if (range.visibility == EBvhVisibility::Culled && pass == 0)
+				continue;
+
+			for (uint32_t begin = range.begin; begin < range.end; )
+			{
+				if (jobDrawCount == CPU_CULL_DRAWS_PER_JOB)
+				{
+					m_BvhJobOffsets.push_back(static_cast<uint32_t>(m_BvhJobRanges.size()));
+					jobDrawCount = 0;
+				}
+
+				const uint32_t end = std::min(range.end, begin + CPU_CULL_DRAWS_PER_JOB - jobDrawCount);
+				m_BvhJobRanges.push_back({ begin, end, range.visibility });
+				jobDrawCount += end - begin;
+				begin = end;
+			}
+		}
+
+		const uint32_t jobCount = static_cast<uint32_t>(m_BvhJobOffsets.size());
+		m_BvhJobOffsets.push_back(static_cast<uint32_t>(m_BvhJobRanges.size()));
+
+		RunCullJobs(m_Chunks, jobCount, 1, [&](CullResult& chunk, uint32_t jobIndex, uint32_t)
+			{
+				for (uint32_t i = m_BvhJobOffsets[jobIndex]; i < m_BvhJobOffsets[jobIndex + 1]; ++i)
+				{
+					const InstanceBvhRange& range = m_BvhJobRanges[i];
+
+					if (range.visibility == EBvhVisibility::Culled)
+					{
+						// Not visible, the history starts over
+						for (uint32_t j = range.begin; j < range.end; ++j)
+						{
+							uint8_t& state = ctx.drawVisibilities[ctx.drawOrder[j]];
+							const uint32_t newState = PackDrawVisibility(0, GetDrawVisibilityLod(state), 0);
+							if (newState != state)
+							{
+								state = static_cast<uint8_t>(newState);
+								++chunk.drawVisibilityChanges;
+							}
+						}
+					}
+					else
+					{
+						cullDraws(chunk, ctx, range.begin, range.end, range.visibility == EBvhVisibility::Intersecting);
+					}
+				}
+			});
+	}
+
+	void CpuCuller::CullMeshlets(CullResult& result, const CullView& view, const CullSettings& settings, uint32_t pass, const CullDepthPyramid* pDepthPyramid)
+	{
+		result.meshlets.clear();
+		result.meshletsTested = 0;
+		result.meshletsAccepted = 0;
+
+		CullKernelContext ctx = GetKernelContext(view, settings, pass, pDepthPyramid);
+		if (settings.bTaskCommands)
+			ctx.taskCommands = result.taskCommands.data();
+		else
+			ctx.drawCommands = result.drawCommands.data();
+
+		const uint32_t commandCount = static_cast<uint32_t>(settings.bTaskCommands ? result.taskCommands.size() : result.drawCommands.size());
+		const CullRangeFunc cullMeshlets = s_CullKernels[static_cast<uint32_t>(m_Kernel)].cullMeshlets;
+
+		RunCullJobs(m_Chunks, commandCount, CPU_CULL_COMMANDS_PER_JOB, [&](CullResult& chunk, uint32_t begin, uint32_t end)
+			{
+				cullMeshlets(chunk, ctx, begin, end);
+			});
+
+		// In command order
+		for (const auto& chunk : m_Chunks)
+		{
+			result.meshlets.insert(result.meshlets.end(), chunk.meshlets.begin(), chunk.meshlets.end());
+			result.meshletsTested += chunk.meshletsTested;
+			result.meshletsAccepted += chunk.meshletsAccepted;
+		}
+	}
+
+	void CpuCuller::CullTriangles(CullResult& result, const CullView& view, const CullSettings& settings, const glm::vec2& viewportSize, const Vertex* vertices,
+		const uint32_t* meshletData)
+	{
+		result.clusterDrawCommands.clear();
+		result.clusterIndices.clear();
+		result.trianglesTested = 0;
+
+		const glm::mat4 viewProjMatrix = view.projMatrix * view.viewMatrix;
+		const bool bTriangleCulling = settings.bTriBackfaceCulling || settings.bTriSmallCulling;
+		const uint32_t meshletCount = static_cast<uint32_t>(result.meshlets.size());
+
+		RunCullJobs(m_Chunks, meshletCount, CPU_CULL_COMMANDS_PER_JOB, [&](CullResult& chunk, uint32_t begin, uint32_t end)
+			{
+				glm::vec3 vertexClip[MESHLET_MAX_VERTICES];
+
+				for (uint32_t m = begin; m < end; ++m)
+				{
+					const CulledMeshlet& culledMeshlet = result.meshlets[m];
+					const MeshDraw& draw = m_Draws[culledMeshlet.drawId];
+					const Meshlet& meshlet = m_Meshlets[culledMeshlet.meshletIndex];
+					const uint32_t indexOffset = meshlet.vertexOffset + meshlet.vertexCount;
+
+					// `BuildWorldMatrix`, multiplied in the order of the shader
+					const glm::mat4 worldMatrix(
+						glm::vec4(draw.worldMatRow0.x, draw.worldMatRow1.x, draw.worldMatRow2.x, 0.0f),
+						glm::vec4(draw.worldMatRow0.y, draw.worldMatRow1.y, draw.worldMatRow2.y, 0.0f),
+						glm::vec4(draw.worldMatRow0.z, draw.worldMatRow1.z, draw.worldMatRow2.z, 0.0f),
+						glm::vec4(draw.worldMatRow0.w, draw.worldMatRow1.w, draw.worldMatRow2.w, 1.0f));
+					const glm::mat4 worldViewProjMatrix = viewProjMatrix * worldMatrix;
+
+					if (bTriangleCulling)
+					{
+						for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+						{
+							const glm::vec3& p = vertices[meshletData[meshlet.vertexOffset + i] + draw.vertexOffset].p;
+							const glm::vec4 position = worldViewProjMatrix * glm::vec4(p, 1.0f);
+							vertexClip[i] = glm::vec3(position.x / position.w, position.y / position.w, position.w);
+						}
+					}
+
+					const uint32_t firstIndex = static_cast<uint32_t>(chunk.clusterIndices.size());
+
+					for (uint32_t i = 0; i < meshlet.triangleCount; ++i)
+					{
+						const uint32_t indices = meshletData[indexOffset + i];
+						const uint32_t i0 = indices & 0xFF, i1 = (indices >> 8) & 0xFF, i2 = (indices >> 16) & 0xFF;
+
+						bool bCulled = false;
+						if (bTriangleCulling)
+						{
+							const glm::vec3& p0 = vertexClip[i0], & p1 = vertexClip[i1], & p2 = vertexClip[i2];
+							const glm::vec2 c0(p0), c1(p1), c2(p2);
+
+							if (settings.bTriBackfaceCulling)
+							{
+								const glm::vec2 c01 = c1 - c0, c02 = c2 - c0;
+								bCulled = bCulled || (c01.x * c02.y - c01.y * c02.x) <= 0.0f;
+							}
+
+							if (settings.bTriSmallCulling)
+							{
+								const glm::vec2 bmin = (glm::min(c0, glm::min(c1, c2)) * 0.5f + 0.5f) * viewportSize;
+								const glm::vec2 bmax = (glm::max(c0, glm::max(c1, c2)) * 0.5f + 0.5f) * viewportSize;
+								const float subpixelPrec = 1.0f / 256.0f;
+
+								// GLSL leaves the direction of the .5 ties of `round()` to the implementation, they round away from zero here
+
+								bCulled = bCulled || std::round(bmin.x - subpixelPrec) == std::round(bmax.x) || std::round(bmin.y) == std::round(bmax.y + subpixelPrec);
+							}
+
+							// Only valid with all the vertices in front of the perspective plane
+							bCulled = bCulled && p0.z > 0.0f && p1.z > 0.0f && p2.z > 0.0f;
+						}
+
+						++chunk.trianglesTested;
+						if (!bCulled)
+						{
+							chunk.clusterIndices.push_back(meshletData[meshlet.vertexOffset + i0] + draw.vertexOffset);
+							chunk.clusterIndices.push_back(meshletData[meshlet.vertexOffset + i1] + draw.vertexOffset);
+							chunk.clusterIndices.push_back(meshletData[meshlet.vertexOffset + i2] + draw.vertexOffset);
+						}
+					}
+
+					const uint32_t indexCount = static_cast<uint32_t>(chunk.clusterIndices.size()) - firstIndex;
+					if (indexCount == 0)
+						continue;
+
+					// Relative to the chunk until the merge
+					MeshDrawCommand drawCommand{};
+					drawCommand.drawId = culledMeshlet.drawId;
+					drawCommand.drawIndexedIndirectCommand.indexCount = indexCount;
+					drawCommand.drawIndexedIndirectCommand.instanceCount = 1;
+					drawCommand.drawIndexedIndirectCommand.firstIndex = firstIndex;
+					drawCommand.drawVisibility = culledMeshlet.drawVisibility;
+					drawCommand.meshletVisibilityOffset = draw.meshletVisibilityOffset;
+					drawCommand.taskOffset = culledMeshlet.meshletIndex;
+					drawCommand.taskCount = 1;
+					chunk.clusterDrawCommands.push_back(drawCommand);
+				}
+			});
+
+		// In meshlet order
+		for (const auto& chunk : m_Chunks)
+		{
+			const uint32_t indexOffset = static_cast<uint32_t>(result.clusterIndices.size());
+			for (MeshDrawCommand drawCommand : chunk.clusterDrawCommands)
+			{
+				drawCommand.drawIndexedIndirectCommand.firstIndex += indexOffset;
+				result.clusterDrawCommands.push_back(drawCommand);
+			}
+			result.clusterIndices.insert(result.clusterIndices.end(), chunk.clusterIndices.begin(), chunk.clusterIndices.end());
+			result.trianglesTested += chunk.trianglesTested;
+		}
+	}
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include "pch.h"
+#include "Config.h"
+#include "Utilities.h"
+#include "Geometry.h"
+#include "InstanceBvh.h"
+#include <atomic>
+
+
+namespace Niagara
+{
+	struct CullKernelContext;
+
+	/**
+	* CPU culling
+	* C++ counterpart of the GPU culling, draws like `DrawCommand.comp` and meshlets like the task shader (`SimpleMesh.task`), with
+	* the tests of `Common.h`. It produces the same command streams and visibility bits, so the culling can be checked on machines
+	* without a GPU, and it can replace the GPU culling on hardware without mesh shaders.
+	* Commands are written in draw order, the result doesn't depend on the thread count. It matches the GPU command order with
+	* `USE_STABLE_COMMAND_COMPACTION` (`CompactCommands.comp`), otherwise the GPU commands are in the order of the atomics.
+	* Bounds are stored in SoA arrays and tested 8 (AVX2), 4 (SSE) or 1 (scalar) at a time. The kernels do the same float operations
+	* in the same order, so they all give identical results. The GPU may differ in the last bits of the transforms, the draw spheres
+	* are transformed to world space once in `Init()` instead of with the combined view-world matrix.
+	*/
+	enum class ECullKernel : uint8_t
+	{
+		Scalar,
+		SSE,
+		AVX2,
+
+		Count
+	};
+
+	// Widest kernel supported by the CPU
+	ECullKernel GetBestCullKernel();
+	const char* GetCullKernelName(ECullKernel kernel);
+
+	// The view uniforms used by the culling
+	struct CullView
+	{
+		glm::mat4 viewMatrix;
+		glm::mat4 projMatrix;
+		glm::vec3 camPos;
+		glm::vec4 frustumValues; // X L/R plane -> (+/-X, 0, Z, 0), Y U/D plane -> (0, +/-Y, Z, 0)
+		glm::vec4 zNearFar; // x - near, y - far
+		glm::vec4 depthPyramidSize; // xy - viewport size, zw - texture size
+		glm::vec4 lodParams; // `GetLodSelectionParams()`
+
+		// Same values as the view uniform buffer, `projMatrix` is reversed Z
+		static CullView Create(const glm::mat4& viewMatrix, const glm::mat4& projMatrix, const glm::vec3& camPos, float zNear, float zFar, const glm::vec4& depthPyramidSize,
+			const glm::vec4& lodParams);
+	};
+
+	namespace VisibilityPacking
+	{
+		using namespace glm;
+#include "../Shaders/VisibilityPacking.h"
+	}
+	// Draw visibility states, one byte per draw like in the GPU words
+	static_assert(DRAW_VISIBILITY_STATE_BITS == 8, "Same layout as in `VisibilityPacking.h`");
+	using VisibilityPacking::GetDrawVisibilityState;
+	using VisibilityPacking::PackDrawVisibility;
+	using VisibilityPacking::GetDrawVisibility;
+	using VisibilityPacking::GetDrawVisibilityLod;
+	using VisibilityPacking::GetDrawVisibilityHistory;
+	using VisibilityPacking::IsDrawVisibilityStable;
+	using VisibilityPacking::GetNextDrawVisibilityHistory;
+
+	// World space bounding spheres of the draws, `worldMatrix * vec4(center, 1.0)` and the radius times the uniform scale
+	void GetDrawBoundingSpheres(std::vector<glm::vec4>& spheres, const std::vector<Mesh>& meshes, const std::vector<MeshDraw>& draws);
+
+	// The debug params used by the culling
+	struct CullSettings
+	{
+		bool bDrawFrustumCulling = true;
+		bool bDrawOcclusionCulling = true;
+		bool bMeshletConeCulling = true;
+		bool bMeshletFrustumCulling = true;
+		bool bMeshletOcclusionCulling = false;
+		bool bMeshShading = true;
+		// Triangles of the accepted meshlets, `CullTriangles()`
+		bool bTriBackfaceCulling = true;
+		bool bTriSmallCulling = true;
+
+		// `MeshTaskCommand`s (the TASK specialization) instead of `MeshDrawCommand`s
+		bool bTaskCommands = true;
+		// The VISIBILITY_HISTORY_FRAMES specialization of `DrawCommand.comp`
+		uint32_t visibilityHistoryFrames = 0;
+	};
+
+	/**
+	* Reversed Z depth pyramid, each texel is the furthest (min) depth of a 2x2 block of the level above, like `HiZBuild.comp`.
+	* Level 0 is a power of two texture, half the depth buffer size rounded up, the depth buffer only covers its top-left corner.
+	*/
+	struct CullDepthPyramid
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		// Half the depth buffer size
+		uint32_t viewportWidth = 0;
+		uint32_t viewportHeight = 0;
+		std::vector<std::vector<float>> levels;
+
+		void Build(const float* depth, uint32_t depthWidth, uint32_t depthHeight);
+		// `depthPyramidSize` of the view
+		glm::vec4 GetSize() const { return glm::vec4(float(viewportWidth), float(viewportHeight), float(width), float(height)); }
+		// `textureLod` with the linear min reduction sampler, clamped to a black border
+		float Sample(float u, float v, float level) const;
+	};
+
+	struct CulledMeshlet
+	{
+		uint32_t drawId;
+		uint32_t meshletIndex;
+		// Draw visibility bit of the command, carried by the cluster draws
+		uint32_t drawVisibility;
+	};
+
+	struct CullResult
+	{
+		// One of them, depending on `CullSettings::bTaskCommands`
+		std::vector<MeshDrawCommand> drawCommands;
+		std::vector<MeshTaskCommand> taskCommands;
+		// Meshlets accepted by `CullMeshlets()`, in command order, i.e. the mesh shader workgroups
+		std::vector<CulledMeshlet> meshlets;
+		// Draws and global vertex indices of `CullTriangles()` like `ClusterCull.comp` writes them, one draw per meshlet with surviving
+		// triangles, in meshlet order
+		std::vector<MeshDrawCommand> clusterDrawCommands;
+		std::vector<uint32_t> clusterIndices;
+
+		uint32_t drawsTested = 0;
+		uint32_t drawsVisible = 0;
+		uint32_t meshletsTested = 0;
+		uint32_t meshletsAccepted = 0;
+		uint32_t trianglesTested = 0;
+		// Instance BVH nodes, 0 without BVH
+		uint32_t nodesVisited = 0;
+		// Late pass occlusion tests skipped by the visibility history
+		uint32_t drawsOcclusionSkipped = 0;
+		// Draw visibility states changed, an atomic each on the GPU without subgroups
+		uint32_t drawVisibilityChanges = 0;
+
+		void Clear();
+	};
+
+	class CpuCuller
+	{
+	public:
+		CpuCuller() = default;
+		NON_COPYABLE(CpuCuller);
+
+		// The meshes, meshlets and draws are referenced, not copied, they must outlive the culler
+		void Init(const std::vector<Mesh>& meshes, const std::vector<Meshlet>& meshlets, const std::vector<MeshDraw>& draws);
+		void Destroy();
+
+		// Draws and meshlets not visible, like the first frame on the GPU
+		void ResetVisibilities();
+
+		// `DrawCommand.comp`, pass 0 is the early pass (draws visible last frame), pass 1 the late pass (occlusion culling, updates the visibilities)
+		void CullDraws(CullResult& result, const CullView& view, const CullSettings& settings, uint32_t pass, const CullDepthPyramid* pDepthPyramid = nullptr);
+		// The task shader, over the commands of the last `CullDraws()` in `result`
+		void CullMeshlets(CullResult& result, const CullView& view, const CullSettings& settings, uint32_t pass, const CullDepthPyramid* pDepthPyramid = nullptr);
+		// The triangle culling of `ClusterCull.comp` (and `SimpleMesh.mesh`), over the meshlets of the last `CullMeshlets()` in `result`.
+		// Unpacked vertices, `viewportSize` is `viewportRect.zw` of the view uniforms.
+		void CullTriangles(CullResult& result, const CullView& view, const CullSettings& settings, const glm::vec2& viewportSize, const Vertex* vertices,
+			const uint32_t* meshletData);
+
+		/**
+		* Culls the draws through the BVH, subtrees outside of the frustum are rejected (and their draws not tested), the draws of subtrees
+		* inside of it skip their frustum test. The draws are laid out and their commands written in `InstanceBvh::drawIndices` order.
+		* The BVH is referenced and must be built from `GetDrawBoundingSpheres()` of the same draws. Null goes back to the draw order.
+		*/
+		void SetInstanceBvh(const InstanceBvh* pBvh);
+		const InstanceBvh* GetInstanceBvh() const { return m_pInstanceBvh; }
+
+		void SetKernel(ECullKernel kernel);
+		ECullKernel GetKernel() const { return m_Kernel; }
+
+		// `VisibilityPacking.h` states, the bytes of the GPU words on little endian machines
+		const std::vector<uint8_t>& GetDrawVisibilities() const { return m_DrawVisibilities; }
+		// Same bit layout as the meshlet visibility buffer
+		void GetMeshletVisibilities(std::vector<uint32_t>& words) const;
+		uint32_t GetMeshletVisibilityCount() const { return m_MeshletVisibilityCount; }
+
+	private:
+		CullKernelContext GetKernelContext(const CullView& view, const CullSettings& settings, uint32_t pass, const CullDepthPyramid* pDepthPyramid);
+		// SoA draw bounds in BVH order if any
+		void BuildDrawSoA();
+		void CullDrawsBvh(const CullKernelContext& ctx);
+
+		const Mesh* m_Meshes{ nullptr };
+		const Meshlet* m_Meshlets{ nullptr };
+		const MeshDraw* m_Draws{ nullptr };
+		uint32_t m_DrawCount{ 0 };
+
+		std::vector<glm::vec4> m_DrawSpheres;
+		// World space draw bounding spheres, padded to the widest kernel
+		std::vector<float> m_DrawCenterX, m_DrawCenterY, m_DrawCenterZ, m_DrawRadius;
+		// Object space meshlet bounding spheres and cones, padded to the widest kernel
+		std::vector<float> m_MeshletCenterX, m_MeshletCenterY, m_MeshletCenterZ, m_MeshletRadius;
+		std::vector<float> m_MeshletConeX, m_MeshletConeY, m_MeshletConeZ, m_MeshletConeCutoff;
+
+		// Bytes written by several jobs, the draws of a job are contiguous in draw or BVH order
+		std::vector<uint8_t> m_DrawVisibilities;
+		// Written by several jobs, with atomics like on the GPU
+		std::unique_ptr<std::atomic<uint32_t>[]> m_MeshletVisibilities;
+		uint32_t m_MeshletVisibilityCount{ 0 };
+
+		// Per job results, merged in order
+		std::vector<CullResult> m_Chunks;
+
+		const InstanceBvh* m_pInstanceBvh{ nullptr };
+		std::vector<InstanceBvhRange> m_BvhRanges;
+		// Ranges split for the jobs, and the first range of each job
+		std::vector<InstanceBvhRange> m_BvhJobRanges;
+		std::vector<uint32_t> m_BvhJobOffsets;
+
+		ECullKernel m_Kernel{ ECullKernel::Scalar };
+	};
+}
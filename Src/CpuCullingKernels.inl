@@ -0,0 +1,132 @@
+// Culling kernels, included by CpuCulling.cpp once per instruction set inside a namespace that defines the vector type `V` of `W`
+// floats, the lane mask type `M` and their operations. Every kernel does the same operations in the same order, no FMA.
+
+// `FrustumCull` of Common.h, on view space spheres
+static inline M FrustumCulled(V x, V y, V z, V r, const CullView& view)
+{
+	M culled = CmpGt(Add(Mul(Neg(Abs(x)), Set1(view.frustumValues.x)), Mul(z, Set1(view.frustumValues.y))), r);
+	culled = Or(culled, CmpGt(Add(Mul(Neg(Abs(y)), Set1(view.frustumValues.z)), Mul(z, Set1(view.frustumValues.w))), r));
+	// Near/Far
+	culled = Or(culled, CmpGt(Sub(z, r), Set1(-view.zNearFar.x)));
+	culled = Or(culled, CmpLt(Add(z, r), Set1(-view.zNearFar.y)));
+
+	return culled;
+}
+
+// `(matrix * vec4(p, 1.0)).xyz`, column major
+static inline void TransformPoint(V& outX, V& outY, V& outZ, const glm::mat4& matrix, V x, V y, V z)
+{
+	outX = Add(Add(Add(Mul(Set1(matrix[0][0]), x), Mul(Set1(matrix[1][0]), y)), Mul(Set1(matrix[2][0]), z)), Set1(matrix[3][0]));
+	outY = Add(Add(Add(Mul(Set1(matrix[0][1]), x), Mul(Set1(matrix[1][1]), y)), Mul(Set1(matrix[2][1]), z)), Set1(matrix[3][1]));
+	outZ = Add(Add(Add(Mul(Set1(matrix[0][2]), x), Mul(Set1(matrix[1][2]), y)), Mul(Set1(matrix[2][2]), z)), Set1(matrix[3][2]));
+}
+
+// `dot(row.xyz, p) + w`, a row of the draw world matrix
+static inline V TransformRow(const glm::vec4& row, V x, V y, V z, V w)
+{
+	return Add(Add(Add(Mul(Set1(row.x), x), Mul(Set1(row.y), y)), Mul(Set1(row.z), z)), w);
+}
+
+// SoA slots [begin, end) of `DrawCommand.comp`, without frustum test for the draws known to be inside
+void CullDrawRange(CullResult& result, const CullKernelContext& ctx, uint32_t begin, uint32_t end, bool bFrustumCulling)
+{
+	const CullView& view = *ctx.view;
+
+	float viewX[W], viewY[W], viewZ[W], radius[W];
+
+	for (uint32_t first = begin; first < end; first += W)
+	{
+		const V x = Load(ctx.drawCenterX + first);
+		const V y = Load(ctx.drawCenterY + first);
+		const V z = Load(ctx.drawCenterZ + first);
+		const V r = Load(ctx.drawRadius + first);
+
+		// View space
+		V vx, vy, vz;
+		TransformPoint(vx, vy, vz, view.viewMatrix, x, y, z);
+
+		const uint32_t culledMask = bFrustumCulling ? MoveMask(FrustumCulled(vx, vy, vz, r, view)) : 0;
+
+		Store(viewX, vx);
+		Store(viewY, vy);
+		Store(viewZ, vz);
+		Store(radius, r);
+
+		const uint32_t laneCount = std::min(W, end - first);
+		for (uint32_t lane = 0; lane < laneCount; ++lane)
+			CullDraw(result, ctx, ctx.drawOrder ? ctx.drawOrder[first + lane] : first + lane, glm::vec4(viewX[lane], viewY[lane], viewZ[lane], radius[lane]), (culledMask & (1u << lane)) == 0);
+	}
+}
+
+// Commands [begin, end) of the task shader, each one processed `W` meshlets at a time
+void CullMeshletRange(CullResult& result, const CullKernelContext& ctx, uint32_t begin, uint32_t end)
+{
+	const CullView& view = *ctx.view;
+	const CullSettings& settings = *ctx.settings;
+
+	float viewX[W], viewY[W], viewZ[W], radius[W];
+
+	for (uint32_t commandIndex = begin; commandIndex < end; ++commandIndex)
+	{
+		const CullTask task = GetCullTask(ctx, commandIndex);
+		const MeshDraw& draw = ctx.draws[task.drawId];
+		const V scale = Set1(GetDrawScale(draw));
+		const V zero = Set1(0.0f);
+
+		for (uint32_t first = 0; first < task.meshletCount; first += W)
+		{
+			const uint32_t meshletIndex = task.meshletOffset + first;
+
+			// World space sphere
+			const V cx = Load(ctx.meshletCenterX + meshletIndex);
+			const V cy = Load(ctx.meshletCenterY + meshletIndex);
+			const V cz = Load(ctx.meshletCenterZ + meshletIndex);
+			const V x = TransformRow(draw.worldMatRow0, cx, cy, cz, Set1(draw.worldMatRow0.w));
+			const V y = TransformRow(draw.worldMatRow1, cx, cy, cz, Set1(draw.worldMatRow1.w));
+			const V z = TransformRow(draw.worldMatRow2, cx, cy, cz, Set1(draw.worldMatRow2.w));
+			const V r = Mul(Load(ctx.meshletRadius + meshletIndex), scale); // just uniform scale
+
+			uint32_t culledMask = 0;
+
+			// World space cone culling, `ConeCull_BoundingSphere`
+			if (settings.bMeshletConeCulling)
+			{
+				const V ax = Load(ctx.meshletConeX + meshletIndex);
+				const V ay = Load(ctx.meshletConeY + meshletIndex);
+				const V az = Load(ctx.meshletConeZ + meshletIndex);
+
+				V coneX = TransformRow(draw.worldMatRow0, ax, ay, az, zero);
+				V coneY = TransformRow(draw.worldMatRow1, ax, ay, az, zero);
+				V coneZ = TransformRow(draw.worldMatRow2, ax, ay, az, zero);
+				const V coneLength = Sqrt(Add(Add(Mul(coneX, coneX), Mul(coneY, coneY)), Mul(coneZ, coneZ)));
+				coneX = Div(coneX, coneLength);
+				coneY = Div(coneY, coneLength);
+				coneZ = Div(coneZ, coneLength);
+
+				const V dx = Sub(x, Set1(view.camPos.x));
+				const V dy = Sub(y, Set1(view.camPos.y));
+				const V dz = Sub(z, Set1(view.camPos.z));
+				const V coneDot = Add(Add(Mul(coneX, dx), Mul(coneY, dy)), Mul(coneZ, dz));
+				const V distance = Sqrt(Add(Add(Mul(dx, dx), Mul(dy, dy)), Mul(dz, dz)));
+
+				culledMask |= MoveMask(CmpGe(coneDot, Add(Mul(Load(ctx.meshletConeCutoff + meshletIndex), distance), r)));
+			}
+
+			// View space frustum culling
+			V vx, vy, vz;
+			TransformPoint(vx, vy, vz, view.viewMatrix, x, y, z);
+
+			if (settings.bMeshletFrustumCulling)
+				culledMask |= MoveMask(FrustumCulled(vx, vy, vz, r, view));
+
+			Store(viewX, vx);
+			Store(viewY, vy);
+			Store(viewZ, vz);
+			Store(radius, r);
+
+			const uint32_t laneCount = std::min(W, task.meshletCount - first);
+			for (uint32_t lane = 0; lane < laneCount; ++lane)
+				CullMeshlet(result, ctx, task, first + lane, glm::vec4(viewX[lane], viewY[lane], viewZ[lane], radius[lane]), (culledMask & (1u << lane)) == 0);
+		}
+	}
+}
@@ -0,0 +1,104 @@
+#include "CullStats.h"
+
+
+namespace Niagara
+{
+	std::string GetCullStatName(uint32_t counter)
+	{
+		static const char* s_CounterNames[] =
+		{
+			"drawsTested",
+			"drawsFrustumCulled",
+			"drawsOcclusionCulled",
+			"drawsVisible",
+			"meshletsTested",
+			"meshletsConeCulled",
+			"meshletsFrustumCulled",
+			"meshletsOcclusionCulled",
+			"meshletsVisible",
+			"trianglesTested",
+			"trianglesBackfaceCulled",
+			"trianglesSmallCulled",
+		};
+		static_assert(ARRAYSIZE(s_CounterNames) == CULL_STATS_DRAW_LOD_0, "A name per counter of `CullStats.h`");
+
+		if (counter < CULL_STATS_DRAW_LOD_0)
+			return s_CounterNames[counter];
+
+		return "drawLod" + std::to_string(counter - CULL_STATS_DRAW_LOD_0);
+	}
+
+	bool CullStatsWriter::Open(const std::string& path)
+	{
+		Close();
+
+		m_File = fopen(path.c_str(), "w");
+		if (m_File == nullptr)
+			return false;
+
+		m_bJson = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+		m_FrameCount = 0;
+
+		if (m_bJson)
+		{
+			fprintf(m_File, "{\n");
+			fprintf(m_File, "\t\"passes\": [\"early\", \"late\"],\n");
+			fprintf(m_File, "\t\"frames\": [");
+		}
+		else
+		{
+			fprintf(m_File, "frame,pass");
+			for (uint32_t counter = 0; counter < CULL_STATS_COUNTER_COUNT; ++counter)
+				fprintf(m_File, ",%s", GetCullStatName(counter).c_str());
+			fprintf(m_File, "\n");
+		}
+
+		return true;
+	}
+
+	void CullStatsWriter::Write(const CullFrameStats& stats)
+	{
+		if (m_File == nullptr)
+			return;
+
+		const unsigned long long frameIndex = static_cast<unsigned long long>(stats.frameIndex);
+
+		if (m_bJson)
+		{
+			fprintf(m_File, "%s\n\t\t{ \"frame\": %llu, \"passes\": [", m_FrameCount > 0 ? "," : "", frameIndex);
+			for (uint32_t pass = 0; pass < CULL_STATS_PASS_COUNT; ++pass)
+			{
+				fprintf(m_File, "%s{ ", pass > 0 ? ", " : "");
+				for (uint32_t counter = 0; counter < CULL_STATS_COUNTER_COUNT; ++counter)
+					fprintf(m_File, "%s\"%s\": %u", counter > 0 ? ", " : "", GetCullStatName(counter).c_str(), stats.Get(pass, counter));
+				fprintf(m_File, " }");
+			}
+			fprintf(m_File, "] }");
+		}
+		else
+		{
+			// A row per pass
+			for (uint32_t pass = 0; pass < CULL_STATS_PASS_COUNT; ++pass)
+			{
+				fprintf(m_File, "%llu,%u", frameIndex, pass);
+				for (uint32_t counter = 0; counter < CULL_STATS_COUNTER_COUNT; ++counter)
+					fprintf(m_File, ",%u", stats.Get(pass, counter));
+				fprintf(m_File, "\n");
+			}
+		}
+
+		++m_FrameCount;
+	}
+
+	void CullStatsWriter::Close()
+	{
+		if (m_File == nullptr)
+			return;
+
+		if (m_bJson)
+			fprintf(m_File, "\n\t]\n}\n");
+
+		fclose(m_File);
+		m_File = nullptr;
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "pch.h"
+#include "Config.h"
+#include "Utilities.h"
+
+
+namespace Niagara
+{
+	/**
+	* Culling statistics
+	* With `--cull-stats` the draw culling and the task and mesh shaders (or the cluster culling) count the items tested and rejected by
+	* each of their stages in the cull stats buffer, per cull pass, with the counters of `Shaders/CullStats.h`. The buffer is cleared at
+	* the beginning of each frame and copied to a readback buffer of its frame in flight, read once the fence of the frame is signaled:
+	* the stats are a few frames late and the CPU never waits for them.
+	*/
+
+	namespace CullStatsPacking
+	{
+		using namespace glm;
+#include "../Shaders/CullStats.h"
+	}
+	using CullStatsPacking::GetCullStatIndex;
+
+	// Contents of the cull stats buffer
+	struct CullFrameStats
+	{
+		// Frame the stats were recorded in
+		uint64_t frameIndex = 0;
+		uint32_t counters[CULL_STATS_PASS_COUNT][CULL_STATS_COUNTER_COUNT] = {};
+
+		uint32_t Get(uint32_t pass, uint32_t counter) const { return counters[pass][counter]; }
+		// Both passes
+		uint32_t GetTotal(uint32_t counter) const { return counters[0][counter] + counters[1][counter]; }
+	};
+	static_assert(sizeof(CullFrameStats::counters) == CULL_STATS_PASS_COUNT * CULL_STATS_COUNTER_COUNT * sizeof(uint32_t), "Same layout as the cull stats buffer");
+
+	// Column of the CSV and key of the JSON, e.g. "drawsFrustumCulled", "drawLod3"
+	std::string GetCullStatName(uint32_t counter);
+
+	// The stats of each frame as a row of a CSV file, or an element of a JSON array if the path ends with ".json"
+	class CullStatsWriter
+	{
+	public:
+		CullStatsWriter() = default;
+		~CullStatsWriter() { Close(); }
+		NON_COPYABLE(CullStatsWriter);
+
+		bool Open(const std::string& path);
+		void Write(const CullFrameStats& stats);
+		void Close();
+
+		bool IsOpen() const { return m_File != nullptr; }
+		uint32_t GetFrameCount() const { return m_FrameCount; }
+
+	private:
+		FILE* m_File = nullptr;
+		bool m_bJson = false;
+		uint32_t m_FrameCount = 0;
+	};
+}
@@ -0,0 +1,82 @@
+#include "DepthPyramid.h"
+
+
+namespace Niagara
+{
+	glm::uvec2 GetDepthPyramidSize(uint32_t depthWidth, uint32_t depthHeight)
+	{
+		return glm::uvec2(
+			std::max(1u, RoundUpToPowerOfTwo(depthWidth >> 1)),
+			std::max(1u, RoundUpToPowerOfTwo(depthHeight >> 1)));
+	}
+
+	uint32_t GetDepthPyramidMipCount(const glm::uvec2& pyramidSize)
+	{
+		return std::max(1u, FloorLog2(std::max(pyramidSize.x, pyramidSize.y)));
+	}
+
+	glm::uvec2 GetDepthPyramidSinglePassGroups(const glm::uvec2& pyramidSize)
+	{
+		return glm::uvec2(
+			DivideAndRoundUp(pyramidSize.x, DEPTH_PYRAMID_SINGLE_PASS_TILE_SIZE),
+			DivideAndRoundUp(pyramidSize.y, DEPTH_PYRAMID_SINGLE_PASS_TILE_SIZE));
+	}
+
+	DepthPyramidPassCounts GetDepthPyramidPassCounts(uint32_t mipCount, bool bSinglePass)
+	{
+		DepthPyramidPassCounts counts{};
+
+		if (bSinglePass)
+		{
+			counts.dispatches = 1;
+			counts.barriers = 1;
+			counts.descriptorPushes = 1;
+		}
+		else
+		{
+			// One barrier before the first mip, then one before each mip that reads the previous one
+			counts.dispatches = mipCount;
+			counts.barriers = mipCount;
+			counts.descriptorPushes = mipCount;
+		}
+
+		return counts;
+	}
+
+	void BuildDepthPyramidReference(std::vector<std::vector<float>>& mips, const float* depth, uint32_t depthWidth, uint32_t depthHeight,
+		const glm::uvec2& pyramidSize, uint32_t mipCount, bool bReversedZ)
+	{
+		auto getFurthest = [bReversedZ](float a, float b, float c, float d)
+		{
+			return bReversedZ ? std::min(std::min(a, b), std::min(c, d)) : std::max(std::max(a, b), std::max(c, d));
+		};
+
+		// Reduces the 2x2 texels under each texel of `dst`, clamped to the source size
+		auto reduce = [&](std::vector<float>& dst, const glm::uvec2& dstSize, const float* src, const glm::uvec2& srcSize)
+		{
+			dst.resize(size_t(dstSize.x) * dstSize.y);
+
+			for (uint32_t y = 0; y < dstSize.y; ++y)
+			{
+				const uint32_t y0 = std::min(y * 2, srcSize.y - 1), y1 = std::min(y * 2 + 1, srcSize.y - 1);
+				for (uint32_t x = 0; x < dstSize.x; ++x)
+				{
+					const uint32_t x0 = std::min(x * 2, srcSize.x - 1), x1 = std::min(x * 2 + 1, srcSize.x - 1);
+					dst[size_t(y) * dstSize.x + x] = getFurthest(
+						src[size_t(y0) * srcSize.x + x0], src[size_t(y0) * srcSize.x + x1],
+						src[size_t(y1) * srcSize.x + x0], src[size_t(y1) * srcSize.x + x1]);
+				}
+			}
+		};
+
+		mips.resize(mipCount);
+
+		for (uint32_t mip = 0; mip < mipCount; ++mip)
+		{
+			if (mip == 0)
+				reduce(mips[0], pyramidSize, depth, glm::uvec2(depthWidth, depthHeight));
+			else
+				reduce(mips[mip], GetDepthPyramidMipSize(pyramidSize, mip), mips[mip - 1].data(), GetDepthPyramidMipSize(pyramidSize, mip - 1));
+		}
+	}
+}
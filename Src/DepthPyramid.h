@@ -0,0 +1,54 @@
+#pragma once
+
+#include "pch.h"
+#include "Config.h"
+#include "Utilities.h"
+
+
+namespace Niagara
+{
+	/**
+	* Depth pyramid
+	* Furthest depth (min with reversed Z) hierarchy of the depth buffer for the occlusion culling. Mip 0 covers 2x2 texels of the
+	* depth buffer and is rounded up to powers of two, so each texel of a mip covers 2x2 texels of the mip above. Each of the 2x2
+	* texels is clamped to the last row / column of its source, so the texels past the edges repeat it.
+	* It's either built one mip per dispatch (`HiZBuild.comp`) or in a single dispatch (`HiZBuildSinglePass.comp`). Both fetch the
+	* texels with the same clamping as the CPU reference below, and min / max are exact, so --validate-depth-pyramid and
+	* niagara_depthpyramidcheck compare them bit for bit. REVERSED_Z (constant_id 0) of both shaders selects min or max.
+	*/
+
+	// One storage image binding per mip in `HiZBuildSinglePass.comp`, the pyramid is up to 4096x4096
+	constexpr uint32_t DEPTH_PYRAMID_MAX_SINGLE_PASS_MIPS = 12;
+	// Mip 0 texels reduced by each workgroup of `HiZBuildSinglePass.comp`, and the mips built from them
+	constexpr uint32_t DEPTH_PYRAMID_SINGLE_PASS_TILE_SIZE = 32;
+	constexpr uint32_t DEPTH_PYRAMID_SINGLE_PASS_GROUP_MIPS = 6;
+
+	glm::uvec2 GetDepthPyramidSize(uint32_t depthWidth, uint32_t depthHeight);
+	// Down to 2 texels along the largest side
+	uint32_t GetDepthPyramidMipCount(const glm::uvec2& pyramidSize);
+	inline glm::uvec2 GetDepthPyramidMipSize(const glm::uvec2& pyramidSize, uint32_t mip)
+	{
+		return glm::max(glm::uvec2(pyramidSize.x >> mip, pyramidSize.y >> mip), glm::uvec2(1));
+	}
+
+	inline bool CanBuildDepthPyramidSinglePass(uint32_t mipCount)
+	{
+		return mipCount <= DEPTH_PYRAMID_MAX_SINGLE_PASS_MIPS;
+	}
+	// Workgroups of `HiZBuildSinglePass.comp`
+	glm::uvec2 GetDepthPyramidSinglePassGroups(const glm::uvec2& pyramidSize);
+
+	// Commands recorded per frame by each build
+	struct DepthPyramidPassCounts
+	{
+		uint32_t dispatches;
+		// `vkCmdPipelineBarrier2` calls, the first one also transitions the depth buffer
+		uint32_t barriers;
+		uint32_t descriptorPushes;
+	};
+	DepthPyramidPassCounts GetDepthPyramidPassCounts(uint32_t mipCount, bool bSinglePass);
+
+	// `mips[i]` - texels of mip `i`, row major
+	void BuildDepthPyramidReference(std::vector<std::vector<float>>& mips, const float* depth, uint32_t depthWidth, uint32_t depthHeight,
+		const glm::uvec2& pyramidSize, uint32_t mipCount, bool bReversedZ = true);
+}
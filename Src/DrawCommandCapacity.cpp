@@ -0,0 +1,60 @@
+#include "DrawCommandCapacity.h"
+
+
+namespace Niagara
+{
+	uint32_t GetDrawCommandCapacity(uint32_t commandCount, uint32_t maxCapacity)
+	{
+		// A quarter of headroom, in 64 bits not to overflow before the clamp
+		const uint64_t capacity = uint64_t(commandCount) + commandCount / 4;
+		if (capacity >= maxCapacity)
+			return maxCapacity;
+
+		return std::min(std::max(DRAW_COMMAND_MIN_CAPACITY, RoundUpToPowerOfTwo(uint32_t(capacity))), maxCapacity);
+	}
+
+	void DrawCommandCapacity::Init(uint32_t capacity, uint32_t maxCapacity, uint32_t shrinkFrames)
+	{
+		m_MaxCapacity = std::max(maxCapacity, 1u);
+		m_Capacity = std::min(std::max(capacity, 1u), m_MaxCapacity);
+		m_ShrinkFrames = shrinkFrames;
+
+		m_WindowPeak = 0;
+		m_WindowFrames = 0;
+
+		m_GrowCount = 0;
+		m_ShrinkCount = 0;
+		m_OverflowCommandCount = 0;
+	}
+
+	bool DrawCommandCapacity::Update(const DrawCommandStats& stats)
+	{
+		m_OverflowCommandCount += stats.overflowCommandCount;
+
+		// Grows before it overflows, a frame dropping commands is already late by the frames in flight
+		if (stats.peakCommandCount > m_Capacity - m_Capacity / 8 && m_Capacity < m_MaxCapacity)
+		{
+			m_Capacity = std::max(GetDrawCommandCapacity(stats.peakCommandCount, m_MaxCapacity), m_Capacity);
+			m_WindowPeak = 0;
+			m_WindowFrames = 0;
+			++m_GrowCount;
+			return true;
+		}
+
+		m_WindowPeak = std::max(m_WindowPeak, stats.peakCommandCount);
+		if (m_ShrinkFrames == 0 || ++m_WindowFrames < m_ShrinkFrames)
+			return false;
+
+		// Only shrinks to a quarter or less, the peaks are then at most 80% of the new capacity, under the growth threshold
+		const uint32_t capacity = GetDrawCommandCapacity(m_WindowPeak, m_MaxCapacity);
+		m_WindowPeak = 0;
+		m_WindowFrames = 0;
+
+		if (capacity > m_Capacity / 4)
+			return false;
+
+		m_Capacity = capacity;
+		++m_ShrinkCount;
+		return true;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "pch.h"
+#include "Config.h"
+#include "Utilities.h"
+
+
+namespace Niagara
+{
+	/**
+	* Draw command capacity
+	* The culling writes its task or draw commands to the draw args buffer up to `commandCapacity` of the view uniforms. The commands
+	* past it are dropped and counted, and the counts read by the draws and the dispatches are clamped to it, so a scene with more
+	* visible work than the buffer holds loses geometry for a few frames instead of corrupting memory.
+	* The peak command count of each frame is copied to a readback buffer of its frame in flight and read once its fence is signaled.
+	* The buffer then grows to fit the peak, or shrinks when the peaks have stayed well under the capacity for a while.
+	* The replaced buffer is kept until the frames in flight are done with it, and the shaders clamp the capacity to the length of the
+	* bound buffer since those frames read the view uniforms that already hold the new capacity.
+	*/
+
+	// Binding 3 of `DrawCommand.comp` and `CompactCommands.comp`
+	struct DrawCommandCounts
+	{
+		// Clamped to the capacity: indirect draw count, or dispatch X groups of the task commands
+		uint32_t commandCount;
+		uint32_t dispatchY;
+		uint32_t dispatchZ;
+		// Commands the pass asked for, the atomic allocations of `DrawCommand.comp`. Reset per pass like `commandCount`.
+		uint32_t requestedCommandCount;
+		// Max requested count of the passes and commands dropped, reset per frame and read back
+		uint32_t peakCommandCount;
+		uint32_t overflowCommandCount;
+	};
+
+	struct DrawCommandStats
+	{
+		uint32_t peakCommandCount;
+		uint32_t overflowCommandCount;
+	};
+
+	// Capacity fitting `commandCount` with some headroom, rounded up to a power of two
+	uint32_t GetDrawCommandCapacity(uint32_t commandCount, uint32_t maxCapacity);
+
+	class DrawCommandCapacity
+	{
+	public:
+		// `maxCapacity` - commands of the largest buffer, `shrinkFrames` - frames the peaks must stay under a quarter of the capacity to shrink it
+		void Init(uint32_t capacity, uint32_t maxCapacity, uint32_t shrinkFrames = DRAW_COMMAND_SHRINK_FRAMES);
+
+		// Stats of a completed frame, returns true if the capacity changed
+		bool Update(const DrawCommandStats& stats);
+
+		uint32_t GetCapacity() const { return m_Capacity; }
+		uint32_t GetGrowCount() const { return m_GrowCount; }
+		uint32_t GetShrinkCount() const { return m_ShrinkCount; }
+		uint64_t GetOverflowCommandCount() const { return m_OverflowCommandCount; }
+
+	private:
+		uint32_t m_Capacity = 0;
+		uint32_t m_MaxCapacity = 0;
+		uint32_t m_ShrinkFrames = 0;
+
+		// Max peak of the frames since the last change of the capacity, or since the last shrink window
+		uint32_t m_WindowPeak = 0;
+		uint32_t m_WindowFrames = 0;
+
+		uint32_t m_GrowCount = 0;
+		uint32_t m_ShrinkCount = 0;
+		uint64_t m_OverflowCommandCount = 0;
+	};
+}
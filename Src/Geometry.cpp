@@ -1,4 +1,14 @@
 #include "Geometry.h"
+#include "JobSystem.h"
+#include <cfloat>
+#include <glm/gtc/packing.hpp>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define VERTEX_PACKING_SSE 1
+#include <emmintrin.h>
+#else
+#define VERTEX_PACKING_SSE 0
+#endif
 
 #include "meshoptimizer.h"
 
@@ -184,9 +194,134 @@ namespace Niagara
 		return true;
 	}
 
-	size_t BuildOptMeshlets(Geometry& result, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+	static uint32_t GetMeshletDataSize(uint32_t vertexCount, uint32_t triangleCount)
+	{
+#if USE_PACKED_PRIMITIVE_INDICES_NV
+		return vertexCount + Niagara::DivideAndRoundUp(triangleCount * 3, 4);
+#else
+		return vertexCount + triangleCount;
+#endif
+	}
+
+	static void SetMeshletBounds(Meshlet& meshlet, const meshopt_Bounds& bounds)
+	{
+		meshlet.boundingSphere = glm::vec4(bounds.center[0], bounds.center[1], bounds.center[2], bounds.radius);
+		meshlet.coneApex = glm::vec4(bounds.cone_apex[0], bounds.cone_apex[1], bounds.cone_apex[2], 0);
+		meshlet.cone = glm::vec4(bounds.cone_axis[0], bounds.cone_axis[1], bounds.cone_axis[2], bounds.cone_cutoff);
+		for (int i = 0; i < 3; ++i)
+			meshlet.coneAxisS8[i] = bounds.cone_axis_s8[i];
+		meshlet.coneCutoffS8 = bounds.cone_cutoff_s8;
+	}
+
+	// Fills `result.meshlets[meshletIndex]` and its data at `meshletDataOffset`, both must be allocated already.
+	// Returns the data offset of the next meshlet.
+	static uint32_t PackMeshlet(Geometry& result, uint32_t meshletIndex, uint32_t meshletDataOffset, const std::vector<Vertex>& vertices,
+		const uint32_t* meshletVertices, uint32_t vertexCount, const uint8_t* meshletTriangles, uint32_t triangleCount)
+	{
+		auto& meshlet = result.meshlets[meshletIndex];
+
+		// Meshlet
+		meshopt_Bounds bounds = meshopt_computeMeshletBounds(
+			meshletVertices,
+			meshletTriangles,
+			triangleCount,
+			&vertices[0].p.x,
+			vertices.size(),
+			sizeof(Vertex));
+		meshlet.vertexCount = static_cast<uint8_t>(vertexCount);
+		meshlet.triangleCount = static_cast<uint8_t>(triangleCount);
+		meshlet.vertexOffset = meshletDataOffset;
+		SetMeshletBounds(meshlet, bounds);
+
+		// Vertex indices
+		for (uint32_t j = 0; j < vertexCount; ++j)
+			result.meshletData[meshletDataOffset + j] = meshletVertices[j];
+
+		meshletDataOffset += vertexCount;
+
+#if USE_PACKED_PRIMITIVE_INDICES_NV
+		// Triangle indices (packed in 4 bytes)
+		const uint32_t* indexGroups = reinterpret_cast<const uint32_t*>(meshletTriangles);
+		uint32_t indexGroupCount = Niagara::DivideAndRoundUp(triangleCount * 3, 4);
+		for (uint32_t j = 0; j < indexGroupCount; ++j)
+			result.meshletData[meshletDataOffset + j] = indexGroups[j];
+
+		meshletDataOffset += indexGroupCount;
+
+#else
+		for (uint32_t j = 0; j < triangleCount; j++)
+			result.meshletData[meshletDataOffset + j] = meshletTriangles[j * 3 + 0] | (meshletTriangles[j * 3 + 1] << 8) | (meshletTriangles[j * 3 + 2] << 16);
+
+		meshletDataOffset += triangleCount;
+
+#endif
+		return meshletDataOffset;
+	}
+
+	void UpdateGeometryBounds(std::vector<Meshlet>& meshlets, std::vector<Mesh>& meshes, const GeometryView& geometry, const std::vector<Vertex>& vertices)
+	{
+		// Meshlet local triangle indices, unpacked from the meshlet data
+		uint8_t meshletTriangles[MESHLET_MAX_PRIMITIVES * 3 + 3];
+
+		auto UpdateMeshlet = [&](Meshlet& meshlet, const Vertex* meshVertices, size_t meshVertexCount)
+		{
+			if (meshlet.triangleCount == 0)
+				return;
+
+			const uint32_t* meshletVertices = &geometry.meshletData[meshlet.vertexOffset];
+			const uint32_t* triangleData = meshletVertices + meshlet.vertexCount;
+#if USE_PACKED_PRIMITIVE_INDICES_NV
+			memcpy(meshletTriangles, triangleData, Niagara::DivideAndRoundUp(meshlet.triangleCount * 3u, 4u) * sizeof(uint32_t));
+#else
+			for (uint32_t j = 0; j < meshlet.triangleCount; ++j)
+			{
+				for (uint32_t k = 0; k < 3; ++k)
+					meshletTriangles[j * 3 + k] = static_cast<uint8_t>(triangleData[j] >> (k * 8));
+			}
+#endif
+
+			SetMeshletBounds(meshlet, meshopt_computeMeshletBounds(meshletVertices, meshletTriangles, meshlet.triangleCount, &meshVertices[0].p.x, meshVertexCount, sizeof(Vertex)));
+		};
+
+		for (auto& mesh : meshes)
+		{
+			const Vertex* meshVertices = &vertices[mesh.vertexOffset];
+
+			for (uint32_t lodIndex = 0; lodIndex < mesh.lodCount; ++lodIndex)
+			{
+				const auto& lod = mesh.lods[lodIndex];
+				for (uint32_t i = lod.meshletOffset; i < lod.meshletOffset + lod.meshletCount; ++i)
+					UpdateMeshlet(meshlets[i], meshVertices, mesh.vertexCount);
+			}
+
+			for (uint32_t i = mesh.clusterOffset; i < mesh.clusterOffset + mesh.clusterCount; ++i)
+				UpdateMeshlet(meshlets[geometry.clusters[i].meshletIndex], meshVertices, mesh.vertexCount);
+
+			// Same center, the radius grows to the farthest vertex
+			const glm::vec3 center = glm::vec3(mesh.boundingSphere);
+			float radius = mesh.boundingSphere.w;
+			for (uint32_t i = 0; i < mesh.vertexCount; ++i)
+				radius = std::max(radius, glm::length(meshVertices[i].p - center));
+			mesh.boundingSphere.w = radius;
+		}
+	}
+
+	void AppendMeshlet(Geometry& result, const std::vector<Vertex>& vertices, const uint32_t* meshletVertices, uint32_t vertexCount, const uint8_t* meshletTriangles, uint32_t triangleCount)
+	{
+		uint32_t meshletDataOffset = static_cast<uint32_t>(result.meshletData.size());
+		result.meshletData.insert(result.meshletData.end(), GetMeshletDataSize(vertexCount, triangleCount), 0);
+
+		uint32_t meshletIndex = static_cast<uint32_t>(result.meshlets.size());
+		result.meshlets.push_back({});
+
+		PackMeshlet(result, meshletIndex, meshletDataOffset, vertices, meshletVertices, vertexCount, meshletTriangles, triangleCount);
+	}
+
+	size_t BuildOptMeshlets(Geometry& result, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, MeshBuildStats* pStats)
 	{
 		static const float ConeWeight = 0.25f;
+		double stageBeginTime = pStats != nullptr ? GetTimestampMs() : 0.0;
+
 		auto meshletCount = meshopt_buildMeshletsBound(indices.size(), MESHLET_MAX_VERTICES, MESHLET_MAX_PRIMITIVES);
 		std::vector<meshopt_Meshlet> optMeshlets(meshletCount);
 		std::vector<uint32_t> meshlet_vertices(meshletCount * MESHLET_MAX_VERTICES);
@@ -205,20 +340,21 @@ namespace Niagara
 			ConeWeight);
 		optMeshlets.resize(meshletCount);
 
-		// Append meshlet data
-		uint32_t vertexCount = 0, triangleCount = 0, indexGroupCount = 0;
-		for (const auto& optMeshlet : optMeshlets)
+		if (pStats != nullptr)
 		{
-			vertexCount += optMeshlet.vertex_count;
-			triangleCount += optMeshlet.triangle_count;
-			indexGroupCount += Niagara::DivideAndRoundUp(optMeshlet.triangle_count * 3, 4);
+			double time = GetTimestampMs();
+			pStats->meshletBuildTime += time - stageBeginTime;
+			pStats->meshletCount += meshletCount;
+			stageBeginTime = time;
 		}
+
+		// Append meshlet data
+		uint32_t meshletDataSize = 0;
+		for (const auto& optMeshlet : optMeshlets)
+			meshletDataSize += GetMeshletDataSize(optMeshlet.vertex_count, optMeshlet.triangle_count);
+
 		uint32_t meshletDataOffset = static_cast<uint32_t>(result.meshletData.size());
-#if USE_PACKED_PRIMITIVE_INDICES_NV
-		result.meshletData.insert(result.meshletData.end(), vertexCount + indexGroupCount, 0);
-#else
-		result.meshletData.insert(result.meshletData.end(), vertexCount + triangleCount, 0);
-#endif
+		result.meshletData.insert(result.meshletData.end(), meshletDataSize, 0);
 
 		uint32_t meshletOffset = static_cast<uint32_t>(result.meshlets.size());
 		result.meshlets.insert(result.meshlets.end(), meshletCount, {});
@@ -226,49 +362,14 @@ namespace Niagara
 		for (uint32_t i = 0; i < meshletCount; ++i)
 		{
 			const auto& optMeshlet = optMeshlets[i];
-			auto& meshlet = result.meshlets[meshletOffset + i];
-
-			// Meshlet
-			meshopt_Bounds bounds = meshopt_computeMeshletBounds(
-				&meshlet_vertices[optMeshlet.vertex_offset],
-				&meshlet_triangles[optMeshlet.triangle_offset],
-				optMeshlet.triangle_count,
-				&vertices[0].p.x,
-				vertices.size(),
-				sizeof(Vertex));
-			meshlet.vertexCount = static_cast<uint8_t>(optMeshlets[i].vertex_count);
-			meshlet.triangleCount = static_cast<uint8_t>(optMeshlets[i].triangle_count);
-			meshlet.vertexOffset = meshletDataOffset;
-			meshlet.boundingSphere = glm::vec4(bounds.center[0], bounds.center[1], bounds.center[2], bounds.radius);
-			meshlet.coneApex = glm::vec4(bounds.cone_apex[0], bounds.cone_apex[1], bounds.cone_apex[0], 0);
-			meshlet.cone = glm::vec4(bounds.cone_axis[0], bounds.cone_axis[1], bounds.cone_axis[2], bounds.cone_cutoff);
-
-			// Vertex indices
-			for (uint32_t j = 0; j < optMeshlet.vertex_count; ++j)
-				result.meshletData[meshletDataOffset + j] = meshlet_vertices[optMeshlet.vertex_offset + j];
-
-			meshletDataOffset += optMeshlet.vertex_count;
-
-#if USE_PACKED_PRIMITIVE_INDICES_NV
-			// Triangle indices (packed in 4 bytes)
-			const uint32_t* indexGroups = reinterpret_cast<uint32_t*>(&meshlet_triangles[optMeshlet.triangle_offset]);
-			uint32_t indexGroupCount = Niagara::DivideAndRoundUp(optMeshlet.triangle_count * 3, 4);
-			for (uint32_t j = 0; j < indexGroupCount; ++j)
-				result.meshletData[meshletDataOffset + j] = indexGroups[j];
-
-			meshletDataOffset += indexGroupCount;
-
-#else
-			const uint8_t* indices = &meshlet_triangles[optMeshlet.triangle_offset];
-			uint32_t triangleCount = optMeshlet.triangle_count;
-			for (uint32_t j = 0; j < triangleCount; j++)
-				result.meshletData[meshletDataOffset + j] = indices[j * 3 + 0] | (indices[j * 3 + 1] << 8) | (indices[j * 3 + 2] << 16);
-
-			meshletDataOffset += triangleCount;
 
-#endif
+			meshletDataOffset = PackMeshlet(result, meshletOffset + i, meshletDataOffset, vertices,
+				&meshlet_vertices[optMeshlet.vertex_offset], optMeshlet.vertex_count, &meshlet_triangles[optMeshlet.triangle_offset], optMeshlet.triangle_count);
 		}
 
+		if (pStats != nullptr)
+			pStats->meshletBoundsTime += GetTimestampMs() - stageBeginTime;
+
 		// Padding
 #if 0
 		if (meshletCount % TASK_GROUP_SIZE != 0)
@@ -282,113 +383,763 @@ namespace Niagara
 		return meshletCount;
 	}
 
-	bool LoadMesh(Geometry& result, const char* path, bool bBuildMeshlets, bool bIndexless)
+	/// Mesh build stages
+	// `LoadMesh` and `LoadMeshes` share these, so the serial and the parallel paths produce identical geometry.
+
+	// Intermediate result of a single mesh, built independently of the shared `Geometry`
+	struct MeshBuildData
+	{
+		glm::vec4 boundingSphere{};
+		// Decoding of the packed vertex positions, see `Mesh`
+		glm::vec4 positionOffset{};
+		glm::vec4 positionScale{};
+		std::vector<Vertex> vertices;
+		std::vector<std::vector<uint32_t>> lodIndices;
+		// Geometric error of each lod in mesh units
+		std::vector<float> lodErrors;
+		// Meshlets of each lod, `meshletData` offsets are relative to the lod
+		std::vector<Geometry> lodMeshlets;
+	};
+
+	// `srcIndices` can be null for a plain triangle list
+	static void OptimizeMesh(MeshBuildData& data, const Vertex* srcVertices, size_t srcVertexCount, const uint32_t* srcIndices, size_t indexCount, MeshBuildStats* pStats)
+	{
+		double stageBeginTime = pStats != nullptr ? GetTimestampMs() : 0.0;
+		auto EndStage = [pStats, &stageBeginTime](double MeshBuildStats::* pStageTime)
+		{
+			if (pStats == nullptr)
+				return;
+
+			double time = GetTimestampMs();
+			pStats->*pStageTime += time - stageBeginTime;
+			stageBeginTime = time;
+		};
+
+		std::vector<uint32_t> remap(srcVertexCount);
+		size_t vertexCount = meshopt_generateVertexRemap(remap.data(), srcIndices, indexCount, srcVertices, srcVertexCount, sizeof(Vertex));
+
+		auto& vertices = data.vertices;
+		std::vector<uint32_t> indices(indexCount);
+		vertices.resize(vertexCount);
+
+		meshopt_remapVertexBuffer(vertices.data(), srcVertices, srcVertexCount, sizeof(Vertex), remap.data());
+		meshopt_remapIndexBuffer(indices.data(), srcIndices, indexCount, remap.data());
+		EndStage(&MeshBuildStats::remapTime);
+
+		meshopt_optimizeVertexCache(indices.data(), indices.data(), indexCount, vertexCount);
+		EndStage(&MeshBuildStats::vertexCacheTime);
+
+		meshopt_optimizeVertexFetch(vertices.data(), indices.data(), indexCount, vertices.data(), vertexCount, sizeof(Vertex));
+		EndStage(&MeshBuildStats::vertexFetchTime);
+
+		if (pStats != nullptr)
+		{
+			pStats->triangleCount += indexCount / 3;
+			pStats->vertexCount += vertexCount;
+		}
+
+		// Bounding sphere
+		glm::vec3 center{ 0.0f };
+		for (const auto& vert : vertices)
+			center += vert.p;
+		center /= vertexCount;
+
+		float radius = 0.0f;
+		glm::vec3 tempVec{};
+		for (const auto& vert : vertices)
+		{
+			tempVec = vert.p - center;
+			radius = std::max(radius, glm::dot(tempVec, tempVec));
+		}
+		radius = sqrtf(radius);
+
+		data.boundingSphere = glm::vec4(center, radius);
+
+		// Bounding box, unorm16 steps of the packed positions
+		glm::vec3 boxMin{ FLT_MAX }, boxMax{ -FLT_MAX };
+		for (const auto& vert : vertices)
+		{
+			boxMin = glm::min(boxMin, vert.p);
+			boxMax = glm::max(boxMax, vert.p);
+		}
+		if (vertexCount == 0)
+			boxMin = boxMax = glm::vec3(0.0f);
+
+		data.positionOffset = glm::vec4(boxMin, 0.0f);
+		data.positionScale = glm::vec4((boxMax - boxMin) * (1.0f / 65535.0f), 0.0f);
+
+		data.lodIndices.clear();
+		data.lodIndices.push_back(std::move(indices));
+		data.lodErrors.assign(1, 0.0f);
+	}
+
+	static bool LoadAndOptimizeMesh(MeshBuildData& data, const char* path, MeshBuildStats* pStats)
 	{
+		double parseBeginTime = pStats != nullptr ? GetTimestampMs() : 0.0;
+
 		std::vector<Vertex> triVertices;
 		if (!LoadObj(triVertices, path))
 			return false;
 
-		size_t indexCount = triVertices.size();
+		if (pStats != nullptr)
+			pStats->parseTime += GetTimestampMs() - parseBeginTime;
 
-		// FIXME: not used now
-		if (bIndexless)
+		OptimizeMesh(data, triVertices.data(), triVertices.size(), nullptr, triVertices.size(), pStats);
+
+		return true;
+	}
+
+	// Normals and uvs for the attribute aware simplification
+	static constexpr uint32_t s_SimplifyAttributeCount = 5;
+
+	static void GetSimplifyAttributes(std::vector<float>& attributes, const std::vector<Vertex>& vertices)
+	{
+		attributes.resize(vertices.size() * s_SimplifyAttributeCount);
+
+		for (size_t i = 0; i < vertices.size(); ++i)
 		{
-			Mesh mesh{};
-			mesh.vertexOffset = static_cast<uint32_t>(result.vertices.size());
-			mesh.vertexCount = static_cast<uint32_t>(triVertices.size());
+			const Vertex& v = vertices[i];
+			float* dst = &attributes[i * s_SimplifyAttributeCount];
 
-			result.vertices.insert(result.vertices.end(), triVertices.begin(), triVertices.end());
-#if 0
-			mesh.indices.resize(indexCount);
-			for (size_t i = 0; i < indexCount; ++i)
-				mesh.indices[i] = i;
+#if USE_DEVICE_8BIT_16BIT_EXTENSIONS
+			// Same encoding as `LoadObj`, n * 127 + 127.5 and half uvs
+			dst[0] = v.n.x / 127.0f - 1.0f;
+			dst[1] = v.n.y / 127.0f - 1.0f;
+			dst[2] = v.n.z / 127.0f - 1.0f;
+			dst[3] = glm::unpackHalf1x16(v.uv.x);
+			dst[4] = glm::unpackHalf1x16(v.uv.y);
+#else
+			dst[0] = v.n.x;
+			dst[1] = v.n.y;
+			dst[2] = v.n.z;
+			dst[3] = v.uv.x;
+			dst[4] = v.uv.y;
 #endif
 		}
-		else
-		{
-			std::vector<uint32_t> remap(indexCount);
-			size_t vertexCount = meshopt_generateVertexRemap(remap.data(), nullptr, indexCount, triVertices.data(), indexCount, sizeof(Vertex));
+	}
+
+	/**
+	* Each lod simplifies the previous one, so the chain itself is sequential. The lods target `LOD_TRIANGLE_RATIO` of the triangles
+	* of the previous one with the attribute aware simplification, the rounds that topology locks fall back to the sloppy
+	* simplification, which ignores the topology. The chain fills `MESH_MAX_LODS` down to `LOD_MIN_TRIANGLES`.
+	*/
+	static void BuildLodChain(MeshBuildData& data, MeshBuildStats* pStats)
+	{
+		const auto& vertices = data.vertices;
+		const size_t vertexCount = vertices.size();
 
-			std::vector<Vertex> vertices(vertexCount);
-			std::vector<uint32_t> indices(indexCount);
+		// Simplification errors are relative to the mesh extents
+		const float errorScale = meshopt_simplifyScale(&vertices[0].p.x, vertexCount, sizeof(Vertex));
 
-			meshopt_remapVertexBuffer(vertices.data(), triVertices.data(), indexCount, sizeof(Vertex), remap.data());
-			meshopt_remapIndexBuffer(indices.data(), nullptr, indexCount, remap.data());
+		std::vector<float> attributes;
+		GetSimplifyAttributes(attributes, vertices);
 
-			meshopt_optimizeVertexCache(indices.data(), indices.data(), indexCount, vertexCount);
-			meshopt_optimizeVertexFetch(vertices.data(), indices.data(), indexCount, vertices.data(), vertexCount, sizeof(Vertex));
+		const float attributeWeights[s_SimplifyAttributeCount] = { LOD_NORMAL_WEIGHT, LOD_NORMAL_WEIGHT, LOD_NORMAL_WEIGHT, LOD_UV_WEIGHT, LOD_UV_WEIGHT };
 
-			// Mesh
-			result.meshes.push_back({});
-			auto& mesh = result.meshes.back();
+		while (data.lodIndices.size() < MESH_MAX_LODS && data.lodIndices.back().size() / 3 > LOD_MIN_TRIANGLES)
+		{
+			const auto& lodIndices = data.lodIndices.back();
+			size_t lodIndexCount = lodIndices.size();
+
+			// Simplify
+			double simplifyBeginTime = pStats != nullptr ? GetTimestampMs() : 0.0;
+
+			std::vector<uint32_t> nextIndices(lodIndexCount);
+			size_t nextTargetIndexCount = std::max(size_t(lodIndexCount / 3 * LOD_TRIANGLE_RATIO), size_t(LOD_MIN_TRIANGLES)) * 3;
+			// The error includes the weighted attribute errors, it's conservative for the lod selection
+			float nextError = 0.0f;
+			size_t nextIndexCount = meshopt_simplifyWithAttributes(nextIndices.data(), lodIndices.data(), lodIndexCount, &vertices[0].p.x, vertexCount, sizeof(Vertex),
+				attributes.data(), s_SimplifyAttributeCount * sizeof(float), attributeWeights, s_SimplifyAttributeCount, nullptr, nextTargetIndexCount, FLT_MAX, 0, &nextError);
+			assert(nextIndexCount <= lodIndexCount);
+
+			// Locked by the topology (borders, seams, non manifold edges)
+			bool bSloppy = false;
+			if (nextIndexCount > nextTargetIndexCount + size_t((lodIndexCount - nextTargetIndexCount) * (1.0f - LOD_MIN_PROGRESS)))
 			{
-				// Vertices
-				mesh.vertexOffset = static_cast<uint32_t>(result.vertices.size());
-				mesh.vertexCount = static_cast<uint32_t>(vertexCount);
-				result.vertices.insert(result.vertices.end(), vertices.begin(), vertices.end());
-
-				// Bounding sphere
-				glm::vec3 center{ 0.0f };
-				for (const auto& vert : vertices)
-					center += vert.p;
-				center /= vertexCount;
-
-				float radius = 0.0f;
-				glm::vec3 tempVec{};
-				for (const auto& vert : vertices)
+				std::vector<uint32_t> sloppyIndices(lodIndexCount);
+				float sloppyError = 0.0f;
+				size_t sloppyIndexCount = meshopt_simplifySloppy(sloppyIndices.data(), lodIndices.data(), lodIndexCount, &vertices[0].p.x, vertexCount, sizeof(Vertex),
+					nextTargetIndexCount, FLT_MAX, &sloppyError);
+
+				if (sloppyIndexCount > 0 && sloppyIndexCount < nextIndexCount)
 				{
-					tempVec = vert.p - center;
-					radius = std::max(radius, glm::dot(tempVec, tempVec));
+					nextIndices.swap(sloppyIndices);
+					nextIndexCount = sloppyIndexCount;
+					nextError = sloppyError;
+					bSloppy = true;
 				}
-				radius = sqrtf(radius);
+			}
 
-				mesh.boundingSphere = glm::vec4(center, radius);
+			// Each lod simplifies the previous one, the errors add up
+			const float nextLodError = data.lodErrors.back() + nextError * errorScale;
 
-				// Lods
-				size_t lodIndexCount = indexCount;
-				std::vector<uint32_t> lodIndices = indices;
-				while (mesh.lodCount < MESH_MAX_LODS)
-				{
-					auto& meshLod = mesh.lods[mesh.lodCount++];
+			if (pStats != nullptr)
+				pStats->simplifyRounds.push_back({ lodIndexCount / 3, nextIndexCount / 3, GetTimestampMs() - simplifyBeginTime, nextLodError, bSloppy });
 
-					// Indices
-					meshLod.indexOffset = static_cast<uint32_t>(result.indices.size());
-					meshLod.indexCount = static_cast<uint32_t>(lodIndexCount);
+			// No progress left, not even with the sloppy simplification
+			if (nextIndexCount == 0 || nextIndexCount == lodIndexCount)
+				break;
 
-					result.indices.insert(result.indices.end(), lodIndices.begin(), lodIndices.end());
+			nextIndices.resize(nextIndexCount);
+			meshopt_optimizeVertexCache(nextIndices.data(), nextIndices.data(), nextIndexCount, vertexCount);
 
-					// Meshlets
-					meshLod.meshletOffset = static_cast<uint32_t>(result.meshlets.size());
-					meshLod.meshletCount = bBuildMeshlets ? static_cast<uint32_t>(BuildOptMeshlets(result, vertices, lodIndices)) : 0;
+			data.lodIndices.push_back(std::move(nextIndices));
+			data.lodErrors.push_back(nextLodError);
+		}
+	}
+
+	static void BuildLodMeshlets(MeshBuildData& data, uint32_t lod, MeshBuildStats* pStats = nullptr)
+	{
+		auto& lodGeometry = data.lodMeshlets[lod];
+		lodGeometry = {};
+		BuildOptMeshlets(lodGeometry, data.vertices, data.lodIndices[lod], pStats);
+	}
+
+	// Appends a built mesh to the shared geometry, offsets are the same as if the mesh was built in place
+	static void AppendMesh(Geometry& result, MeshBuildData& data, bool bBuildMeshlets)
+	{
+		result.meshes.push_back({});
+		auto& mesh = result.meshes.back();
+
+		// Vertices
+		mesh.vertexOffset = static_cast<uint32_t>(result.vertices.size());
+		mesh.vertexCount = static_cast<uint32_t>(data.vertices.size());
+		result.vertices.insert(result.vertices.end(), data.vertices.begin(), data.vertices.end());
+
+		mesh.boundingSphere = data.boundingSphere;
+		mesh.positionOffset = data.positionOffset;
+		mesh.positionScale = data.positionScale;
+
+		// Lods
+		for (uint32_t lod = 0; lod < static_cast<uint32_t>(data.lodIndices.size()); ++lod)
+		{
+			const auto& lodIndices = data.lodIndices[lod];
+			auto& meshLod = mesh.lods[mesh.lodCount++];
+
+			// Indices
+			meshLod.indexOffset = static_cast<uint32_t>(result.indices.size());
+			meshLod.indexCount = static_cast<uint32_t>(lodIndices.size());
+			meshLod.error = data.lodErrors[lod];
 
-					// Simplify
-					size_t nextTargetIndexCount = size_t(double(lodIndexCount * 0.5f)); // 0.75, 0.5
-					size_t nextIndexCount = meshopt_simplify(lodIndices.data(), lodIndices.data(), lodIndexCount, &vertices[0].p.x, vertexCount, sizeof(Vertex), nextTargetIndexCount, 1e-2f);
-					assert(nextIndexCount <= lodIndexCount);
+			result.indices.insert(result.indices.end(), lodIndices.begin(), lodIndices.end());
 
-					// We've reched the error bound
-					if (nextIndexCount == lodIndexCount)
-						break;
+			// Meshlets
+			meshLod.meshletOffset = static_cast<uint32_t>(result.meshlets.size());
+			meshLod.meshletCount = 0;
 
-					lodIndexCount = nextIndexCount;
-					lodIndices.resize(lodIndexCount);
-					meshopt_optimizeVertexCache(lodIndices.data(), lodIndices.data(), lodIndexCount, vertexCount);
+			if (bBuildMeshlets)
+			{
+				const auto& lodGeometry = data.lodMeshlets[lod];
+				uint32_t meshletDataOffset = static_cast<uint32_t>(result.meshletData.size());
+
+				result.meshletData.insert(result.meshletData.end(), lodGeometry.meshletData.begin(), lodGeometry.meshletData.end());
+				for (auto meshlet : lodGeometry.meshlets)
+				{
+					meshlet.vertexOffset += meshletDataOffset;
+					result.meshlets.push_back(meshlet);
 				}
+
+				meshLod.meshletCount = static_cast<uint32_t>(lodGeometry.meshlets.size());
 			}
 		}
 
 		// Pad meshlets to TASK_GROUP_SIZE to allow shaders to over-read when running task shaders
-#if 1
 		size_t meshletCount = result.meshlets.size();
 		if (meshletCount % TASK_GROUP_SIZE != 0)
 		{
 			size_t paddingCount = TASK_GROUP_SIZE - meshletCount % TASK_GROUP_SIZE;
 			result.meshlets.insert(result.meshlets.end(), paddingCount, {});
-			meshletCount += paddingCount;
 		}
-#endif
+	}
+
+	static void BuildMeshData(Geometry& result, MeshBuildData& data, bool bBuildMeshlets, MeshBuildStats* pStats)
+	{
+		BuildLodChain(data, pStats);
+
+		if (bBuildMeshlets)
+		{
+			data.lodMeshlets.resize(data.lodIndices.size());
+			for (uint32_t lod = 0; lod < static_cast<uint32_t>(data.lodIndices.size()); ++lod)
+				BuildLodMeshlets(data, lod, pStats);
+		}
+
+		AppendMesh(result, data, bBuildMeshlets);
+	}
+
+
+	bool LoadMesh(Geometry& result, const char* path, bool bBuildMeshlets, bool bIndexless, MeshBuildStats* pStats)
+	{
+		// FIXME: not used now
+		if (bIndexless)
+		{
+			std::vector<Vertex> triVertices;
+			if (!LoadObj(triVertices, path))
+				return false;
+
+			Mesh mesh{};
+			mesh.vertexOffset = static_cast<uint32_t>(result.vertices.size());
+			mesh.vertexCount = static_cast<uint32_t>(triVertices.size());
+
+			result.vertices.insert(result.vertices.end(), triVertices.begin(), triVertices.end());
+
+			return true;
+		}
+
+		MeshBuildData data{};
+		if (!LoadAndOptimizeMesh(data, path, pStats))
+			return false;
+
+		BuildMeshData(result, data, bBuildMeshlets, pStats);
 
 		// TODO: optimize the mesh for more efficient GPU rendering
 		return true;
 	}
+
+	void BuildMesh(Geometry& result, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, bool bBuildMeshlets, MeshBuildStats* pStats)
+	{
+		MeshBuildData data{};
+		if (indices.empty())
+			OptimizeMesh(data, vertices.data(), vertices.size(), nullptr, vertices.size(), pStats);
+		else
+			OptimizeMesh(data, vertices.data(), vertices.size(), indices.data(), indices.size(), pStats);
+
+		BuildMeshData(result, data, bBuildMeshlets, pStats);
+	}
+
+	size_t LoadMeshes(Geometry& result, const std::vector<std::string>& paths, bool bBuildMeshlets, std::vector<bool>* pLoaded)
+	{
+		const uint32_t meshCount = static_cast<uint32_t>(paths.size());
+
+		if (!g_JobSystem.IsInited())
+		{
+			size_t loadedCount = 0;
+			for (uint32_t i = 0; i < meshCount; ++i)
+			{
+				bool bLoaded = LoadMesh(result, paths[i].c_str(), bBuildMeshlets);
+				loadedCount += bLoaded ? 1 : 0;
+				if (pLoaded != nullptr)
+					pLoaded->push_back(bLoaded);
+			}
+			return loadedCount;
+		}
+
+		std::vector<MeshBuildData> meshData(meshCount);
+		std::unique_ptr<bool[]> loaded(new bool[meshCount]());
+
+		// Meshes in parallel, and the meshlets of each lod in parallel within a mesh
+		JobCounter meshCounter{};
+		g_JobSystem.ParallelFor(meshCounter, meshCount, 1, [&](uint32_t i)
+			{
+				auto& data = meshData[i];
+				if (!LoadAndOptimizeMesh(data, paths[i].c_str(), nullptr))
+					return;
+
+				BuildLodChain(data, nullptr);
+
+				if (bBuildMeshlets)
+				{
+					const uint32_t lodCount = static_cast<uint32_t>(data.lodIndices.size());
+					data.lodMeshlets.resize(lodCount);
+
+					JobCounter lodCounter{};
+					g_JobSystem.ParallelFor(lodCounter, lodCount, 1, [&data](uint32_t lod) { BuildLodMeshlets(data, lod); });
+					g_JobSystem.Wait(lodCounter);
+				}
+
+				loaded[i] = true;
+			});
+		g_JobSystem.Wait(meshCounter);
+
+		// Merge in a fixed order to keep the offsets identical to the serial path
+		size_t loadedCount = 0;
+		for (uint32_t i = 0; i < meshCount; ++i)
+		{
+			if (loaded[i])
+			{
+				AppendMesh(result, meshData[i], bBuildMeshlets);
+				++loadedCount;
+			}
+			if (pLoaded != nullptr)
+				pLoaded->push_back(loaded[i]);
+
+			meshData[i] = {};
+		}
+
+		return loadedCount;
+	}
+
+	/// Draw packing
+
+	static uint32_t PackUnorm16(float value)
+	{
+		return static_cast<uint32_t>(roundf(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+	}
+
+	static uint32_t PackSnorm16(float value)
+	{
+		return static_cast<uint32_t>(static_cast<int32_t>(roundf(std::clamp(value, -1.0f, 1.0f) * 32767.0f))) & 0xFFFFu;
+	}
+
+	PackedMeshDraw PackMeshDraw(const glm::vec3& position, const glm::vec4& orientation, float scale, uint32_t meshIndex, int32_t vertexOffset, uint32_t meshletVisibilityOffset)
+	{
+		const int32_t minCell = -DRAW_CELL_BIAS, maxCell = DRAW_CELL_BIAS - 1;
+
+		PackedMeshDraw packedDraw;
+
+		uint32_t cellBits[3], localBits[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			const float p = position[i] / DRAW_CELL_SIZE;
+			const int32_t cell = std::clamp(static_cast<int32_t>(floorf(p)), minCell, maxCell);
+			assert(p >= float(minCell) && p <= float(maxCell + 1));
+
+			cellBits[i] = static_cast<uint32_t>(cell + DRAW_CELL_BIAS);
+			localBits[i] = PackUnorm16(p - float(cell));
+		}
+		packedDraw.cell = cellBits[0] | (cellBits[1] << DRAW_CELL_BITS) | (cellBits[2] << (2 * DRAW_CELL_BITS));
+		packedDraw.positionXY = localBits[0] | (localBits[1] << 16);
+
+		const float log2Scale = log2f(std::max(scale, FLT_MIN));
+		packedDraw.positionZScale = localBits[2] | (PackUnorm16((log2Scale + DRAW_SCALE_LOG2_RANGE * 0.5f) / DRAW_SCALE_LOG2_RANGE) << 16);
+
+		const glm::vec4 q = glm::normalize(orientation);
+		packedDraw.orientationXY = PackSnorm16(q.x) | (PackSnorm16(q.y) << 16);
+		packedDraw.orientationZW = PackSnorm16(q.z) | (PackSnorm16(q.w) << 16);
+
+		packedDraw.meshIndex = meshIndex;
+		packedDraw.vertexOffset = vertexOffset;
+		packedDraw.meshletVisibilityOffset = meshletVisibilityOffset;
+
+		return packedDraw;
+	}
+
+	MeshDraw UnpackMeshDraw(const PackedMeshDraw& packedDraw)
+	{
+		const glm::mat4 worldMat = DrawPacking::UnpackDrawWorldMatrix(packedDraw);
+
+		MeshDraw draw;
+		draw.worldMatRow0 = glm::vec4(worldMat[0][0], worldMat[1][0], worldMat[2][0], worldMat[3][0]);
+		draw.worldMatRow1 = glm::vec4(worldMat[0][1], worldMat[1][1], worldMat[2][1], worldMat[3][1]);
+		draw.worldMatRow2 = glm::vec4(worldMat[0][2], worldMat[1][2], worldMat[2][2], worldMat[3][2]);
+		draw.vertexOffset = packedDraw.vertexOffset;
+		draw.meshIndex = packedDraw.meshIndex;
+		draw.meshletVisibilityOffset = packedDraw.meshletVisibilityOffset;
+
+		return draw;
+	}
+
+	/// Meshlet packing
+
+	PackedMeshlet PackMeshletHeader(const Meshlet& meshlet, const glm::vec4& meshSphere)
+	{
+		PackedMeshlet packedMeshlet{};
+		packedMeshlet.vertexOffset = meshlet.vertexOffset;
+
+		// Center, in the bounding box of the mesh sphere
+		const glm::vec3 center = glm::vec3(meshlet.boundingSphere);
+		const glm::vec3 meshCenter = glm::vec3(meshSphere);
+		const float meshRadius = meshSphere.w;
+
+		uint32_t centerBits[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			const float t = meshRadius > 0.0f ? (center[i] - meshCenter[i]) / meshRadius * 0.5f + 0.5f : 0.5f;
+			centerBits[i] = static_cast<uint32_t>(roundf(std::clamp(t, 0.0f, 1.0f) * 1023.0f));
+		}
+		packedMeshlet.center = centerBits[0] | (centerBits[1] << MESHLET_CENTER_BITS) | (centerBits[2] << (2 * MESHLET_CENTER_BITS));
+
+		// Radius, grown by the center error and rounded up, so the decoded sphere contains the meshlet one
+		const glm::vec3 decodedCenter = glm::vec3(MeshletPacking::UnpackMeshletSphere(packedMeshlet, meshSphere));
+		const float radius = meshlet.boundingSphere.w + glm::length(decodedCenter - center) + meshRadius * (1.0f / 65536.0f);
+
+		// Out of the range, or a degenerate mesh sphere, the meshlet gets a sphere that is never culled
+		uint32_t radiusBits = 0;
+		if (meshRadius > 0.0f && radius <= meshRadius * MESHLET_RADIUS_RANGE)
+			radiusBits = static_cast<uint32_t>(ceilf(radius / (meshRadius * MESHLET_RADIUS_RANGE) * 65534.0f));
+		else if (radius > 0.0f)
+			radiusBits = MESHLET_RADIUS_UNBOUNDED;
+		packedMeshlet.radiusCounts = radiusBits | (uint32_t(meshlet.vertexCount) << 16) | (uint32_t(meshlet.triangleCount) << 24);
+
+		// Cone. A cutoff that saturates can't cover the axis error any more, such cones never cull.
+		if (meshlet.coneCutoffS8 < 127)
+		{
+			packedMeshlet.cone =
+				uint32_t(uint8_t(meshlet.coneAxisS8[0])) |
+				(uint32_t(uint8_t(meshlet.coneAxisS8[1])) << 8) |
+				(uint32_t(uint8_t(meshlet.coneAxisS8[2])) << 16) |
+				(uint32_t(uint8_t(meshlet.coneCutoffS8)) << 24);
+		}
+		else
+		{
+			packedMeshlet.cone = 127u << 24;
+		}
+
+		return packedMeshlet;
+	}
+
+	Meshlet UnpackMeshletHeader(const PackedMeshlet& packedMeshlet, const glm::vec4& meshSphere)
+	{
+		Meshlet meshlet{};
+		meshlet.boundingSphere = MeshletPacking::UnpackMeshletSphere(packedMeshlet, meshSphere);
+		meshlet.cone = MeshletPacking::UnpackMeshletCone(packedMeshlet);
+		meshlet.vertexOffset = packedMeshlet.vertexOffset;
+		meshlet.vertexCount = static_cast<uint8_t>(MeshletPacking::UnpackMeshletVertexCount(packedMeshlet));
+		meshlet.triangleCount = static_cast<uint8_t>(MeshletPacking::UnpackMeshletTriangleCount(packedMeshlet));
+		for (int i = 0; i < 3; ++i)
+			meshlet.coneAxisS8[i] = static_cast<int8_t>(packedMeshlet.cone >> (8 * i));
+		meshlet.coneCutoffS8 = static_cast<int8_t>(packedMeshlet.cone >> 24);
+
+		return meshlet;
+	}
+
+	/// Vertex packing
+
+	// Source normal and uv, decoded like the full vertices in the shaders
+	static glm::vec3 GetVertexNormal(const Vertex& v)
+	{
+#if USE_DEVICE_8BIT_16BIT_EXTENSIONS
+		return glm::vec3(v.n.x / 127.0f - 1.0f, v.n.y / 127.0f - 1.0f, v.n.z / 127.0f - 1.0f);
+#else
+		return v.n;
+#endif
+	}
+
+	static uint32_t PackVertexUv(const Vertex& v)
+	{
+#if USE_DEVICE_8BIT_16BIT_EXTENSIONS
+		return uint32_t(v.uv.x) | (uint32_t(v.uv.y) << 16);
+#else
+		return uint32_t(meshopt_quantizeHalf(v.uv.x)) | (uint32_t(meshopt_quantizeHalf(v.uv.y)) << 16);
+#endif
+	}
+
+	static glm::vec2 GetVertexUv(const Vertex& v)
+	{
+#if USE_DEVICE_8BIT_16BIT_EXTENSIONS
+		return glm::vec2(glm::unpackHalf1x16(v.uv.x), glm::unpackHalf1x16(v.uv.y));
+#else
+		return v.uv;
+#endif
+	}
+
+	// The SSE path does the same operations in the same order, values are rounded by adding 0.5 (with the sign of the value) and truncating
+	static PackedVertex PackVertex(const Vertex& v, const glm::vec3& offset, const glm::vec3& invScale)
+	{
+		uint32_t q[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			const float t = std::min(std::max((v.p[i] - offset[i]) * invScale[i], 0.0f), 65535.0f);
+			q[i] = static_cast<uint32_t>(t + 0.5f);
+		}
+
+		// Octahedral normal
+		const glm::vec3 n = GetVertexNormal(v);
+		const float l1 = std::max(fabsf(n.x) + fabsf(n.y) + fabsf(n.z), FLT_MIN);
+		const float nx = n.x / l1, ny = n.y / l1, nz = n.z / l1;
+
+		float ox = nx, oy = ny;
+		if (nz < 0.0f)
+		{
+			ox = (1.0f - fabsf(ny)) * copysignf(1.0f, nx);
+			oy = (1.0f - fabsf(nx)) * copysignf(1.0f, ny);
+		}
+		const uint32_t e0 = static_cast<uint32_t>(static_cast<int32_t>(ox * 127.0f + copysignf(0.5f, ox))) & 0xFFu;
+		const uint32_t e1 = static_cast<uint32_t>(static_cast<int32_t>(oy * 127.0f + copysignf(0.5f, oy))) & 0xFFu;
+
+		PackedVertex packedVertex;
+		packedVertex.positionXY = q[0] | (q[1] << 16);
+		packedVertex.positionZNormal = q[2] | (e0 << 16) | (e1 << 24);
+		packedVertex.uv = PackVertexUv(v);
+
+		return packedVertex;
+	}
+
+#if VERTEX_PACKING_SSE
+	static inline __m128 SelectSse(__m128 mask, __m128 a, __m128 b)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+
+	// Packs 4 vertices, SoA in registers
+	static void PackVertices4(PackedVertex* dst, const Vertex* src, const glm::vec3& offset, const glm::vec3& invScale)
+	{
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 maxValue = _mm_set1_ps(65535.0f);
+
+		__m128i q[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			const __m128 p = _mm_setr_ps(src[0].p[i], src[1].p[i], src[2].p[i], src[3].p[i]);
+			const __m128 t = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(p, _mm_set1_ps(offset[i])), _mm_set1_ps(invScale[i])), zero), maxValue);
+			q[i] = _mm_cvttps_epi32(_mm_add_ps(t, half));
+		}
+
+		const glm::vec3 n0 = GetVertexNormal(src[0]), n1 = GetVertexNormal(src[1]), n2 = GetVertexNormal(src[2]), n3 = GetVertexNormal(src[3]);
+		__m128 nx = _mm_setr_ps(n0.x, n1.x, n2.x, n3.x);
+		__m128 ny = _mm_setr_ps(n0.y, n1.y, n2.y, n3.y);
+		__m128 nz = _mm_setr_ps(n0.z, n1.z, n2.z, n3.z);
+
+		const __m128 l1 = _mm_max_ps(_mm_add_ps(_mm_add_ps(_mm_andnot_ps(signMask, nx), _mm_andnot_ps(signMask, ny)), _mm_andnot_ps(signMask, nz)), _mm_set1_ps(FLT_MIN));
+		nx = _mm_div_ps(nx, l1);
+		ny = _mm_div_ps(ny, l1);
+		nz = _mm_div_ps(nz, l1);
+
+		const __m128 signX = _mm_or_ps(_mm_and_ps(nx, signMask), one);
+		const __m128 signY = _mm_or_ps(_mm_and_ps(ny, signMask), one);
+		const __m128 foldedX = _mm_mul_ps(_mm_sub_ps(one, _mm_andnot_ps(signMask, ny)), signX);
+		const __m128 foldedY = _mm_mul_ps(_mm_sub_ps(one, _mm_andnot_ps(signMask, nx)), signY);
+
+		const __m128 lower = _mm_cmplt_ps(nz, zero);
+		const __m128 ox = SelectSse(lower, foldedX, nx);
+		const __m128 oy = SelectSse(lower, foldedY, ny);
+
+		const __m128 scale = _mm_set1_ps(127.0f);
+		const __m128i e0 = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(ox, scale), _mm_or_ps(_mm_and_ps(ox, signMask), half)));
+		const __m128i e1 = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(oy, scale), _mm_or_ps(_mm_and_ps(oy, signMask), half)));
+
+		alignas(16) uint32_t qx[4], qy[4], qz[4], ex[4], ey[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(qx), q[0]);
+		_mm_store_si128(reinterpret_cast<__m128i*>(qy), q[1]);
+		_mm_store_si128(reinterpret_cast<__m128i*>(qz), q[2]);
+		_mm_store_si128(reinterpret_cast<__m128i*>(ex), e0);
+		_mm_store_si128(reinterpret_cast<__m128i*>(ey), e1);
+
+		for (int i = 0; i < 4; ++i)
+		{
+			dst[i].positionXY = qx[i] | (qy[i] << 16);
+			dst[i].positionZNormal = qz[i] | ((ex[i] & 0xFFu) << 16) | ((ey[i] & 0xFFu) << 24);
+			dst[i].uv = PackVertexUv(src[i]);
+		}
+	}
+#endif
+
+	void PackVertices(PackedVertex* dst, const Vertex* src, size_t count, const Mesh& mesh, bool bSimd)
+	{
+		const glm::vec3 offset = glm::vec3(mesh.positionOffset);
+		glm::vec3 invScale{ 0.0f };
+		for (int i = 0; i < 3; ++i)
+			invScale[i] = mesh.positionScale[i] > 0.0f ? 1.0f / mesh.positionScale[i] : 0.0f;
+
+		size_t i = 0;
+#if VERTEX_PACKING_SSE
+		if (bSimd)
+		{
+			for (; i + 4 <= count; i += 4)
+				PackVertices4(dst + i, src + i, offset, invScale);
+		}
+#endif
+		for (; i < count; ++i)
+			dst[i] = PackVertex(src[i], offset, invScale);
+	}
+
+	VertexPackingError MeasureVertexPackingError(const PackedVertex* packed, const Vertex* src, size_t count, const Mesh& mesh)
+	{
+		VertexPackingError error{};
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			const glm::vec3 p = VertexPacking::UnpackVertexPosition(packed[i], mesh.positionOffset, mesh.positionScale);
+			error.position = std::max(error.position, glm::length(p - src[i].p));
+
+			const glm::vec3 srcNormal = GetVertexNormal(src[i]);
+			const float srcLength = glm::length(srcNormal);
+			if (srcLength > EPS)
+			{
+				const glm::vec3 n = VertexPacking::UnpackVertexNormal(packed[i]);
+				const float cosAngle = std::clamp(glm::dot(n, srcNormal / srcLength), -1.0f, 1.0f);
+				error.normal = std::max(error.normal, glm::degrees(acosf(cosAngle)));
+			}
+
+			const glm::vec2 uv = VertexPacking::UnpackVertexUv(packed[i]);
+			const glm::vec2 srcUv = GetVertexUv(src[i]);
+			error.uv = std::max(error.uv, std::max(fabsf(uv.x - srcUv.x), fabsf(uv.y - srcUv.y)));
+		}
+
+		return error;
+	}
+
+	void PackMeshVertices(std::vector<PackedVertex>& packedVertices, const GeometryView& geometry, std::vector<VertexPackingError>* pErrors)
+	{
+		const uint32_t meshCount = static_cast<uint32_t>(geometry.meshes.size());
+
+		packedVertices.assign(geometry.vertices.size(), PackedVertex{});
+		if (pErrors != nullptr)
+			pErrors->assign(meshCount, VertexPackingError{});
+
+		auto packMesh = [&](uint32_t meshIndex)
+		{
+			const Mesh& mesh = geometry.meshes[meshIndex];
+			PackVertices(packedVertices.data() + mesh.vertexOffset, geometry.vertices.data() + mesh.vertexOffset, mesh.vertexCount, mesh);
+
+			if (pErrors != nullptr)
+				(*pErrors)[meshIndex] = MeasureVertexPackingError(packedVertices.data() + mesh.vertexOffset, geometry.vertices.data() + mesh.vertexOffset, mesh.vertexCount, mesh);
+		};
+
+		if (g_JobSystem.IsInited())
+		{
+			JobCounter counter{};
+			g_JobSystem.ParallelFor(counter, meshCount, 1, packMesh);
+			g_JobSystem.Wait(counter);
+		}
+		else
+		{
+			for (uint32_t i = 0; i < meshCount; ++i)
+				packMesh(i);
+		}
+	}
+
+	void PackMeshletHeaders(std::vector<PackedMeshlet>& packedMeshlets, const GeometryView& geometry)
+	{
+		packedMeshlets.assign(geometry.meshlets.size(), PackedMeshlet{});
+
+		for (const auto& mesh : geometry.meshes)
+		{
+			for (uint32_t lodIndex = 0; lodIndex < mesh.lodCount; ++lodIndex)
+			{
+				const auto& lod = mesh.lods[lodIndex];
+				for (uint32_t i = lod.meshletOffset; i < lod.meshletOffset + lod.meshletCount; ++i)
+					packedMeshlets[i] = PackMeshletHeader(geometry.meshlets[i], mesh.boundingSphere);
+			}
+
+			for (uint32_t i = mesh.clusterOffset; i < mesh.clusterOffset + mesh.clusterCount; ++i)
+			{
+				const uint32_t meshletIndex = geometry.clusters[i].meshletIndex;
+				packedMeshlets[meshletIndex] = PackMeshletHeader(geometry.meshlets[meshletIndex], mesh.boundingSphere);
+			}
+		}
+	}
+
+	glm::vec4 GetLodSelectionParams(const glm::mat4& projMatrix, float viewportHeight, float errorThreshold, float hysteresis)
+	{
+		// Pixels covered by a unit length at distance 1
+		const float pixelsPerUnit = fabsf(projMatrix[1][1]) * viewportHeight * 0.5f;
+
+		return glm::vec4(errorThreshold, hysteresis, pixelsPerUnit, 0.0f);
+	}
+
+	uint32_t SelectMeshLod(const Mesh& mesh, const glm::vec4& lodParams, float zNear, float distance, float scale, uint32_t lastLodIndex)
+	{
+		// Error of 1 pixel at the distance, in mesh units
+		const float pixelError = std::max(distance, zNear) / (std::max(lodParams.z, EPS) * scale);
+		const float threshold = lodParams.x * pixelError;
+		const float hysteresisThreshold = threshold * (1.0f - lodParams.y);
+
+		uint32_t lodIndex = 0;
+		uint32_t hysteresisLodIndex = 0;
+		for (uint32_t i = 1; i < mesh.lodCount; ++i)
+		{
+			if (mesh.lods[i].error <= threshold)
+				lodIndex = i;
+			if (mesh.lods[i].error <= hysteresisThreshold)
+				hysteresisLodIndex = i;
+		}
+
+		if (lodIndex > lastLodIndex)
+			lodIndex = std::max(hysteresisLodIndex, lastLodIndex);
+
+		return lodIndex;
+	}
 }
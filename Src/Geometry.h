@@ -103,6 +103,9 @@ namespace Niagara
 		uint32_t vertexOffset;
 		uint8_t vertexCount = 0;
 		uint8_t triangleCount = 0;
+		// `meshopt_Bounds::cone_axis_s8` and `cone_cutoff_s8`, for `PackedMeshlet`
+		int8_t coneAxisS8[3] = {};
+		int8_t coneCutoffS8 = 0;
 	};
 
 	struct MeshLod
@@ -111,19 +114,136 @@ namespace Niagara
 		uint32_t indexCount;
 		uint32_t meshletOffset;
 		uint32_t meshletCount;
+		// Max distance to the lod 0 surface in mesh units, 0 for lod 0
+		float error;
 	};
 
 	struct alignas(16) Mesh
 	{
 		glm::vec4 boundingSphere;
+		// Decoding of the `PackedVertex` positions, xyz - bounding box min and extent / 65535
+		glm::vec4 positionOffset;
+		glm::vec4 positionScale;
 
 		uint32_t vertexOffset;
 		uint32_t vertexCount;
 
 		uint32_t lodCount;
 		MeshLod lods[MESH_MAX_LODS];
+
+		// Cluster LOD DAG in `Geometry::clusters`, none if it wasn't built
+		uint32_t clusterOffset;
+		uint32_t clusterCount;
+	};
+
+	// Cluster of the cluster LOD DAG of a mesh, see `ClusterLod.h`. It's drawn as meshlet `meshletIndex` iff its projected `selfError`
+	// is small enough and its `parentError` isn't. Spheres and errors are in mesh space.
+	struct alignas(16) MeshCluster
+	{
+		glm::vec4 selfSphere; // xyz - center, w - radius
+		glm::vec4 parentSphere;
+		float selfError;
+		float parentError; // FLT_MAX for the roots
+		uint32_t meshletIndex;
+		uint32_t level;
+	};
+
+	// Draws and indirect commands, same layouts as in `MeshCommon.h`
+	struct alignas(16) MeshDraw
+	{
+		glm::vec4 worldMatRow0;
+		glm::vec4 worldMatRow1;
+		glm::vec4 worldMatRow2;
+	
+		int32_t  vertexOffset; // == meshes[meshIndex].vertexOffset, helps data locality in mesh shader
+		uint32_t meshIndex;
+		uint32_t meshletVisibilityOffset;
+	};
+
+	// Mesh index of the empty draws in the free slots of the draw buffer, the culling skips them
+	constexpr uint32_t INVALID_MESH_INDEX = ~0u;
+
+	struct MeshDrawCommand
+	{
+		uint32_t drawId;
+		VkDrawIndexedIndirectCommand drawIndexedIndirectCommand; // 5 uint32_t
+
+		// Used by mesh shading path
+		uint32_t drawVisibility;
+		uint32_t meshletVisibilityOffset;
+
+		// Switch from MeshShaderNV to MeshShaderEXT
+#if 0
+		VkDrawMeshTasksIndirectCommandNV drawMeshTaskIndirectCommand; // 2 uint32_t
+#else
+		uint32_t taskOffset;
+		uint32_t taskCount;
+		VkDrawMeshTasksIndirectCommandEXT drawMeshTaskIndirectCommand; // 3 uint32_t
+#endif
 	};
 
+	struct MeshTaskCommand
+	{
+		uint32_t drawId;
+		uint32_t taskOffset;
+		uint32_t taskCount;
+		uint32_t meshletVisibilityData; // low bit: draw visibility, higher 31 bit: meshVisibilityOffset
+	};
+
+	// Compact draw encoding, the decoding is shared with the shaders
+	namespace DrawPacking
+	{
+		using namespace glm;
+#include "../Shaders/DrawPacking.h"
+	}
+	using DrawPacking::PackedMeshDraw;
+	static_assert(sizeof(PackedMeshDraw) == 32, "Same layout as in `DrawPacking.h`");
+
+	// `orientation` xyz - vector part, w - scalar part. Positions are clamped to the cells of `DrawPacking.h`, +/-32K units.
+	PackedMeshDraw PackMeshDraw(const glm::vec3& position, const glm::vec4& orientation, float scale, uint32_t meshIndex, int32_t vertexOffset, uint32_t meshletVisibilityOffset);
+	// Decoded like in the shaders
+	MeshDraw UnpackMeshDraw(const PackedMeshDraw& packedDraw);
+
+	// Compact meshlet encoding, the decoding is shared with the shaders
+	namespace MeshletPacking
+	{
+		using namespace glm;
+#include "../Shaders/MeshletPacking.h"
+	}
+	using MeshletPacking::PackedMeshlet;
+	static_assert(sizeof(PackedMeshlet) == 16, "Same layout as in `MeshletPacking.h`");
+
+	// `meshSphere` is the bounding sphere of the mesh of the meshlet, the decoded bounds contain the ones of `meshlet`
+	PackedMeshlet PackMeshletHeader(const Meshlet& meshlet, const glm::vec4& meshSphere);
+	// Decoded like in the shaders, the cone axis isn't normalized and `coneApex` is lost
+	Meshlet UnpackMeshletHeader(const PackedMeshlet& packedMeshlet, const glm::vec4& meshSphere);
+
+	// Compact vertex encoding, the decoding is shared with the shaders
+	namespace VertexPacking
+	{
+		using namespace glm;
+#include "../Shaders/VertexPacking.h"
+	}
+	using VertexPacking::PackedVertex;
+	static_assert(sizeof(PackedVertex) == 12, "Same layout as in `VertexPacking.h`");
+
+	// Max errors of the packed vertices against the source ones: position in mesh units, normal angle in degrees, uv
+	struct VertexPackingError
+	{
+		float position = 0.0f;
+		float normal = 0.0f;
+		float uv = 0.0f;
+	};
+
+	// Packs vertices of `mesh`, 4 at a time with SSE on x86-64. `bSimd` false forces the scalar path, the results are the same.
+	void PackVertices(PackedVertex* dst, const Vertex* src, size_t count, const Mesh& mesh, bool bSimd = true);
+	VertexPackingError MeasureVertexPackingError(const PackedVertex* packed, const Vertex* src, size_t count, const Mesh& mesh);
+
+	// `lodParams` of the view uniforms, `errorThreshold` in pixels
+	glm::vec4 GetLodSelectionParams(const glm::mat4& projMatrix, float viewportHeight, float errorThreshold, float hysteresis);
+	// Same as `SelectLod()` in `MeshCommon.h`, `distance` is the view space distance to the bounding sphere of the draw
+	uint32_t SelectMeshLod(const Mesh& mesh, const glm::vec4& lodParams, float zNear, float distance, float scale, uint32_t lastLodIndex);
+
 	struct Geometry
 	{
 		std::vector<Vertex> vertices;
@@ -132,9 +252,71 @@ namespace Niagara
 		std::vector<Meshlet> meshlets;
 
 		std::vector<Mesh> meshes;
+		std::vector<MeshCluster> clusters;
+	};
+
+	// Read-only view of a geometry, either owned by a `Geometry` or mapped from a geometry cache
+	struct GeometryView
+	{
+		ArrayView<Vertex> vertices;
+		ArrayView<uint32_t> indices;
+		ArrayView<uint32_t> meshletData;
+		ArrayView<Meshlet> meshlets;
+
+		ArrayView<Mesh> meshes;
+		ArrayView<MeshCluster> clusters;
+
+		GeometryView() = default;
+		GeometryView(const Geometry& geometry)
+			: vertices{ geometry.vertices }, indices{ geometry.indices }, meshletData{ geometry.meshletData }, meshlets{ geometry.meshlets }, meshes{ geometry.meshes },
+			clusters{ geometry.clusters } { }
+	};
+
+	// `PackMeshletHeader` of all the meshlets of the lods and the clusters, with the sphere of their mesh. The meshlets of neither stay
+	// zero (empty).
+	void PackMeshletHeaders(std::vector<PackedMeshlet>& packedMeshlets, const GeometryView& geometry);
+	// `PackVertices` of all the meshes, in parallel on `g_JobSystem` if it's inited. `pErrors` receives the error of each mesh.
+	void PackMeshVertices(std::vector<PackedVertex>& packedVertices, const GeometryView& geometry, std::vector<VertexPackingError>* pErrors = nullptr);
+
+	// CPU timings of the mesh build stages in milliseconds, accumulated over all the meshes built with the same stats
+	struct MeshBuildStats
+	{
+		struct SimplifyRound
+		{
+			size_t sourceTriangleCount;
+			size_t resultTriangleCount;
+			double time;
+			// Lod error of the result in mesh units
+			float error;
+			// Fell back to `meshopt_simplifySloppy`
+			bool bSloppy;
+		};
+
+		double parseTime = 0.0;
+		double remapTime = 0.0;
+		double vertexCacheTime = 0.0;
+		double vertexFetchTime = 0.0;
+		std::vector<SimplifyRound> simplifyRounds;
+		double meshletBuildTime = 0.0;
+		// Meshlet bounds and meshlet data packing
+		double meshletBoundsTime = 0.0;
+
+		size_t triangleCount = 0;
+		size_t vertexCount = 0;
+		size_t meshletCount = 0;
 	};
 
-	size_t BuildOptMeshlets(Geometry& result, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+	size_t BuildOptMeshlets(Geometry& result, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, MeshBuildStats* pStats = nullptr);
+	// Recomputes the meshlet bounds and grows the mesh spheres of `geometry` for `vertices`, e.g. the lossy decoded ones of a compressed
+	// geometry, so that the culling stays conservative with them. `meshlets` and `meshes` are the ones of `geometry` to update.
+	void UpdateGeometryBounds(std::vector<Meshlet>& meshlets, std::vector<Mesh>& meshes, const GeometryView& geometry, const std::vector<Vertex>& vertices);
+	// Appends a single meshlet. `meshletVertices` index `vertices`, `meshletTriangles` has 3 meshlet local indices per triangle, padded to 4 bytes.
+	void AppendMeshlet(Geometry& result, const std::vector<Vertex>& vertices, const uint32_t* meshletVertices, uint32_t vertexCount, const uint8_t* meshletTriangles, uint32_t triangleCount);
 	bool LoadObj(std::vector<Vertex>& vertices, const char* path);
-	bool LoadMesh(Geometry& result, const char* path, bool bBuildMeshlets = true, bool bIndexless = false);
+	bool LoadMesh(Geometry& result, const char* path, bool bBuildMeshlets = true, bool bIndexless = false, MeshBuildStats* pStats = nullptr);
+	// Same as `LoadMesh` for an already triangulated mesh, `indices` can be empty for a plain triangle list
+	void BuildMesh(Geometry& result, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, bool bBuildMeshlets = true, MeshBuildStats* pStats = nullptr);
+	// Loads meshes in parallel on `g_JobSystem` (serially if it's not inited), the result is identical to calling `LoadMesh` in order.
+	// Returns the number of loaded meshes, `pLoaded` receives a flag per path.
+	size_t LoadMeshes(Geometry& result, const std::vector<std::string>& paths, bool bBuildMeshlets = true, std::vector<bool>* pLoaded = nullptr);
 }
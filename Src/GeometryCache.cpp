@@ -0,0 +1,269 @@
+#include "GeometryCache.h"
+#include "ClusterLod.h"
+#include <fstream>
+
+
+namespace Niagara
+{
+	static uint64_t AlignOffset(uint64_t offset)
+	{
+		return (offset + GEOMETRY_CACHE_ALIGNMENT - 1) & ~uint64_t(GEOMETRY_CACHE_ALIGNMENT - 1);
+	}
+
+	template <typename T>
+	static bool GetSection(ArrayView<T>& view, const MappedFile& file, const GeometryCacheHeader& header, GeometryCacheSection section)
+	{
+		const auto& desc = header.sections[static_cast<uint32_t>(section)];
+
+		if (desc.offset % GEOMETRY_CACHE_ALIGNMENT != 0 || desc.offset > file.GetSize() || desc.count > (file.GetSize() - desc.offset) / sizeof(T))
+			return false;
+
+		view = ArrayView<T>(reinterpret_cast<const T*>(file.GetData() + desc.offset), static_cast<size_t>(desc.count));
+		return true;
+	}
+
+	// Bits of a float setting, for the hashed settings
+	static uint32_t FloatBits(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	uint64_t GeometryCache::HashSources(const std::vector<std::string>& sourcePaths)
+	{
+		uint64_t hash = HashValue(sourcePaths.size());
+
+		for (const auto& path : sourcePaths)
+		{
+			MappedFile file;
+			if (!file.Open(path))
+				return 0;
+
+			hash = HashValue(file.GetSize(), hash);
+			hash = HashBytes(file.GetData(), file.GetSize(), hash);
+		}
+
+		return hash;
+	}
+
+	uint64_t GeometryCache::HashConfig(bool bBuildMeshlets, bool bCompressed, bool bClusterLod)
+	{
+		const uint32_t settings[] =
+		{
+			MESHLET_MAX_VERTICES,
+			MESHLET_MAX_PRIMITIVES,
+			MESH_MAX_LODS,
+			LOD_MIN_TRIANGLES,
+			FloatBits(LOD_TRIANGLE_RATIO),
+			FloatBits(LOD_MIN_PROGRESS),
+			FloatBits(LOD_NORMAL_WEIGHT),
+			FloatBits(LOD_UV_WEIGHT),
+			TASK_GROUP_SIZE,
+			USE_DEVICE_8BIT_16BIT_EXTENSIONS,
+			USE_PACKED_PRIMITIVE_INDICES_NV,
+			bBuildMeshlets ? 1u : 0u,
+			bCompressed ? 1u : 0u,
+			bClusterLod ? 1u : 0u,
+			GEOMETRY_CODEC_CHUNK_SIZE,
+			static_cast<uint32_t>(GEOMETRY_CODEC_POSITION_BITS),
+
+			// Layouts
+			static_cast<uint32_t>(sizeof(Vertex)),
+			static_cast<uint32_t>(sizeof(Meshlet)),
+			static_cast<uint32_t>(sizeof(Mesh)),
+			static_cast<uint32_t>(sizeof(MeshCluster)),
+			static_cast<uint32_t>(sizeof(CompressedGeometryChunk)),
+		};
+
+		return HashBytes(settings, sizeof(settings));
+	}
+
+	bool GeometryCache::Write(const std::string& cachePath, const Geometry& geometry, uint64_t sourceHash, uint64_t configHash, bool bCompressed)
+	{
+		GeometryView view(geometry);
+
+		CompressedGeometry compressedGeometry{};
+		if (bCompressed)
+		{
+			CompressGeometry(compressedGeometry, view);
+			view.vertices = {};
+			view.indices = {};
+			view.meshletData = {};
+		}
+		const CompressedGeometryView compressedView(compressedGeometry);
+
+		struct SectionData
+		{
+			const void* data;
+			size_t count;
+			size_t stride;
+		};
+		const SectionData sectionData[] =
+		{
+			{ view.vertices.data(), view.vertices.size(), sizeof(Vertex) },
+			{ view.indices.data(), view.indices.size(), sizeof(uint32_t) },
+			{ view.meshletData.data(), view.meshletData.size(), sizeof(uint32_t) },
+			{ view.meshlets.data(), view.meshlets.size(), sizeof(Meshlet) },
+			{ view.meshes.data(), view.meshes.size(), sizeof(Mesh) },
+			{ view.clusters.data(), view.clusters.size(), sizeof(MeshCluster) },
+			{ compressedView.chunks.data(), compressedView.chunks.size(), sizeof(CompressedGeometryChunk) },
+			{ compressedView.data.data(), compressedView.data.size(), sizeof(uint8_t) },
+		};
+		static_assert(ARRAYSIZE(sectionData) == static_cast<size_t>(GeometryCacheSection::Count), "Missing geometry cache section!");
+
+		GeometryCacheHeader header{};
+		header.magic = GEOMETRY_CACHE_MAGIC;
+		header.version = GEOMETRY_CACHE_VERSION;
+		header.sourceHash = sourceHash;
+		header.configHash = configHash;
+
+		uint64_t offset = AlignOffset(sizeof(GeometryCacheHeader));
+		for (size_t i = 0; i < ARRAYSIZE(sectionData); ++i)
+		{
+			header.sections[i].offset = offset;
+			header.sections[i].count = sectionData[i].count;
+			offset = AlignOffset(offset + sectionData[i].count * sectionData[i].stride);
+		}
+		header.fileSize = offset;
+
+		const std::string tempPath = cachePath + ".tmp";
+		{
+			std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+			if (!file.is_open())
+				return false;
+
+			static const char Padding[GEOMETRY_CACHE_ALIGNMENT] = {};
+
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			uint64_t written = sizeof(header);
+
+			for (size_t i = 0; i < ARRAYSIZE(sectionData); ++i)
+			{
+				file.write(Padding, static_cast<std::streamsize>(header.sections[i].offset - written));
+				file.write(reinterpret_cast<const char*>(sectionData[i].data), static_cast<std::streamsize>(sectionData[i].count * sectionData[i].stride));
+				written = header.sections[i].offset + sectionData[i].count * sectionData[i].stride;
+			}
+			file.write(Padding, static_cast<std::streamsize>(header.fileSize - written));
+
+			if (!file.good())
+			{
+				file.close();
+				std::remove(tempPath.c_str());
+				return false;
+			}
+		}
+
+		// Replace the old cache, it must not be mapped at this point
+		std::remove(cachePath.c_str());
+		if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0)
+		{
+			std::remove(tempPath.c_str());
+			return false;
+		}
+
+		return true;
+	}
+
+	bool GeometryCache::Load(const std::string& cachePath, uint64_t sourceHash, uint64_t configHash)
+	{
+		Close();
+
+		if (!m_File.Open(cachePath))
+			return false;
+
+		bool bValid = m_File.GetSize() >= sizeof(GeometryCacheHeader);
+
+		GeometryCacheHeader header{};
+		if (bValid)
+		{
+			memcpy(&header, m_File.GetData(), sizeof(header));
+
+			bValid = header.magic == GEOMETRY_CACHE_MAGIC &&
+				header.version == GEOMETRY_CACHE_VERSION &&
+				header.sourceHash == sourceHash &&
+				header.configHash == configHash &&
+				header.fileSize == m_File.GetSize();
+		}
+
+		bValid = bValid &&
+			GetSection(m_View.vertices, m_File, header, GeometryCacheSection::Vertices) &&
+			GetSection(m_View.indices, m_File, header, GeometryCacheSection::Indices) &&
+			GetSection(m_View.meshletData, m_File, header, GeometryCacheSection::MeshletData) &&
+			GetSection(m_View.meshlets, m_File, header, GeometryCacheSection::Meshlets) &&
+			GetSection(m_View.meshes, m_File, header, GeometryCacheSection::Meshes) &&
+			GetSection(m_View.clusters, m_File, header, GeometryCacheSection::Clusters) &&
+			GetSection(m_CompressedView.chunks, m_File, header, GeometryCacheSection::CompressedChunks) &&
+			GetSection(m_CompressedView.data, m_File, header, GeometryCacheSection::CompressedData);
+
+		if (bValid && !m_CompressedView.chunks.empty())
+		{
+			m_CompressedView.meshlets = m_View.meshlets;
+			m_CompressedView.meshes = m_View.meshes;
+			m_CompressedView.clusters = m_View.clusters;
+		}
+
+		if (!bValid)
+		{
+			Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	void GeometryCache::Close()
+	{
+		m_File.Close();
+		m_View = {};
+		m_CompressedView = {};
+	}
+
+	bool LoadCachedGeometry(GeometryCache& cache, Geometry& geometry, GeometryView& view, const std::string& cachePath, const std::vector<std::string>& sourcePaths, bool bBuildMeshlets,
+		bool bCompressed, bool bClusterLod)
+	{
+		bClusterLod = bClusterLod && bBuildMeshlets;
+
+		const uint64_t sourceHash = GeometryCache::HashSources(sourcePaths);
+		const uint64_t configHash = GeometryCache::HashConfig(bBuildMeshlets, bCompressed, bClusterLod);
+
+		if (sourceHash != 0 && cache.Load(cachePath, sourceHash, configHash))
+		{
+			view = cache.GetView();
+			return !view.meshes.empty();
+		}
+
+		cache.Close();
+
+		std::vector<bool> meshLoaded;
+		size_t loadedCount = LoadMeshes(geometry, sourcePaths, bBuildMeshlets, &meshLoaded);
+		for (size_t i = 0; i < meshLoaded.size(); ++i)
+		{
+			if (!meshLoaded[i])
+				printf("Load mesh failed: %s\n", sourcePaths[i].c_str());
+		}
+
+		if (bClusterLod)
+			BuildMeshClusterLods(geometry);
+
+		view = GeometryView(geometry);
+		if (loadedCount == 0)
+			return false;
+
+		// Only cache complete geometries, a missing source will be retried next time
+		if (sourceHash == 0 || loadedCount != sourcePaths.size())
+			return true;
+
+		if (GeometryCache::Write(cachePath, geometry, sourceHash, configHash, bCompressed) && cache.Load(cachePath, sourceHash, configHash))
+		{
+			view = cache.GetView();
+			geometry = {};
+		}
+		else
+		{
+			printf("Write geometry cache failed: %s\n", cachePath.c_str());
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "pch.h"
+#include "Config.h"
+#include "Utilities.h"
+#include "Geometry.h"
+#include "GeometryCodec.h"
+
+
+namespace Niagara
+{
+	/**
+	* Geometry cache (.ngeo)
+	* A cooked `Geometry` laid out so that it can be memory mapped and uploaded without any parsing or copying.
+	* File layout: `GeometryCacheHeader`, then each section (vertices, indices, meshlet data, meshlets, meshes, clusters) starting at
+	* a multiple of `GEOMETRY_CACHE_ALIGNMENT`. The header stores a hash of the source files and of the build settings,
+	* a cache whose hashes don't match is considered stale and rebuilt.
+	* A compressed cache leaves the vertex, index and meshlet data sections empty and stores the codec chunks instead, see
+	* `GeometryCodec.h`. Its streams have to be decoded before the upload.
+	*/
+	constexpr uint32_t GEOMETRY_CACHE_MAGIC = 0x4F45474E; // "NGEO"
+	constexpr uint32_t GEOMETRY_CACHE_VERSION = 9;
+	constexpr uint32_t GEOMETRY_CACHE_ALIGNMENT = 64;
+
+	enum class GeometryCacheSection : uint32_t
+	{
+		Vertices = 0,
+		Indices,
+		MeshletData,
+		Meshlets,
+		Meshes,
+		Clusters,
+		CompressedChunks,
+		CompressedData,
+
+		Count
+	};
+
+	struct GeometryCacheHeader
+	{
+		struct Section
+		{
+			uint64_t offset;
+			uint64_t count;
+		};
+
+		uint32_t magic;
+		uint32_t version;
+		uint64_t sourceHash;
+		uint64_t configHash;
+		uint64_t fileSize;
+
+		Section sections[static_cast<uint32_t>(GeometryCacheSection::Count)];
+	};
+
+	class GeometryCache
+	{
+	public:
+		GeometryCache() = default;
+		NON_COPYABLE(GeometryCache);
+
+		// Hash of the contents of all source files, 0 if any of them can't be read
+		static uint64_t HashSources(const std::vector<std::string>& sourcePaths);
+		// Hash of everything that changes the cooked data besides the sources
+		static uint64_t HashConfig(bool bBuildMeshlets, bool bCompressed, bool bClusterLod);
+
+		// Writes `geometry` to `cachePath`, via a temporary file so that a failed write never leaves a truncated cache behind
+		static bool Write(const std::string& cachePath, const Geometry& geometry, uint64_t sourceHash, uint64_t configHash, bool bCompressed = false);
+
+		// Maps `cachePath`, fails if the file is missing, corrupted or doesn't match the hashes
+		bool Load(const std::string& cachePath, uint64_t sourceHash, uint64_t configHash);
+		void Close();
+
+		bool IsLoaded() const { return m_File.IsOpen(); }
+		bool IsCompressed() const { return !m_CompressedView.chunks.empty(); }
+		// Views point into the mapped file, they're valid until `Close()`. The vertices, indices and meshlet data of a compressed
+		// cache are only in the compressed view.
+		const GeometryView& GetView() const { return m_View; }
+		const CompressedGeometryView& GetCompressedView() const { return m_CompressedView; }
+
+	private:
+		MappedFile m_File;
+		GeometryView m_View;
+		CompressedGeometryView m_CompressedView;
+	};
+
+	// Maps the cache of `sourcePaths` if it's up to date, otherwise loads the meshes into `geometry`, cooks the cache
+	// and maps it. `view` refers to the mapped cache, or to `geometry` if the cache couldn't be written.
+	// With `bCompressed` the cooked cache is compressed, check `cache.IsCompressed()` before using the streams of `view`.
+	// With `bClusterLod` and `bBuildMeshlets` the meshes get their cluster LOD DAG, see `BuildMeshClusterLods`.
+	// Returns false if no mesh could be loaded.
+	bool LoadCachedGeometry(GeometryCache& cache, Geometry& geometry, GeometryView& view, const std::string& cachePath, const std::vector<std::string>& sourcePaths, bool bBuildMeshlets = true,
+		bool bCompressed = false, bool bClusterLod = false);
+}
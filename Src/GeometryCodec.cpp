@@ -0,0 +1,328 @@
+#include "GeometryCodec.h"
+#include "JobSystem.h"
+
+#include "meshoptimizer.h"
+
+
+namespace Niagara
+{
+	// Octahedral normals, decoded to snorm components
+#if USE_DEVICE_8BIT_16BIT_EXTENSIONS
+	using OctNormal = int8_t;
+#else
+	using OctNormal = int16_t;
+#endif
+	constexpr size_t NORMAL_STRIDE = 4 * sizeof(OctNormal);
+	constexpr int NORMAL_BITS = 8 * sizeof(OctNormal);
+
+	constexpr size_t POSITION_STRIDE = sizeof(Vertex::p);
+	constexpr size_t UV_STRIDE = sizeof(Vertex::uv);
+
+	static glm::vec3 LoadNormal(const Vertex& v)
+	{
+#if USE_DEVICE_8BIT_16BIT_EXTENSIONS
+		glm::vec3 n = glm::vec3(v.n.x, v.n.y, v.n.z) / 127.0f - 1.0f;
+#else
+		glm::vec3 n = v.n;
+#endif
+		float length = glm::length(n);
+		return length > EPS ? n / length : glm::vec3(0.0f, 0.0f, 1.0f);
+	}
+
+	static void StoreNormal(Vertex& v, const OctNormal* n)
+	{
+#if USE_DEVICE_8BIT_16BIT_EXTENSIONS
+		// Same encoding as `LoadObj`, n * 127 + 127.5
+		v.n = glm::u8vec4(n[0] + 127, n[1] + 127, n[2] + 127, 0);
+#else
+		v.n = glm::vec3(n[0], n[1], n[2]) / 32767.0f;
+#endif
+	}
+
+	static uint32_t AppendEncodedVertices(std::vector<uint8_t>& data, const void* vertices, size_t count, size_t stride)
+	{
+		size_t offset = data.size();
+		data.resize(offset + meshopt_encodeVertexBufferBound(count, stride));
+
+		size_t size = meshopt_encodeVertexBuffer(data.data() + offset, data.size() - offset, vertices, count, stride);
+		data.resize(offset + size);
+
+		return static_cast<uint32_t>(size);
+	}
+
+	static uint32_t AppendEncodedIndices(std::vector<uint8_t>& data, const uint32_t* indices, size_t count)
+	{
+		size_t offset = data.size();
+		data.resize(offset + meshopt_encodeIndexBufferBound(count, ~0u));
+
+		size_t size = meshopt_encodeIndexBuffer(data.data() + offset, data.size() - offset, indices, count);
+		data.resize(offset + size);
+
+		return static_cast<uint32_t>(size);
+	}
+
+	static void EncodeChunk(CompressedGeometryChunk& chunk, std::vector<uint8_t>& data, const GeometryView& geometry, const std::vector<uint32_t>& filteredPositions)
+	{
+		const size_t begin = chunk.elementOffset;
+		const size_t count = chunk.elementCount;
+
+		switch (chunk.stream)
+		{
+		case GeometryStream::Vertices:
+		{
+			std::vector<float> normals(count * 4);
+			std::vector<OctNormal> octNormals(count * 4);
+			std::vector<uint8_t> uvs(count * UV_STRIDE);
+
+			for (size_t i = 0; i < count; ++i)
+			{
+				const Vertex& v = geometry.vertices[begin + i];
+
+				glm::vec3 n = LoadNormal(v);
+				normals[i * 4 + 0] = n.x;
+				normals[i * 4 + 1] = n.y;
+				normals[i * 4 + 2] = n.z;
+				normals[i * 4 + 3] = 0.0f;
+
+				memcpy(&uvs[i * UV_STRIDE], &v.uv, UV_STRIDE);
+			}
+			meshopt_encodeFilterOct(octNormals.data(), count, NORMAL_STRIDE, NORMAL_BITS, normals.data());
+
+			chunk.dataSizes[static_cast<uint32_t>(GeometryCodecPart::Position)] = AppendEncodedVertices(data, &filteredPositions[begin * 3], count, POSITION_STRIDE);
+			chunk.dataSizes[static_cast<uint32_t>(GeometryCodecPart::Normal)] = AppendEncodedVertices(data, octNormals.data(), count, NORMAL_STRIDE);
+			chunk.dataSizes[static_cast<uint32_t>(GeometryCodecPart::Uv)] = AppendEncodedVertices(data, uvs.data(), count, UV_STRIDE);
+			break;
+		}
+
+		case GeometryStream::Indices:
+			chunk.dataSizes[0] = AppendEncodedIndices(data, geometry.indices.data() + begin, count);
+			break;
+
+		case GeometryStream::MeshletData:
+			chunk.dataSizes[0] = AppendEncodedVertices(data, geometry.meshletData.data() + begin, count, sizeof(uint32_t));
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	static bool DecodeChunk(uint8_t* dst, const CompressedGeometryView& geometry, const CompressedGeometryChunk& chunk)
+	{
+		const uint8_t* data = geometry.data.data() + chunk.dataOffset;
+		const size_t count = chunk.elementCount;
+
+		dst += chunk.elementOffset * GetGeometryStreamStride(chunk.stream);
+
+		switch (chunk.stream)
+		{
+		case GeometryStream::Vertices:
+		{
+			const uint32_t positionSize = chunk.dataSizes[static_cast<uint32_t>(GeometryCodecPart::Position)];
+			const uint32_t normalSize = chunk.dataSizes[static_cast<uint32_t>(GeometryCodecPart::Normal)];
+			const uint32_t uvSize = chunk.dataSizes[static_cast<uint32_t>(GeometryCodecPart::Uv)];
+
+			// Attributes are decoded and unfiltered in a scratch buffer, then interleaved into `dst`
+			std::vector<uint8_t> scratch(count * (POSITION_STRIDE + NORMAL_STRIDE + UV_STRIDE));
+			uint8_t* positions = scratch.data();
+			uint8_t* normals = positions + count * POSITION_STRIDE;
+			uint8_t* uvs = normals + count * NORMAL_STRIDE;
+
+			if (meshopt_decodeVertexBuffer(positions, count, POSITION_STRIDE, data, positionSize) != 0 ||
+				meshopt_decodeVertexBuffer(normals, count, NORMAL_STRIDE, data + positionSize, normalSize) != 0 ||
+				meshopt_decodeVertexBuffer(uvs, count, UV_STRIDE, data + positionSize + normalSize, uvSize) != 0)
+				return false;
+
+			meshopt_decodeFilterExp(positions, count, POSITION_STRIDE);
+			meshopt_decodeFilterOct(normals, count, NORMAL_STRIDE);
+
+			Vertex* vertices = reinterpret_cast<Vertex*>(dst);
+			for (size_t i = 0; i < count; ++i)
+			{
+				Vertex v{};
+				memcpy(&v.p, positions + i * POSITION_STRIDE, POSITION_STRIDE);
+				StoreNormal(v, reinterpret_cast<const OctNormal*>(normals + i * NORMAL_STRIDE));
+				memcpy(&v.uv, uvs + i * UV_STRIDE, UV_STRIDE);
+
+				vertices[i] = v;
+			}
+			return true;
+		}
+
+		case GeometryStream::Indices:
+			return meshopt_decodeIndexBuffer(dst, count, sizeof(uint32_t), data, chunk.dataSizes[0]) == 0;
+
+		case GeometryStream::MeshletData:
+			return meshopt_decodeVertexBuffer(dst, count, sizeof(uint32_t), data, chunk.dataSizes[0]) == 0;
+
+		default:
+			return false;
+		}
+	}
+
+	static bool IsChunkValid(const CompressedGeometryView& geometry, const CompressedGeometryChunk& chunk, size_t elementCount)
+	{
+		uint64_t dataSize = 0;
+		for (uint32_t size : chunk.dataSizes)
+			dataSize += size;
+
+		return chunk.elementOffset <= elementCount && chunk.elementCount <= elementCount - chunk.elementOffset &&
+			chunk.dataOffset <= geometry.data.size() && dataSize <= geometry.data.size() - chunk.dataOffset;
+	}
+
+	size_t CompressedGeometryView::GetElementCount(GeometryStream stream) const
+	{
+		size_t count = 0;
+		for (const auto& chunk : chunks)
+		{
+			if (chunk.stream == stream)
+				count += chunk.elementCount;
+		}
+
+		return count;
+	}
+
+	size_t CompressedGeometryView::GetDecodedSize(GeometryStream stream) const
+	{
+		return GetElementCount(stream) * GetGeometryStreamStride(stream);
+	}
+
+	size_t GetGeometryStreamStride(GeometryStream stream)
+	{
+		switch (stream)
+		{
+		case GeometryStream::Vertices:		return sizeof(Vertex);
+		case GeometryStream::Indices:		return sizeof(uint32_t);
+		case GeometryStream::MeshletData:	return sizeof(uint32_t);
+		default:							return 0;
+		}
+	}
+
+	void CompressGeometry(CompressedGeometry& result, const GeometryView& geometry)
+	{
+		result = {};
+		result.meshlets.assign(geometry.meshlets.begin(), geometry.meshlets.end());
+		result.meshes.assign(geometry.meshes.begin(), geometry.meshes.end());
+		result.clusters.assign(geometry.clusters.begin(), geometry.clusters.end());
+
+		// The exponent filter runs over the whole stream, chunks must not pick their own exponents
+		const size_t vertexCount = geometry.vertices.size();
+		std::vector<uint32_t> filteredPositions(vertexCount * 3);
+		if (vertexCount > 0)
+		{
+			std::vector<float> positions(vertexCount * 3);
+			for (size_t i = 0; i < vertexCount; ++i)
+				memcpy(&positions[i * 3], &geometry.vertices[i].p, POSITION_STRIDE);
+
+			meshopt_encodeFilterExp(filteredPositions.data(), vertexCount, POSITION_STRIDE, GEOMETRY_CODEC_POSITION_BITS, positions.data(), meshopt_EncodeExpSharedComponent);
+		}
+
+		const size_t elementCounts[] = { vertexCount, geometry.indices.size(), geometry.meshletData.size() };
+		static_assert(ARRAYSIZE(elementCounts) == static_cast<size_t>(GeometryStream::Count), "Missing geometry stream!");
+
+		for (uint32_t stream = 0; stream < static_cast<uint32_t>(GeometryStream::Count); ++stream)
+		{
+			for (size_t offset = 0; offset < elementCounts[stream]; offset += GEOMETRY_CODEC_CHUNK_SIZE)
+			{
+				CompressedGeometryChunk chunk{};
+				chunk.stream = static_cast<GeometryStream>(stream);
+				chunk.elementOffset = static_cast<uint32_t>(offset);
+				chunk.elementCount = static_cast<uint32_t>(std::min<size_t>(GEOMETRY_CODEC_CHUNK_SIZE, elementCounts[stream] - offset));
+				result.chunks.push_back(chunk);
+			}
+		}
+
+		const uint32_t chunkCount = static_cast<uint32_t>(result.chunks.size());
+		std::vector<std::vector<uint8_t>> chunkData(chunkCount);
+
+		auto Encode = [&](uint32_t i) { EncodeChunk(result.chunks[i], chunkData[i], geometry, filteredPositions); };
+
+		if (g_JobSystem.IsInited())
+		{
+			JobCounter counter;
+			g_JobSystem.ParallelFor(counter, chunkCount, 1, Encode);
+			g_JobSystem.Wait(counter);
+		}
+		else
+		{
+			for (uint32_t i = 0; i < chunkCount; ++i)
+				Encode(i);
+		}
+
+		size_t dataSize = 0;
+		for (const auto& data : chunkData)
+			dataSize += data.size();
+
+		result.data.reserve(dataSize);
+		for (uint32_t i = 0; i < chunkCount; ++i)
+		{
+			result.chunks[i].dataOffset = result.data.size();
+			result.data.insert(result.data.end(), chunkData[i].begin(), chunkData[i].end());
+		}
+
+		// The culling bounds must contain the decoded positions, not the source ones
+		if (vertexCount > 0)
+		{
+			std::vector<Vertex> decodedVertices(vertexCount);
+			bool bDecoded = DecodeGeometryStream(decodedVertices.data(), CompressedGeometryView(result), GeometryStream::Vertices);
+			assert(bDecoded);
+			if (bDecoded)
+				UpdateGeometryBounds(result.meshlets, result.meshes, geometry, decodedVertices);
+		}
+	}
+
+	bool DecodeGeometryStream(void* dst, const CompressedGeometryView& geometry, GeometryStream stream)
+	{
+		const size_t elementCount = geometry.GetElementCount(stream);
+
+		std::vector<uint32_t> chunkIndices;
+		for (uint32_t i = 0; i < static_cast<uint32_t>(geometry.chunks.size()); ++i)
+		{
+			const auto& chunk = geometry.chunks[i];
+			if (chunk.stream != stream)
+				continue;
+
+			if (!IsChunkValid(geometry, chunk, elementCount))
+				return false;
+
+			chunkIndices.push_back(i);
+		}
+
+		std::atomic<bool> bFailed{ false };
+		auto Decode = [&](uint32_t i)
+		{
+			if (!DecodeChunk(static_cast<uint8_t*>(dst), geometry, geometry.chunks[chunkIndices[i]]))
+				bFailed.store(true, std::memory_order_relaxed);
+		};
+
+		const uint32_t chunkCount = static_cast<uint32_t>(chunkIndices.size());
+		if (g_JobSystem.IsInited())
+		{
+			JobCounter counter;
+			g_JobSystem.ParallelFor(counter, chunkCount, 1, Decode);
+			g_JobSystem.Wait(counter);
+		}
+		else
+		{
+			for (uint32_t i = 0; i < chunkCount; ++i)
+				Decode(i);
+		}
+
+		return !bFailed.load();
+	}
+
+	bool DecompressGeometry(Geometry& result, const CompressedGeometryView& geometry)
+	{
+		result = {};
+		result.vertices.resize(geometry.GetElementCount(GeometryStream::Vertices));
+		result.indices.resize(geometry.GetElementCount(GeometryStream::Indices));
+		result.meshletData.resize(geometry.GetElementCount(GeometryStream::MeshletData));
+		result.meshlets.assign(geometry.meshlets.begin(), geometry.meshlets.end());
+		result.meshes.assign(geometry.meshes.begin(), geometry.meshes.end());
+		result.clusters.assign(geometry.clusters.begin(), geometry.clusters.end());
+
+		return DecodeGeometryStream(result.vertices.data(), geometry, GeometryStream::Vertices) &&
+			DecodeGeometryStream(result.indices.data(), geometry, GeometryStream::Indices) &&
+			DecodeGeometryStream(result.meshletData.data(), geometry, GeometryStream::MeshletData);
+	}
+}
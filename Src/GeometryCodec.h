@@ -0,0 +1,94 @@
+#pragma once
+
+#include "pch.h"
+#include "Config.h"
+#include "Utilities.h"
+#include "Geometry.h"
+
+
+namespace Niagara
+{
+	/**
+	* Geometry codec
+	* Compresses the vertex, index and meshlet data streams of a `Geometry` with the meshoptimizer codecs. The streams are split
+	* into chunks that are encoded and decoded independently, so a decode can be spread over the job system and written straight
+	* into mapped staging memory.
+	* Vertices are stored per attribute: positions go through the exponent filter with a shared exponent per component (the
+	* whole stream shares it, so equal positions always decode to equal values and no cracks open along the seams), normals
+	* through the octahedral filter, uvs are stored as is. Indices use the index codec, meshlet data the vertex codec with a
+	* 4 byte stride. Positions and normals are lossy, everything else round trips exactly. The meshlet and mesh bounds of the
+	* compressed geometry are recomputed from the decoded positions, so they stay conservative.
+	*/
+	// Elements per chunk, a multiple of 3 so that index chunks hold whole triangles
+	constexpr uint32_t GEOMETRY_CODEC_CHUNK_SIZE = 3 * 32 * 1024;
+	// Mantissa bits of the exponent filtered positions
+	constexpr int GEOMETRY_CODEC_POSITION_BITS = 16;
+
+	enum class GeometryStream : uint32_t
+	{
+		Vertices = 0,
+		Indices,
+		MeshletData,
+
+		Count
+	};
+
+	enum class GeometryCodecPart : uint32_t
+	{
+		Position = 0,
+		Normal,
+		Uv,
+
+		Count
+	};
+
+	struct CompressedGeometryChunk
+	{
+		GeometryStream stream;
+		uint32_t elementOffset;
+		uint32_t elementCount;
+		// Vertex chunks store one encoded buffer per `GeometryCodecPart` back to back, the other streams only use the first one
+		uint32_t dataSizes[static_cast<uint32_t>(GeometryCodecPart::Count)];
+		uint64_t dataOffset;
+	};
+
+	struct CompressedGeometry
+	{
+		std::vector<CompressedGeometryChunk> chunks;
+		std::vector<uint8_t> data;
+
+		// Small enough to be kept uncompressed
+		std::vector<Meshlet> meshlets;
+		std::vector<Mesh> meshes;
+		std::vector<MeshCluster> clusters;
+	};
+
+	// Read-only view of a compressed geometry, either owned by a `CompressedGeometry` or mapped from a geometry cache
+	struct CompressedGeometryView
+	{
+		ArrayView<CompressedGeometryChunk> chunks;
+		ArrayView<uint8_t> data;
+
+		ArrayView<Meshlet> meshlets;
+		ArrayView<Mesh> meshes;
+		ArrayView<MeshCluster> clusters;
+
+		CompressedGeometryView() = default;
+		CompressedGeometryView(const CompressedGeometry& geometry)
+			: chunks{ geometry.chunks }, data{ geometry.data }, meshlets{ geometry.meshlets }, meshes{ geometry.meshes }, clusters{ geometry.clusters } { }
+
+		size_t GetElementCount(GeometryStream stream) const;
+		size_t GetDecodedSize(GeometryStream stream) const;
+	};
+
+	size_t GetGeometryStreamStride(GeometryStream stream);
+
+	// Chunks are encoded in parallel on `g_JobSystem` if it's inited
+	void CompressGeometry(CompressedGeometry& result, const GeometryView& geometry);
+
+	// Decodes `stream` into `dst`, which must hold `GetDecodedSize(stream)` bytes. `dst` is only written to, sequentially per chunk,
+	// so it can point to write-combined memory. Chunks are decoded in parallel on `g_JobSystem` if it's inited.
+	// Returns false if any chunk is corrupted.
+	bool DecodeGeometryStream(void* dst, const CompressedGeometryView& geometry, GeometryStream stream);
+	bool DecompressGeometry(Geometry& result, const CompressedGeometryView& geometry);
+}
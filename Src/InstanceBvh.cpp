@@ -0,0 +1,352 @@
+#include "InstanceBvh.h"
+#include "CpuCulling.h"
+#include "JobSystem.h"
+#include <cfloat>
+
+
+namespace Niagara
+{
+	// Levels split serially, the subtrees below are built in parallel
+	static const uint32_t s_BvhParallelDepth = 6;
+	static const uint32_t s_BvhChunkSize = 64 * 1024;
+
+	struct BvhBuildContext
+	{
+		const glm::vec4* spheres;
+		const uint32_t* drawIndices;
+		const uint32_t* codes;
+		uint32_t leafSize;
+	};
+
+	struct BvhSubtree
+	{
+		uint32_t begin;
+		uint32_t end;
+
+		std::vector<InstanceBvhNode> nodes;
+		uint32_t leafCount;
+		uint32_t depth;
+	};
+
+	static void RunBvhJobs(uint32_t count, const JobSystem::IndexedJobFunc& func)
+	{
+		if (g_JobSystem.IsInited() && count > 1)
+		{
+			JobCounter counter;
+			g_JobSystem.ParallelFor(counter, count, 1, func);
+			g_JobSystem.Wait(counter);
+		}
+		else
+		{
+			for (uint32_t i = 0; i < count; ++i)
+				func(i);
+		}
+	}
+
+	// Inserts two zero bits before each of the 10 low bits
+	static uint32_t ExpandBits(uint32_t v)
+	{
+		v = (v * 0x00010001u) & 0xFF0000FFu;
+		v = (v * 0x00000101u) & 0x0F00F00Fu;
+		v = (v * 0x00000011u) & 0xC30C30C3u;
+		v = (v * 0x00000005u) & 0x49249249u;
+		return v;
+	}
+
+	// `p` in [0, 1]
+	static uint32_t GetMortonCode(const glm::vec3& p)
+	{
+		const uint32_t x = static_cast<uint32_t>(std::clamp(p.x * 1024.0f, 0.0f, 1023.0f));
+		const uint32_t y = static_cast<uint32_t>(std::clamp(p.y * 1024.0f, 0.0f, 1023.0f));
+		const uint32_t z = static_cast<uint32_t>(std::clamp(p.z * 1024.0f, 0.0f, 1023.0f));
+		return (ExpandBits(x) << 2) | (ExpandBits(y) << 1) | ExpandBits(z);
+	}
+
+	// Sorts chunks on the job system, then merges pairs of sorted runs level by level
+	static void ParallelSort(std::vector<uint64_t>& keys)
+	{
+		const size_t count = keys.size();
+		const uint32_t chunkCount = static_cast<uint32_t>((count + s_BvhChunkSize - 1) / s_BvhChunkSize);
+
+		RunBvhJobs(chunkCount, [&](uint32_t i)
+			{
+				const size_t begin = size_t(i) * s_BvhChunkSize;
+				std::sort(keys.begin() + begin, keys.begin() + std::min(count, begin + s_BvhChunkSize));
+			});
+
+		for (uint32_t width = 1; width < chunkCount; width *= 2)
+		{
+			RunBvhJobs(DivideAndRoundUp(chunkCount, 2 * width), [&](uint32_t i)
+				{
+					const size_t begin = size_t(i) * 2 * width * s_BvhChunkSize;
+					const size_t middle = std::min(count, begin + size_t(width) * s_BvhChunkSize);
+					const size_t end = std::min(count, begin + size_t(2) * width * s_BvhChunkSize);
+					if (middle < end)
+						std::inplace_merge(keys.begin() + begin, keys.begin() + middle, keys.begin() + end);
+				});
+		}
+	}
+
+	// First draw of the right child, at the highest bit that differs in [begin, end), or the middle if all the codes are equal
+	static uint32_t FindSplit(const BvhBuildContext& ctx, uint32_t begin, uint32_t end)
+	{
+		const uint32_t first = ctx.codes[begin], last = ctx.codes[end - 1];
+		if (first == last)
+			return begin + (end - begin) / 2;
+
+		// Codes are sorted, the ones with this bit set come last
+		const uint32_t bit = 1u << FloorLog2(first ^ last);
+		return static_cast<uint32_t>(std::partition_point(ctx.codes + begin, ctx.codes + end, [bit](uint32_t code) { return (code & bit) == 0; }) - ctx.codes);
+	}
+
+	// Covers the float error of the merges and of the view transform of the culling, which must stay conservative
+	static glm::vec4 PadSphere(glm::vec4 sphere)
+	{
+		sphere.w += 1e-5f * (sphere.w + std::max(fabsf(sphere.x), std::max(fabsf(sphere.y), fabsf(sphere.z))));
+		return sphere;
+	}
+
+	static glm::vec4 MergeSpheres(const glm::vec4& a, const glm::vec4& b)
+	{
+		const glm::vec3 ca{ a.x, a.y, a.z };
+		const glm::vec3 cb{ b.x, b.y, b.z };
+		const float distance = glm::length(cb - ca);
+
+		if (distance + b.w <= a.w)
+			return a;
+		if (distance + a.w <= b.w)
+			return b;
+
+		const float radius = (distance + a.w + b.w) * 0.5f;
+		const glm::vec3 center = ca + (cb - ca) * ((radius - a.w) / distance);
+		return PadSphere(glm::vec4(center.x, center.y, center.z, radius));
+	}
+
+	static glm::vec4 GetLeafSphere(const BvhBuildContext& ctx, uint32_t begin, uint32_t end)
+	{
+		glm::vec3 minBounds{ FLT_MAX }, maxBounds{ -FLT_MAX };
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			const glm::vec4& sphere = ctx.spheres[ctx.drawIndices[i]];
+			minBounds = glm::min(minBounds, glm::vec3(sphere.x - sphere.w, sphere.y - sphere.w, sphere.z - sphere.w));
+			maxBounds = glm::max(maxBounds, glm::vec3(sphere.x + sphere.w, sphere.y + sphere.w, sphere.z + sphere.w));
+		}
+
+		const glm::vec3 center = (minBounds + maxBounds) * 0.5f;
+		float radius = 0.0f;
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			const glm::vec4& sphere = ctx.spheres[ctx.drawIndices[i]];
+			radius = std::max(radius, glm::length(glm::vec3(sphere.x, sphere.y, sphere.z) - center) + sphere.w);
+		}
+
+		return PadSphere(glm::vec4(center.x, center.y, center.z, radius));
+	}
+
+	// Appends the subtree of the draws [begin, end) depth first, skip indices relative to `nodes`. Returns its depth.
+	static uint32_t BuildSubtree(std::vector<InstanceBvhNode>& nodes, uint32_t& leafCount, const BvhBuildContext& ctx, uint32_t begin, uint32_t end)
+	{
+		const uint32_t nodeIndex = static_cast<uint32_t>(nodes.size());
+		nodes.push_back({});
+		nodes[nodeIndex].drawOffset = begin;
+		nodes[nodeIndex].drawCount = end - begin;
+
+		if (end - begin <= ctx.leafSize)
+		{
+			nodes[nodeIndex].boundingSphere = GetLeafSphere(ctx, begin, end);
+			nodes[nodeIndex].skipIndex = nodeIndex + 1;
+			nodes[nodeIndex].leaf = 1;
+			++leafCount;
+			return 1;
+		}
+
+		const uint32_t split = FindSplit(ctx, begin, end);
+		const uint32_t leftDepth = BuildSubtree(nodes, leafCount, ctx, begin, split);
+		const uint32_t rightIndex = static_cast<uint32_t>(nodes.size());
+		const uint32_t rightDepth = BuildSubtree(nodes, leafCount, ctx, split, end);
+
+		nodes[nodeIndex].boundingSphere = MergeSpheres(nodes[nodeIndex + 1].boundingSphere, nodes[rightIndex].boundingSphere);
+		nodes[nodeIndex].skipIndex = static_cast<uint32_t>(nodes.size());
+		nodes[nodeIndex].leaf = 0;
+
+		return 1 + std::max(leftDepth, rightDepth);
+	}
+
+	static bool IsSubtreeRoot(const BvhBuildContext& ctx, uint32_t begin, uint32_t end, uint32_t depth)
+	{
+		return depth == s_BvhParallelDepth || end - begin <= ctx.leafSize;
+	}
+
+	// The subtrees below the serial levels, in depth first order
+	static void CollectSubtrees(std::vector<BvhSubtree>& subtrees, const BvhBuildContext& ctx, uint32_t begin, uint32_t end, uint32_t depth)
+	{
+		if (IsSubtreeRoot(ctx, begin, end, depth))
+		{
+			subtrees.push_back({ begin, end });
+			return;
+		}
+
+		const uint32_t split = FindSplit(ctx, begin, end);
+		CollectSubtrees(subtrees, ctx, begin, split, depth + 1);
+		CollectSubtrees(subtrees, ctx, split, end, depth + 1);
+	}
+
+	// Same recursion as `CollectSubtrees`, appends the serial levels and the built subtrees depth first. Returns the depth.
+	static uint32_t EmitNodes(InstanceBvh& bvh, std::vector<BvhSubtree>& subtrees, uint32_t& subtreeIndex, const BvhBuildContext& ctx, uint32_t begin, uint32_t end, uint32_t depth)
+	{
+		if (IsSubtreeRoot(ctx, begin, end, depth))
+		{
+			BvhSubtree& subtree = subtrees[subtreeIndex++];
+			assert(subtree.begin == begin && subtree.end == end);
+
+			const uint32_t baseIndex = static_cast<uint32_t>(bvh.nodes.size());
+			for (auto& node : subtree.nodes)
+				node.skipIndex += baseIndex;
+			bvh.nodes.insert(bvh.nodes.end(), subtree.nodes.begin(), subtree.nodes.end());
+			bvh.leafCount += subtree.leafCount;
+
+			return subtree.depth;
+		}
+
+		const uint32_t nodeIndex = static_cast<uint32_t>(bvh.nodes.size());
+		bvh.nodes.push_back({});
+		bvh.nodes[nodeIndex].drawOffset = begin;
+		bvh.nodes[nodeIndex].drawCount = end - begin;
+
+		const uint32_t split = FindSplit(ctx, begin, end);
+		const uint32_t leftDepth = EmitNodes(bvh, subtrees, subtreeIndex, ctx, begin, split, depth + 1);
+		const uint32_t rightIndex = static_cast<uint32_t>(bvh.nodes.size());
+		const uint32_t rightDepth = EmitNodes(bvh, subtrees, subtreeIndex, ctx, split, end, depth + 1);
+
+		bvh.nodes[nodeIndex].boundingSphere = MergeSpheres(bvh.nodes[nodeIndex + 1].boundingSphere, bvh.nodes[rightIndex].boundingSphere);
+		bvh.nodes[nodeIndex].skipIndex = static_cast<uint32_t>(bvh.nodes.size());
+		bvh.nodes[nodeIndex].leaf = 0;
+
+		return 1 + std::max(leftDepth, rightDepth);
+	}
+
+	void BuildInstanceBvh(InstanceBvh& bvh, const std::vector<glm::vec4>& spheres, uint32_t leafSize)
+	{
+		bvh.nodes.clear();
+		bvh.drawIndices.clear();
+		bvh.leafCount = 0;
+		bvh.depth = 0;
+
+		const uint32_t drawCount = static_cast<uint32_t>(spheres.size());
+		if (drawCount == 0)
+			return;
+
+		// Morton codes of the centers, in the bounds of the centers
+		glm::vec3 minBounds{ FLT_MAX }, maxBounds{ -FLT_MAX };
+		for (const auto& sphere : spheres)
+		{
+			minBounds = glm::min(minBounds, glm::vec3(sphere.x, sphere.y, sphere.z));
+			maxBounds = glm::max(maxBounds, glm::vec3(sphere.x, sphere.y, sphere.z));
+		}
+		const glm::vec3 invExtent = 1.0f / glm::max(maxBounds - minBounds, glm::vec3(EPS));
+
+		// Code in the high bits, draw index in the low bits, the order only depends on the input
+		std::vector<uint64_t> keys(drawCount);
+		const uint32_t chunkCount = DivideAndRoundUp(drawCount, s_BvhChunkSize);
+		RunBvhJobs(chunkCount, [&](uint32_t chunkIndex)
+			{
+				const uint32_t begin = chunkIndex * s_BvhChunkSize;
+				const uint32_t end = std::min(drawCount, begin + s_BvhChunkSize);
+				for (uint32_t i = begin; i < end; ++i)
+				{
+					const glm::vec3 p = (glm::vec3(spheres[i].x, spheres[i].y, spheres[i].z) - minBounds) * invExtent;
+					keys[i] = (uint64_t(GetMortonCode(p)) << 32) | i;
+				}
+			});
+
+		ParallelSort(keys);
+
+		std::vector<uint32_t> codes(drawCount);
+		bvh.drawIndices.resize(drawCount);
+		for (uint32_t i = 0; i < drawCount; ++i)
+		{
+			codes[i] = static_cast<uint32_t>(keys[i] >> 32);
+			bvh.drawIndices[i] = static_cast<uint32_t>(keys[i]);
+		}
+
+		BvhBuildContext ctx;
+		ctx.spheres = spheres.data();
+		ctx.drawIndices = bvh.drawIndices.data();
+		ctx.codes = codes.data();
+		ctx.leafSize = std::max(1u, leafSize);
+
+		std::vector<BvhSubtree> subtrees;
+		CollectSubtrees(subtrees, ctx, 0, drawCount, 0);
+
+		RunBvhJobs(static_cast<uint32_t>(subtrees.size()), [&](uint32_t i)
+			{
+				auto& subtree = subtrees[i];
+				subtree.leafCount = 0;
+				subtree.depth = BuildSubtree(subtree.nodes, subtree.leafCount, ctx, subtree.begin, subtree.end);
+			});
+
+		size_t nodeCount = 0;
+		for (const auto& subtree : subtrees)
+			nodeCount += subtree.nodes.size();
+		bvh.nodes.reserve(nodeCount + subtrees.size());
+
+		uint32_t subtreeIndex = 0;
+		bvh.depth = EmitNodes(bvh, subtrees, subtreeIndex, ctx, 0, drawCount, 0);
+	}
+
+	/// CPU reference traversal
+
+	// `FrustumCull` of a view space sphere, the signed distances to the planes are positive outside
+	static EBvhVisibility ClassifySphere(const glm::vec4& sphere, const CullView& view)
+	{
+		// Closest of the L/R and of the U/D planes
+		const float distanceX = -fabsf(sphere.x) * view.frustumValues.x + sphere.z * view.frustumValues.y;
+		const float distanceY = -fabsf(sphere.y) * view.frustumValues.z + sphere.z * view.frustumValues.w;
+		// Near/Far
+		const float distanceNear = sphere.z + view.zNearFar.x;
+		const float distanceFar = -view.zNearFar.y - sphere.z;
+
+		const float distance = std::max(std::max(distanceX, distanceY), std::max(distanceNear, distanceFar));
+		if (distance > sphere.w)
+			return EBvhVisibility::Culled;
+		if (distance < -sphere.w)
+			return EBvhVisibility::Inside;
+		return EBvhVisibility::Intersecting;
+	}
+
+	static void AppendRange(std::vector<InstanceBvhRange>& ranges, uint32_t begin, uint32_t end, EBvhVisibility visibility)
+	{
+		if (!ranges.empty() && ranges.back().end == begin && ranges.back().visibility == visibility)
+			ranges.back().end = end;
+		else
+			ranges.push_back({ begin, end, visibility });
+	}
+
+	uint32_t CullInstanceBvh(std::vector<InstanceBvhRange>& ranges, const InstanceBvh& bvh, const CullView& view)
+	{
+		const uint32_t nodeCount = static_cast<uint32_t>(bvh.nodes.size());
+		uint32_t visitedCount = 0;
+
+		uint32_t nodeIndex = 0;
+		while (nodeIndex < nodeCount)
+		{
+			const InstanceBvhNode& node = bvh.nodes[nodeIndex];
+			++visitedCount;
+
+			const glm::vec4 center = view.viewMatrix * glm::vec4(node.boundingSphere.x, node.boundingSphere.y, node.boundingSphere.z, 1.0f);
+			const EBvhVisibility visibility = ClassifySphere(glm::vec4(center.x, center.y, center.z, node.boundingSphere.w), view);
+
+			// Descend
+			if (visibility == EBvhVisibility::Intersecting && node.leaf == 0)
+			{
+				++nodeIndex;
+				continue;
+			}
+
+			AppendRange(ranges, node.drawOffset, node.drawOffset + node.drawCount, visibility);
+			nodeIndex = node.skipIndex;
+		}
+
+		return visitedCount;
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "pch.h"
+#include "Config.h"
+#include "Utilities.h"
+
+
+namespace Niagara
+{
+	struct CullView;
+
+	/**
+	* Instance BVH
+	* Bounding sphere hierarchy over the draws of a scene, the culling rejects (or accepts) whole subtrees of draws instead of
+	* testing each one of them. Draws are sorted along the Morton curve of their centers and split top-down at the highest
+	* differing bit of their codes (linear BVH). The top of the tree is split serially, its subtrees are built on the job system.
+	* Nodes are stored depth first, in 32 bytes with std430 layout. A node is followed by its subtree, `skipIndex` is the node after
+	* it, so the traversal is a loop without a stack: descend by going to the next node, reject the subtree by going to `skipIndex`.
+	* The draws of a subtree are a contiguous range of `drawIndices`.
+	*/
+	struct alignas(16) InstanceBvhNode
+	{
+		glm::vec4 boundingSphere; // world space, encloses the bounding spheres of the draws of the subtree
+		uint32_t drawOffset; // in `InstanceBvh::drawIndices`
+		uint32_t drawCount;
+		uint32_t skipIndex;
+		uint32_t leaf; // 1 - no child nodes
+	};
+
+	struct InstanceBvh
+	{
+		std::vector<InstanceBvhNode> nodes;
+		// Draws in Morton order
+		std::vector<uint32_t> drawIndices;
+
+		uint32_t leafCount = 0;
+		uint32_t depth = 0;
+	};
+
+	// `spheres` are the world space bounding spheres of the draws. The result doesn't depend on the thread count.
+	void BuildInstanceBvh(InstanceBvh& bvh, const std::vector<glm::vec4>& spheres, uint32_t leafSize = INSTANCE_BVH_LEAF_SIZE);
+
+	/// CPU reference traversal
+
+	enum class EBvhVisibility : uint8_t
+	{
+		Culled,
+		// The draws need their own frustum test
+		Intersecting,
+		Inside
+	};
+
+	struct InstanceBvhRange
+	{
+		// In `InstanceBvh::drawIndices`
+		uint32_t begin;
+		uint32_t end;
+		EBvhVisibility visibility;
+	};
+
+	// Frustum culls the nodes with the test of `FrustumCull` (Common.h). Appends the draw ranges of all the draws, culled ones included,
+	// in `drawIndices` order with adjacent ranges of the same visibility merged. Returns the number of visited nodes.
+	uint32_t CullInstanceBvh(std::vector<InstanceBvhRange>& ranges, const InstanceBvh& bvh, const CullView& view);
+}
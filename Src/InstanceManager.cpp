@@ -0,0 +1,421 @@
+#include "InstanceManager.h"
+
+#include <glm/gtc/quaternion.hpp>
+
+
+namespace Niagara
+{
+	// In `Slot::dirtyFlags`, the slot is in the dirty list
+	static const uint32_t s_SlotDirty = 1u << 31;
+	static const uint32_t s_ScatterFlags = DRAW_SCATTER_RESET_DRAW_VISIBILITY | DRAW_SCATTER_RESET_MESHLET_VISIBILITY;
+
+	void InstanceManager::Init(const std::vector<Mesh>& meshes, uint32_t maxInstances, uint32_t maxMeshletVisibilityBits, bool bPackedDraws)
+	{
+		Destroy();
+
+		m_pMeshes = &meshes;
+		m_bPackedDraws = bPackedDraws;
+		m_MaxInstances = maxInstances;
+		m_MaxMeshletVisibilityBits = maxMeshletVisibilityBits;
+
+		m_Slots.reserve(maxInstances);
+		m_Handles.reserve(maxInstances);
+	}
+
+	void InstanceManager::Destroy()
+	{
+		m_pMeshes = nullptr;
+
+		m_Slots.clear();
+		m_FreeSlots.clear();
+		m_InstanceCount = 0;
+
+		m_Handles.clear();
+		m_FreeHandles.clear();
+
+		m_DirtySlots.clear();
+
+		m_FreeRangesByOffset.clear();
+		m_FreeRangesBySize.clear();
+		m_MeshletVisibilityEnd = 0;
+
+		m_Stats = Stats{};
+	}
+
+	InstanceHandle InstanceManager::Add(const InstanceDesc& desc)
+	{
+		assert(m_pMeshes != nullptr);
+
+		if (desc.meshIndex >= m_pMeshes->size() || (m_FreeSlots.empty() && m_Slots.size() >= m_MaxInstances))
+		{
+			++m_Stats.failedAddCount;
+			return InstanceHandle{};
+		}
+
+		const uint32_t meshletCount = (*m_pMeshes)[desc.meshIndex].lods[0].meshletCount;
+		uint32_t meshletVisibilityOffset = 0;
+		if (!AllocateMeshletVisibility(meshletCount, meshletVisibilityOffset))
+		{
+			++m_Stats.failedAddCount;
+			return InstanceHandle{};
+		}
+
+		uint32_t slotIndex = 0;
+		if (!m_FreeSlots.empty())
+		{
+			slotIndex = m_FreeSlots.back();
+			m_FreeSlots.pop_back();
+		}
+		else
+		{
+			slotIndex = static_cast<uint32_t>(m_Slots.size());
+			m_Slots.push_back(Slot{ InstanceDesc{}, ~0u, 0, 0, 0 });
+		}
+
+		InstanceHandle handle;
+		if (!m_FreeHandles.empty())
+		{
+			handle.index = m_FreeHandles.back();
+			m_FreeHandles.pop_back();
+		}
+		else
+		{
+			handle.index = static_cast<uint32_t>(m_Handles.size());
+			m_Handles.push_back(HandleEntry{ ~0u, 0 });
+		}
+
+		HandleEntry& entry = m_Handles[handle.index];
+		entry.slot = slotIndex;
+		handle.generation = entry.generation;
+
+		Slot& slot = m_Slots[slotIndex];
+		slot.desc = desc;
+		slot.handleIndex = handle.index;
+		slot.meshletVisibilityOffset = meshletVisibilityOffset;
+		slot.meshletVisibilityCount = meshletCount;
+		MarkDirty(slotIndex, DRAW_SCATTER_RESET_DRAW_VISIBILITY | DRAW_SCATTER_RESET_MESHLET_VISIBILITY);
+
+		++m_InstanceCount;
+		++m_Stats.addCount;
+
+		return handle;
+	}
+
+	bool InstanceManager::Remove(InstanceHandle handle)
+	{
+		Slot* pSlot = GetSlot(handle);
+		if (pSlot == nullptr)
+			return false;
+
+		HandleEntry& entry = m_Handles[handle.index];
+		const uint32_t slotIndex = entry.slot;
+
+		// Stale handles of this index don't match anymore
+		entry.slot = ~0u;
+		++entry.generation;
+		m_FreeHandles.push_back(handle.index);
+
+		FreeMeshletVisibility(pSlot->meshletVisibilityOffset, pSlot->meshletVisibilityCount);
+
+		// The empty draw doesn't own any meshlet visibility bits, a pending clear of the old range is dropped
+		pSlot->handleIndex = ~0u;
+		pSlot->meshletVisibilityOffset = 0;
+		pSlot->meshletVisibilityCount = 0;
+		m_FreeSlots.push_back(slotIndex);
+		MarkDirty(slotIndex, DRAW_SCATTER_RESET_DRAW_VISIBILITY);
+
+		--m_InstanceCount;
+		++m_Stats.removeCount;
+
+		return true;
+	}
+
+	bool InstanceManager::Update(InstanceHandle handle, const InstanceDesc& desc)
+	{
+		Slot* pSlot = GetSlot(handle);
+		if (pSlot == nullptr || desc.meshIndex >= m_pMeshes->size())
+			return false;
+
+		uint32_t flags = 0;
+		if (desc.meshIndex != pSlot->desc.meshIndex)
+		{
+			const uint32_t meshletCount = (*m_pMeshes)[desc.meshIndex].lods[0].meshletCount;
+			uint32_t meshletVisibilityOffset = 0;
+			if (!AllocateMeshletVisibility(meshletCount, meshletVisibilityOffset))
+				return false;
+
+			FreeMeshletVisibility(pSlot->meshletVisibilityOffset, pSlot->meshletVisibilityCount);
+
+			pSlot->meshletVisibilityOffset = meshletVisibilityOffset;
+			pSlot->meshletVisibilityCount = meshletCount;
+			flags = DRAW_SCATTER_RESET_MESHLET_VISIBILITY;
+		}
+
+		pSlot->desc = desc;
+		MarkDirty(m_Handles[handle.index].slot, flags);
+
+		++m_Stats.updateCount;
+
+		return true;
+	}
+
+	bool InstanceManager::IsAlive(InstanceHandle handle) const
+	{
+		return GetSlot(handle) != nullptr;
+	}
+
+	const InstanceDesc* InstanceManager::GetDesc(InstanceHandle handle) const
+	{
+		const Slot* pSlot = GetSlot(handle);
+		return pSlot != nullptr ? &pSlot->desc : nullptr;
+	}
+
+	uint32_t InstanceManager::GetDrawIndex(InstanceHandle handle) const
+	{
+		return GetSlot(handle) != nullptr ? m_Handles[handle.index].slot : ~0u;
+	}
+
+	uint32_t InstanceManager::Compact(bool bForce)
+	{
+		const uint32_t slotCount = static_cast<uint32_t>(m_Slots.size());
+		const uint32_t freeCount = slotCount - m_InstanceCount;
+		if (freeCount == 0 || (!bForce && freeCount <= slotCount * INSTANCE_COMPACTION_FREE_RATIO))
+			return 0;
+
+		// Lowest holes first, filled by the last instances
+		std::sort(m_FreeSlots.begin(), m_FreeSlots.end());
+
+		uint32_t end = slotCount;
+		auto trimFreeSlots = [&]()
+		{
+			while (end > 0 && m_Slots[end - 1].handleIndex == ~0u)
+				--end;
+		};
+		trimFreeSlots();
+
+		uint32_t moveCount = 0;
+		for (size_t i = 0; i < m_FreeSlots.size() && m_FreeSlots[i] < end; ++i)
+		{
+			const uint32_t dstIndex = m_FreeSlots[i];
+			Slot& src = m_Slots[end - 1];
+			Slot& dst = m_Slots[dstIndex];
+
+			dst.desc = src.desc;
+			dst.handleIndex = src.handleIndex;
+			dst.meshletVisibilityOffset = src.meshletVisibilityOffset;
+			dst.meshletVisibilityCount = src.meshletVisibilityCount;
+			m_Handles[dst.handleIndex].slot = dstIndex;
+
+			// A pending clear of the meshlet visibility range moves with the instance, the draw visibility of the hole is stale
+			const uint32_t flags = (src.dirtyFlags & DRAW_SCATTER_RESET_MESHLET_VISIBILITY) | DRAW_SCATTER_RESET_DRAW_VISIBILITY;
+			dst.dirtyFlags &= s_SlotDirty;
+			MarkDirty(dstIndex, flags);
+
+			src.handleIndex = ~0u;
+			--end;
+			trimFreeSlots();
+
+			++moveCount;
+		}
+
+		m_Slots.resize(end);
+		m_FreeSlots.clear();
+
+		// The slots past the end are not drawn anymore
+		m_DirtySlots.erase(std::remove_if(m_DirtySlots.begin(), m_DirtySlots.end(), [end](uint32_t slot) { return slot >= end; }), m_DirtySlots.end());
+
+		++m_Stats.compactionCount;
+		m_Stats.moveCount += moveCount;
+
+		return moveCount;
+	}
+
+	uint32_t InstanceManager::GatherScatters(uint8_t* dst, uint32_t maxCount)
+	{
+		const uint32_t count = std::min(maxCount, static_cast<uint32_t>(m_DirtySlots.size()));
+		const uint32_t stride = GetScatterStride();
+
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const uint32_t slotIndex = m_DirtySlots[i];
+			Slot& slot = m_Slots[slotIndex];
+
+			DrawScatter scatter;
+			scatter.drawIndex = slotIndex;
+			scatter.flags = slot.dirtyFlags & s_ScatterFlags;
+			scatter.meshletVisibilityOffset = slot.meshletVisibilityOffset;
+			scatter.meshletVisibilityCount = slot.meshletVisibilityCount;
+
+			uint8_t* pRecord = dst + size_t(i) * stride;
+			memcpy(pRecord, &scatter, sizeof(scatter));
+			WriteDraw(pRecord + sizeof(scatter), slotIndex);
+
+			slot.dirtyFlags = 0;
+		}
+
+		m_DirtySlots.erase(m_DirtySlots.begin(), m_DirtySlots.begin() + count);
+		m_Stats.scatterCount += count;
+
+		return count;
+	}
+
+	void InstanceManager::WriteDraws(std::vector<uint8_t>& draws)
+	{
+		const uint32_t stride = GetDrawStride();
+
+		draws.resize(m_Slots.size() * stride);
+		for (uint32_t i = 0; i < m_Slots.size(); ++i)
+		{
+			WriteDraw(draws.data() + size_t(i) * stride, i);
+			m_Slots[i].dirtyFlags = 0;
+		}
+
+		m_DirtySlots.clear();
+	}
+
+	InstanceManager::Slot* InstanceManager::GetSlot(InstanceHandle handle)
+	{
+		return const_cast<Slot*>(static_cast<const InstanceManager*>(this)->GetSlot(handle));
+	}
+
+	const InstanceManager::Slot* InstanceManager::GetSlot(InstanceHandle handle) const
+	{
+		if (handle.index >= m_Handles.size())
+			return nullptr;
+
+		const HandleEntry& entry = m_Handles[handle.index];
+		if (entry.slot == ~0u || entry.generation != handle.generation)
+			return nullptr;
+
+		return &m_Slots[entry.slot];
+	}
+
+	void InstanceManager::MarkDirty(uint32_t slot, uint32_t flags)
+	{
+		uint32_t& dirtyFlags = m_Slots[slot].dirtyFlags;
+		if ((dirtyFlags & s_SlotDirty) == 0)
+			m_DirtySlots.push_back(slot);
+
+		dirtyFlags |= s_SlotDirty | flags;
+	}
+
+	void InstanceManager::WriteDraw(uint8_t* dst, uint32_t slotIndex) const
+	{
+		const Slot& slot = m_Slots[slotIndex];
+		const bool bEmpty = slot.handleIndex == ~0u;
+
+		if (m_bPackedDraws)
+		{
+			PackedMeshDraw packedDraw{};
+			packedDraw.meshIndex = INVALID_MESH_INDEX;
+
+			if (!bEmpty)
+			{
+				const InstanceDesc& desc = slot.desc;
+				const Mesh& mesh = (*m_pMeshes)[desc.meshIndex];
+				packedDraw = PackMeshDraw(desc.position, desc.orientation, desc.scale, desc.meshIndex, static_cast<int32_t>(mesh.vertexOffset), slot.meshletVisibilityOffset);
+			}
+
+			memcpy(dst, &packedDraw, sizeof(packedDraw));
+		}
+		else
+		{
+			MeshDraw draw{};
+			draw.meshIndex = INVALID_MESH_INDEX;
+
+			if (!bEmpty)
+			{
+				const InstanceDesc& desc = slot.desc;
+				const Mesh& mesh = (*m_pMeshes)[desc.meshIndex];
+
+				glm::mat4 worldMat = glm::mat4_cast(glm::quat(desc.orientation.w, desc.orientation.x, desc.orientation.y, desc.orientation.z));
+				worldMat[0] = worldMat[0] * desc.scale;
+				worldMat[1] = worldMat[1] * desc.scale;
+				worldMat[2] = worldMat[2] * desc.scale;
+				worldMat[3] = glm::vec4(desc.position.x, desc.position.y, desc.position.z, 1.0f);
+
+				draw.worldMatRow0 = glm::vec4(worldMat[0][0], worldMat[1][0], worldMat[2][0], worldMat[3][0]);
+				draw.worldMatRow1 = glm::vec4(worldMat[0][1], worldMat[1][1], worldMat[2][1], worldMat[3][1]);
+				draw.worldMatRow2 = glm::vec4(worldMat[0][2], worldMat[1][2], worldMat[2][2], worldMat[3][2]);
+				draw.vertexOffset = static_cast<int32_t>(mesh.vertexOffset);
+				draw.meshIndex = desc.meshIndex;
+				draw.meshletVisibilityOffset = slot.meshletVisibilityOffset;
+			}
+
+			memcpy(dst, &draw, sizeof(draw));
+		}
+	}
+
+	/// Meshlet visibility ranges
+
+	bool InstanceManager::AllocateMeshletVisibility(uint32_t count, uint32_t& offset)
+	{
+		offset = 0;
+		if (count == 0)
+			return true;
+
+		auto it = m_FreeRangesBySize.lower_bound(std::make_pair(count, 0u));
+		if (it != m_FreeRangesBySize.end())
+		{
+			const uint32_t rangeCount = it->first;
+			offset = it->second;
+
+			EraseFreeRange(m_FreeRangesByOffset.find(offset));
+			if (rangeCount > count)
+				InsertFreeRange(offset + count, rangeCount - count);
+
+			return true;
+		}
+
+		if (uint64_t(m_MeshletVisibilityEnd) + count > m_MaxMeshletVisibilityBits)
+			return false;
+
+		offset = m_MeshletVisibilityEnd;
+		m_MeshletVisibilityEnd += count;
+
+		return true;
+	}
+
+	void InstanceManager::FreeMeshletVisibility(uint32_t offset, uint32_t count)
+	{
+		if (count == 0)
+			return;
+
+		// Merge with the next and the previous free ranges
+		auto next = m_FreeRangesByOffset.find(offset + count);
+		if (next != m_FreeRangesByOffset.end())
+		{
+			count += next->second;
+			EraseFreeRange(next);
+		}
+
+		auto prev = m_FreeRangesByOffset.lower_bound(offset);
+		if (prev != m_FreeRangesByOffset.begin())
+		{
+			--prev;
+			if (prev->first + prev->second == offset)
+			{
+				offset = prev->first;
+				count += prev->second;
+				EraseFreeRange(prev);
+			}
+		}
+
+		if (offset + count == m_MeshletVisibilityEnd)
+			m_MeshletVisibilityEnd = offset;
+		else
+			InsertFreeRange(offset, count);
+	}
+
+	void InstanceManager::InsertFreeRange(uint32_t offset, uint32_t count)
+	{
+		m_FreeRangesByOffset.emplace(offset, count);
+		m_FreeRangesBySize.emplace(count, offset);
+	}
+
+	void InstanceManager::EraseFreeRange(std::map<uint32_t, uint32_t>::iterator it)
+	{
+		m_FreeRangesBySize.erase(std::make_pair(it->second, it->first));
+		m_FreeRangesByOffset.erase(it);
+	}
+}
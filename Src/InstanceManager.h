@@ -0,0 +1,157 @@
+#pragma once
+
+#include "pch.h"
+#include "Config.h"
+#include "Utilities.h"
+#include "Geometry.h"
+#include <map>
+#include <set>
+
+
+namespace Niagara
+{
+	/**
+	* Instance manager
+	* The instances of a scene behind stable handles. Each instance owns a slot of the draw buffer and a range of the meshlet
+	* visibility bits (1 bit per meshlet of its lod 0). Removed slots are reused by the next adds, `Compact()` moves the last
+	* instances into the holes once too many slots are free. Freed slots hold empty draws (`INVALID_MESH_INDEX`) until then.
+	* Changes only mark their slots dirty, `GatherScatters()` writes the dirty slots as scatter records that `ScatterDraws.comp`
+	* copies into the draw buffer, so the per frame upload depends on the number of changes, not on the scene size.
+	* Not thread safe, the scene is changed from the main thread.
+	*/
+
+	// Header of a scatter record, followed by the draw (`MeshDraw` or `PackedMeshDraw`). Same layout as in `ScatterDraws.comp`.
+	struct DrawScatter
+	{
+		uint32_t drawIndex;
+		uint32_t flags; // DRAW_SCATTER_*
+		uint32_t meshletVisibilityOffset;
+		uint32_t meshletVisibilityCount;
+	};
+
+	// The slot has a new instance or lost one, its draw visibility is reset (late pass only for a frame)
+	constexpr uint32_t DRAW_SCATTER_RESET_DRAW_VISIBILITY = 1;
+	// The meshlet visibility range has a new owner, its bits are cleared
+	constexpr uint32_t DRAW_SCATTER_RESET_MESHLET_VISIBILITY = 2;
+
+	struct InstanceHandle
+	{
+		uint32_t index = ~0u;
+		uint32_t generation = 0;
+
+		bool IsValid() const { return index != ~0u; }
+	};
+
+	struct InstanceDesc
+	{
+		glm::vec3 position = glm::vec3(0.0f);
+		glm::vec4 orientation = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f); // xyz - vector part, w - scalar part
+		float scale = 1.0f;
+		uint32_t meshIndex = 0;
+	};
+
+	class InstanceManager
+	{
+	public:
+		struct Stats
+		{
+			uint64_t addCount = 0;
+			uint64_t removeCount = 0;
+			uint64_t updateCount = 0;
+			// Instances moved by the compactions
+			uint64_t moveCount = 0;
+			uint64_t scatterCount = 0;
+			uint32_t compactionCount = 0;
+			// Adds that ran out of slots or meshlet visibility bits
+			uint32_t failedAddCount = 0;
+		};
+
+		InstanceManager() = default;
+		NON_COPYABLE(InstanceManager);
+
+		// `meshes` must outlive the manager. Capacities are the draw buffer size in draws and the meshlet visibility buffer size in bits.
+		void Init(const std::vector<Mesh>& meshes, uint32_t maxInstances, uint32_t maxMeshletVisibilityBits, bool bPackedDraws);
+		void Destroy();
+
+		// Returns an invalid handle when out of slots or meshlet visibility bits
+		InstanceHandle Add(const InstanceDesc& desc);
+		bool Remove(InstanceHandle handle);
+		// A new mesh gets a new meshlet visibility range
+		bool Update(InstanceHandle handle, const InstanceDesc& desc);
+
+		bool IsAlive(InstanceHandle handle) const;
+		const InstanceDesc* GetDesc(InstanceHandle handle) const;
+		// Slot in the draw buffer, it changes when the instance is moved by a compaction
+		uint32_t GetDrawIndex(InstanceHandle handle) const;
+
+		// Moves the last instances into the free slots when more than `INSTANCE_COMPACTION_FREE_RATIO` of the slots are free (or always
+		// with `bForce`) and shrinks the draw count. Returns the number of moved instances.
+		uint32_t Compact(bool bForce = false);
+
+		// Writes up to `maxCount` scatter records (`GetScatterStride()` bytes each) of the dirty slots to `dst`, oldest changes first.
+		// The slots are clean afterwards, the remaining ones are gathered by the next calls. Returns the number of records.
+		uint32_t GatherScatters(uint8_t* dst, uint32_t maxCount);
+		uint32_t GetPendingScatterCount() const { return static_cast<uint32_t>(m_DirtySlots.size()); }
+
+		// Draw buffer contents of all the slots, for a full upload. All the slots are clean afterwards.
+		void WriteDraws(std::vector<uint8_t>& draws);
+
+		// Slots the culling goes through, the free ones below it hold empty draws
+		uint32_t GetDrawCount() const { return static_cast<uint32_t>(m_Slots.size()); }
+		uint32_t GetInstanceCount() const { return m_InstanceCount; }
+		uint32_t GetDrawStride() const { return m_bPackedDraws ? sizeof(PackedMeshDraw) : sizeof(MeshDraw); }
+		uint32_t GetScatterStride() const { return sizeof(DrawScatter) + GetDrawStride(); }
+		// End of the allocated meshlet visibility bits
+		uint32_t GetMeshletVisibilityCount() const { return m_MeshletVisibilityEnd; }
+		const Stats& GetStats() const { return m_Stats; }
+
+	private:
+		struct Slot
+		{
+			InstanceDesc desc;
+			uint32_t handleIndex; // ~0u - free
+			uint32_t meshletVisibilityOffset;
+			uint32_t meshletVisibilityCount;
+			uint32_t dirtyFlags; // DRAW_SCATTER_* and `s_SlotDirty`
+		};
+
+		struct HandleEntry
+		{
+			uint32_t slot; // ~0u - free
+			uint32_t generation;
+		};
+
+		Slot* GetSlot(InstanceHandle handle);
+		const Slot* GetSlot(InstanceHandle handle) const;
+		void MarkDirty(uint32_t slot, uint32_t flags);
+		void WriteDraw(uint8_t* dst, uint32_t slot) const;
+
+		// Best fit over the free ranges, then from the end of the allocated bits
+		bool AllocateMeshletVisibility(uint32_t count, uint32_t& offset);
+		void FreeMeshletVisibility(uint32_t offset, uint32_t count);
+		void InsertFreeRange(uint32_t offset, uint32_t count);
+		void EraseFreeRange(std::map<uint32_t, uint32_t>::iterator it);
+
+		const std::vector<Mesh>* m_pMeshes = nullptr;
+		bool m_bPackedDraws = false;
+		uint32_t m_MaxInstances = 0;
+		uint32_t m_MaxMeshletVisibilityBits = 0;
+
+		std::vector<Slot> m_Slots;
+		std::vector<uint32_t> m_FreeSlots;
+		uint32_t m_InstanceCount = 0;
+
+		std::vector<HandleEntry> m_Handles;
+		std::vector<uint32_t> m_FreeHandles;
+
+		// Slots in change order, each one once
+		std::vector<uint32_t> m_DirtySlots;
+
+		// Free meshlet visibility ranges, by offset (for the merges) and by size (for the allocations)
+		std::map<uint32_t, uint32_t> m_FreeRangesByOffset;
+		std::set<std::pair<uint32_t, uint32_t>> m_FreeRangesBySize; // (count, offset)
+		uint32_t m_MeshletVisibilityEnd = 0;
+
+		Stats m_Stats;
+	};
+}
@@ -0,0 +1,182 @@
+#include "JobSystem.h"
+
+namespace Niagara
+{
+	JobSystem g_JobSystem{};
+
+	// Index of the worker running on the current thread, g_InvalidWorker for external threads
+	static constexpr uint32_t g_InvalidWorker = ~0u;
+	static thread_local uint32_t t_WorkerIndex = g_InvalidWorker;
+
+
+	void JobSystem::Init(uint32_t threadCount)
+	{
+		Destroy();
+
+		if (threadCount == 0)
+		{
+			uint32_t hardwareThreads = std::thread::hardware_concurrency();
+			threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+		}
+
+		m_Queues.resize(threadCount);
+		for (auto& queue : m_Queues)
+			queue.reset(new WorkQueue());
+
+		m_bRunning = true;
+
+		m_Workers.reserve(threadCount);
+		for (uint32_t i = 0; i < threadCount; ++i)
+			m_Workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+	}
+
+	void JobSystem::Destroy()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_WakeMutex);
+			m_bRunning = false;
+		}
+		m_WakeCondition.notify_all();
+
+		for (auto& worker : m_Workers)
+		{
+			if (worker.joinable())
+				worker.join();
+		}
+		m_Workers.clear();
+		m_Queues.clear();
+	}
+
+	void JobSystem::Execute(JobCounter& counter, JobFunc&& job)
+	{
+		counter.pending.fetch_add(1, std::memory_order_relaxed);
+
+		// No workers, run it in place
+		if (m_Queues.empty())
+		{
+			job();
+			counter.pending.fetch_sub(1, std::memory_order_release);
+			return;
+		}
+
+		Push(Job{ std::move(job), &counter });
+	}
+
+	void JobSystem::ParallelFor(JobCounter& counter, uint32_t count, uint32_t groupSize, const IndexedJobFunc& func)
+	{
+		groupSize = std::max(1u, groupSize);
+
+		// The jobs may outlive `func` (a temporary when called with a lambda), they share a copy of it
+		auto pFunc = std::make_shared<IndexedJobFunc>(func);
+
+		for (uint32_t begin = 0; begin < count; begin += groupSize)
+		{
+			uint32_t end = std::min(count, begin + groupSize);
+			Execute(counter, [begin, end, pFunc]()
+				{
+					for (uint32_t i = begin; i < end; ++i)
+						(*pFunc)(i);
+				});
+		}
+	}
+
+	void JobSystem::Wait(JobCounter& counter)
+	{
+		// Help out instead of blocking, the jobs we wait on may be sitting in our own queue
+		while (!counter.IsDone())
+		{
+			if (!RunOne(t_WorkerIndex))
+				std::this_thread::yield();
+		}
+	}
+
+	void JobSystem::Push(Job&& job)
+	{
+		uint32_t queueIndex = t_WorkerIndex;
+		if (queueIndex == g_InvalidWorker)
+			queueIndex = m_NextQueue.fetch_add(1, std::memory_order_relaxed) % static_cast<uint32_t>(m_Queues.size());
+
+		// Count the job before it becomes visible, so a thief can never decrement first
+		{
+			std::lock_guard<std::mutex> lock(m_WakeMutex);
+			m_QueuedJobs.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		{
+			auto& queue = *m_Queues[queueIndex];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.jobs.push_back(std::move(job));
+		}
+		m_WakeCondition.notify_one();
+	}
+
+	bool JobSystem::Pop(uint32_t queueIndex, Job& job)
+	{
+		auto& queue = *m_Queues[queueIndex];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.jobs.empty())
+			return false;
+
+		job = std::move(queue.jobs.back());
+		queue.jobs.pop_back();
+		return true;
+	}
+
+	bool JobSystem::Steal(uint32_t thiefIndex, Job& job)
+	{
+		const uint32_t queueCount = static_cast<uint32_t>(m_Queues.size());
+		const uint32_t start = thiefIndex == g_InvalidWorker ? 0 : thiefIndex + 1;
+
+		for (uint32_t i = 0; i < queueCount; ++i)
+		{
+			uint32_t victim = (start + i) % queueCount;
+			if (victim == thiefIndex)
+				continue;
+
+			auto& queue = *m_Queues[victim];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.jobs.empty())
+				continue;
+
+			job = std::move(queue.jobs.front());
+			queue.jobs.pop_front();
+			return true;
+		}
+
+		return false;
+	}
+
+	bool JobSystem::RunOne(uint32_t queueIndex)
+	{
+		Job job{};
+		bool bFound = (queueIndex != g_InvalidWorker && Pop(queueIndex, job)) || Steal(queueIndex, job);
+		if (!bFound)
+			return false;
+
+		m_QueuedJobs.fetch_sub(1, std::memory_order_relaxed);
+
+		job.func();
+		job.counter->pending.fetch_sub(1, std::memory_order_release);
+
+		return true;
+	}
+
+	void JobSystem::WorkerLoop(uint32_t workerIndex)
+	{
+		t_WorkerIndex = workerIndex;
+
+		while (true)
+		{
+			if (RunOne(workerIndex))
+				continue;
+
+			std::unique_lock<std::mutex> lock(m_WakeMutex);
+			m_WakeCondition.wait(lock, [this]() { return !m_bRunning || m_QueuedJobs.load(std::memory_order_relaxed) > 0; });
+
+			if (!m_bRunning)
+				break;
+		}
+
+		t_WorkerIndex = g_InvalidWorker;
+	}
+}
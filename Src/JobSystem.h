@@ -0,0 +1,81 @@
+#pragma once
+
+#include "pch.h"
+#include "Utilities.h"
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+
+
+namespace Niagara
+{
+	// Tracks a group of jobs, `JobSystem::Wait()` returns when all of them are finished
+	struct JobCounter
+	{
+		std::atomic<uint32_t> pending{ 0 };
+
+		bool IsDone() const { return pending.load(std::memory_order_acquire) == 0; }
+	};
+
+	/**
+	* Work-stealing job system
+	* Each worker owns a job deque. Jobs submitted from a worker go to the back of its own deque, jobs submitted from other threads
+	* are distributed round-robin. A worker pops from the back of its own deque (LIFO, cache friendly for nested jobs), and steals
+	* from the front of the others when it runs dry. `Wait()` keeps executing jobs while the counter is pending, so jobs can spawn
+	* and wait on child jobs without deadlocking the pool.
+	*/
+	class JobSystem
+	{
+	public:
+		using JobFunc = std::function<void()>;
+		using IndexedJobFunc = std::function<void(uint32_t)>;
+
+		JobSystem() = default;
+		NON_COPYABLE(JobSystem);
+
+		// threadCount == 0 uses all hardware threads but the calling one
+		void Init(uint32_t threadCount = 0);
+		void Destroy();
+
+		void Execute(JobCounter& counter, JobFunc&& job);
+		// Calls func(i) for i in [0, count), `groupSize` indices per job
+		void ParallelFor(JobCounter& counter, uint32_t count, uint32_t groupSize, const IndexedJobFunc& func);
+		void Wait(JobCounter& counter);
+
+		uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Workers.size()); }
+		bool IsInited() const { return !m_Queues.empty(); }
+
+	private:
+		struct Job
+		{
+			JobFunc func;
+			JobCounter* counter{ nullptr };
+		};
+
+		struct WorkQueue
+		{
+			std::mutex mutex;
+			std::deque<Job> jobs;
+		};
+
+		void Push(Job&& job);
+		bool Pop(uint32_t queueIndex, Job& job);
+		bool Steal(uint32_t thiefIndex, Job& job);
+		bool RunOne(uint32_t queueIndex);
+		void WorkerLoop(uint32_t workerIndex);
+
+		std::vector<std::thread> m_Workers;
+		std::vector<std::unique_ptr<WorkQueue>> m_Queues;
+
+		std::atomic<bool> m_bRunning{ false };
+		std::atomic<uint32_t> m_NextQueue{ 0 };
+		std::atomic<uint32_t> m_QueuedJobs{ 0 };
+
+		std::mutex m_WakeMutex;
+		std::condition_variable m_WakeCondition;
+	};
+	extern JobSystem g_JobSystem;
+}
@@ -0,0 +1,384 @@
+#include "Profiler.h"
+#include "Device.h"
+
+
+namespace Niagara
+{
+	Profiler g_Profiler;
+
+	namespace
+	{
+		// Innermost scope of the thread, and the frame it belongs to so that a scope never parents one of a later frame
+		thread_local uint32_t t_CurrentScope = Profiler::s_InvalidScope;
+		thread_local uint64_t t_CurrentScopeFrame = 0;
+
+		// Small thread ids for the trace
+		std::atomic<uint32_t> s_ThreadCount{ 0 };
+		thread_local uint32_t t_ThreadIndex = ~0u;
+
+		uint32_t GetThreadIndex()
+		{
+			if (t_ThreadIndex == ~0u)
+				t_ThreadIndex = s_ThreadCount.fetch_add(1);
+			return t_ThreadIndex;
+		}
+
+		void WriteJsonString(FILE* file, const std::string& str)
+		{
+			fputc('"', file);
+			for (char c : str)
+			{
+				if (c == '"' || c == '\\')
+					fputc('\\', file);
+				fputc(c, file);
+			}
+			fputc('"', file);
+		}
+	}
+
+
+	/// ProfileHistory
+
+	void ProfileHistory::Add(double ms)
+	{
+		if (m_Samples.size() < PROFILER_HISTORY_FRAMES)
+			m_Samples.push_back(ms);
+		else
+			m_Samples[m_Next] = ms;
+
+		m_Next = (m_Next + 1) % PROFILER_HISTORY_FRAMES;
+		m_Last = ms;
+	}
+
+	ProfileStats ProfileHistory::GetStats() const
+	{
+		ProfileStats stats{};
+		if (m_Samples.empty())
+			return stats;
+
+		std::vector<double> samples = m_Samples;
+		std::sort(samples.begin(), samples.end());
+
+		double sum = 0.0;
+		for (double sample : samples)
+			sum += sample;
+
+		// Nearest rank
+		const size_t p99Rank = (samples.size() * 99 + 99) / 100;
+
+		stats.minMs = samples.front();
+		stats.avgMs = sum / samples.size();
+		stats.p99Ms = samples[std::min(p99Rank, samples.size()) - 1];
+		stats.lastMs = m_Last;
+		stats.sampleCount = static_cast<uint32_t>(samples.size());
+
+		return stats;
+	}
+
+
+	/// Profiler
+
+	void Profiler::Init(const Device& device, uint32_t framesInFlight, uint32_t maxScopes)
+	{
+		Destroy(device);
+
+		m_Device = &device;
+		m_MaxScopes = std::max(maxScopes, 1u);
+		m_TimestampPeriod = device.properties.limits.timestampPeriod;
+
+		const uint32_t queueFamilies[] = { device.queueFamilyIndices.graphics, device.queueFamilyIndices.compute, device.queueFamilyIndices.transfer };
+		static_assert(ARRAYSIZE(queueFamilies) == (uint32_t)EQueueFamily::Count, "A queue family index per `EQueueFamily`");
+		for (uint32_t i = 0; i < (uint32_t)EQueueFamily::Count; ++i)
+		{
+			const uint32_t validBits = queueFamilies[i] < device.queueFamilyProperties.size() ? device.queueFamilyProperties[queueFamilies[i]].timestampValidBits : 0;
+			m_TimestampMasks[i] = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+		}
+
+		m_Frames.resize(std::max(framesInFlight, 1u));
+		for (auto& frame : m_Frames)
+		{
+			frame.reset(new Frame());
+			frame->scopes.resize(m_MaxScopes);
+			frame->queryPool.Init(device, VK_QUERY_TYPE_TIMESTAMP, 2 * m_MaxScopes);
+			frame->queryPool.Reset(device, 0, 2 * m_MaxScopes);
+		}
+
+		m_CurrentFrame = nullptr;
+	}
+
+	void Profiler::Destroy(const Device& device)
+	{
+		CloseTrace();
+
+		for (auto& frame : m_Frames)
+			frame->queryPool.Destroy(device);
+		m_Frames.clear();
+
+		m_CurrentFrame = nullptr;
+		m_Device = nullptr;
+	}
+
+	void Profiler::BeginFrame(uint32_t frameInFlight, uint64_t frameIndex)
+	{
+		if (m_Frames.empty())
+			return;
+
+		Frame& frame = *m_Frames[frameInFlight % m_Frames.size()];
+		if (frame.bRecorded)
+			ResolveFrame(frame);
+
+		frame.scopeCount = 0;
+		frame.frameIndex = frameIndex;
+		m_CurrentFrame = &frame;
+	}
+
+	void Profiler::EndFrame()
+	{
+		if (m_CurrentFrame == nullptr)
+			return;
+
+		m_CurrentFrame->cpuEndMs = GetTimestampMs();
+		m_CurrentFrame->bRecorded = true;
+		m_CurrentFrame = nullptr;
+	}
+
+	uint32_t Profiler::BeginScope(VkCommandBuffer cmd, const std::string& name, EQueueFamily queue, uint32_t parent)
+	{
+		Frame* frame = m_CurrentFrame;
+		if (frame == nullptr)
+			return s_InvalidScope;
+
+		const uint32_t scopeIndex = frame->scopeCount.fetch_add(1);
+		if (scopeIndex >= m_MaxScopes)
+		{
+			++m_DroppedScopeCount;
+			return s_InvalidScope;
+		}
+
+		const uint32_t prevScope = GetCurrentScope();
+		if (parent == s_InvalidScope)
+			parent = prevScope;
+
+		Scope& scope = frame->scopes[scopeIndex];
+		scope.name = name;
+		scope.parent = parent;
+		scope.prevScope = prevScope;
+		scope.depth = parent != s_InvalidScope ? frame->scopes[parent].depth + 1 : 0;
+		scope.threadIndex = GetThreadIndex();
+		scope.queue = queue;
+		scope.bTimestamps = cmd != VK_NULL_HANDLE && m_TimestampMasks[(uint32_t)queue] != 0;
+
+		t_CurrentScope = scopeIndex;
+		t_CurrentScopeFrame = frame->frameIndex;
+
+		if (scope.bTimestamps)
+			frame->queryPool.WriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 2 * scopeIndex);
+
+		scope.cpuBeginMs = GetTimestampMs();
+
+		return scopeIndex;
+	}
+
+	void Profiler::EndScope(VkCommandBuffer cmd, uint32_t scopeIndex)
+	{
+		Frame* frame = m_CurrentFrame;
+		if (frame == nullptr || scopeIndex == s_InvalidScope)
+			return;
+
+		Scope& scope = frame->scopes[scopeIndex];
+		scope.cpuEndMs = GetTimestampMs();
+
+		if (scope.bTimestamps)
+			frame->queryPool.WriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 2 * scopeIndex + 1);
+
+		t_CurrentScope = scope.prevScope;
+	}
+
+	uint32_t Profiler::GetCurrentScope() const
+	{
+		const Frame* frame = m_CurrentFrame;
+		if (frame == nullptr || t_CurrentScopeFrame != frame->frameIndex)
+			return s_InvalidScope;
+
+		return t_CurrentScope;
+	}
+
+	void Profiler::ResolveFrame(Frame& frame)
+	{
+		frame.bRecorded = false;
+
+		const uint32_t scopeCount = std::min(frame.scopeCount.load(), m_MaxScopes);
+		if (scopeCount == 0)
+			return;
+
+		// Value and availability per query, the queries of the CPU only scopes are never available
+		std::vector<uint64_t> results(4 * scopeCount, 0);
+		frame.queryPool.GetResults(*m_Device, 0, 2 * scopeCount, results.size() * sizeof(uint64_t), results.data(), 2 * sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+		frame.queryPool.Reset(*m_Device, 0, 2 * scopeCount);
+
+		// Scopes of the same path are summed, e.g. a pass recorded twice
+		struct FrameSample
+		{
+			double cpuMs{ 0.0 };
+			double gpuMs{ 0.0 };
+			bool bGpu{ false };
+		};
+		std::vector<std::string> paths(scopeCount);
+		std::vector<std::string> framePaths;
+		std::unordered_map<std::string, FrameSample> frameSamples;
+
+		for (uint32_t i = 0; i < scopeCount; ++i)
+		{
+			const Scope& scope = frame.scopes[i];
+
+			// A parent is always begun before its children
+			paths[i] = scope.parent != s_InvalidScope ? paths[scope.parent] + "/" + scope.name : scope.name;
+
+			auto iter = frameSamples.find(paths[i]);
+			if (iter == frameSamples.end())
+			{
+				iter = frameSamples.emplace(paths[i], FrameSample{}).first;
+				framePaths.push_back(paths[i]);
+
+				if (m_Histories.find(paths[i]) == m_Histories.end())
+				{
+					m_Histories[paths[i]].depth = scope.depth;
+					m_Paths.push_back(paths[i]);
+				}
+			}
+
+			FrameSample& sample = iter->second;
+			const double cpuMs = scope.cpuEndMs - scope.cpuBeginMs;
+			sample.cpuMs += cpuMs;
+
+			if (m_TraceFile != nullptr)
+				WriteTraceEvent(scope.name, "cpu", scope.cpuBeginMs, cpuMs, 0, scope.threadIndex, frame.frameIndex);
+
+			const uint64_t* begin = &results[4 * i];
+			const uint64_t* end = &results[4 * i + 2];
+			if (!scope.bTimestamps || begin[1] == 0 || end[1] == 0)
+				continue;
+
+			const uint64_t mask = m_TimestampMasks[(uint32_t)scope.queue];
+			const double gpuMs = double((end[0] - begin[0]) & mask) * m_TimestampPeriod * 1e-6;
+			sample.gpuMs += gpuMs;
+			sample.bGpu = true;
+
+			if (m_TraceFile != nullptr)
+			{
+				const double gpuBeginMs = double(begin[0] & mask) * m_TimestampPeriod * 1e-6;
+				if (!m_bGpuOffsetValid)
+				{
+					m_GpuOffsetMs = frame.cpuEndMs - gpuBeginMs;
+					m_bGpuOffsetValid = true;
+				}
+				WriteTraceEvent(scope.name, "gpu", gpuBeginMs + m_GpuOffsetMs, gpuMs, 1, (uint32_t)scope.queue, frame.frameIndex);
+			}
+		}
+
+		for (const auto& path : framePaths)
+		{
+			const FrameSample& sample = frameSamples[path];
+			ScopeHistory& history = m_Histories[path];
+
+			history.cpu.Add(sample.cpuMs);
+			if (sample.bGpu)
+				history.gpu.Add(sample.gpuMs);
+		}
+
+		++m_ResolvedFrameCount;
+	}
+
+	bool Profiler::OpenTrace(const std::string& path)
+	{
+		CloseTrace();
+
+		m_TraceFile = fopen(path.c_str(), "w");
+		if (m_TraceFile == nullptr)
+			return false;
+
+		m_TraceBeginMs = GetTimestampMs();
+		m_bGpuOffsetValid = false;
+
+		// Processes and threads of the GPU track
+		const char* queueNames[] = { "Graphics", "Compute", "Transfer" };
+		static_assert(ARRAYSIZE(queueNames) == (uint32_t)EQueueFamily::Count, "A name per `EQueueFamily`");
+
+		fprintf(m_TraceFile, "{\n\t\"displayTimeUnit\": \"ms\",\n\t\"traceEvents\": [\n");
+		fprintf(m_TraceFile, "\t\t{ \"name\": \"process_name\", \"ph\": \"M\", \"pid\": 0, \"args\": { \"name\": \"CPU\" } },\n");
+		fprintf(m_TraceFile, "\t\t{ \"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": { \"name\": \"GPU\" } }");
+		for (uint32_t i = 0; i < (uint32_t)EQueueFamily::Count; ++i)
+			fprintf(m_TraceFile, ",\n\t\t{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": { \"name\": \"%s\" } }", i, queueNames[i]);
+
+		return true;
+	}
+
+	void Profiler::CloseTrace()
+	{
+		if (m_TraceFile == nullptr)
+			return;
+
+		fprintf(m_TraceFile, "\n\t]\n}\n");
+
+		fclose(m_TraceFile);
+		m_TraceFile = nullptr;
+	}
+
+	void Profiler::WriteTraceEvent(const std::string& name, const char* category, double beginMs, double durationMs, uint32_t pid, uint32_t tid, uint64_t frameIndex)
+	{
+		// Complete events, in microseconds
+		fprintf(m_TraceFile, ",\n\t\t{ \"name\": ");
+		WriteJsonString(m_TraceFile, name);
+		fprintf(m_TraceFile, ", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %u, \"tid\": %u, \"args\": { \"frame\": %llu } }",
+			category, (beginMs - m_TraceBeginMs) * 1000.0, durationMs * 1000.0, pid, tid, static_cast<unsigned long long>(frameIndex));
+	}
+
+	std::vector<ProfileScopeStats> Profiler::GetStats() const
+	{
+		std::vector<ProfileScopeStats> stats;
+		stats.reserve(m_Paths.size());
+
+		for (const auto& path : m_Paths)
+			stats.push_back(GetScopeStats(path));
+
+		return stats;
+	}
+
+	ProfileScopeStats Profiler::GetScopeStats(const std::string& path) const
+	{
+		ProfileScopeStats stats{};
+		stats.path = path;
+
+		auto iter = m_Histories.find(path);
+		if (iter == m_Histories.end())
+			return stats;
+
+		stats.depth = iter->second.depth;
+		stats.cpu = iter->second.cpu.GetStats();
+		stats.gpu = iter->second.gpu.GetStats();
+
+		return stats;
+	}
+
+	void Profiler::PrintStats() const
+	{
+		printf("Profiler, %llu frames resolved, last %u, ms\n", static_cast<unsigned long long>(m_ResolvedFrameCount), PROFILER_HISTORY_FRAMES);
+		printf("  %-32s %28s %28s\n", "Scope", "Cpu min / avg / p99", "Gpu min / avg / p99");
+
+		for (const auto& stats : GetStats())
+		{
+			const size_t nameBegin = stats.path.find_last_of('/');
+			const std::string name = std::string(2 * stats.depth, ' ') + (nameBegin != std::string::npos ? stats.path.substr(nameBegin + 1) : stats.path);
+
+			printf("  %-32s %8.3f / %7.3f / %7.3f", name.c_str(), stats.cpu.minMs, stats.cpu.avgMs, stats.cpu.p99Ms);
+			if (stats.gpu.sampleCount > 0)
+				printf(" %8.3f / %7.3f / %7.3f\n", stats.gpu.minMs, stats.gpu.avgMs, stats.gpu.p99Ms);
+			else
+				printf(" %28s\n", "-");
+		}
+
+		if (m_DroppedScopeCount > 0)
+			printf("  %llu scopes dropped past %u per frame\n", static_cast<unsigned long long>(m_DroppedScopeCount.load()), m_MaxScopes);
+	}
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "pch.h"
+#include "Config.h"
+#include "Utilities.h"
+#include "VkQuery.h"
+#include "CommandManager.h"
+#include <atomic>
+#include <unordered_map>
+
+
+namespace Niagara
+{
+	class Device;
+
+	/**
+	* Profiler
+	* Hierarchical CPU and GPU scopes. A scope times the host code between its begin and end and, given a command buffer, writes a
+	* timestamp at both ends into the query pool of the frame in flight. The render graph wraps each pass in a scope, the scopes begun
+	* inside a pass are nested in it. Scopes begun on the job threads take their parent explicitly.
+	* The queries are reset on the host, the ones of a frame in flight are read when it comes back around, after its fence, and never
+	* waited for: the times are the frames in flight late. Each resolved frame adds a sample per scope path to a window of the last
+	* `PROFILER_HISTORY_FRAMES` (min, avg, p99), and the scopes can be written to a Chrome trace (chrome://tracing, ui.perfetto.dev).
+	*/
+
+	struct ProfileStats
+	{
+		double minMs = 0.0;
+		double avgMs = 0.0;
+		double p99Ms = 0.0;
+		double lastMs = 0.0;
+		uint32_t sampleCount = 0;
+	};
+
+	struct ProfileScopeStats
+	{
+		// Names of the parents and the scope, separated by '/', e.g. "Frame/Early Draw"
+		std::string path;
+		uint32_t depth = 0;
+		ProfileStats cpu;
+		// No samples for the CPU only scopes
+		ProfileStats gpu;
+	};
+
+	// Samples of the last frames
+	class ProfileHistory
+	{
+	public:
+		void Add(double ms);
+		ProfileStats GetStats() const;
+
+	private:
+		std::vector<double> m_Samples;
+		uint32_t m_Next = 0;
+		double m_Last = 0.0;
+	};
+
+	class Profiler
+	{
+	public:
+		static constexpr uint32_t s_InvalidScope = ~0u;
+
+		Profiler() = default;
+		NON_COPYABLE(Profiler);
+
+		// Needs `hostQueryReset`
+		void Init(const Device& device, uint32_t framesInFlight, uint32_t maxScopes = PROFILER_MAX_SCOPES);
+		void Destroy(const Device& device);
+
+		// Once the fence of the frame in flight is signaled, resolves the frame it recorded before
+		void BeginFrame(uint32_t frameInFlight, uint64_t frameIndex);
+		void EndFrame();
+
+		// CPU only if `cmd` is null, `parent` - scope begun on another thread, the current scope of this thread by default.
+		// Returns `s_InvalidScope` outside a frame or past `maxScopes`.
+		uint32_t BeginScope(VkCommandBuffer cmd, const std::string& name, EQueueFamily queue = EQueueFamily::Graphics, uint32_t parent = s_InvalidScope);
+		void EndScope(VkCommandBuffer cmd, uint32_t scope);
+		// Innermost scope of this thread
+		uint32_t GetCurrentScope() const;
+
+		// Chrome trace of the frames resolved until `CloseTrace()`
+		bool OpenTrace(const std::string& path);
+		void CloseTrace();
+
+		std::vector<ProfileScopeStats> GetStats() const;
+		ProfileScopeStats GetScopeStats(const std::string& path) const;
+		// Min, avg and p99 of each scope, indented by depth
+		void PrintStats() const;
+
+		uint64_t GetResolvedFrameCount() const { return m_ResolvedFrameCount; }
+		uint64_t GetDroppedScopeCount() const { return m_DroppedScopeCount; }
+
+	private:
+		struct Scope
+		{
+			std::string name;
+			uint32_t parent{ s_InvalidScope };
+			// Current scope of the thread before this one
+			uint32_t prevScope{ s_InvalidScope };
+			uint32_t depth{ 0 };
+			uint32_t threadIndex{ 0 };
+			EQueueFamily queue{ EQueueFamily::Graphics };
+			bool bTimestamps{ false };
+			double cpuBeginMs{ 0.0 };
+			double cpuEndMs{ 0.0 };
+		};
+
+		struct Frame
+		{
+			// Begin and end timestamps of scope i at queries 2i and 2i + 1
+			QueryPool queryPool;
+			std::vector<Scope> scopes;
+			std::atomic<uint32_t> scopeCount{ 0 };
+			uint64_t frameIndex{ 0 };
+			double cpuEndMs{ 0.0 };
+			bool bRecorded{ false };
+		};
+
+		struct ScopeHistory
+		{
+			uint32_t depth{ 0 };
+			ProfileHistory cpu;
+			ProfileHistory gpu;
+		};
+
+		void ResolveFrame(Frame& frame);
+		void WriteTraceEvent(const std::string& name, const char* category, double beginMs, double durationMs, uint32_t pid, uint32_t tid, uint64_t frameIndex);
+
+		const Device* m_Device{ nullptr };
+		std::vector<std::unique_ptr<Frame>> m_Frames;
+		Frame* m_CurrentFrame{ nullptr };
+		uint32_t m_MaxScopes{ 0 };
+
+		// Nanoseconds per tick, and valid bits of the timestamps per queue family, no timestamps where it's 0
+		double m_TimestampPeriod{ 1.0 };
+		uint64_t m_TimestampMasks[(uint32_t)EQueueFamily::Count]{};
+
+		// Paths in the order they were first resolved
+		std::vector<std::string> m_Paths;
+		std::unordered_map<std::string, ScopeHistory> m_Histories;
+		uint64_t m_ResolvedFrameCount{ 0 };
+		std::atomic<uint64_t> m_DroppedScopeCount{ 0 };
+
+		FILE* m_TraceFile{ nullptr };
+		double m_TraceBeginMs{ 0.0 };
+		// GPU time of the trace, aligned once to the end of the recording of the first frame with timestamps
+		double m_GpuOffsetMs{ 0.0 };
+		bool m_bGpuOffsetValid{ false };
+	};
+	extern Profiler g_Profiler;
+
+	// Scope of the enclosing block
+	class ProfileScope
+	{
+	public:
+		ProfileScope(VkCommandBuffer cmd, const std::string& name, EQueueFamily queue = EQueueFamily::Graphics, uint32_t parent = Profiler::s_InvalidScope)
+			: m_Cmd{ cmd }, m_Scope{ g_Profiler.BeginScope(cmd, name, queue, parent) } {  }
+		~ProfileScope() { g_Profiler.EndScope(m_Cmd, m_Scope); }
+		NON_COPYABLE(ProfileScope);
+
+	private:
+		VkCommandBuffer m_Cmd;
+		uint32_t m_Scope;
+	};
+}
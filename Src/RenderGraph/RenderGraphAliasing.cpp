@@ -0,0 +1,140 @@
+#include "RenderGraphAliasing.h"
+#include "Utilities.h"
+
+
+namespace Niagara
+{
+	static bool LifetimesOverlap(const RGTransientResource& a, const RGTransientResource& b)
+	{
+		return a.firstUse <= b.lastUse && b.firstUse <= a.lastUse;
+	}
+
+	void BuildAliasingPlan(RGAliasingPlan& plan, const std::vector<RGTransientResource>& resources)
+	{
+		const uint32_t resourceCount = static_cast<uint32_t>(resources.size());
+
+		plan.blocks.clear();
+		plan.placements.assign(resourceCount, RGAliasingPlan::Placement{ ~0u, 0 });
+		plan.aliases.assign(resourceCount, {});
+		plan.unaliasedSize = 0;
+		plan.aliasedSize = 0;
+		plan.peakLiveSize = 0;
+
+		// Largest first, ties broken by the first use so that the plan only depends on the graph
+		std::vector<uint32_t> order(resourceCount);
+		for (uint32_t i = 0; i < resourceCount; ++i)
+			order[i] = i;
+		std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+			const auto& ra = resources[a];
+			const auto& rb = resources[b];
+			if (ra.size != rb.size)
+				return ra.size > rb.size;
+			if (ra.firstUse != rb.firstUse)
+				return ra.firstUse < rb.firstUse;
+			return a < b;
+		});
+
+		// Resources placed in each block
+		std::vector<std::vector<uint32_t>> blockResources;
+
+		struct Range
+		{
+			uint64_t begin;
+			uint64_t end;
+		};
+		std::vector<Range> occupied;
+
+		for (uint32_t resourceIndex : order)
+		{
+			const auto& resource = resources[resourceIndex];
+			plan.unaliasedSize += resource.size;
+
+			uint32_t blockIndex = ~0u;
+			uint64_t offset = 0;
+
+			for (uint32_t i = 0; i < static_cast<uint32_t>(plan.blocks.size()); ++i)
+			{
+				const auto& block = plan.blocks[i];
+				if (block.bImage != resource.bImage || (block.memoryTypeBits & resource.memoryTypeBits) == 0 || block.size < resource.size)
+					continue;
+
+				// Memory of the resources alive at the same time
+				occupied.clear();
+				for (uint32_t other : blockResources[i])
+				{
+					if (LifetimesOverlap(resource, resources[other]))
+						occupied.push_back({ plan.placements[other].offset, plan.placements[other].offset + resources[other].size });
+				}
+				std::sort(occupied.begin(), occupied.end(), [](const Range& a, const Range& b) { return a.begin < b.begin; });
+
+				// First fit
+				uint64_t candidate = 0;
+				for (const auto& range : occupied)
+				{
+					if (candidate + resource.size <= range.begin)
+						break;
+					candidate = std::max(candidate, AlignUp(range.end, resource.alignment));
+				}
+
+				if (candidate + resource.size <= block.size)
+				{
+					blockIndex = i;
+					offset = candidate;
+					break;
+				}
+			}
+
+			if (blockIndex == ~0u)
+			{
+				blockIndex = static_cast<uint32_t>(plan.blocks.size());
+				plan.blocks.push_back({ resource.size, resource.alignment, resource.memoryTypeBits, resource.bImage });
+				blockResources.emplace_back();
+			}
+
+			plan.blocks[blockIndex].alignment = std::max(plan.blocks[blockIndex].alignment, resource.alignment);
+			plan.blocks[blockIndex].memoryTypeBits &= resource.memoryTypeBits;
+			blockResources[blockIndex].push_back(resourceIndex);
+			plan.placements[resourceIndex] = { blockIndex, offset };
+		}
+
+		// Aliases, earlier resources of the same block whose memory overlaps
+		for (uint32_t i = 0; i < static_cast<uint32_t>(plan.blocks.size()); ++i)
+		{
+			for (uint32_t resourceIndex : blockResources[i])
+			{
+				const auto& resource = resources[resourceIndex];
+				const uint64_t begin = plan.placements[resourceIndex].offset;
+				const uint64_t end = begin + resource.size;
+
+				for (uint32_t other : blockResources[i])
+				{
+					const uint64_t otherBegin = plan.placements[other].offset;
+					const uint64_t otherEnd = otherBegin + resources[other].size;
+					if (resources[other].lastUse < resource.firstUse && otherBegin < end && begin < otherEnd)
+						plan.aliases[resourceIndex].push_back(other);
+				}
+				std::sort(plan.aliases[resourceIndex].begin(), plan.aliases[resourceIndex].end());
+			}
+
+			plan.aliasedSize += plan.blocks[i].size;
+		}
+
+		// Peak of the live memory
+		uint32_t passCount = 0;
+		for (const auto& resource : resources)
+			passCount = std::max(passCount, resource.lastUse + 1);
+
+		std::vector<uint64_t> liveSizes(passCount + 1, 0);
+		for (const auto& resource : resources)
+		{
+			liveSizes[resource.firstUse] += resource.size;
+			liveSizes[resource.lastUse + 1] -= resource.size;
+		}
+		uint64_t liveSize = 0;
+		for (uint32_t i = 0; i < passCount; ++i)
+		{
+			liveSize += liveSizes[i];
+			plan.peakLiveSize = std::max(plan.peakLiveSize, liveSize);
+		}
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "pch.h"
+
+
+namespace Niagara
+{
+	/**
+	* Transient memory aliasing
+	* A transient resource of the render graph only lives between its first and last use in the execution list, resources whose
+	* lifetimes are disjoint can share the same memory. The plan places the resources into memory blocks, largest first, each one
+	* at the lowest offset that doesn't overlap the memory of a resource whose lifetime overlaps its own. A new block is opened
+	* when none fits, it's as large as its first (largest) resource.
+	* Buffers and images never share a block, so the buffer-image granularity doesn't matter.
+	* Pure CPU, the device only provides the memory requirements.
+	*/
+	struct RGTransientResource
+	{
+		uint64_t size{ 0 };
+		uint64_t alignment{ 1 };
+		uint32_t memoryTypeBits{ ~0u };
+		// Indices into the execution list
+		uint32_t firstUse{ 0 };
+		uint32_t lastUse{ 0 };
+		bool bImage{ false };
+	};
+
+	struct RGMemoryBlock
+	{
+		uint64_t size{ 0 };
+		// Largest alignment of the resources of the block
+		uint64_t alignment{ 1 };
+		// Memory types supported by all of the resources of the block
+		uint32_t memoryTypeBits{ ~0u };
+		bool bImage{ false };
+	};
+
+	struct RGAliasingPlan
+	{
+		struct Placement
+		{
+			uint32_t block;
+			uint64_t offset;
+		};
+
+		std::vector<RGMemoryBlock> blocks;
+		// Per resource
+		std::vector<Placement> placements;
+		// Per resource, the resources that used its memory before it, its first use needs an aliasing barrier after their last use
+		std::vector<std::vector<uint32_t>> aliases;
+
+		// Sum of the resource sizes, i.e. one allocation per resource
+		uint64_t unaliasedSize{ 0 };
+		// Sum of the block sizes
+		uint64_t aliasedSize{ 0 };
+		// Largest sum of the sizes of the resources alive during a pass, the lower bound of `aliasedSize`
+		uint64_t peakLiveSize{ 0 };
+	};
+
+	void BuildAliasingPlan(RGAliasingPlan& plan, const std::vector<RGTransientResource>& resources);
+}
@@ -1,4 +1,7 @@
 #include "RenderGraphBuilder.h"
+#include "Utilities.h"
+#include "JobSystem.h"
+#include "Profiler.h"
 
 namespace Niagara
 {
@@ -75,6 +78,8 @@ namespace Niagara
 		m_WritePasses.clear();
 		m_ReadPasses.clear();
 		m_bCacheValid = false;
+
+		firstUse = lastUse = g_InvalidHandle;
 	}
 
 	/// RGResourcePool
@@ -87,6 +92,8 @@ namespace Niagara
 
 	void RGResourcePool::Destroy()
 	{
+		DestroyTransients();
+
 		for (auto& buffer : m_Buffers)
 			buffer.Destroy(*m_Device);
 		m_Buffers.clear();
@@ -122,17 +129,8 @@ namespace Niagara
 
 	Image* RGResourcePool::CreateTexture(const RGTextureDesc& desc, const std::string &name)
 	{
-		uint32_t w = 1, h = 1, d = (uint32_t)desc.d;
-		if (desc.sizeType == ESizeType::Absolute)
-		{
-			w = static_cast<uint32_t>(desc.w);
-			h = static_cast<uint32_t>(desc.h);
-		}
-		else
-		{
-			w = static_cast<uint32_t>(desc.w * m_ViewportSize.width);
-			h = static_cast<uint32_t>(desc.h * m_ViewportSize.height);
-		}
+		const VkExtent3D extent = GetExtent(desc);
+		const uint32_t w = extent.width, h = extent.height, d = extent.depth;
 
 		auto iter = m_TextureMap.find(name);
 		if (iter == m_TextureMap.end())
@@ -159,6 +157,203 @@ namespace Niagara
 		}
 	}
 
+	VkExtent3D RGResourcePool::GetExtent(const RGTextureDesc& desc) const
+	{
+		VkExtent3D extent{ 1, 1, static_cast<uint32_t>(desc.d) };
+		if (desc.sizeType == ESizeType::Absolute)
+		{
+			extent.width = static_cast<uint32_t>(desc.w);
+			extent.height = static_cast<uint32_t>(desc.h);
+		}
+		else
+		{
+			extent.width = static_cast<uint32_t>(desc.w * m_ViewportSize.width);
+			extent.height = static_cast<uint32_t>(desc.h * m_ViewportSize.height);
+		}
+		return extent;
+	}
+
+	VkBufferCreateInfo RGResourcePool::GetCreateInfo(const RGBufferDesc& desc) const
+	{
+		VkBufferCreateInfo createInfo{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+		createInfo.size = desc.size;
+		createInfo.usage = desc.usage;
+		createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		return createInfo;
+	}
+
+	VkImageCreateInfo RGResourcePool::GetCreateInfo(const RGTextureDesc& desc) const
+	{
+		const VkExtent3D extent = GetExtent(desc);
+
+		VkImageCreateInfo createInfo{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+		createInfo.imageType = extent.depth > 1 ? VK_IMAGE_TYPE_3D : VK_IMAGE_TYPE_2D;
+		createInfo.format = desc.format;
+		createInfo.extent = extent;
+		createInfo.mipLevels = desc.mipLevels;
+		createInfo.arrayLayers = desc.arrayLayers;
+		createInfo.samples = static_cast<VkSampleCountFlagBits>(desc.samples);
+		createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		createInfo.usage = desc.usage;
+		createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		return createInfo;
+	}
+
+	VkMemoryRequirements RGResourcePool::GetMemoryRequirements(const RGBufferDesc& desc) const
+	{
+		VkBufferCreateInfo createInfo = GetCreateInfo(desc);
+
+		VkDeviceBufferMemoryRequirements requirementsInfo{ VK_STRUCTURE_TYPE_DEVICE_BUFFER_MEMORY_REQUIREMENTS };
+		requirementsInfo.pCreateInfo = &createInfo;
+
+		VkMemoryRequirements2 requirements{ VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2 };
+		vkGetDeviceBufferMemoryRequirements(*m_Device, &requirementsInfo, &requirements);
+
+		return requirements.memoryRequirements;
+	}
+
+	VkMemoryRequirements RGResourcePool::GetMemoryRequirements(const RGTextureDesc& desc) const
+	{
+		VkImageCreateInfo createInfo = GetCreateInfo(desc);
+
+		VkDeviceImageMemoryRequirements requirementsInfo{ VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS };
+		requirementsInfo.pCreateInfo = &createInfo;
+
+		VkMemoryRequirements2 requirements{ VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2 };
+		vkGetDeviceImageMemoryRequirements(*m_Device, &requirementsInfo, &requirements);
+
+		return requirements.memoryRequirements;
+	}
+
+	void RGResourcePool::AllocateTransientBlocks(const RGAliasingPlan& plan, uint64_t frameIndex)
+	{
+		if (!m_TransientBlocks.empty())
+		{
+			Transients retired;
+			retired.blocks = std::move(m_TransientBlocks);
+			retired.buffers = std::move(m_TransientBuffers);
+			retired.textures = std::move(m_TransientTextures);
+			retired.frameIndex = frameIndex;
+			m_RetiredTransients.push_back(std::move(retired));
+
+			m_TransientBlocks.clear();
+			m_TransientBuffers.clear();
+			m_TransientTextures.clear();
+		}
+
+		for (const auto& block : plan.blocks)
+		{
+			VkMemoryRequirements memRequirements{};
+			memRequirements.size = block.size;
+			memRequirements.alignment = block.alignment;
+			memRequirements.memoryTypeBits = block.memoryTypeBits;
+
+			VmaAllocationCreateInfo memInfo{};
+			memInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+			VmaAllocation allocation{ VK_NULL_HANDLE };
+			VK_CHECK(vmaAllocateMemory(m_Device->memoryAllocator, &memRequirements, &memInfo, &allocation, nullptr));
+			m_TransientBlocks.push_back(allocation);
+		}
+	}
+
+	Buffer* RGResourcePool::CreateTransientBuffer(const RGBufferDesc& desc, const RGAliasingPlan::Placement& placement)
+	{
+		VkBufferCreateInfo createInfo = GetCreateInfo(desc);
+
+		m_TransientBuffers.emplace_back("");
+		auto& buffer = m_TransientBuffers.back();
+		VK_CHECK(vkCreateBuffer(*m_Device, &createInfo, nullptr, &buffer.buffer));
+
+		VmaAllocation block = m_TransientBlocks[placement.block];
+		VK_CHECK(vmaBindBufferMemory2(m_Device->memoryAllocator, block, placement.offset, buffer.buffer, nullptr));
+
+		VmaAllocationInfo allocInfo{};
+		vmaGetAllocationInfo(m_Device->memoryAllocator, block, &allocInfo);
+
+		// The memory belongs to the block, `allocation` stays null
+		buffer.memory = allocInfo.deviceMemory;
+		buffer.memOffset = allocInfo.offset + placement.offset;
+		buffer.size = desc.size;
+		buffer.bufferUsage = desc.usage;
+
+		return &buffer;
+	}
+
+	Image* RGResourcePool::CreateTransientTexture(const RGTextureDesc& desc, const RGAliasingPlan::Placement& placement)
+	{
+		VkImageCreateInfo createInfo = GetCreateInfo(desc);
+
+		m_TransientTextures.emplace_back("");
+		auto& texture = m_TransientTextures.back();
+		VK_CHECK(vkCreateImage(*m_Device, &createInfo, nullptr, &texture.image));
+
+		VK_CHECK(vmaBindImageMemory2(m_Device->memoryAllocator, m_TransientBlocks[placement.block], placement.offset, texture.image, nullptr));
+
+		// The memory belongs to the block, `memory` stays null so that `Image::Destroy()` doesn't free it
+		texture.type = createInfo.imageType;
+		texture.extent = createInfo.extent;
+		texture.format = createInfo.format;
+		texture.usage = createInfo.usage;
+		texture.sampleCount = createInfo.samples;
+		texture.tiling = createInfo.tiling;
+		texture.arrayLayers = createInfo.arrayLayers;
+		texture.subresource.arrayLayer = createInfo.arrayLayers;
+		texture.subresource.mipLevel = createInfo.mipLevels;
+		texture.subresource.aspectMask = IsDepthStencilFormat(createInfo.format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+		texture.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		VkImageViewType viewType = createInfo.imageType == VK_IMAGE_TYPE_3D ? VK_IMAGE_VIEW_TYPE_3D :
+			createInfo.arrayLayers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+		texture.CreateImageView(*m_Device, viewType, 0, 0, createInfo.mipLevels, createInfo.arrayLayers);
+
+		return &texture;
+	}
+
+	void RGResourcePool::ReleaseRetiredTransients(uint64_t frameIndex)
+	{
+		// The fence of the frame in flight is waited for before the compile, so the frames that used the retired transients,
+		// the one that retired them excluded, are done once as many frames as there are in flight have begun since
+		while (!m_RetiredTransients.empty() && m_RetiredTransients.front().frameIndex + Renderer::MAX_FRAMES_IN_FLIGHT <= frameIndex)
+		{
+			DestroyTransients(m_RetiredTransients.front());
+			m_RetiredTransients.pop_front();
+		}
+	}
+
+	void RGResourcePool::DestroyTransients()
+	{
+		for (auto& retired : m_RetiredTransients)
+			DestroyTransients(retired);
+		m_RetiredTransients.clear();
+
+		Transients current;
+		current.blocks = std::move(m_TransientBlocks);
+		current.buffers = std::move(m_TransientBuffers);
+		current.textures = std::move(m_TransientTextures);
+		DestroyTransients(current);
+
+		m_TransientBlocks.clear();
+		m_TransientBuffers.clear();
+		m_TransientTextures.clear();
+	}
+
+	void RGResourcePool::DestroyTransients(Transients& transients)
+	{
+		for (auto& buffer : transients.buffers)
+			vkDestroyBuffer(*m_Device, buffer.buffer, nullptr);
+		transients.buffers.clear();
+
+		for (auto& texture : transients.textures)
+			texture.Destroy(*m_Device);
+		transients.textures.clear();
+
+		for (auto allocation : transients.blocks)
+			vmaFreeMemory(m_Device->memoryAllocator, allocation);
+		transients.blocks.clear();
+	}
+
 	/// RGPass
 
 	RGPass::RGPass(const std::string& inName, PassFlags inFlags) : name{ inName }, m_PassFlags { inFlags }, m_Index{ g_InvalidHandle }
@@ -313,6 +508,23 @@ namespace Niagara
 	{
 		m_Renderer = renderer;
 		m_ResourcePool->Init(renderer->GetDevice(), renderer->ViewportExtent());
+
+		// Also called on resize
+		if (m_TimelineSemaphores[0] == VK_NULL_HANDLE)
+		{
+			VkSemaphoreTypeCreateInfo typeInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO };
+			typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+			typeInfo.initialValue = 0;
+
+			VkSemaphoreCreateInfo createInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+			createInfo.pNext = &typeInfo;
+
+			for (uint32_t i = 0; i < s_QueueCount; ++i)
+			{
+				VK_CHECK(vkCreateSemaphore(renderer->GetDevice(), &createInfo, nullptr, &m_TimelineSemaphores[i]));
+				m_TimelineValues[i] = 0;
+			}
+		}
 	}
 
 	void RGBuilder::Destroy()
@@ -321,8 +533,23 @@ namespace Niagara
 		m_Textures.clear();
 		m_BufferMap.clear();
 		m_TextureMap.clear();
+		m_TransientResources.clear();
 
 		m_ResourcePool->Destroy();
+
+		for (auto& semaphore : m_TimelineSemaphores)
+		{
+			if (semaphore != VK_NULL_HANDLE)
+				vkDestroySemaphore(m_Renderer->GetDevice(), semaphore, nullptr);
+			semaphore = VK_NULL_HANDLE;
+		}
+
+		for (auto& pools : m_RecordPools)
+		{
+			for (auto& pool : pools)
+				pool->Destroy();
+			pools.clear();
+		}
 	}
 
 	void RGBuilder::Resize(const VkExtent2D& viewportSize)
@@ -444,8 +671,11 @@ namespace Niagara
 		m_Passes.clear();
 		m_PassMap.clear();
 
-		m_ExecutionList.clear();
-		m_PassDependencies.clear();
+		// Accesses are declared again with the passes
+		for (auto& buffer : m_Buffers)
+			buffer->Reset();
+		for (auto& texture : m_Textures)
+			texture->Reset();
 
 		m_bCacheValid = false;
 	}
@@ -454,6 +684,8 @@ namespace Niagara
 	{
 		m_bValid = true;
 
+		m_ResourcePool->ReleaseRetiredTransients(m_Renderer->GetFrameIndex());
+
 		if (m_Passes.empty())
 		{
 			m_bValid = false;
@@ -468,36 +700,242 @@ namespace Niagara
 			return;
 		}
 
+		// Same passes and accesses as the previous compile, only the parameters of the passes may differ, which the plan
+		// doesn't depend on. Passes are looked up by index at execution, so the new ones are used as they are.
+		const uint64_t hash = ComputeStructureHash();
+		if (hash == m_CompiledHash)
+		{
+			m_bCacheValid = true;
+			return;
+		}
+
 		BuildExecutionList();
+		BuildLifetimes();
 		BuildResources();
+		BuildQueues();
 		BuildBarriers();
+		BuildBatches();
+
+		if (m_bLogCompile && m_Batches.size() > 1)
+			DumpSchedule();
 
+		m_CompiledHash = hash;
 		m_bCacheValid = true;
 	}
 
+	uint64_t RGBuilder::ComputeStructureHash() const
+	{
+		uint64_t hash = HashValue(m_Output);
+
+		const VkExtent2D viewport = m_Renderer->ViewportExtent();
+		hash = HashValue(viewport.width, hash);
+		hash = HashValue(viewport.height, hash);
+
+		auto HashAccess = [&hash](const RGResourceRef resource, const AccessInfo& access) {
+			hash = HashValue(resource, hash);
+			hash = HashValue(access.pipelineStage, hash);
+			hash = HashValue(access.access, hash);
+		};
+		auto HashBuffers = [&](const std::vector<AccessedBuffer>& buffers) {
+			hash = HashValue(buffers.size(), hash);
+			for (const auto& accessed : buffers)
+				HashAccess(accessed.buffer, accessed.access);
+		};
+		auto HashTextures = [&](const auto& textures) {
+			hash = HashValue(textures.size(), hash);
+			for (const auto& accessed : textures)
+			{
+				HashAccess(accessed.texture, accessed.access);
+				hash = HashValue(accessed.layout, hash);
+			}
+		};
+
+		hash = HashValue(m_Passes.size(), hash);
+		for (const auto& pass : m_Passes)
+		{
+			hash = HashBytes(pass->name.data(), pass->name.size(), hash);
+			hash = HashValue(pass->m_PassFlags, hash);
+			hash = HashValue(pass->enablePassCulling, hash);
+			hash = HashValue(pass->enableAsyncCompute, hash);
+
+			HashBuffers(pass->GetInBuffers());
+			HashBuffers(pass->GetOutBuffers());
+			HashTextures(pass->GetInTextures());
+			HashTextures(pass->GetOutTextures());
+			HashTextures(pass->GetInputAttachments());
+			HashTextures(pass->GetColorAttachments());
+
+			const auto& depthAttachment = pass->GetDepthAttachment();
+			HashAccess(depthAttachment.texture, depthAttachment.access);
+			hash = HashValue(depthAttachment.layout, hash);
+		}
+
+		// Descs decide the transient memory
+		for (const auto& buffer : m_Buffers)
+		{
+			hash = HashValue(buffer->desc.size, hash);
+			hash = HashValue(buffer->desc.usage, hash);
+		}
+		for (const auto& texture : m_Textures)
+		{
+			const auto& desc = texture->desc;
+			hash = HashValue(desc.sizeType, hash);
+			hash = HashValue(desc.w, hash);
+			hash = HashValue(desc.h, hash);
+			hash = HashValue(desc.d, hash);
+			hash = HashValue(desc.format, hash);
+			hash = HashValue(desc.samples, hash);
+			hash = HashValue(desc.mipLevels, hash);
+			hash = HashValue(desc.arrayLayers, hash);
+			hash = HashValue(desc.usage, hash);
+		}
+
+		// 0 stands for no compiled plan
+		return hash != 0 ? hash : 1;
+	}
+
+	void RGBuilder::BenchmarkCompile(Renderer* renderer)
+	{
+		const uint32_t passCounts[] = { 16, 64, 256, 1024 };
+		const uint32_t fullFrameCount = 8;
+		const uint32_t cachedFrameCount = 64;
+
+		printf("RG::Compile benchmark, ms per frame\n");
+		printf("  %6s %10s %10s %10s\n", "Passes", "Declare", "Full", "Cached");
+
+		for (uint32_t passCount : passCounts)
+		{
+			RGBuilder builder;
+			builder.Init(renderer);
+			builder.m_bLogCompile = false;
+
+			std::vector<RGBufferRef> buffers(passCount);
+			for (uint32_t i = 0; i < passCount; ++i)
+				buffers[i] = builder.CreateRGBuffer(RGBufferDesc::Create(64 * 1024), "BenchBuffer" + std::to_string(i));
+
+			auto output = builder.CreateRGTexture(RGTextureDesc::Create2D(64, 64, VK_FORMAT_R8G8B8A8_UNORM), "BenchOutput");
+			builder.SetOutputTexture(output);
+
+			// A chain of compute passes, each one reads the buffer written by the previous one
+			auto Declare = [&]() {
+				builder.Reset();
+
+				for (uint32_t i = 0; i < passCount; ++i)
+				{
+					struct PassData { uint32_t index; } params{ i };
+
+					auto& pass = builder.AddPass("BenchPass" + std::to_string(i), (PassFlags)EPassFlags::Compute, std::move(params), [](VkCommandBuffer cmd) { });
+
+					if (i > 0)
+						pass.ReadBuffer(buffers[i - 1], { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT }, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+					pass.WriteBuffer(buffers[i], { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT }, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+					if (i == passCount - 1)
+						pass.WriteStorageTexture(output);
+				}
+			};
+
+			double fullMs = 0.0;
+			for (uint32_t frame = 0; frame < fullFrameCount; ++frame)
+			{
+				Declare();
+				builder.InvalidateCompile();
+
+				double start = GetTimestampMs();
+				builder.Compile();
+				fullMs += GetTimestampMs() - start;
+			}
+
+			double declareMs = 0.0;
+			double cachedMs = 0.0;
+			for (uint32_t frame = 0; frame < cachedFrameCount; ++frame)
+			{
+				double start = GetTimestampMs();
+				Declare();
+				double declared = GetTimestampMs();
+				builder.Compile();
+				declareMs += declared - start;
+				cachedMs += GetTimestampMs() - declared;
+			}
+
+			printf("  %6u %10.4f %10.4f %10.4f\n", passCount, declareMs / cachedFrameCount, fullMs / fullFrameCount, cachedMs / cachedFrameCount);
+
+			builder.Destroy();
+		}
+	}
+
 	void RGBuilder::Execute()
 	{
 		if (!m_bValid)
 			return;
 
-		VkCommandBuffer cmd = m_Renderer->GetCommandBuffer();
-		g_CommandContext.BeginCommandBuffer(cmd);
+		const Device& device = m_Renderer->GetDevice();
+		const bool bMultiQueue = m_Batches.size() > 1;
+
+		// Timeline values of the frame are relative to the values reached by the previous one
+		const uint64_t frameValues[s_QueueCount] = { m_TimelineValues[0], m_TimelineValues[1] };
 
-		uint32_t i = 0;
-		for (const auto& passIndex : m_ExecutionList) 
+		for (uint32_t batchIndex = 0; batchIndex < static_cast<uint32_t>(m_Batches.size()); ++batchIndex)
 		{
-			auto pass = m_Passes[passIndex].get();
+			const auto& batch = m_Batches[batchIndex];
+			const bool bGraphics = batch.queue == EQueueFamily::Graphics;
 
-			PipelineBarriers(cmd, passIndex);
+			// Graphics command buffers are submitted in order with the rest of the frame
+			VkCommandBuffer cmd = bGraphics ? m_Renderer->GetCommandBuffer() :
+				g_CommandMgr.GetCommandBuffer(device, m_Renderer->GetFrameIndex() + 1, EQueueFamily::Compute);
+			g_CommandContext.BeginCommandBuffer(cmd);
 
-			pass->PreExecute(cmd);
+			RecordBatch(cmd, batchIndex);
 
-			pass->Execute(cmd);
+			g_CommandContext.EndCommandBuffer(cmd);
 
-			pass->PostExecute(cmd);
+			if (!bMultiQueue)
+				continue;
+
+			const uint32_t queueIndex = GetQueueIndex(batch.queue);
+
+			std::vector<VkSemaphoreSubmitInfo> waitInfos;
+			if (batch.waitValue > 0)
+			{
+				VkSemaphoreSubmitInfo waitInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO };
+				waitInfo.semaphore = m_TimelineSemaphores[1 - queueIndex];
+				waitInfo.value = frameValues[1 - queueIndex] + batch.waitValue;
+				waitInfo.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+				waitInfos.push_back(waitInfo);
+			}
+
+			std::vector<VkSemaphoreSubmitInfo> signalInfos;
+			if (batch.signalValue > 0)
+			{
+				VkSemaphoreSubmitInfo signalInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO };
+				signalInfo.semaphore = m_TimelineSemaphores[queueIndex];
+				signalInfo.value = frameValues[queueIndex] + batch.signalValue;
+				signalInfo.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+				signalInfos.push_back(signalInfo);
+			}
+
+			if (bGraphics)
+			{
+				if (!waitInfos.empty() || !signalInfos.empty())
+					m_Renderer->SubmitActiveCommands(waitInfos, signalInfos);
+			}
+			else
+			{
+				VkCommandBufferSubmitInfo cmdInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO };
+				cmdInfo.commandBuffer = cmd;
+
+				VkSubmitInfo2 submitInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO_2 };
+				submitInfo.waitSemaphoreInfoCount = static_cast<uint32_t>(waitInfos.size());
+				submitInfo.pWaitSemaphoreInfos = waitInfos.data();
+				submitInfo.commandBufferInfoCount = 1;
+				submitInfo.pCommandBufferInfos = &cmdInfo;
+				submitInfo.signalSemaphoreInfoCount = static_cast<uint32_t>(signalInfos.size());
+				submitInfo.pSignalSemaphoreInfos = signalInfos.data();
+				VK_CHECK(vkQueueSubmit2(g_CommandMgr.ComputeQueue(), 1, &submitInfo, VK_NULL_HANDLE));
+			}
 		}
 
-		g_CommandContext.EndCommandBuffer(cmd);
+		for (uint32_t i = 0; i < s_QueueCount; ++i)
+			m_TimelineValues[i] += m_FrameSignalCounts[i];
 	}
 
 	void RGBuilder::BuildPass(uint32_t passIndex, uint32_t level)
@@ -556,6 +994,8 @@ namespace Niagara
 	
 	void RGBuilder::BuildExecutionList()
 	{
+		m_ExecutionList.clear();
+		m_PassDependencies.clear();
 		m_PassDependencies.resize(m_Passes.size());
 
 		RGResourceRef output = m_Output;
@@ -594,10 +1034,120 @@ namespace Niagara
 		}
 	}
 
+	void RGBuilder::BuildLifetimes()
+	{
+		for (auto& buffer : m_Buffers)
+			buffer->firstUse = buffer->lastUse = g_InvalidHandle;
+		for (auto& texture : m_Textures)
+			texture->firstUse = texture->lastUse = g_InvalidHandle;
+
+		auto UpdateBufferLifetimes = [](const auto& buffers, uint32_t executionIndex) {
+			for (auto& accessed : buffers)
+			{
+				if (accessed.buffer != nullptr)
+					accessed.buffer->UpdateLifetime(executionIndex);
+			}
+		};
+		auto UpdateTextureLifetimes = [](const auto& textures, uint32_t executionIndex) {
+			for (auto& accessed : textures)
+			{
+				if (accessed.texture != nullptr)
+					accessed.texture->UpdateLifetime(executionIndex);
+			}
+		};
+
+		for (uint32_t i = 0; i < static_cast<uint32_t>(m_ExecutionList.size()); ++i)
+		{
+			auto pass = m_Passes[m_ExecutionList[i]].get();
+
+			UpdateBufferLifetimes(pass->GetInBuffers(), i);
+			UpdateBufferLifetimes(pass->GetOutBuffers(), i);
+			UpdateTextureLifetimes(pass->GetInTextures(), i);
+			UpdateTextureLifetimes(pass->GetOutTextures(), i);
+			UpdateTextureLifetimes(pass->GetInputAttachments(), i);
+			UpdateTextureLifetimes(pass->GetColorAttachments(), i);
+
+			auto textureRef = pass->GetDepthAttachment().texture;
+			if (textureRef != nullptr)
+				textureRef->UpdateLifetime(i);
+		}
+	}
+
+	void RGBuilder::BuildTransientResources(uint32_t& physicalResourceCount)
+	{
+		m_TransientResources.clear();
+
+		std::vector<RGTransientResource> transients;
+		auto AddTransient = [&](RGResourceRef resource, const VkMemoryRequirements& memRequirements, bool bImage) {
+			RGTransientResource transient{};
+			transient.size = memRequirements.size;
+			transient.alignment = memRequirements.alignment;
+			transient.memoryTypeBits = memRequirements.memoryTypeBits;
+			transient.firstUse = resource->firstUse;
+			transient.lastUse = resource->lastUse;
+			transient.bImage = bImage;
+
+			transients.push_back(transient);
+			m_TransientResources.push_back(resource);
+		};
+
+		for (auto& buffer : m_Buffers)
+		{
+			if (buffer->isExternal)
+				continue;
+
+			buffer->SetPhysicalResource(nullptr);
+			buffer->physicalIndex = g_InvalidHandle;
+			if (buffer->IsUsed())
+				AddTransient(buffer.get(), m_ResourcePool->GetMemoryRequirements(buffer->desc), false);
+		}
+		for (auto& texture : m_Textures)
+		{
+			if (texture->isExternal)
+				continue;
+
+			texture->SetPhysicalResource(nullptr);
+			texture->physicalIndex = g_InvalidHandle;
+			if (texture->IsUsed())
+				AddTransient(texture.get(), m_ResourcePool->GetMemoryRequirements(texture->desc), true);
+		}
+
+		BuildAliasingPlan(m_AliasingPlan, transients);
+
+		m_ResourcePool->AllocateTransientBlocks(m_AliasingPlan, m_Renderer->GetFrameIndex());
+		for (uint32_t i = 0; i < static_cast<uint32_t>(m_TransientResources.size()); ++i)
+		{
+			const auto& placement = m_AliasingPlan.placements[i];
+			if (transients[i].bImage)
+			{
+				auto textureRef = static_cast<RGTextureRef>(m_TransientResources[i]);
+				textureRef->SetPhysicalResource(m_ResourcePool->CreateTransientTexture(textureRef->desc, placement));
+			}
+			else
+			{
+				auto bufferRef = static_cast<RGBufferRef>(m_TransientResources[i]);
+				bufferRef->SetPhysicalResource(m_ResourcePool->CreateTransientBuffer(bufferRef->desc, placement));
+			}
+			m_TransientResources[i]->physicalIndex = physicalResourceCount++;
+		}
+
+		if (!m_bLogCompile)
+			return;
+
+		const double toMB = 1.0 / (1024.0 * 1024.0);
+		printf("RG::Transient memory: %.2f MB aliased, %.2f MB without aliasing (%.2f MB live at peak), %u resources in %u blocks.\n",
+			m_AliasingPlan.aliasedSize * toMB, m_AliasingPlan.unaliasedSize * toMB, m_AliasingPlan.peakLiveSize * toMB,
+			static_cast<uint32_t>(transients.size()), static_cast<uint32_t>(m_AliasingPlan.blocks.size()));
+	}
+
 	void RGBuilder::BuildResources()
 	{
 		uint32_t physicalResourceCount = m_ExternalResourceCount;
 
+#if USE_RG_TRANSIENT_ALIASING
+		BuildTransientResources(physicalResourceCount);
+#else
+
 		auto UpdateBufferResources = [&](const auto& buffers) {
 			if (!buffers.empty())
 			{
@@ -660,189 +1210,460 @@ namespace Niagara
 			}
 
 		}
+#endif
 
 		m_PhysicalResourceCount = physicalResourceCount;
 	}
 
+	void RGBuilder::BuildQueues()
+	{
+		const auto& queueFamilies = m_Renderer->GetDevice().queueFamilyIndices;
+		const bool bAsyncCompute = USE_RG_ASYNC_COMPUTE && queueFamilies.compute != queueFamilies.graphics;
+
+		m_PassQueues.assign(m_ExecutionList.size(), EQueueFamily::Graphics);
+		for (uint32_t i = 0; i < static_cast<uint32_t>(m_ExecutionList.size()); ++i)
+		{
+			const auto* pass = m_Passes[m_ExecutionList[i]].get();
+			if (bAsyncCompute && (pass->enableAsyncCompute || (pass->m_PassFlags & (uint32_t)EPassFlags::AsyncCompute)))
+				m_PassQueues[i] = EQueueFamily::Compute;
+		}
+	}
+
 	void RGBuilder::BuildBarriers()
 	{
-#if 0
-		struct Barrier
-		{
-			VkPipelineStageFlags2 srcStageMask{ 0 };
-			VkPipelineStageFlags2 dstStageMask{ 0 };
-			VkAccessFlags2 srcAccessMask{ 0 };
-			VkAccessFlags2 dstAccessMask{ 0 };
-			VkImageLayout srcLayout{ VK_IMAGE_LAYOUT_UNDEFINED };
-			VkImageLayout dstLayout{ VK_IMAGE_LAYOUT_UNDEFINED };
+		const uint32_t executionCount = static_cast<uint32_t>(m_ExecutionList.size());
+		const auto& queueFamilies = m_Renderer->GetDevice().queueFamilyIndices;
+		auto GetQueueFamilyIndex = [&](EQueueFamily queue) {
+			return queue == EQueueFamily::Compute ? queueFamilies.compute : queueFamilies.graphics;
 		};
-#endif
 
+		// Last access of each physical resource, and the execution index of its last use
 		std::vector<Barrier> barriers(m_PhysicalResourceCount);
-
-		auto& passBarrierList = m_PassBarriers;
-		passBarrierList.resize(m_ExecutionList.size());
-
-		auto UpdatePassBufferBarriers = [&](std::vector<Barrier>& passBarriers, const auto& buffers) {
-			if (!buffers.empty()) {
-				for (auto& accessed : buffers) {
-					auto bufferRef = accessed.buffer;
-					if (bufferRef != nullptr && bufferRef->GetPhysicalResource() != nullptr && bufferRef->physicalIndex != g_InvalidHandle) {
-						auto& barrier = barriers[bufferRef->physicalIndex];
-						if (!(barrier.dstAccessMask & accessed.access.access)) {
-							passBarriers.emplace_back(Barrier{});
-							auto& newBarrier = passBarriers.back();
-							newBarrier.srcAccessMask = barrier.dstAccessMask;
-							newBarrier.srcStageMask = barrier.dstStageMask;
-							newBarrier.dstAccessMask = barrier.dstAccessMask = accessed.access.access;
-							newBarrier.dstStageMask = barrier.dstStageMask = accessed.access.pipelineStage;
-						}
-					}
-				}
+		std::vector<uint32_t> lastUses(m_PhysicalResourceCount, g_InvalidHandle);
+		// Resources whose next barrier is an aliasing barrier, it has to be emitted even if the accesses match
+		std::vector<bool> aliasBarriers(m_PhysicalResourceCount, false);
+
+		m_PassBarriers.assign(executionCount, {});
+		m_PassReleases.assign(executionCount, {});
+		m_PrologueBarriers.clear();
+		m_EpilogueBarriers.clear();
+		m_QueueDependencies.clear();
+
+		auto UpdateBarrier = [&](uint32_t executionIndex, RGResourceRef resource, bool bImage, const AccessInfo& access, VkImageLayout layout) {
+			if (resource == nullptr || resource->physicalIndex == g_InvalidHandle)
+				return;
+
+			const uint32_t index = resource->physicalIndex;
+			auto& state = barriers[index];
+			const uint32_t lastUse = lastUses[index];
+			lastUses[index] = executionIndex;
+
+			const EQueueFamily queue = m_PassQueues[executionIndex];
+			const EQueueFamily lastQueue = lastUse != g_InvalidHandle ? m_PassQueues[lastUse] : EQueueFamily::Graphics;
+
+			// Ownership transfer, the contents of a transient resource don't survive its first use so it doesn't need one
+			if (lastQueue != queue && (lastUse != g_InvalidHandle || resource->isExternal))
+			{
+				Barrier release{};
+				release.srcStageMask = lastUse != g_InvalidHandle ? state.dstStageMask : VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+				release.srcAccessMask = lastUse != g_InvalidHandle ? state.dstAccessMask : VK_ACCESS_2_MEMORY_WRITE_BIT;
+				release.srcLayout = state.dstLayout;
+				release.dstLayout = bImage ? layout : state.dstLayout;
+				release.srcQueueFamily = GetQueueFamilyIndex(lastQueue);
+				release.dstQueueFamily = GetQueueFamilyIndex(queue);
+				release.resource = resource;
+				release.bImage = bImage;
+
+				Barrier acquire = release;
+				acquire.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+				acquire.srcAccessMask = VK_ACCESS_2_NONE;
+				acquire.dstStageMask = access.pipelineStage;
+				acquire.dstAccessMask = access.access;
+
+				(lastUse != g_InvalidHandle ? m_PassReleases[lastUse] : m_PrologueBarriers).push_back(release);
+				m_PassBarriers[executionIndex].push_back(acquire);
+				m_QueueDependencies.push_back({ lastUse, executionIndex });
 			}
-		};
-		auto UpdatePassImageBarriers = [&](std::vector<Barrier>& passBarriers, const auto& textures) {
-			if (!textures.empty()) {
-				for (auto& accessed : textures) {
-					auto textureRef = accessed.texture;
-					if (textureRef != nullptr && textureRef->GetPhysicalResource() != nullptr && textureRef->physicalIndex != g_InvalidHandle) {
-						auto& barrier = barriers[textureRef->physicalIndex];
-						if (!(barrier.dstAccessMask & accessed.access.access) || !(barrier.dstLayout & accessed.layout)) {
-							passBarriers.emplace_back(Barrier{});
-							auto& newBarrier = passBarriers.back();
-							newBarrier.srcAccessMask = barrier.dstAccessMask;
-							newBarrier.srcStageMask = barrier.dstStageMask;
-							newBarrier.srcLayout = barrier.dstLayout;
-							newBarrier.dstAccessMask = barrier.dstAccessMask = accessed.access.access;
-							newBarrier.dstStageMask = barrier.dstStageMask = accessed.access.pipelineStage;
-							newBarrier.dstLayout = barrier.dstLayout = accessed.layout;
-						}
-					}
-				}
+			else if (aliasBarriers[index] || !(state.dstAccessMask & access.access) || (bImage && state.dstLayout != layout))
+			{
+				Barrier barrier{};
+				barrier.srcStageMask = state.dstStageMask;
+				barrier.srcAccessMask = state.dstAccessMask;
+				barrier.srcLayout = state.dstLayout;
+				barrier.dstStageMask = access.pipelineStage;
+				barrier.dstAccessMask = access.access;
+				barrier.dstLayout = bImage ? layout : VK_IMAGE_LAYOUT_UNDEFINED;
+				barrier.resource = resource;
+				barrier.bImage = bImage;
+
+				m_PassBarriers[executionIndex].push_back(barrier);
 			}
+			else
+			{
+				return;
+			}
+
+			aliasBarriers[index] = false;
+			state.dstStageMask = access.pipelineStage;
+			state.dstAccessMask = access.access;
+			if (bImage)
+				state.dstLayout = layout;
+		};
+		auto UpdateBufferBarriers = [&](uint32_t executionIndex, const auto& buffers) {
+			for (auto& accessed : buffers)
+				UpdateBarrier(executionIndex, accessed.buffer, false, accessed.access, VK_IMAGE_LAYOUT_UNDEFINED);
+		};
+		auto UpdateTextureBarriers = [&](uint32_t executionIndex, const auto& textures) {
+			for (auto& accessed : textures)
+				UpdateBarrier(executionIndex, accessed.texture, true, accessed.access, accessed.layout);
 		};
 
-		uint32_t i = 0;
-		for (const auto& passIndex : m_ExecutionList)
+		for (uint32_t i = 0; i < executionCount; ++i)
 		{
-			auto pass = m_Passes[passIndex].get();
-			auto& passBarriers = passBarrierList[i++];
+			auto pass = m_Passes[m_ExecutionList[i]].get();
 
-			auto& inBuffers = pass->GetInBuffers();
-			UpdatePassBufferBarriers(passBarriers, inBuffers);
-			
-			auto& outBuffers = pass->GetOutBuffers();
-			UpdatePassBufferBarriers(passBarriers, outBuffers);
-			
-			auto& inTextures = pass->GetInTextures();
-			UpdatePassImageBarriers(passBarriers, inTextures);
-			
-			auto& outTextures = pass->GetOutTextures();
-			UpdatePassImageBarriers(passBarriers, outTextures);
-			
-			auto& inAttachments = pass->GetInputAttachments();
-			UpdatePassImageBarriers(passBarriers, inAttachments);
-			
-			auto& colorAttachments = pass->GetColorAttachments();
-			UpdatePassImageBarriers(passBarriers, colorAttachments);
-			
-			auto& depthAttachment = pass->GetDepthAttachment();
+#if USE_RG_TRANSIENT_ALIASING
+			// Aliasing barriers, the first use of a transient resource waits for the last use of the resources that used its memory
+			// before, its contents are discarded (undefined layout). A semaphore wait does it for the resources of the other queue.
+			for (uint32_t t = 0; t < static_cast<uint32_t>(m_TransientResources.size()); ++t)
 			{
-				auto textureRef = depthAttachment.texture;
-				if (textureRef != nullptr && textureRef->GetPhysicalResource() != nullptr && textureRef->physicalIndex != g_InvalidHandle) 
+				auto resourceRef = m_TransientResources[t];
+				const auto& aliases = m_AliasingPlan.aliases[t];
+				if (resourceRef->firstUse != i || aliases.empty())
+					continue;
+
+				Barrier aliasBarrier{};
+				for (uint32_t alias : aliases)
 				{
-					auto& barrier = barriers[textureRef->physicalIndex];
-					if (!(barrier.dstAccessMask & depthAttachment.access.access) || !(barrier.dstLayout & depthAttachment.layout)) 
+					const auto aliasRef = m_TransientResources[alias];
+					if (m_PassQueues[aliasRef->lastUse] != m_PassQueues[i])
 					{
-						passBarriers.emplace_back(Barrier{});
-						auto& newBarrier = passBarriers.back();
-						newBarrier.srcAccessMask = barrier.dstAccessMask;
-						newBarrier.srcStageMask = barrier.dstStageMask;
-						newBarrier.srcLayout = barrier.dstLayout;
-						newBarrier.dstAccessMask = barrier.dstAccessMask = depthAttachment.access.access;
-						newBarrier.dstStageMask = barrier.dstStageMask = depthAttachment.access.pipelineStage;
-						newBarrier.dstLayout = barrier.dstLayout = depthAttachment.layout;
+						m_QueueDependencies.push_back({ aliasRef->lastUse, i });
+						continue;
 					}
+
+					const auto& aliasState = barriers[aliasRef->physicalIndex];
+					aliasBarrier.dstStageMask |= aliasState.dstStageMask;
+					aliasBarrier.dstAccessMask |= aliasState.dstAccessMask;
 				}
+				barriers[resourceRef->physicalIndex] = aliasBarrier;
+				aliasBarriers[resourceRef->physicalIndex] = true;
 			}
+#endif
+
+			UpdateBufferBarriers(i, pass->GetInBuffers());
+			UpdateBufferBarriers(i, pass->GetOutBuffers());
+			UpdateTextureBarriers(i, pass->GetInTextures());
+			UpdateTextureBarriers(i, pass->GetOutTextures());
+			UpdateTextureBarriers(i, pass->GetInputAttachments());
+			UpdateTextureBarriers(i, pass->GetColorAttachments());
 
+			const auto& depthAttachment = pass->GetDepthAttachment();
+			UpdateBarrier(i, depthAttachment.texture, true, depthAttachment.access, depthAttachment.layout);
 		}
+
+		// External resources last used on the compute queue go back to the graphics queue
+		auto ReleaseExternal = [&](RGResourceRef resource, bool bImage) {
+			if (!resource->isExternal || resource->physicalIndex == g_InvalidHandle)
+				return;
+
+			const uint32_t lastUse = lastUses[resource->physicalIndex];
+			if (lastUse == g_InvalidHandle || m_PassQueues[lastUse] == EQueueFamily::Graphics)
+				return;
+
+			const auto& state = barriers[resource->physicalIndex];
+
+			Barrier release{};
+			release.srcStageMask = state.dstStageMask;
+			release.srcAccessMask = state.dstAccessMask;
+			release.srcLayout = release.dstLayout = state.dstLayout;
+			release.srcQueueFamily = GetQueueFamilyIndex(m_PassQueues[lastUse]);
+			release.dstQueueFamily = GetQueueFamilyIndex(EQueueFamily::Graphics);
+			release.resource = resource;
+			release.bImage = bImage;
+
+			Barrier acquire = release;
+			acquire.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+			acquire.srcAccessMask = VK_ACCESS_2_NONE;
+			acquire.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+			acquire.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+			m_PassReleases[lastUse].push_back(release);
+			m_EpilogueBarriers.push_back(acquire);
+		};
+		for (auto& buffer : m_Buffers)
+			ReleaseExternal(buffer.get(), false);
+		for (auto& texture : m_Textures)
+			ReleaseExternal(texture.get(), true);
 	}
 
-	void RGBuilder::PipelineBarriers(VkCommandBuffer cmd, uint32_t passIndex)
+	void RGBuilder::BuildBatches()
 	{
-		uint32_t barrierOffset = 0;
-		auto BufferBarriers = [&barrierOffset](const auto& inBuffers, const std::vector<Barrier>& inBarriers) {
-			if (!inBuffers.empty())
-			{
-				for (const auto &accessed : inBuffers)
-				{
-					if (accessed.buffer != nullptr)
-					{
-						const auto& barrier = inBarriers[barrierOffset++];
+		const uint32_t executionCount = static_cast<uint32_t>(m_ExecutionList.size());
+		const bool bAsyncCompute = std::find(m_PassQueues.begin(), m_PassQueues.end(), EQueueFamily::Compute) != m_PassQueues.end();
 
-						auto bufferRef = accessed.buffer;
-						auto buffer = bufferRef->GetPhysicalResource();
-						g_CommandContext.BufferBarrier2(*buffer, 0, bufferRef->desc.size, 
-							barrier.srcStageMask, barrier.dstStageMask, barrier.srcAccessMask, barrier.dstAccessMask);
-					}
-				}
+		m_Batches.clear();
+		std::vector<uint32_t> passBatches(executionCount);
+
+		// The prologue is a graphics submit that orders the compute work of the frame after the graphics work of the previous one
+		// (transient memory is shared across frames) and releases the external resources
+		if (bAsyncCompute)
+		{
+			QueueBatch prologue{};
+			prologue.bPrologue = true;
+			m_Batches.push_back(prologue);
+		}
+
+		for (uint32_t i = 0; i < executionCount; ++i)
+		{
+			if (m_Batches.empty() || m_Batches.back().queue != m_PassQueues[i] || m_Batches.back().bPrologue)
+			{
+				QueueBatch batch{};
+				batch.queue = m_PassQueues[i];
+				batch.begin = i;
+				m_Batches.push_back(batch);
 			}
+			m_Batches.back().end = i + 1;
+			passBatches[i] = static_cast<uint32_t>(m_Batches.size() - 1);
+		}
+
+		if (!bAsyncCompute)
+		{
+			m_FrameSignalCounts[0] = m_FrameSignalCounts[1] = 0;
+			return;
+		}
+
+		// The epilogue acquires the external resources back and joins the compute queue, so that the frame fence covers it
+		{
+			QueueBatch epilogue{};
+			epilogue.begin = epilogue.end = executionCount;
+			epilogue.bEpilogue = true;
+			m_Batches.push_back(epilogue);
+		}
+
+		const uint32_t batchCount = static_cast<uint32_t>(m_Batches.size());
+		auto AddWait = [&](uint32_t srcBatch, uint32_t dstBatch) {
+			auto& batch = m_Batches[dstBatch];
+			if (m_Batches[srcBatch].queue != batch.queue)
+				batch.waitBatch = batch.waitBatch == g_InvalidHandle ? srcBatch : std::max(batch.waitBatch, srcBatch);
 		};
-		auto ImageBarriers = [&barrierOffset](const auto& inTextures, const std::vector<Barrier>& inBarriers)
+
+		for (const auto& dependency : m_QueueDependencies)
+			AddWait(dependency.first != g_InvalidHandle ? passBatches[dependency.first] : 0, passBatches[dependency.second]);
+
+		for (uint32_t i = 0; i < batchCount; ++i)
 		{
-			if (!inTextures.empty())
+			if (m_Batches[i].queue == EQueueFamily::Compute)
 			{
-				for (const auto& accessed : inTextures)
-				{
-					if (accessed.texture != nullptr)
-					{
-						const auto& barrier = inBarriers[barrierOffset++];
+				AddWait(0, i);
+				break;
+			}
+		}
+		for (uint32_t i = batchCount; i-- > 0; )
+		{
+			if (m_Batches[i].queue == EQueueFamily::Compute)
+			{
+				AddWait(i, batchCount - 1);
+				break;
+			}
+		}
 
-						auto textureRef = accessed.texture;
-						auto texture = textureRef->GetPhysicalResource();
-						// FIXME: use different ImageView, not just views[0]
-						g_CommandContext.ImageBarrier2(*texture, texture->views[0].subresourceRange,
-							barrier.srcLayout, barrier.dstLayout, barrier.srcStageMask, barrier.dstStageMask, barrier.srcAccessMask, barrier.dstAccessMask);
-					}
-				}
+		// Only the batches that are waited for signal
+		std::vector<bool> signals(batchCount, false);
+		for (const auto& batch : m_Batches)
+		{
+			if (batch.waitBatch != g_InvalidHandle)
+				signals[batch.waitBatch] = true;
+		}
+
+		uint64_t signalCounts[s_QueueCount]{};
+		for (uint32_t i = 0; i < batchCount; ++i)
+		{
+			if (signals[i])
+				m_Batches[i].signalValue = ++signalCounts[GetQueueIndex(m_Batches[i].queue)];
+		}
+
+		// A wait is redundant if an earlier batch of the same queue waited for a later value already
+		uint64_t waitedValues[s_QueueCount]{};
+		for (auto& batch : m_Batches)
+		{
+			if (batch.waitBatch == g_InvalidHandle)
+				continue;
+
+			uint64_t& waitedValue = waitedValues[GetQueueIndex(batch.queue)];
+			const uint64_t value = m_Batches[batch.waitBatch].signalValue;
+			if (value > waitedValue)
+				batch.waitValue = waitedValue = value;
+		}
+
+		m_FrameSignalCounts[0] = signalCounts[0];
+		m_FrameSignalCounts[1] = signalCounts[1];
+	}
+
+	void RGBuilder::EmitBarriers(VkCommandBuffer cmd, const std::vector<Barrier>& barriers)
+	{
+		if (barriers.empty())
+			return;
+
+		uint32_t barrierCount = 0;
+		for (const auto& barrier : barriers)
+		{
+			if (barrier.bImage)
+			{
+				auto* texture = static_cast<RGTextureRef>(barrier.resource)->GetPhysicalResource();
+				// FIXME: use different ImageView, not just views[0]
+				g_CommandContext.ImageBarrier2(*texture, texture->views[0].subresourceRange,
+					barrier.srcLayout, barrier.dstLayout, barrier.srcStageMask, barrier.dstStageMask, barrier.srcAccessMask, barrier.dstAccessMask,
+					barrier.srcQueueFamily, barrier.dstQueueFamily);
 			}
-		};
-		
-		auto *pass = m_Passes[passIndex].get();
-		auto &passBarriers = m_PassBarriers[passIndex];
+			else
+			{
+				auto bufferRef = static_cast<RGBufferRef>(barrier.resource);
+				auto* buffer = bufferRef->GetPhysicalResource();
+				g_CommandContext.BufferBarrier2(*buffer, 0, bufferRef->desc.size,
+					barrier.srcStageMask, barrier.dstStageMask, barrier.srcAccessMask, barrier.dstAccessMask,
+					barrier.srcQueueFamily, barrier.dstQueueFamily);
+			}
+
+			// The context caches a limited number of barriers
+			if (++barrierCount % CommandContext::s_MaxBarrierNum == 0)
+				g_CommandContext.PipelineBarriers2(cmd);
+		}
+
+		g_CommandContext.PipelineBarriers2(cmd);
+	}
+
+	void RGBuilder::PipelineBarriers(VkCommandBuffer cmd, uint32_t executionIndex)
+	{
+		EmitBarriers(cmd, m_PassBarriers[executionIndex]);
+	}
+
+	void RGBuilder::RecordPasses(VkCommandBuffer cmd, uint32_t begin, uint32_t end, uint32_t parentScope)
+	{
+		for (uint32_t i = begin; i < end; ++i)
 		{
-			auto& inBuffers = pass->GetInBuffers();
-			BufferBarriers(inBuffers, passBarriers);
+			auto pass = m_Passes[m_ExecutionList[i]].get();
 
-			auto& outBuffers = pass->GetOutBuffers();
-			BufferBarriers(outBuffers, passBarriers);
+			// Barriers included, the scopes of the pass are nested in it
+			ProfileScope passScope(cmd, pass->name, m_PassQueues[i], parentScope);
 
-			auto& inTextures = pass->GetInTextures();
-			ImageBarriers(inTextures, passBarriers);
+			PipelineBarriers(cmd, i);
 
-			auto& outTextures = pass->GetOutTextures();
-			ImageBarriers(outTextures, passBarriers);
+			pass->PreExecute(cmd);
 
-			auto& inAttachments = pass->GetInputAttachments();
-			ImageBarriers(inAttachments, passBarriers);
+			pass->Execute(cmd);
 
-			auto& colorAttachments = pass->GetColorAttachments();
-			ImageBarriers(colorAttachments, passBarriers);
+			pass->PostExecute(cmd);
 
-			auto& depthAttachment = pass->GetDepthAttachment();
+			EmitBarriers(cmd, m_PassReleases[i]);
+		}
+	}
+
+	void RGBuilder::RecordBatch(VkCommandBuffer cmd, uint32_t batchIndex)
+	{
+		const auto& batch = m_Batches[batchIndex];
+		// Parent of the pass scopes, also the ones recorded by the jobs
+		const uint32_t parentScope = g_Profiler.GetCurrentScope();
+
+		if (batch.bPrologue)
+			EmitBarriers(cmd, m_PrologueBarriers);
+
+#if USE_RG_PARALLEL_RECORDING
+		const uint32_t rangeCount = (batch.end - batch.begin + RG_PASSES_PER_RECORD_JOB - 1) / RG_PASSES_PER_RECORD_JOB;
+
+		if (rangeCount > 1 && g_JobSystem.IsInited())
+		{
+			const Device& device = m_Renderer->GetDevice();
+			const uint64_t fenceVal = m_Renderer->GetFrameIndex() + 1;
+
+			auto& pools = m_RecordPools[GetQueueIndex(batch.queue)];
+			const uint32_t familyIndex = batch.queue == EQueueFamily::Graphics ? device.queueFamilyIndices.graphics : device.queueFamilyIndices.compute;
+			while (pools.size() < rangeCount)
 			{
-				auto textureRef = depthAttachment.texture;
-				if (textureRef != nullptr && textureRef->GetPhysicalResource() != nullptr && textureRef->physicalIndex != g_InvalidHandle)
+				pools.emplace_back(new CommandPool());
+				pools.back()->Init(device, familyIndex, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+			}
+
+			// Command buffers are taken here, the pools are only touched by this thread
+			std::vector<VkCommandBuffer> secondaryCmds(rangeCount);
+			for (uint32_t i = 0; i < rangeCount; ++i)
+				secondaryCmds[i] = pools[i]->GetCommandBuffer(fenceVal, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
+			JobCounter counter;
+			g_JobSystem.ParallelFor(counter, rangeCount, 1, [&](uint32_t rangeIndex)
 				{
-					auto* texture = textureRef->GetPhysicalResource();
-					auto& barrier = passBarriers[barrierOffset++];
-					g_CommandContext.ImageBarrier2(*texture, texture->views[0].subresourceRange,
-						barrier.srcLayout, barrier.dstLayout, barrier.srcStageMask, barrier.dstStageMask, barrier.srcAccessMask, barrier.dstAccessMask);
-				}
+					const uint32_t begin = batch.begin + rangeIndex * RG_PASSES_PER_RECORD_JOB;
+					const uint32_t end = std::min(batch.end, begin + RG_PASSES_PER_RECORD_JOB);
+
+					// Passes begin and end their rendering within the range, nothing is inherited
+					VkCommandBufferInheritanceInfo inheritanceInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+
+					VkCommandBufferBeginInfo beginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+					beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+					beginInfo.pInheritanceInfo = &inheritanceInfo;
+					VK_CHECK(vkBeginCommandBuffer(secondaryCmds[rangeIndex], &beginInfo));
+
+					// The context is per thread, drop what a previous job left in it
+					g_CommandContext.Invalidate();
+
+					// Barriers are recorded with the passes, the primary command buffer executes the ranges in order so
+					// the ones crossing a range boundary still sit between their passes
+					RecordPasses(secondaryCmds[rangeIndex], begin, end, parentScope);
+
+					g_CommandContext.EndCommandBuffer(secondaryCmds[rangeIndex]);
+				});
+			g_JobSystem.Wait(counter);
+
+			vkCmdExecuteCommands(cmd, rangeCount, secondaryCmds.data());
+		}
+		else
+#endif
+		{
+			RecordPasses(cmd, batch.begin, batch.end, parentScope);
+		}
+
+		if (batch.bEpilogue)
+			EmitBarriers(cmd, m_EpilogueBarriers);
+	}
+
+	void RGBuilder::DumpSchedule() const
+	{
+		const char* queueNames[] = { "Graphics", "Compute" };
+
+		printf("RG::Schedule, %u passes in %u batches\n", static_cast<uint32_t>(m_ExecutionList.size()), static_cast<uint32_t>(m_Batches.size()));
+		for (uint32_t b = 0; b < static_cast<uint32_t>(m_Batches.size()); ++b)
+		{
+			const auto& batch = m_Batches[b];
+			const uint32_t queueIndex = GetQueueIndex(batch.queue);
+
+			printf("  [%u] %-8s", b, queueNames[queueIndex]);
+			if (batch.waitValue > 0)
+				printf(" wait %s %llu,", queueNames[1 - queueIndex], static_cast<unsigned long long>(batch.waitValue));
+
+			uint32_t transferCount = 0;
+			if (batch.bPrologue)
+			{
+				printf(" prologue");
+				transferCount += static_cast<uint32_t>(m_PrologueBarriers.size());
+			}
+			for (uint32_t i = batch.begin; i < batch.end; ++i)
+			{
+				printf(" %s", m_Passes[m_ExecutionList[i]]->name.c_str());
+				for (const auto& barrier : m_PassBarriers[i])
+					transferCount += barrier.srcQueueFamily != barrier.dstQueueFamily ? 1 : 0;
+				transferCount += static_cast<uint32_t>(m_PassReleases[i].size());
+			}
+			if (batch.bEpilogue)
+			{
+				printf(" epilogue");
+				transferCount += static_cast<uint32_t>(m_EpilogueBarriers.size());
 			}
 
-			g_CommandContext.PipelineBarriers2(cmd);
+			if (transferCount > 0)
+				printf(", %u ownership transfers", transferCount);
+			if (batch.signalValue > 0)
+				printf(", signal %s %llu", queueNames[queueIndex], static_cast<unsigned long long>(batch.signalValue));
+			printf("\n");
 		}
 	}
 }
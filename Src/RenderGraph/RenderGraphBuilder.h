@@ -1,9 +1,12 @@
 #pragma once
 
 #include "pch.h"
+#include "Config.h"
 #include "VkCommon.h"
 #include "Renderer.h"
+#include "RenderGraphAliasing.h"
 #include <set>
+#include <deque>
 #include <unordered_set>
 #include <unordered_map>
 
@@ -112,11 +115,21 @@ namespace Niagara
 		const std::string& GetName() const { return m_Name; }
 		void SetName(const std::string& name) { m_Name = name; }
 
+		void UpdateLifetime(uint32_t executionIndex)
+		{
+			firstUse = std::min(firstUse, executionIndex);
+			lastUse = lastUse == g_InvalidHandle ? executionIndex : std::max(lastUse, executionIndex);
+		}
+		bool IsUsed() const { return firstUse != g_InvalidHandle; }
+
 		void Reset();
 		bool IsCacheValid() const { return m_bCacheValid; }
 
 		bool isExternal{ false };
 		std::uint32_t physicalIndex{ g_InvalidHandle };
+		// First and last use, indices into the execution list
+		std::uint32_t firstUse{ g_InvalidHandle };
+		std::uint32_t lastUse{ g_InvalidHandle };
 
 	private:
 		std::string m_Name;
@@ -210,7 +223,25 @@ namespace Niagara
 		Buffer* CreateBuffer(const RGBufferDesc &desc, const std::string &name);
 		Image* CreateTexture(const RGTextureDesc &desc, const std::string &name);
 
+		// Transient resources are created without memory and bound into the shared memory blocks of an aliasing plan,
+		// they're recreated by each compile. The ones of the previous plan may still be used by the frames in flight,
+		// they're retired and destroyed `MAX_FRAMES_IN_FLIGHT` frames later.
+		VkMemoryRequirements GetMemoryRequirements(const RGBufferDesc& desc) const;
+		VkMemoryRequirements GetMemoryRequirements(const RGTextureDesc& desc) const;
+
+		void AllocateTransientBlocks(const RGAliasingPlan& plan, uint64_t frameIndex);
+		Buffer* CreateTransientBuffer(const RGBufferDesc& desc, const RGAliasingPlan::Placement& placement);
+		Image* CreateTransientTexture(const RGTextureDesc& desc, const RGAliasingPlan::Placement& placement);
+		// Destroys the retired transients that no frame in flight can use anymore
+		void ReleaseRetiredTransients(uint64_t frameIndex);
+		// Destroys all the transients right away, the device must be idle
+		void DestroyTransients();
+
 	private:
+		VkExtent3D GetExtent(const RGTextureDesc& desc) const;
+		VkBufferCreateInfo GetCreateInfo(const RGBufferDesc& desc) const;
+		VkImageCreateInfo GetCreateInfo(const RGTextureDesc& desc) const;
+
 		const Device* m_Device{ nullptr };
 		VkExtent2D m_ViewportSize{ 1,1 };
 
@@ -218,6 +249,22 @@ namespace Niagara
 		std::unordered_map<std::string, uint32_t> m_TextureMap;
 		std::vector<Buffer> m_Buffers;
 		std::vector<Image> m_Textures;
+
+		// Transients, deques so that the resources never move
+		struct Transients
+		{
+			std::vector<VmaAllocation> blocks;
+			std::deque<Buffer> buffers;
+			std::deque<Image> textures;
+			// Frame that retired them
+			uint64_t frameIndex{ 0 };
+		};
+		void DestroyTransients(Transients& transients);
+
+		std::vector<VmaAllocation> m_TransientBlocks;
+		std::deque<Buffer> m_TransientBuffers;
+		std::deque<Image> m_TransientTextures;
+		std::deque<Transients> m_RetiredTransients;
 	};
 
 
@@ -454,25 +501,51 @@ namespace Niagara
 			}
 		}
 
+		// Drops the declared passes, the compiled plan is kept until `Compile()` finds the new declarations differ
 		void Reset();
+		// Skipped when the structural hash of the declarations matches the one of the previous compile
 		void Compile();
 		void Execute();
 
 		bool IsCacheValid() const { return m_bCacheValid; }
+		// Forces the next `Compile()` to rebuild the plan
+		void InvalidateCompile() { m_CompiledHash = 0; m_bCacheValid = false; }
+
+		// Hash of everything the compiled plan depends on: the passes in declaration order, their flags and resource accesses,
+		// the resource descs, the output and the viewport. Parameters and lambdas of the passes aren't part of it.
+		uint64_t ComputeStructureHash() const;
+
+		// Times full and cached compiles of synthetic compute chains of increasing pass counts
+		static void BenchmarkCompile(Renderer* renderer);
+
+		// Transient memory of the last compile
+		const RGAliasingPlan& GetAliasingPlan() const { return m_AliasingPlan; }
+
+		// Prints the queue batches of the last compile, with their semaphore waits and signals and the ownership transfers
+		void DumpSchedule() const;
 
 	private:
 		void BuildExecutionList();
 		void BuildPass(uint32_t passIndex, uint32_t level = 0);
 		void BuildDependencies(uint32_t passIndex, const std::set<uint32_t> &dependentPasses, uint32_t level = 0);
+		void BuildLifetimes();
 		void BuildResources();
+		void BuildTransientResources(uint32_t& physicalResourceCount);
+		void BuildQueues();
 		void BuildBarriers();
+		void BuildBatches();
 
-		void PipelineBarriers(VkCommandBuffer cmd, uint32_t passIndex);
+		void PipelineBarriers(VkCommandBuffer cmd, uint32_t executionIndex);
+		// Barriers, pass and ownership releases of the execution range [begin, end), each pass in a profile scope under `parentScope`
+		void RecordPasses(VkCommandBuffer cmd, uint32_t begin, uint32_t end, uint32_t parentScope);
+		void RecordBatch(VkCommandBuffer cmd, uint32_t batchIndex);
 
 		Renderer* m_Renderer{ nullptr };
 
 		bool m_bValid{ true };
 		bool m_bCacheValid{ false };
+		uint64_t m_CompiledHash{ 0 };
+		bool m_bLogCompile{ RG_LOG_COMPILE != 0 };
 		
 		std::vector<std::unique_ptr<RGPass>> m_Passes;
 		std::unordered_map<std::string, uint32_t> m_PassMap; // name - pass index
@@ -498,8 +571,61 @@ namespace Niagara
 			VkAccessFlags2 dstAccessMask{ 0 };
 			VkImageLayout srcLayout{ VK_IMAGE_LAYOUT_UNDEFINED };
 			VkImageLayout dstLayout{ VK_IMAGE_LAYOUT_UNDEFINED };
+			// Queue family ownership transfer if they differ
+			uint32_t srcQueueFamily{ VK_QUEUE_FAMILY_IGNORED };
+			uint32_t dstQueueFamily{ VK_QUEUE_FAMILY_IGNORED };
+			RGResourceRef resource{ nullptr };
+			bool bImage{ false };
 		};
+		void EmitBarriers(VkCommandBuffer cmd, const std::vector<Barrier>& barriers);
+
+		// Per execution index, barriers (and ownership acquires) before the pass and ownership releases after it
 		std::vector<std::vector<Barrier>> m_PassBarriers;
+		std::vector<std::vector<Barrier>> m_PassReleases;
+		// External resources are owned by the graphics queue between frames, released to the compute queue at the start of
+		// the frame and acquired back at its end
+		std::vector<Barrier> m_PrologueBarriers;
+		std::vector<Barrier> m_EpilogueBarriers;
+
+		// Multi-queue schedule
+		// Consecutive passes of the execution list on the same queue form a batch, recorded into its own command buffer. Each
+		// queue has a timeline semaphore, a batch waits on the other queue only for what it depends on.
+		struct QueueBatch
+		{
+			EQueueFamily queue{ EQueueFamily::Graphics };
+			// Range of the execution list
+			uint32_t begin{ 0 };
+			uint32_t end{ 0 };
+			// Batch of the other queue this one waits for
+			uint32_t waitBatch{ g_InvalidHandle };
+			// Timeline values relative to the start of the frame, 0 if none
+			uint64_t waitValue{ 0 };
+			uint64_t signalValue{ 0 };
+			bool bPrologue{ false };
+			bool bEpilogue{ false };
+		};
+		static constexpr uint32_t s_QueueCount = 2;
+		static uint32_t GetQueueIndex(EQueueFamily queue) { return queue == EQueueFamily::Graphics ? 0 : 1; }
+
+		// Per execution index
+		std::vector<EQueueFamily> m_PassQueues;
+		// Cross-queue dependencies between execution indices, g_InvalidHandle stands for the prologue
+		std::vector<std::pair<uint32_t, uint32_t>> m_QueueDependencies;
+		std::vector<QueueBatch> m_Batches;
+
+		VkSemaphore m_TimelineSemaphores[s_QueueCount]{};
+		uint64_t m_TimelineValues[s_QueueCount]{};
+		uint64_t m_FrameSignalCounts[s_QueueCount]{};
+
+		// Parallel recording
+		// A batch is split into ranges of RG_PASSES_PER_RECORD_JOB passes, each one recorded by a job into a secondary command
+		// buffer, executed in order by the primary one. A command pool per range slot and queue, so no two jobs share a pool,
+		// their command buffers are recycled per frame in flight by the pool.
+		std::vector<std::unique_ptr<CommandPool>> m_RecordPools[s_QueueCount];
+
+		// Transient resources, in the order of the aliasing plan
+		std::vector<RGResourceRef> m_TransientResources;
+		RGAliasingPlan m_AliasingPlan;
 
 		// A resource pool -> a viewport
 		std::unique_ptr<RGResourcePool> m_ResourcePool;
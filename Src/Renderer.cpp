@@ -1,7 +1,9 @@
 #include "Renderer.h"
 #include "CommandManager.h"
 #include "VkQuery.h"
+#include "Profiler.h"
 #include "RenderGraph/RenderGraphBuilder.h"
+#include "JobSystem.h"
 
 #include <iostream>
 
@@ -333,6 +335,7 @@ namespace Niagara
 
 			auto& features12 = m_DeviceFeatures.features12;
 			features12.drawIndirectCount = VK_TRUE;
+			features12.timelineSemaphore = VK_TRUE;
 			features12.storageBuffer8BitAccess = VK_TRUE;
 			features12.uniformAndStorageBuffer8BitAccess = VK_TRUE;
 			features12.storagePushConstant8 = VK_TRUE;
@@ -341,6 +344,7 @@ namespace Niagara
 			features12.samplerFilterMinmax = VK_TRUE;
 			features12.scalarBlockLayout = VK_TRUE;
 			features12.bufferDeviceAddress = VK_TRUE;
+			features12.hostQueryReset = VK_TRUE;
 			features13.pNext = &features12;
 
 			auto& features11 = m_DeviceFeatures.features11;
@@ -394,11 +398,15 @@ namespace Niagara
 		// Common states
 		g_CommonStates.Init(m_Device);
 		g_CommonQueryPools.Init(m_Device);
+		g_Profiler.Init(m_Device, MAX_FRAMES_IN_FLIGHT);
 
 		g_BufferMgr.InitViewDependentBuffers(*this);
 		g_TextureMgr.Init(m_Device, s_ResourcePath + "Textures/");
 
 		// Render graph
+#if USE_RG_PARALLEL_RECORDING
+		g_JobSystem.Init();
+#endif
 		m_GraphBuilder->Init(this);
 		RegisterExternalResources();
 
@@ -407,6 +415,10 @@ namespace Niagara
 
 		OnInit();
 
+#if RG_COMPILE_BENCHMARK
+		RGBuilder::BenchmarkCompile(this);
+#endif
+
 		return true;
 	}
 
@@ -417,6 +429,9 @@ namespace Niagara
 		DestroyFrameResources();
 
 		m_GraphBuilder->Destroy();
+#if USE_RG_PARALLEL_RECORDING
+		g_JobSystem.Destroy();
+#endif
 
 		g_BufferMgr.Cleanup(m_Device);
 		g_TextureMgr.Cleanup(m_Device);
@@ -425,6 +440,7 @@ namespace Niagara
 
 		g_CommonStates.Destroy(m_Device);
 		g_CommonQueryPools.Destroy(m_Device);
+		g_Profiler.Destroy(m_Device);
 
 #if defined(_DEBUG)
 		DestroyDebugUtilsMessengerEXT(m_Instance, m_DebugMessenger, nullptr);
@@ -472,13 +488,19 @@ namespace Niagara
 
 		// Only reset fences if we are submitting work
 		vkResetFences(m_Device, ARRAYSIZE(waitFences), waitFences);
+
+		// Resolves the frame this frame in flight recorded before
+		g_Profiler.BeginFrame(m_FrameIndex % MAX_FRAMES_IN_FLIGHT, m_FrameIndex);
 		
 		OnRender();
 
 		// RenderGraph: After
 		{
-			if (!m_GraphBuilder->IsCacheValid())
+			// Reuses the previous plan when the structure of the graph is unchanged
+			{
+				ProfileScope compileScope(VK_NULL_HANDLE, "RG Compile");
 				m_GraphBuilder->Compile();
+			}
 
 			m_GraphBuilder->Execute();
 		}
@@ -531,6 +553,8 @@ namespace Niagara
 			VK_CHECK(vkQueueSubmit(g_CommandMgr.GraphicsQueue(), 1, &submitInfo, sync.inFlightFence));
 		}
 
+		g_Profiler.EndFrame();
+
 		// Present
 		{
 			VkResult result = m_Swapchain.QueuePresent(g_CommandMgr.GraphicsQueue(), imageIndex, sync.renderCompleteSemaphore);
@@ -600,6 +624,24 @@ namespace Niagara
 		return cmd;
 	}
 
+	void Renderer::SubmitActiveCommands(const std::vector<VkSemaphoreSubmitInfo>& waitInfos, const std::vector<VkSemaphoreSubmitInfo>& signalInfos)
+	{
+		std::vector<VkCommandBufferSubmitInfo> cmdInfos(m_ActiveCmds.size(), { VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO });
+		for (size_t i = 0; i < m_ActiveCmds.size(); ++i)
+			cmdInfos[i].commandBuffer = m_ActiveCmds[i];
+
+		VkSubmitInfo2 submitInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO_2 };
+		submitInfo.waitSemaphoreInfoCount = static_cast<uint32_t>(waitInfos.size());
+		submitInfo.pWaitSemaphoreInfos = waitInfos.data();
+		submitInfo.commandBufferInfoCount = static_cast<uint32_t>(cmdInfos.size());
+		submitInfo.pCommandBufferInfos = cmdInfos.data();
+		submitInfo.signalSemaphoreInfoCount = static_cast<uint32_t>(signalInfos.size());
+		submitInfo.pSignalSemaphoreInfos = signalInfos.data();
+		VK_CHECK(vkQueueSubmit2(g_CommandMgr.GraphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE));
+
+		m_ActiveCmds.clear();
+	}
+
 	void Renderer::FrameResource::Init(const Device& device)
 	{
 		syncObjects.Init(device);
@@ -149,6 +149,9 @@ namespace Niagara
 		const VkExtent2D& ViewportExtent() const { return m_ViewportSize; }
 		const VkExtent2D& RenderExtent() const { return m_RenderExtent; }
 		VkCommandBuffer GetCommandBuffer(EQueueFamily queueFamily = EQueueFamily::Graphics);
+		// Submits the command buffers recorded so far to the graphics queue, the rest of the frame is submitted by `Render()`
+		void SubmitActiveCommands(const std::vector<VkSemaphoreSubmitInfo>& waitInfos, const std::vector<VkSemaphoreSubmitInfo>& signalInfos);
+		uint64_t GetFrameIndex() const { return m_FrameIndex; }
 
 	protected:
 		std::vector<const char*> m_InstanceExtensions;
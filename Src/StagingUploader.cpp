@@ -0,0 +1,416 @@
+#include "StagingUploader.h"
+#include "Device.h"
+
+
+namespace Niagara
+{
+	StagingUploader g_StagingUploader;
+
+	// Ring allocations are aligned for fast memcpy into write-combined memory
+	constexpr VkDeviceSize RING_ALIGNMENT = 64;
+
+	void StagingUploader::Init(const Device& device, VkDeviceSize capacity, EQueueFamily queueFamily)
+	{
+		m_pDevice = &device;
+		m_QueueFamily = queueFamily;
+		m_bOwnershipTransfer = queueFamily != EQueueFamily::Graphics &&
+			(queueFamily == EQueueFamily::Transfer ? device.queueFamilyIndices.transfer : device.queueFamilyIndices.compute) != device.queueFamilyIndices.graphics;
+
+		m_Capacity = AlignUp(capacity, RING_ALIGNMENT);
+		m_RingBuffer.Init(device, m_Capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+			VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+		m_Head = m_Tail = 0;
+
+		VkSemaphoreTypeCreateInfo typeInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO };
+		typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		typeInfo.initialValue = 0;
+
+		VkSemaphoreCreateInfo createInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+		createInfo.pNext = &typeInfo;
+		VK_CHECK(vkCreateSemaphore(device, &createInfo, nullptr, &m_Semaphore));
+		m_LastValue = 0;
+
+		m_Stats = {};
+	}
+
+	void StagingUploader::Destroy(const Device& device)
+	{
+		if (!IsInited())
+			return;
+
+		Flush();
+		Wait();
+		Reclaim(false);
+
+		vkDestroySemaphore(device, m_Semaphore, nullptr);
+		m_Semaphore = VK_NULL_HANDLE;
+
+		m_RingBuffer.Destroy(device);
+		m_pDevice = nullptr;
+	}
+
+	void StagingUploader::Upload(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size)
+	{
+		// Pieces of a quarter of the ring, so that a large upload never waits for the ring to drain completely
+		const VkDeviceSize maxPieceSize = m_Capacity / 4;
+		const uint8_t* src = static_cast<const uint8_t*>(data);
+
+		for (VkDeviceSize offset = 0; offset < size; offset += maxPieceSize)
+		{
+			VkDeviceSize pieceSize = std::min(maxPieceSize, size - offset);
+
+			uint8_t* dst = Allocate(dstBuffer, dstOffset + offset, pieceSize);
+			memcpy(dst, src + offset, pieceSize);
+		}
+	}
+
+	uint8_t* StagingUploader::Allocate(VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size)
+	{
+		assert(IsInited());
+
+		m_Stats.uploadedBytes += size;
+
+		if (size > m_Capacity / 2)
+		{
+			Buffer stagingBuffer;
+			stagingBuffer.Init(*m_pDevice, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+				VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+			m_PendingBuffers.push_back(stagingBuffer);
+
+			m_PendingCopies.push_back({ stagingBuffer.buffer, dstBuffer, VkBufferCopy{ 0, dstOffset, size } });
+			return stagingBuffer.mappedData;
+		}
+
+		VkDeviceSize ringOffset = 0;
+		uint8_t* data = AllocateRing(size, ringOffset);
+
+		m_PendingCopies.push_back({ m_RingBuffer.buffer, dstBuffer, VkBufferCopy{ ringOffset, dstOffset, size } });
+		return data;
+	}
+
+	uint8_t* StagingUploader::AllocateRing(VkDeviceSize size, VkDeviceSize& ringOffset)
+	{
+		const VkDeviceSize alignedSize = AlignUp(size, RING_ALIGNMENT);
+
+		for (;;)
+		{
+			// An allocation never wraps around, the end of the ring is skipped and recycled with the pending batch
+			uint64_t head = m_Head;
+			VkDeviceSize offset = head % m_Capacity;
+			if (offset + alignedSize > m_Capacity)
+			{
+				head += m_Capacity - offset;
+				offset = 0;
+			}
+
+			if (head + alignedSize - m_Tail <= m_Capacity)
+			{
+				m_Head = head + alignedSize;
+				ringOffset = offset;
+				return m_RingBuffer.mappedData + offset;
+			}
+
+			if (Reclaim(false))
+				continue;
+
+			// The ring is full, submit what's pending so that it can be recycled, then wait for the oldest batch
+			if (m_Batches.empty())
+				Flush();
+
+			++m_Stats.stallCount;
+			Reclaim(true);
+		}
+	}
+
+	bool StagingUploader::Reclaim(bool bWait)
+	{
+		if (m_Batches.empty())
+			return false;
+
+		if (bWait)
+			Wait(m_Batches.front().value);
+
+		const uint64_t completedValue = GetCompletedValue();
+
+		bool bReclaimed = false;
+		while (!m_Batches.empty() && m_Batches.front().value <= completedValue)
+		{
+			Batch& batch = m_Batches.front();
+
+			m_Tail = batch.ringEnd;
+
+			auto& cmdPool = g_CommandMgr.GetCommandPool(m_QueueFamily);
+			cmdPool.Free(1, &batch.cmd);
+			if (batch.releaseCmd != VK_NULL_HANDLE)
+				g_CommandMgr.GetCommandPool(EQueueFamily::Graphics).Free(1, &batch.releaseCmd);
+			if (batch.acquireCmd != VK_NULL_HANDLE)
+				g_CommandMgr.GetCommandPool(EQueueFamily::Graphics).Free(1, &batch.acquireCmd);
+
+			for (auto& buffer : batch.dedicatedBuffers)
+				buffer.Destroy(*m_pDevice);
+
+			m_Batches.pop_front();
+			bReclaimed = true;
+		}
+
+		return bReclaimed;
+	}
+
+	void StagingUploader::RecordCopies(VkCommandBuffer cmd)
+	{
+		// Merges consecutive regions that are contiguous in both buffers, then issues a single copy per run of regions that share
+		// the same source and destination buffers
+		std::vector<VkBufferCopy> regions;
+		regions.reserve(m_PendingCopies.size());
+
+		for (size_t i = 0; i < m_PendingCopies.size(); )
+		{
+			const VkBuffer srcBuffer = m_PendingCopies[i].srcBuffer;
+			const VkBuffer dstBuffer = m_PendingCopies[i].dstBuffer;
+
+			regions.clear();
+			for (; i < m_PendingCopies.size() && m_PendingCopies[i].srcBuffer == srcBuffer && m_PendingCopies[i].dstBuffer == dstBuffer; ++i)
+			{
+				const VkBufferCopy& copy = m_PendingCopies[i].copy;
+
+				if (!regions.empty())
+				{
+					VkBufferCopy& last = regions.back();
+					if (last.srcOffset + last.size == copy.srcOffset && last.dstOffset + last.size == copy.dstOffset)
+					{
+						last.size += copy.size;
+						continue;
+					}
+				}
+
+				regions.push_back(copy);
+			}
+
+			vkCmdCopyBuffer(cmd, srcBuffer, dstBuffer, static_cast<uint32_t>(regions.size()), regions.data());
+			m_Stats.copyCount += static_cast<uint32_t>(regions.size());
+		}
+	}
+
+	uint64_t StagingUploader::Flush()
+	{
+		if (!IsInited() || m_PendingCopies.empty())
+			return 0;
+
+		const Device& device = *m_pDevice;
+		const uint32_t graphicsFamily = device.queueFamilyIndices.graphics;
+		const uint32_t uploadFamily = m_QueueFamily == EQueueFamily::Transfer ? device.queueFamilyIndices.transfer :
+			m_QueueFamily == EQueueFamily::Compute ? device.queueFamilyIndices.compute : graphicsFamily;
+
+		m_RingBuffer.Flush(device);
+		for (const auto& buffer : m_PendingBuffers)
+			buffer.Flush(device);
+
+		// Destination buffers, for the ownership transfer
+		std::vector<VkBufferMemoryBarrier> ownershipBarriers;
+		if (m_bOwnershipTransfer)
+		{
+			std::vector<VkBuffer> dstBuffers;
+			for (const auto& copy : m_PendingCopies)
+				dstBuffers.push_back(copy.dstBuffer);
+			std::sort(dstBuffers.begin(), dstBuffers.end());
+			dstBuffers.erase(std::unique(dstBuffers.begin(), dstBuffers.end()), dstBuffers.end());
+
+			for (VkBuffer buffer : dstBuffers)
+			{
+				VkBufferMemoryBarrier barrier{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+				barrier.buffer = buffer;
+				barrier.offset = 0;
+				barrier.size = VK_WHOLE_SIZE;
+				ownershipBarriers.push_back(barrier);
+			}
+		}
+
+		Batch batch{};
+		batch.ringEnd = m_Head;
+		batch.dedicatedBuffers = std::move(m_PendingBuffers);
+		m_PendingBuffers.clear();
+
+		VkCommandBufferBeginInfo beginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		uint64_t releaseValue = 0;
+
+		if (m_bOwnershipTransfer)
+		{
+			// Release from the graphics queue, ordered after all the graphics work submitted before, which may still read the buffers
+			batch.releaseCmd = g_CommandMgr.GetCommandPool(EQueueFamily::Graphics).CreateCommandBuffer();
+			VK_CHECK(vkBeginCommandBuffer(batch.releaseCmd, &beginInfo));
+
+			for (auto& barrier : ownershipBarriers)
+			{
+				barrier.srcQueueFamilyIndex = graphicsFamily;
+				barrier.dstQueueFamilyIndex = uploadFamily;
+				barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+				barrier.dstAccessMask = 0;
+			}
+			vkCmdPipelineBarrier(batch.releaseCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+				0, nullptr, static_cast<uint32_t>(ownershipBarriers.size()), ownershipBarriers.data(), 0, nullptr);
+
+			VK_CHECK(vkEndCommandBuffer(batch.releaseCmd));
+
+			releaseValue = ++m_LastValue;
+
+			VkTimelineSemaphoreSubmitInfo releaseTimelineInfo{ VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO };
+			releaseTimelineInfo.signalSemaphoreValueCount = 1;
+			releaseTimelineInfo.pSignalSemaphoreValues = &releaseValue;
+
+			VkSubmitInfo releaseInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
+			releaseInfo.pNext = &releaseTimelineInfo;
+			releaseInfo.commandBufferCount = 1;
+			releaseInfo.pCommandBuffers = &batch.releaseCmd;
+			releaseInfo.signalSemaphoreCount = 1;
+			releaseInfo.pSignalSemaphores = &m_Semaphore;
+			VK_CHECK(vkQueueSubmit(g_CommandMgr.GraphicsQueue(), 1, &releaseInfo, VK_NULL_HANDLE));
+		}
+
+		// Copies
+		batch.cmd = g_CommandMgr.GetCommandPool(m_QueueFamily).CreateCommandBuffer();
+		VK_CHECK(vkBeginCommandBuffer(batch.cmd, &beginInfo));
+
+		if (m_bOwnershipTransfer)
+		{
+			// Acquire
+			for (auto& barrier : ownershipBarriers)
+			{
+				barrier.srcAccessMask = 0;
+				barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			}
+			vkCmdPipelineBarrier(batch.cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+				0, nullptr, static_cast<uint32_t>(ownershipBarriers.size()), ownershipBarriers.data(), 0, nullptr);
+		}
+		else
+		{
+			// The first scope covers everything submitted to the queue before, the copies must not overwrite data still being read
+			VkMemoryBarrier barrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+			barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			vkCmdPipelineBarrier(batch.cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+				1, &barrier, 0, nullptr, 0, nullptr);
+		}
+
+		RecordCopies(batch.cmd);
+
+		if (m_bOwnershipTransfer)
+		{
+			// Release
+			for (auto& barrier : ownershipBarriers)
+			{
+				barrier.srcQueueFamilyIndex = uploadFamily;
+				barrier.dstQueueFamilyIndex = graphicsFamily;
+				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.dstAccessMask = 0;
+			}
+			vkCmdPipelineBarrier(batch.cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+				0, nullptr, static_cast<uint32_t>(ownershipBarriers.size()), ownershipBarriers.data(), 0, nullptr);
+		}
+		else
+		{
+			// The second scope covers everything submitted to the queue later
+			VkMemoryBarrier barrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+			vkCmdPipelineBarrier(batch.cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+				1, &barrier, 0, nullptr, 0, nullptr);
+		}
+
+		VK_CHECK(vkEndCommandBuffer(batch.cmd));
+
+		const uint64_t copyValue = ++m_LastValue;
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo{ VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO };
+		timelineInfo.signalSemaphoreValueCount = 1;
+		timelineInfo.pSignalSemaphoreValues = &copyValue;
+
+		VkSubmitInfo submitInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
+		submitInfo.pNext = &timelineInfo;
+		if (m_bOwnershipTransfer)
+		{
+			timelineInfo.waitSemaphoreValueCount = 1;
+			timelineInfo.pWaitSemaphoreValues = &releaseValue;
+
+			submitInfo.waitSemaphoreCount = 1;
+			submitInfo.pWaitSemaphores = &m_Semaphore;
+			submitInfo.pWaitDstStageMask = &waitStage;
+		}
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &batch.cmd;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &m_Semaphore;
+		VK_CHECK(vkQueueSubmit(g_CommandMgr.GetCommandQueue(m_QueueFamily), 1, &submitInfo, VK_NULL_HANDLE));
+
+		batch.value = copyValue;
+
+		if (m_bOwnershipTransfer)
+		{
+			// Acquire on the graphics queue, ordered before all the graphics work submitted afterwards
+			batch.acquireCmd = g_CommandMgr.GetCommandPool(EQueueFamily::Graphics).CreateCommandBuffer();
+			VK_CHECK(vkBeginCommandBuffer(batch.acquireCmd, &beginInfo));
+
+			for (auto& barrier : ownershipBarriers)
+			{
+				barrier.srcAccessMask = 0;
+				barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+			}
+			vkCmdPipelineBarrier(batch.acquireCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+				0, nullptr, static_cast<uint32_t>(ownershipBarriers.size()), ownershipBarriers.data(), 0, nullptr);
+
+			VK_CHECK(vkEndCommandBuffer(batch.acquireCmd));
+
+			const uint64_t acquireValue = ++m_LastValue;
+
+			VkTimelineSemaphoreSubmitInfo acquireTimelineInfo{ VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO };
+			acquireTimelineInfo.waitSemaphoreValueCount = 1;
+			acquireTimelineInfo.pWaitSemaphoreValues = &copyValue;
+			acquireTimelineInfo.signalSemaphoreValueCount = 1;
+			acquireTimelineInfo.pSignalSemaphoreValues = &acquireValue;
+
+			VkSubmitInfo acquireInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
+			acquireInfo.pNext = &acquireTimelineInfo;
+			acquireInfo.waitSemaphoreCount = 1;
+			acquireInfo.pWaitSemaphores = &m_Semaphore;
+			acquireInfo.pWaitDstStageMask = &waitStage;
+			acquireInfo.commandBufferCount = 1;
+			acquireInfo.pCommandBuffers = &batch.acquireCmd;
+			acquireInfo.signalSemaphoreCount = 1;
+			acquireInfo.pSignalSemaphores = &m_Semaphore;
+			VK_CHECK(vkQueueSubmit(g_CommandMgr.GraphicsQueue(), 1, &acquireInfo, VK_NULL_HANDLE));
+
+			batch.value = acquireValue;
+		}
+
+		m_PendingCopies.clear();
+		m_Batches.push_back(std::move(batch));
+		++m_Stats.batchCount;
+
+		return m_Batches.back().value;
+	}
+
+	void StagingUploader::Wait(uint64_t value)
+	{
+		if (!IsInited())
+			return;
+
+		value = std::min(value, m_LastValue);
+		if (value == 0)
+			return;
+
+		VkSemaphoreWaitInfo waitInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &m_Semaphore;
+		waitInfo.pValues = &value;
+		VK_CHECK(vkWaitSemaphores(*m_pDevice, &waitInfo, UINT64_MAX));
+	}
+
+	uint64_t StagingUploader::GetCompletedValue() const
+	{
+		uint64_t value = 0;
+		VK_CHECK(vkGetSemaphoreCounterValue(*m_pDevice, m_Semaphore, &value));
+		return value;
+	}
+}
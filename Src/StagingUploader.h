@@ -0,0 +1,109 @@
+#pragma once
+
+#include "pch.h"
+#include "VkCommon.h"
+#include "Utilities.h"
+#include "CommandManager.h"
+#include "Buffer.h"
+#include <deque>
+
+
+namespace Niagara
+{
+	class Device;
+
+	/**
+	* Staging uploader
+	* A persistently mapped ring buffer that batches the uploads to device local buffers. Uploads are written into the ring and
+	* recorded as copy regions, `Flush()` submits all of the pending copies in a single command buffer, merging the regions that
+	* are contiguous both in the ring and in the destination. Each submitted batch signals a timeline semaphore value, the ring
+	* space of a batch is recycled once the semaphore reaches it. The host only blocks when the ring runs out of space.
+	* The copies are ordered after all the work submitted to the graphics queue before the flush, so a buffer can be overwritten
+	* while earlier frames still read it. On a dedicated transfer queue family, the destination buffers are released by a graphics
+	* queue submit and acquired by the transfer, then released back and acquired by a graphics queue submit that waits on the
+	* transfer. The graphics queue never waits on the host either way.
+	* Not thread safe, uploads are recorded from the main thread.
+	*/
+	class StagingUploader
+	{
+	public:
+		struct Stats
+		{
+			uint64_t uploadedBytes = 0;
+			uint32_t batchCount = 0;
+			// Copy regions after merging
+			uint32_t copyCount = 0;
+			// Times the host waited for a batch to free ring space
+			uint32_t stallCount = 0;
+		};
+
+		StagingUploader() = default;
+		NON_COPYABLE(StagingUploader);
+
+		void Init(const Device& device, VkDeviceSize capacity, EQueueFamily queueFamily = EQueueFamily::Graphics);
+		void Destroy(const Device& device);
+
+		// Copies `data` into the ring, uploads larger than the ring are split
+		void Upload(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+		// Mapped staging memory for `size` bytes that the caller fills before any other call to the uploader, it's copied to `dstBuffer`
+		// by the next flush (an allocation can flush the pending copies when the ring is full).
+		// Allocations that don't fit in the ring get a dedicated staging buffer, released with their batch.
+		uint8_t* Allocate(VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size);
+
+		// Submits the pending copies, they're visible to everything submitted to the graphics queue afterwards.
+		// Returns the timeline value signaled by the batch, 0 if nothing was pending.
+		uint64_t Flush();
+		// Blocks until the semaphore reaches `value`, by default until all the submitted batches are done
+		void Wait(uint64_t value = UINT64_MAX);
+
+		bool IsInited() const { return m_Semaphore != VK_NULL_HANDLE; }
+		VkSemaphore GetSemaphore() const { return m_Semaphore; }
+		uint64_t GetCompletedValue() const;
+		const Stats& GetStats() const { return m_Stats; }
+
+	private:
+		struct CopyRegion
+		{
+			VkBuffer srcBuffer;
+			VkBuffer dstBuffer;
+			VkBufferCopy copy;
+		};
+
+		struct Batch
+		{
+			uint64_t value;
+			// Ring position released when the batch is done
+			uint64_t ringEnd;
+			VkCommandBuffer cmd;
+			// Ownership transfers on the graphics queue, to the upload queue family and back
+			VkCommandBuffer releaseCmd;
+			VkCommandBuffer acquireCmd;
+			std::vector<Buffer> dedicatedBuffers;
+		};
+
+		uint8_t* AllocateRing(VkDeviceSize size, VkDeviceSize& ringOffset);
+		// Recycles the batches that are done, waits for the oldest one if `bWait`. Returns false if there was nothing to recycle.
+		bool Reclaim(bool bWait);
+		void RecordCopies(VkCommandBuffer cmd);
+
+		const Device* m_pDevice{ nullptr };
+		EQueueFamily m_QueueFamily{ EQueueFamily::Graphics };
+		bool m_bOwnershipTransfer{ false };
+
+		Buffer m_RingBuffer;
+		VkDeviceSize m_Capacity{ 0 };
+		// Monotonic positions, the ring offset is position % capacity. Pending and in flight data lives in [tail, head).
+		uint64_t m_Head{ 0 };
+		uint64_t m_Tail{ 0 };
+
+		std::vector<CopyRegion> m_PendingCopies;
+		std::vector<Buffer> m_PendingBuffers;
+		std::deque<Batch> m_Batches;
+
+		VkSemaphore m_Semaphore{ VK_NULL_HANDLE };
+		uint64_t m_LastValue{ 0 };
+
+		Stats m_Stats;
+	};
+	extern StagingUploader g_StagingUploader;
+}
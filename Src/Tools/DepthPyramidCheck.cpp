@@ -0,0 +1,491 @@
+// Headless check of the depth pyramid builds against `BuildDepthPyramidReference()`, on any Vulkan 1.3 device with a compute queue
+// (lavapipe without a GPU). Synthetic depth buffers of odd sizes go through the per mip dispatches of `HiZBuild.comp` and the single
+// dispatch of `HiZBuildSinglePass.comp`, bound like in main.cpp, and every mip is read back and compared bit for bit with the CPU
+// reference. Both with reversed Z (min) and forward Z (max), REVERSED_Z of the shaders.
+//
+// Exits with 1 if a mip differs, 77 (skipped by ctest) if there's no Vulkan device with storage image writes without a format or the
+// SPIR-V can't be read.
+//
+// Usage: niagara_depthpyramidcheck [--spirv <dir>]
+
+#include "pch.h"
+#include "Config.h"
+#include "Utilities.h"
+#include "DepthPyramid.h"
+#include "GpuCheck.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+#ifndef NIAGARA_SPIRV_PATH
+#define NIAGARA_SPIRV_PATH "../Src/CompiledShaders/"
+#endif
+
+using namespace Niagara;
+
+
+// `HiZBuild.comp`
+constexpr uint32_t GROUP_SIZE = 8;
+
+// Bindings of `HiZBuildSinglePass.comp`, the mips are `SinglePassMipBinding + i`
+enum SinglePassBinding : uint32_t
+{
+	SinglePassDepthBinding = 0,
+	SinglePassMipBinding = 1,
+	SinglePassCounterBinding = 1 + DEPTH_PYRAMID_MAX_SINGLE_PASS_MIPS,
+};
+
+// `_Constants` of `HiZBuildSinglePass.comp`
+struct SinglePassConstants
+{
+	glm::uvec2 depthSize;
+	glm::uvec2 pyramidSize;
+	uint32_t mipCount;
+	uint32_t groupCount;
+};
+
+struct GpuImage
+{
+	VkImage image = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	// One view per mip
+	std::vector<VkImageView> views;
+};
+
+static GpuImage CreateImage(const GpuContext& gpu, uint32_t width, uint32_t height, uint32_t mipCount, VkImageUsageFlags usage)
+{
+	GpuImage image;
+
+	VkImageCreateInfo imageInfo{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = VK_FORMAT_R32_SFLOAT;
+	imageInfo.extent = { width, height, 1 };
+	imageInfo.mipLevels = mipCount;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = usage;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	VK_CHECK(vkCreateImage(gpu.device, &imageInfo, nullptr, &image.image));
+
+	VkMemoryRequirements memRequirements{};
+	vkGetImageMemoryRequirements(gpu.device, image.image, &memRequirements);
+	VkMemoryAllocateInfo allocInfo{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+	allocInfo.allocationSize = memRequirements.size;
+	allocInfo.memoryTypeIndex = GetMemoryType(gpu, memRequirements.memoryTypeBits, 0);
+	VK_CHECK(vkAllocateMemory(gpu.device, &allocInfo, nullptr, &image.memory));
+	VK_CHECK(vkBindImageMemory(gpu.device, image.image, image.memory, 0));
+
+	image.views.resize(mipCount);
+	for (uint32_t i = 0; i < mipCount; ++i)
+	{
+		VkImageViewCreateInfo viewInfo{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+		viewInfo.image = image.image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = VK_FORMAT_R32_SFLOAT;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1 };
+		VK_CHECK(vkCreateImageView(gpu.device, &viewInfo, nullptr, &image.views[i]));
+	}
+
+	return image;
+}
+
+static void DestroyImage(const GpuContext& gpu, GpuImage& image)
+{
+	for (VkImageView view : image.views)
+		vkDestroyImageView(gpu.device, view, nullptr);
+	vkDestroyImage(gpu.device, image.image, nullptr);
+	vkFreeMemory(gpu.device, image.memory, nullptr);
+	image = {};
+}
+
+static void ImageBarrier(VkCommandBuffer cmd, VkImage image, VkImageLayout oldLayout, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess,
+	VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+	VkImageMemoryBarrier barrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstAccessMask = dstAccess;
+	barrier.oldLayout = oldLayout;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, 1 };
+	vkCmdPipelineBarrier(cmd, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+// Deterministic depths in [0, 1], a quarter of them equal so that the texels of a 2x2 block often tie
+static void GenerateDepth(std::vector<float>& depth, uint32_t width, uint32_t height, uint32_t seed)
+{
+	std::srand(seed);
+
+	depth.resize(size_t(width) * height);
+	for (auto& value : depth)
+		value = (std::rand() % 4 == 0) ? 0.5f : float(std::rand()) / float(RAND_MAX);
+}
+
+int main(int argc, char** argv)
+{
+	std::string spirvPath = NIAGARA_SPIRV_PATH;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+
+		if (arg == "--spirv" && i + 1 < argc)
+			spirvPath = std::string(argv[++i]) + "/";
+		else
+		{
+			printf("Usage: %s [--spirv <dir>]\n", argv[0]);
+			return arg == "--help" ? 0 : 1;
+		}
+	}
+
+	// Odd and non power of two sizes, from a single texel to a pyramid of 11 mips. The mip counts cover the single pass build that
+	// stops after the workgroup mips, and the ones finished by the last workgroup with 1, 2 and more mips past mip 5.
+	const glm::uvec2 DepthSizes[] = { { 1, 1 }, { 3, 5 }, { 17, 9 }, { 64, 64 }, { 255, 129 }, { 1000, 3 }, { 1921, 1081 }, { 3001, 2999 } };
+
+	GpuContext gpu;
+	if (!InitGpu(gpu, "niagara_depthpyramidcheck"))
+	{
+		printf("No Vulkan 1.3 device with a compute queue, skipped.\n");
+		DestroyGpu(gpu);
+		return EXIT_SKIPPED;
+	}
+	printf("Device: %s\n", gpu.properties.deviceName);
+
+	if (!gpu.bStorageImageWriteWithoutFormat)
+	{
+		printf("No storage image writes without a format for `HiZBuild.comp`, skipped.\n");
+		DestroyGpu(gpu);
+		return EXIT_SKIPPED;
+	}
+
+	VkShaderModule buildShader = LoadShader(gpu, spirvPath + "HiZBuild.comp.spv");
+	VkShaderModule singlePassShader = LoadShader(gpu, spirvPath + "HiZBuildSinglePass.comp.spv");
+	if (buildShader == VK_NULL_HANDLE || singlePassShader == VK_NULL_HANDLE)
+	{
+		printf("Failed to load the SPIR-V from %s, skipped.\n", spirvPath.c_str());
+		vkDestroyShaderModule(gpu.device, buildShader, nullptr);
+		vkDestroyShaderModule(gpu.device, singlePassShader, nullptr);
+		DestroyGpu(gpu);
+		return EXIT_SKIPPED;
+	}
+
+	// Layouts, main.cpp pushes the same bindings
+	std::vector<VkDescriptorSetLayoutBinding> bindings =
+	{
+		{ 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+		{ 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+	};
+
+	VkDescriptorSetLayoutCreateInfo setLayoutInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+	setLayoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	setLayoutInfo.pBindings = bindings.data();
+	VkDescriptorSetLayout buildSetLayout = VK_NULL_HANDLE;
+	VK_CHECK(vkCreateDescriptorSetLayout(gpu.device, &setLayoutInfo, nullptr, &buildSetLayout));
+
+	bindings.clear();
+	bindings.push_back({ SinglePassDepthBinding, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr });
+	for (uint32_t i = 0; i < DEPTH_PYRAMID_MAX_SINGLE_PASS_MIPS; ++i)
+		bindings.push_back({ SinglePassMipBinding + i, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr });
+	bindings.push_back({ SinglePassCounterBinding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr });
+
+	setLayoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	setLayoutInfo.pBindings = bindings.data();
+	VkDescriptorSetLayout singlePassSetLayout = VK_NULL_HANDLE;
+	VK_CHECK(vkCreateDescriptorSetLayout(gpu.device, &setLayoutInfo, nullptr, &singlePassSetLayout));
+
+	// `srcSize`
+	VkPushConstantRange pushConstantRange{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(glm::vec4) };
+
+	VkPipelineLayoutCreateInfo layoutInfo{ VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+	layoutInfo.setLayoutCount = 1;
+	layoutInfo.pSetLayouts = &buildSetLayout;
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pPushConstantRanges = &pushConstantRange;
+	VkPipelineLayout buildPipelineLayout = VK_NULL_HANDLE;
+	VK_CHECK(vkCreatePipelineLayout(gpu.device, &layoutInfo, nullptr, &buildPipelineLayout));
+
+	pushConstantRange.size = sizeof(SinglePassConstants);
+	layoutInfo.pSetLayouts = &singlePassSetLayout;
+	VkPipelineLayout singlePassPipelineLayout = VK_NULL_HANDLE;
+	VK_CHECK(vkCreatePipelineLayout(gpu.device, &layoutInfo, nullptr, &singlePassPipelineLayout));
+
+	// Forward Z then reversed Z
+	VkPipeline buildPipelines[2], singlePassPipelines[2];
+	for (uint32_t reversedZ = 0; reversedZ < 2; ++reversedZ)
+	{
+		buildPipelines[reversedZ] = CreatePipeline(gpu, buildShader, buildPipelineLayout, { { 0, reversedZ } });
+		singlePassPipelines[reversedZ] = CreatePipeline(gpu, singlePassShader, singlePassPipelineLayout, { { 0, reversedZ } });
+	}
+
+	// A set per mip of the per mip build and one for the single pass build, reset for each depth buffer
+	const uint32_t maxSetCount = DEPTH_PYRAMID_MAX_SINGLE_PASS_MIPS + 1;
+	VkDescriptorPoolSize poolSizes[] =
+	{
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, maxSetCount },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, DEPTH_PYRAMID_MAX_SINGLE_PASS_MIPS * 2 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 },
+	};
+	VkDescriptorPoolCreateInfo descriptorPoolInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+	descriptorPoolInfo.maxSets = maxSetCount;
+	descriptorPoolInfo.poolSizeCount = ARRAYSIZE(poolSizes);
+	descriptorPoolInfo.pPoolSizes = poolSizes;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	VK_CHECK(vkCreateDescriptorPool(gpu.device, &descriptorPoolInfo, nullptr, &descriptorPool));
+
+	// Only read with `texelFetch()`
+	VkSamplerCreateInfo samplerInfo{ VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	VkSampler sampler = VK_NULL_HANDLE;
+	VK_CHECK(vkCreateSampler(gpu.device, &samplerInfo, nullptr, &sampler));
+
+	// Finished workgroups of the single pass build, reset by the last one
+	HostBuffer counterBuffer = CreateBuffer(gpu, sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+	VkCommandBufferAllocateInfo cmdAllocInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+	cmdAllocInfo.commandPool = gpu.commandPool;
+	cmdAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	cmdAllocInfo.commandBufferCount = 1;
+	VkCommandBuffer cmd = VK_NULL_HANDLE;
+	VK_CHECK(vkAllocateCommandBuffers(gpu.device, &cmdAllocInfo, &cmd));
+
+	VkCommandBufferBeginInfo beginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	auto submitAndWait = [&]()
+	{
+		VK_CHECK(vkEndCommandBuffer(cmd));
+
+		VkSubmitInfo submitInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &cmd;
+		VK_CHECK(vkQueueSubmit(gpu.queue, 1, &submitInfo, gpu.fence));
+		VK_CHECK(vkWaitForFences(gpu.device, 1, &gpu.fence, VK_TRUE, UINT64_MAX));
+		VK_CHECK(vkResetFences(gpu.device, 1, &gpu.fence));
+	};
+
+	std::vector<float> depth;
+	std::vector<std::vector<float>> referenceMips;
+	bool bFailed = false;
+
+	for (uint32_t sizeIndex = 0; sizeIndex < ARRAYSIZE(DepthSizes) && !bFailed; ++sizeIndex)
+	{
+		const uint32_t depthWidth = DepthSizes[sizeIndex].x, depthHeight = DepthSizes[sizeIndex].y;
+		const glm::uvec2 pyramidSize = GetDepthPyramidSize(depthWidth, depthHeight);
+		const uint32_t mipCount = GetDepthPyramidMipCount(pyramidSize);
+		assert(CanBuildDepthPyramidSinglePass(mipCount));
+
+		GenerateDepth(depth, depthWidth, depthHeight, sizeIndex + 1);
+
+		GpuImage depthImage = CreateImage(gpu, depthWidth, depthHeight, 1, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+		GpuImage pyramidImage = CreateImage(gpu, pyramidSize.x, pyramidSize.y, mipCount,
+			VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+
+		// The mips read back one after the other
+		std::vector<VkBufferImageCopy> copyRegions(mipCount);
+		VkDeviceSize readbackSize = 0;
+		for (uint32_t i = 0; i < mipCount; ++i)
+		{
+			const glm::uvec2 mipSize = GetDepthPyramidMipSize(pyramidSize, i);
+
+			VkBufferImageCopy& region = copyRegions[i];
+			region = {};
+			region.bufferOffset = readbackSize;
+			region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 };
+			region.imageExtent = { mipSize.x, mipSize.y, 1 };
+
+			readbackSize += VkDeviceSize(mipSize.x) * mipSize.y * sizeof(float);
+		}
+		HostBuffer readbackBuffer = CreateBuffer(gpu, readbackSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+
+		// Depth upload
+		{
+			HostBuffer stagingBuffer = CreateBuffer(gpu, depth.data(), depth.size() * sizeof(float), VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+
+			VkBufferImageCopy region{};
+			region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+			region.imageExtent = { depthWidth, depthHeight, 1 };
+
+			VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+			ImageBarrier(cmd, depthImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+			vkCmdCopyBufferToImage(cmd, stagingBuffer.buffer, depthImage.image, VK_IMAGE_LAYOUT_GENERAL, 1, &region);
+			ImageBarrier(cmd, depthImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+			submitAndWait();
+
+			DestroyBuffer(gpu, stagingBuffer);
+		}
+
+		// Descriptors, like the ones main.cpp pushes. Mip `i` of the per mip build reads the depth buffer or mip `i - 1`.
+		VK_CHECK(vkResetDescriptorPool(gpu.device, descriptorPool, 0));
+
+		std::vector<VkDescriptorSetLayout> setLayouts(mipCount, buildSetLayout);
+		setLayouts.push_back(singlePassSetLayout);
+
+		VkDescriptorSetAllocateInfo setAllocInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+		setAllocInfo.descriptorPool = descriptorPool;
+		setAllocInfo.descriptorSetCount = static_cast<uint32_t>(setLayouts.size());
+		setAllocInfo.pSetLayouts = setLayouts.data();
+		std::vector<VkDescriptorSet> descriptorSets(setLayouts.size());
+		VK_CHECK(vkAllocateDescriptorSets(gpu.device, &setAllocInfo, descriptorSets.data()));
+		const VkDescriptorSet singlePassSet = descriptorSets.back();
+
+		{
+			std::vector<VkDescriptorImageInfo> imageInfos;
+			imageInfos.reserve(mipCount * 2 + 1 + DEPTH_PYRAMID_MAX_SINGLE_PASS_MIPS);
+			std::vector<VkWriteDescriptorSet> writes;
+
+			auto addImage = [&](VkDescriptorSet set, uint32_t binding, VkDescriptorType type, VkImageView view)
+			{
+				imageInfos.push_back({ type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ? sampler : VK_NULL_HANDLE, view, VK_IMAGE_LAYOUT_GENERAL });
+
+				VkWriteDescriptorSet write{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+				write.dstSet = set;
+				write.dstBinding = binding;
+				write.descriptorCount = 1;
+				write.descriptorType = type;
+				write.pImageInfo = &imageInfos.back();
+				writes.push_back(write);
+			};
+
+			for (uint32_t i = 0; i < mipCount; ++i)
+			{
+				addImage(descriptorSets[i], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, i == 0 ? depthImage.views[0] : pyramidImage.views[i - 1]);
+				addImage(descriptorSets[i], 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, pyramidImage.views[i]);
+			}
+
+			// The bindings past the last mip are never written
+			addImage(singlePassSet, SinglePassDepthBinding, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, depthImage.views[0]);
+			for (uint32_t i = 0; i < DEPTH_PYRAMID_MAX_SINGLE_PASS_MIPS; ++i)
+				addImage(singlePassSet, SinglePassMipBinding + i, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, pyramidImage.views[std::min(i, mipCount - 1)]);
+
+			VkDescriptorBufferInfo counterInfo{ counterBuffer.buffer, 0, VK_WHOLE_SIZE };
+			VkWriteDescriptorSet write{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+			write.dstSet = singlePassSet;
+			write.dstBinding = SinglePassCounterBinding;
+			write.descriptorCount = 1;
+			write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			write.pBufferInfo = &counterInfo;
+			writes.push_back(write);
+
+			vkUpdateDescriptorSets(gpu.device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+		}
+
+		for (uint32_t reversedZ = 0; reversedZ < 2 && !bFailed; ++reversedZ)
+		{
+			BuildDepthPyramidReference(referenceMips, depth.data(), depthWidth, depthHeight, pyramidSize, mipCount, reversedZ != 0);
+
+			const char* buildResults[2] = {};
+			for (uint32_t singlePass = 0; singlePass < 2; ++singlePass)
+			{
+				memset(counterBuffer.data, 0, counterBuffer.size);
+
+				VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+
+				// Cleared to a depth out of [0, 1], a texel that isn't written doesn't keep the one of the previous build
+				const VkClearColorValue clearColor = { { -1.0f, 0.0f, 0.0f, 0.0f } };
+				const VkImageSubresourceRange clearRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipCount, 0, 1 };
+				ImageBarrier(cmd, pyramidImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+				vkCmdClearColorImage(cmd, pyramidImage.image, VK_IMAGE_LAYOUT_GENERAL, &clearColor, 1, &clearRange);
+				ImageBarrier(cmd, pyramidImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+				if (singlePass)
+				{
+					const glm::uvec2 groupCount = GetDepthPyramidSinglePassGroups(pyramidSize);
+					const SinglePassConstants constants = { glm::uvec2(depthWidth, depthHeight), pyramidSize, mipCount, groupCount.x * groupCount.y };
+
+					vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, singlePassPipelines[reversedZ]);
+					vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, singlePassPipelineLayout, 0, 1, &singlePassSet, 0, nullptr);
+					vkCmdPushConstants(cmd, singlePassPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+					vkCmdDispatch(cmd, groupCount.x, groupCount.y, 1);
+				}
+				else
+				{
+					vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, buildPipelines[reversedZ]);
+
+					for (uint32_t i = 0; i < mipCount; ++i)
+					{
+						const glm::uvec2 mipSize = GetDepthPyramidMipSize(pyramidSize, i);
+						glm::vec4 srcSize;
+						if (i == 0)
+						{
+							srcSize = GetSizeAndInvSize(depthWidth, depthHeight);
+						}
+						else
+						{
+							const glm::uvec2 srcMipSize = GetDepthPyramidMipSize(pyramidSize, i - 1);
+							srcSize = GetSizeAndInvSize(srcMipSize.x, srcMipSize.y);
+
+							ComputeBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+						}
+
+						vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, buildPipelineLayout, 0, 1, &descriptorSets[i], 0, nullptr);
+						vkCmdPushConstants(cmd, buildPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(srcSize), &srcSize);
+						vkCmdDispatch(cmd, DivideAndRoundUp(mipSize.x, GROUP_SIZE), DivideAndRoundUp(mipSize.y, GROUP_SIZE), 1);
+					}
+				}
+
+				ComputeBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+				vkCmdCopyImageToBuffer(cmd, pyramidImage.image, VK_IMAGE_LAYOUT_GENERAL, readbackBuffer.buffer, mipCount, copyRegions.data());
+
+				VkMemoryBarrier hostBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+				hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+				vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0, nullptr, 0, nullptr);
+
+				submitAndWait();
+
+				buildResults[singlePass] = "match";
+				for (uint32_t i = 0; i < mipCount; ++i)
+				{
+					const glm::uvec2 mipSize = GetDepthPyramidMipSize(pyramidSize, i);
+					const float* gpuMip = reinterpret_cast<const float*>(readbackBuffer.data + copyRegions[i].bufferOffset);
+					const std::vector<float>& cpuMip = referenceMips[i];
+
+					size_t mismatch = FindMismatch(gpuMip, cpuMip.data(), cpuMip.size());
+					if (mismatch != cpuMip.size())
+					{
+						printf("%ux%u %s Z, %s build, mip %u texel (%zu, %zu) differs: %.9g on the GPU, %.9g on the CPU\n", depthWidth, depthHeight,
+							reversedZ ? "reversed" : "forward", singlePass ? "single pass" : "per mip", i, mismatch % mipSize.x, mismatch / mipSize.x, gpuMip[mismatch], cpuMip[mismatch]);
+						buildResults[singlePass] = "FAILED";
+						bFailed = true;
+						break;
+					}
+				}
+			}
+
+			printf("%ux%u %s Z, %u mips of %ux%u: per mip %s, single pass %s.\n", depthWidth, depthHeight, reversedZ ? "reversed" : "forward", mipCount,
+				pyramidSize.x, pyramidSize.y, buildResults[0], buildResults[1]);
+		}
+
+		DestroyBuffer(gpu, readbackBuffer);
+		DestroyImage(gpu, pyramidImage);
+		DestroyImage(gpu, depthImage);
+	}
+
+	// Cleanup
+	DestroyBuffer(gpu, counterBuffer);
+	vkDestroySampler(gpu.device, sampler, nullptr);
+	vkDestroyDescriptorPool(gpu.device, descriptorPool, nullptr);
+	for (uint32_t reversedZ = 0; reversedZ < 2; ++reversedZ)
+	{
+		vkDestroyPipeline(gpu.device, buildPipelines[reversedZ], nullptr);
+		vkDestroyPipeline(gpu.device, singlePassPipelines[reversedZ], nullptr);
+	}
+	vkDestroyPipelineLayout(gpu.device, buildPipelineLayout, nullptr);
+	vkDestroyPipelineLayout(gpu.device, singlePassPipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(gpu.device, buildSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(gpu.device, singlePassSetLayout, nullptr);
+	vkDestroyShaderModule(gpu.device, buildShader, nullptr);
+	vkDestroyShaderModule(gpu.device, singlePassShader, nullptr);
+	DestroyGpu(gpu);
+
+	return bFailed ? 1 : 0;
+}
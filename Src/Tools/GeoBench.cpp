@@ -0,0 +1,1377 @@
+// Headless CPU benchmark of the geometry pipeline, no Vulkan device needed.
+// Times each build stage of `LoadMesh` / `BuildOptMeshlets` for the OBJ meshes and a set of procedural meshes,
+// prints a summary and writes the results as JSON to track regressions. With --json - the JSON goes to stdout and the summary to stderr.
+//
+// Each geometry is also compressed with the geometry codec and decoded on all threads, unless --no-codec is given.
+// With --cluster-lod it also builds the cluster LOD DAG of each mesh like the geometry loader, and checks that the selection of the stored
+// clusters matches the CPU reference traversal of the DAG at a few distances.
+// With --cull it culls a scene of instances of each OBJ mesh with the CPU culling, for each kernel and thread count, and checks that
+// they all produce the same commands and visibilities, then compares the brute force draw culling with the instance BVH. The draws also
+// go through a `PackedMeshDraw` round trip, to check its precision. The draw visibility bytes of a cull pass are measured, and the
+// visibility history is checked not to change the culling of the static scene. The draw args buffer capacity is run over the peak
+// command counts of the frames, read back late like in main.cpp, and checked to end up fitting them without the worst case size.
+// With --instances it churns a scene of instances through the instance manager, applies the scatter records to a copy of the draw
+// buffer like `ScatterDraws.comp`, and checks it against a full rebuild of the draw buffer.
+// With --meshlet-packing it packs the meshlet headers into `PackedMeshlet`s and checks that the culling with them is conservative: the
+// decoded spheres contain the meshlet vertices, and the quantized cones only cull meshlets whose triangles all face away from the camera.
+// With --vertex-packing it packs the vertices into `PackedVertex`s with the scalar and the SSE encoders, checks that they match and
+// measures the decoding errors.
+//
+// Exits with 1 if any of the checks fails, after writing the JSON.
+//
+// Usage: niagara_geobench [--obj <path>]... [--tris <count>[,<count>...]] [--json <path>|-] [--no-meshlets] [--no-codec] [--cluster-lod]
+//                         [--cull] [--cull-draws <count>] [--instances] [--meshlet-packing] [--vertex-packing]
+
+#include "pch.h"
+#include "Config.h"
+#include "Utilities.h"
+#include "Geometry.h"
+#include "GeometryCodec.h"
+#include "ClusterLod.h"
+#include "CpuCulling.h"
+#include "DrawCommandCapacity.h"
+#include "InstanceBvh.h"
+#include "InstanceManager.h"
+#include "JobSystem.h"
+
+#include "meshoptimizer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include <glm/gtc/random.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#ifdef _WIN32
+#include <Psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#ifndef NIAGARA_RESOURCE_PATH
+#define NIAGARA_RESOURCE_PATH "../Resources/"
+#endif
+
+using namespace Niagara;
+
+
+struct BenchMesh
+{
+	std::string name;
+	// Procedural meshes only
+	size_t targetTriangleCount = 0;
+	double generateTime = 0.0;
+
+	bool bLoaded = false;
+	double totalTime = 0.0;
+	uint32_t lodCount = 0;
+	MeshBuildStats stats;
+	double peakRssMB = 0.0;
+
+	bool bCodec = false;
+	size_t rawSize = 0;
+	size_t compressedSize = 0;
+	double encodeTime = 0.0;
+	double decodeTime = 0.0; // best of a few runs
+	uint32_t decodeThreadCount = 0;
+	bool bLosslessStreamsMatch = false;
+	float maxPositionError = 0.0f; // relative to the mesh radius
+
+	struct ClusterLodSelection
+	{
+		float distance; // in mesh radii
+		size_t clusterCount;
+		size_t triangleCount;
+		bool bTraversalMatches;
+	};
+
+	bool bClusterLod = false;
+	double clusterLodTime = 0.0;
+	// The clusters stored in the geometry match the DAG
+	bool bClusterLodStored = false;
+	size_t clusterCount = 0;
+	size_t clusterGroupCount = 0;
+	uint32_t clusterLevelCount = 0;
+	std::vector<ClusterLodSelection> clusterSelections;
+
+	struct CullRun
+	{
+		ECullKernel kernel;
+		uint32_t threadCount;
+		// Per frame, early and late pass
+		double drawTime;
+		double meshletTime;
+		double drawsPerSecond;
+		double meshletsPerSecond;
+		// Same commands, meshlets and visibilities as the scalar kernel on one thread
+		bool bMatches;
+	};
+
+	bool bCull = false;
+	uint32_t cullDrawCount = 0;
+	// Late pass of the last frame
+	uint32_t cullVisibleDrawCount = 0;
+	size_t cullCommandCount = 0;
+	size_t cullMeshletCount = 0;
+	std::vector<CullRun> cullRuns;
+
+	struct CullBvhRun
+	{
+		// Per frame, early and late pass
+		double drawTime;
+		// Late pass of the last frame
+		uint32_t nodesVisited;
+		uint32_t drawsTested;
+	};
+
+	// Best kernel on all threads
+	double cullBvhBuildTime = 0.0;
+	size_t cullBvhNodeCount = 0;
+	uint32_t cullBvhLeafCount = 0;
+	uint32_t cullBvhDepth = 0;
+	CullBvhRun cullBruteForce{};
+	CullBvhRun cullBvh{};
+	// Same commands (in any order), meshlets and visibilities
+	bool bCullBvhMatches = false;
+
+	// Draw visibility buffer bytes read and written per cull pass, with the packed states and with a word per draw
+	double cullVisibilityBytes = 0.0;
+	double cullVisibilityBytesUnpacked = 0.0;
+	uint32_t cullHistoryFrames = 0;
+	double cullHistoryOcclusionSkipped = 0.0;
+	// Same commands and meshlets as without the visibility history
+	bool bCullHistoryMatches = false;
+
+	// Draw args buffer capacity, in task commands: peak of the frames, and final capacities from the commands of all the draws at
+	// lod 0 and from the smallest capacity
+	uint32_t cullCommandPeak = 0;
+	uint32_t cullCapacityFromScene = 0;
+	uint32_t cullCapacityFromMin = 0;
+	uint32_t cullCapacityGrows = 0;
+	uint32_t cullCapacityShrinks = 0;
+	// Commands past the capacity before it grew, from the smallest capacity
+	uint64_t cullCapacityDropped = 0;
+	// Both fit the peak, within 4x of the capacity fitting it (the shrink threshold)
+	bool bCullCapacityFits = false;
+
+	// Max errors of the `PackedMeshDraw` round trip: world units, world matrix rotation elements, relative scale
+	double drawPackingPositionError = 0.0;
+	double drawPackingRotationError = 0.0;
+	double drawPackingScaleError = 0.0;
+
+	// Dynamic instances, times and uploads per frame
+	bool bInstances = false;
+	uint32_t instanceChangesPerFrame = 0;
+	uint32_t instanceDrawCount = 0; // after the last frame
+	double instanceChangeTime = 0.0;
+	double instanceGatherTime = 0.0;
+	double instanceScattersPerFrame = 0.0;
+	double instanceUploadBytesPerFrame = 0.0;
+	uint32_t instanceCompactionCount = 0;
+	uint64_t instanceMoveCount = 0;
+	// The scattered draw buffer matches a full rebuild, meshlet visibility ranges don't overlap
+	bool bInstancesMatch = false;
+
+	// `PackedMeshlet` headers
+	bool bMeshletPacking = false;
+	double meshletPackingTime = 0.0;
+	// Mean radius of the decoded spheres relative to the meshlet ones, without the spheres out of the radius range (never culled)
+	double meshletPackingRadiusRatio = 0.0;
+	uint64_t meshletUnboundedSpheres = 0;
+	uint64_t meshletConeTests = 0;
+	uint64_t meshletConeCulledFull = 0;
+	uint64_t meshletConeCulledPacked = 0;
+	// Meshlet vertices out of their decoded sphere, packed cone culls with a front facing triangle
+	uint64_t meshletSphereFailures = 0;
+	uint64_t meshletConeFailures = 0;
+
+	// `PackedVertex` encoding, single threaded
+	bool bVertexPacking = false;
+	double vertexPackingScalarTime = 0.0;
+	double vertexPackingSimdTime = 0.0;
+	VertexPackingError vertexPackingError{};
+	// The SSE encoder gives the same bits as the scalar one
+	bool bVertexPackingMatches = false;
+};
+
+static double GetPeakRssMB()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters{};
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+	return 0.0;
+#else
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	return usage.ru_maxrss / (1024.0 * 1024.0); // bytes
+#else
+	return usage.ru_maxrss / 1024.0; // kilobytes
+#endif
+#endif
+}
+
+static Vertex MakeVertex(const glm::vec3& p, const glm::vec3& n, const glm::vec2& uv)
+{
+	// Same encoding as `LoadObj`
+	Vertex v{};
+	v.p = p;
+#if USE_DEVICE_8BIT_16BIT_EXTENSIONS
+	v.n.x = static_cast<uint8_t>(n.x * 127.f + 127.5f);
+	v.n.y = static_cast<uint8_t>(n.y * 127.f + 127.5f);
+	v.n.z = static_cast<uint8_t>(n.z * 127.f + 127.5f);
+	v.uv.x = meshopt_quantizeHalf(uv.x);
+	v.uv.y = meshopt_quantizeHalf(uv.y);
+#else
+	v.n = n;
+	v.uv = uv;
+#endif
+	return v;
+}
+
+// Displaced UV sphere with about `triangleCount` triangles, the displacement gives the simplifier some work to do
+static void GenerateMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, size_t triangleCount)
+{
+	const uint32_t rings = std::max(2u, static_cast<uint32_t>(sqrt(triangleCount / 4.0)));
+	const uint32_t segments = std::max(3u, static_cast<uint32_t>(triangleCount / (2 * size_t(rings))));
+
+	const float Pi = 3.14159265f;
+
+	vertices.clear();
+	vertices.reserve(size_t(rings + 1) * (segments + 1));
+	for (uint32_t r = 0; r <= rings; ++r)
+	{
+		float v = float(r) / rings;
+		float theta = v * Pi;
+
+		for (uint32_t s = 0; s <= segments; ++s)
+		{
+			float u = float(s) / segments;
+			float phi = u * 2.0f * Pi;
+
+			glm::vec3 n{ sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi) };
+			float radius = 1.0f + 0.05f * sinf(13.0f * theta) * cosf(17.0f * phi) + 0.01f * sinf(97.0f * theta + 61.0f * phi);
+
+			vertices.push_back(MakeVertex(n * radius, n, glm::vec2(u, v)));
+		}
+	}
+
+	indices.clear();
+	indices.reserve(size_t(rings) * segments * 6);
+	for (uint32_t r = 0; r < rings; ++r)
+	{
+		for (uint32_t s = 0; s < segments; ++s)
+		{
+			uint32_t i0 = r * (segments + 1) + s;
+			uint32_t i1 = i0 + 1;
+			uint32_t i2 = i0 + (segments + 1);
+			uint32_t i3 = i2 + 1;
+
+			indices.insert(indices.end(), { i0, i2, i1, i1, i2, i3 });
+		}
+	}
+}
+
+// Compresses `geometry`, then decodes all of its streams on the job system
+static void BenchCodec(BenchMesh& mesh, const Geometry& geometry)
+{
+	const int DecodeRuns = 3;
+
+	CompressedGeometry compressed;
+	double beginTime = GetTimestampMs();
+	CompressGeometry(compressed, GeometryView(geometry));
+	mesh.encodeTime = GetTimestampMs() - beginTime;
+
+	const CompressedGeometryView view(compressed);
+
+	// Allocated and touched up front, so that the timings don't include page faults
+	Geometry decoded{};
+	decoded.vertices.resize(geometry.vertices.size());
+	decoded.indices.resize(geometry.indices.size());
+	decoded.meshletData.resize(geometry.meshletData.size());
+
+	bool bDecoded = true;
+	mesh.decodeTime = DBL_MAX;
+	for (int run = 0; run < DecodeRuns; ++run)
+	{
+		beginTime = GetTimestampMs();
+		bDecoded &= DecodeGeometryStream(decoded.vertices.data(), view, GeometryStream::Vertices);
+		bDecoded &= DecodeGeometryStream(decoded.indices.data(), view, GeometryStream::Indices);
+		bDecoded &= DecodeGeometryStream(decoded.meshletData.data(), view, GeometryStream::MeshletData);
+		mesh.decodeTime = std::min(mesh.decodeTime, GetTimestampMs() - beginTime);
+	}
+
+	mesh.bCodec = true;
+	mesh.decodeThreadCount = g_JobSystem.GetThreadCount() + 1;
+	mesh.rawSize = geometry.vertices.size() * sizeof(Vertex) + geometry.indices.size() * sizeof(uint32_t) + geometry.meshletData.size() * sizeof(uint32_t);
+	mesh.compressedSize = compressed.data.size() + compressed.chunks.size() * sizeof(CompressedGeometryChunk);
+	mesh.bLosslessStreamsMatch = bDecoded && decoded.indices == geometry.indices && decoded.meshletData == geometry.meshletData;
+
+	float maxError = 0.0f;
+	for (size_t i = 0; i < geometry.vertices.size(); ++i)
+		maxError = std::max(maxError, glm::length(decoded.vertices[i].p - geometry.vertices[i].p));
+	mesh.maxPositionError = maxError / std::max(geometry.meshes[0].boundingSphere.w, EPS);
+}
+
+// Builds the cluster LOD of the first mesh of `geometry` like the geometry loader does, and compares the flat selection of the stored
+// clusters with the traversal of the DAG from a few distances
+static void BenchClusterLod(BenchMesh& mesh, const Geometry& geometry)
+{
+	Geometry clusterGeometry = geometry;
+	double beginTime = GetTimestampMs();
+	BuildMeshClusterLods(clusterGeometry);
+	mesh.clusterLodTime = GetTimestampMs() - beginTime;
+
+	const Mesh& srcMesh = clusterGeometry.meshes[0];
+	const MeshLod& srcLod = srcMesh.lods[0];
+
+	// Same build as the loader, for the groups of the traversal
+	std::vector<Vertex> vertices(geometry.vertices.begin() + srcMesh.vertexOffset, geometry.vertices.begin() + srcMesh.vertexOffset + srcMesh.vertexCount);
+	std::vector<uint32_t> indices(geometry.indices.begin() + srcLod.indexOffset, geometry.indices.begin() + srcLod.indexOffset + srcLod.indexCount);
+
+	ClusterLod clusterLod;
+	BuildClusterLod(clusterLod, vertices, indices);
+
+	mesh.bClusterLod = true;
+	mesh.clusterCount = clusterLod.clusters.size();
+	mesh.clusterGroupCount = clusterLod.groups.size();
+	mesh.clusterLevelCount = clusterLod.levelCount;
+
+	// 1080p, 60 degrees vertical fov, 1 pixel error
+	const float ProjScale = 1080.0f / (2.0f * tanf(glm::radians(60.0f) * 0.5f));
+	const float ErrorThreshold = 1.0f;
+	const float Distances[] = { 1.5f, 4.0f, 16.0f, 64.0f, 256.0f };
+
+	const glm::vec3 center{ srcMesh.boundingSphere.x, srcMesh.boundingSphere.y, srcMesh.boundingSphere.z };
+	const float radius = srcMesh.boundingSphere.w;
+
+	// The stored clusters are the ones of the DAG, with their own meshlets
+	mesh.bClusterLodStored = srcMesh.clusterCount == clusterLod.clusters.size();
+	for (uint32_t i = 0; i < srcMesh.clusterCount && mesh.bClusterLodStored; ++i)
+	{
+		const MeshCluster& cluster = clusterGeometry.clusters[srcMesh.clusterOffset + i];
+		mesh.bClusterLodStored = cluster.meshletIndex < clusterGeometry.meshlets.size() &&
+			clusterGeometry.meshlets[cluster.meshletIndex].triangleCount * 3u == clusterLod.clusters[i].indexCount;
+	}
+
+	std::vector<uint32_t> selected, traversed;
+	for (float distance : Distances)
+	{
+		glm::vec3 cameraPos = center + glm::vec3(0.0f, 0.0f, radius * distance);
+
+		selected.clear();
+		size_t triangleCount = 0;
+		for (uint32_t i = 0; i < srcMesh.clusterCount; ++i)
+		{
+			const MeshCluster& cluster = clusterGeometry.clusters[srcMesh.clusterOffset + i];
+			if (IsClusterLodSelected(cluster, cameraPos, ProjScale, ErrorThreshold))
+			{
+				selected.push_back(i);
+				triangleCount += clusterGeometry.meshlets[cluster.meshletIndex].triangleCount;
+			}
+		}
+
+		TraverseClusterLod(traversed, clusterLod, cameraPos, ProjScale, ErrorThreshold);
+
+		mesh.clusterSelections.push_back({ distance, selected.size(), triangleCount, selected == traversed });
+	}
+}
+
+// Culls a scene of `drawCount` instances of the meshes of `geometry`, placed like in main.cpp, with each CPU culling kernel and
+// thread count. The camera looks down -Z from the scene center, a wall covers the left half of the depth buffer.
+static void BenchCulling(BenchMesh& mesh, const Geometry& geometry, uint32_t drawCount)
+{
+	const int Frames = 5;
+	const uint32_t Width = 1920, Height = 1080;
+	const float ZNear = 0.01f;
+	const float WallDistance = MAX_DRAW_DISTANCE * 0.25f;
+
+	std::srand(42);
+
+	const uint32_t meshCount = static_cast<uint32_t>(geometry.meshes.size());
+	std::vector<MeshDraw> draws(drawCount);
+	uint32_t meshletVisibilityCount = 0;
+	for (auto& draw : draws)
+	{
+		auto t = glm::ballRand<float>(SCENE_RADIUS);
+		auto s = glm::linearRand(1.0f, 2.0f) * 2.0f;
+		auto theta = glm::radians(glm::linearRand<float>(0.0f, 180.0));
+		auto axis = glm::sphericalRand(1.0f);
+
+		auto r = glm::quat(cosf(theta), axis * sinf(theta));
+
+		glm::mat4 worldMat = glm::mat4_cast(r);
+		worldMat[0] = worldMat[0] * s;
+		worldMat[1] = worldMat[1] * s;
+		worldMat[2] = worldMat[2] * s;
+		worldMat[3] = glm::vec4(t.x, t.y, t.z, +1.0f);
+
+		draw.worldMatRow0 = glm::vec4(worldMat[0][0], worldMat[1][0], worldMat[2][0], worldMat[3][0]);
+		draw.worldMatRow1 = glm::vec4(worldMat[0][1], worldMat[1][1], worldMat[2][1], worldMat[3][1]);
+		draw.worldMatRow2 = glm::vec4(worldMat[0][2], worldMat[1][2], worldMat[2][2], worldMat[3][2]);
+
+		draw.meshIndex = glm::linearRand<uint32_t>(0, meshCount - 1);
+		draw.vertexOffset = geometry.meshes[draw.meshIndex].vertexOffset;
+		draw.meshletVisibilityOffset = meshletVisibilityCount;
+
+		const MeshDraw unpackedDraw = UnpackMeshDraw(PackMeshDraw(t, glm::vec4(r.x, r.y, r.z, r.w), s, draw.meshIndex, draw.vertexOffset, draw.meshletVisibilityOffset));
+		const glm::vec4* rows[] = { &draw.worldMatRow0, &draw.worldMatRow1, &draw.worldMatRow2 };
+		const glm::vec4* unpackedRows[] = { &unpackedDraw.worldMatRow0, &unpackedDraw.worldMatRow1, &unpackedDraw.worldMatRow2 };
+		for (int row = 0; row < 3; ++row)
+		{
+			mesh.drawPackingPositionError = std::max(mesh.drawPackingPositionError, double(fabsf(unpackedRows[row]->w - rows[row]->w)));
+			for (int column = 0; column < 3; ++column)
+				mesh.drawPackingRotationError = std::max(mesh.drawPackingRotationError, double(fabsf((*unpackedRows[row])[column] - (*rows[row])[column]) / s));
+		}
+		const float unpackedScale = sqrtf(unpackedDraw.worldMatRow0.x * unpackedDraw.worldMatRow0.x + unpackedDraw.worldMatRow1.x * unpackedDraw.worldMatRow1.x + unpackedDraw.worldMatRow2.x * unpackedDraw.worldMatRow2.x);
+		mesh.drawPackingScaleError = std::max(mesh.drawPackingScaleError, double(fabsf(unpackedScale / s - 1.0f)));
+		assert(unpackedDraw.meshIndex == draw.meshIndex && unpackedDraw.vertexOffset == draw.vertexOffset && unpackedDraw.meshletVisibilityOffset == draw.meshletVisibilityOffset);
+
+		meshletVisibilityCount += geometry.meshes[draw.meshIndex].lods[0].meshletCount;
+	}
+
+	const glm::mat4 projMatrix = MakeInfReversedZProjRH(glm::radians(60.0f), float(Width) / float(Height), ZNear);
+
+	std::vector<float> depth(size_t(Width) * Height, 0.0f);
+	const float wallDepth = -projMatrix[2][2] - projMatrix[3][2] / -WallDistance;
+	for (uint32_t y = 0; y < Height; ++y)
+		std::fill_n(depth.begin() + size_t(y) * Width, Width / 2, wallDepth);
+
+	CullDepthPyramid depthPyramid;
+	depthPyramid.Build(depth.data(), Width, Height);
+
+	const CullView view = CullView::Create(glm::mat4(1.0f), projMatrix, glm::vec3(0.0f), ZNear, MAX_DRAW_DISTANCE, depthPyramid.GetSize(),
+		GetLodSelectionParams(projMatrix, float(Height), LOD_ERROR_THRESHOLD, LOD_HYSTERESIS));
+	const CullSettings settings{};
+
+	CpuCuller culler;
+	culler.Init(geometry.meshes, geometry.meshlets, draws);
+
+	std::vector<uint32_t> threadCounts;
+	const uint32_t hardwareThreadCount = std::max(1u, std::thread::hardware_concurrency());
+	for (uint32_t threadCount = 1; threadCount < hardwareThreadCount; threadCount *= 2)
+		threadCounts.push_back(threadCount);
+	threadCounts.push_back(hardwareThreadCount);
+
+	mesh.bCull = true;
+	mesh.cullDrawCount = drawCount;
+
+	uint64_t referenceHash = 0;
+	CullResult result;
+	std::vector<uint32_t> meshletVisibilities;
+
+	for (uint32_t kernel = 0; kernel <= static_cast<uint32_t>(GetBestCullKernel()); ++kernel)
+	{
+		for (uint32_t threadCount : threadCounts)
+		{
+			g_JobSystem.Destroy();
+			if (threadCount > 1)
+				g_JobSystem.Init(threadCount - 1);
+
+			culler.SetKernel(static_cast<ECullKernel>(kernel));
+			culler.ResetVisibilities();
+
+			uint64_t hash = HASH_SEED;
+			double drawTime = 0.0, meshletTime = 0.0;
+			uint64_t drawsTested = 0, meshletsTested = 0;
+
+			// The first frame only fills the visibilities
+			for (int frame = 0; frame <= Frames; ++frame)
+			{
+				for (uint32_t pass = 0; pass < 2; ++pass)
+				{
+					double beginTime = GetTimestampMs();
+					culler.CullDraws(result, view, settings, pass, &depthPyramid);
+					double drawEndTime = GetTimestampMs();
+					culler.CullMeshlets(result, view, settings, pass, &depthPyramid);
+					double endTime = GetTimestampMs();
+
+					hash = HashBytes(result.taskCommands.data(), result.taskCommands.size() * sizeof(MeshTaskCommand), hash);
+					hash = HashBytes(result.meshlets.data(), result.meshlets.size() * sizeof(CulledMeshlet), hash);
+
+					if (frame > 0)
+					{
+						drawTime += drawEndTime - beginTime;
+						meshletTime += endTime - drawEndTime;
+						drawsTested += result.drawsTested;
+						meshletsTested += result.meshletsTested;
+					}
+				}
+			}
+
+			culler.GetMeshletVisibilities(meshletVisibilities);
+			hash = HashBytes(meshletVisibilities.data(), meshletVisibilities.size() * sizeof(uint32_t), hash);
+			hash = HashBytes(culler.GetDrawVisibilities().data(), culler.GetDrawVisibilities().size(), hash);
+
+			if (mesh.cullRuns.empty())
+			{
+				referenceHash = hash;
+				mesh.cullVisibleDrawCount = result.drawsVisible;
+				mesh.cullCommandCount = result.taskCommands.size();
+				mesh.cullMeshletCount = result.meshlets.size();
+			}
+
+			BenchMesh::CullRun run;
+			run.kernel = culler.GetKernel();
+			run.threadCount = threadCount;
+			run.drawTime = drawTime / Frames;
+			run.meshletTime = meshletTime / Frames;
+			run.drawsPerSecond = drawTime > 0.0 ? drawsTested / (drawTime * 1e-3) : 0.0;
+			run.meshletsPerSecond = meshletTime > 0.0 ? meshletsTested / (meshletTime * 1e-3) : 0.0;
+			run.bMatches = hash == referenceHash;
+			mesh.cullRuns.push_back(run);
+		}
+	}
+
+	// Brute force against the instance BVH, on the threads of the last run. The BVH changes the command order, they are compared sorted.
+	std::vector<glm::vec4> drawSpheres;
+	GetDrawBoundingSpheres(drawSpheres, geometry.meshes, draws);
+
+	InstanceBvh bvh;
+	double buildBeginTime = GetTimestampMs();
+	BuildInstanceBvh(bvh, drawSpheres);
+	mesh.cullBvhBuildTime = GetTimestampMs() - buildBeginTime;
+	mesh.cullBvhNodeCount = bvh.nodes.size();
+	mesh.cullBvhLeafCount = bvh.leafCount;
+	mesh.cullBvhDepth = bvh.depth;
+
+	culler.SetKernel(GetBestCullKernel());
+
+	uint64_t bvhHashes[2] = {};
+	std::vector<MeshTaskCommand> taskCommands;
+	std::vector<CulledMeshlet> meshlets;
+
+	for (uint32_t i = 0; i < 2; ++i)
+	{
+		BenchMesh::CullBvhRun& run = i > 0 ? mesh.cullBvh : mesh.cullBruteForce;
+
+		culler.SetInstanceBvh(i > 0 ? &bvh : nullptr);
+		culler.ResetVisibilities();
+
+		uint64_t hash = HASH_SEED;
+		double drawTime = 0.0;
+
+		for (int frame = 0; frame <= Frames; ++frame)
+		{
+			for (uint32_t pass = 0; pass < 2; ++pass)
+			{
+				double beginTime = GetTimestampMs();
+				culler.CullDraws(result, view, settings, pass, &depthPyramid);
+				double endTime = GetTimestampMs();
+				culler.CullMeshlets(result, view, settings, pass, &depthPyramid);
+
+				if (frame > 0)
+					drawTime += endTime - beginTime;
+
+				run.nodesVisited = result.nodesVisited;
+				run.drawsTested = result.drawsTested;
+
+				taskCommands = result.taskCommands;
+				std::sort(taskCommands.begin(), taskCommands.end(), [](const MeshTaskCommand& a, const MeshTaskCommand& b)
+					{
+						return a.drawId != b.drawId ? a.drawId < b.drawId : a.taskOffset < b.taskOffset;
+					});
+				meshlets = result.meshlets;
+				std::sort(meshlets.begin(), meshlets.end(), [](const CulledMeshlet& a, const CulledMeshlet& b)
+					{
+						return a.drawId != b.drawId ? a.drawId < b.drawId : a.meshletIndex < b.meshletIndex;
+					});
+
+				hash = HashBytes(taskCommands.data(), taskCommands.size() * sizeof(MeshTaskCommand), hash);
+				hash = HashBytes(meshlets.data(), meshlets.size() * sizeof(CulledMeshlet), hash);
+			}
+		}
+
+		culler.GetMeshletVisibilities(meshletVisibilities);
+		hash = HashBytes(meshletVisibilities.data(), meshletVisibilities.size() * sizeof(uint32_t), hash);
+		hash = HashBytes(culler.GetDrawVisibilities().data(), culler.GetDrawVisibilities().size(), hash);
+
+		run.drawTime = drawTime / Frames;
+		bvhHashes[i] = hash;
+	}
+
+	mesh.bCullBvhMatches = bvhHashes[0] == bvhHashes[1];
+
+	culler.SetInstanceBvh(nullptr);
+
+	// Without and with the visibility history. The scene is static, the draws skipping their occlusion tests would pass them anyway.
+	const int HistoryFrames = 20;
+	const uint64_t visibilityWordBytes = uint64_t(DivideAndRoundUp(drawCount, DRAW_VISIBILITY_STATES_PER_WORD)) * sizeof(uint32_t);
+	mesh.cullHistoryFrames = DRAW_VISIBILITY_HISTORY_FRAMES > 0 ? DRAW_VISIBILITY_HISTORY_FRAMES : 4;
+
+	uint64_t historyHashes[2] = {};
+	std::vector<uint32_t> framePeaks;
+
+	for (uint32_t i = 0; i < 2; ++i)
+	{
+		CullSettings historySettings = settings;
+		historySettings.visibilityHistoryFrames = i > 0 ? mesh.cullHistoryFrames : 0;
+
+		culler.ResetVisibilities();
+		if (i == 0)
+			framePeaks.assign(HistoryFrames, 0);
+
+		uint64_t hash = HASH_SEED;
+		uint64_t packedBytes = 0, unpackedBytes = 0, occlusionSkipped = 0;
+
+		for (int frame = 0; frame <= HistoryFrames; ++frame)
+		{
+			for (uint32_t pass = 0; pass < 2; ++pass)
+			{
+				culler.CullDraws(result, view, historySettings, pass, &depthPyramid);
+				culler.CullMeshlets(result, view, historySettings, pass, &depthPyramid);
+
+				hash = HashBytes(result.taskCommands.data(), result.taskCommands.size() * sizeof(MeshTaskCommand), hash);
+				hash = HashBytes(result.meshlets.data(), result.meshlets.size() * sizeof(CulledMeshlet), hash);
+
+				if (frame > 0 && i == 0)
+					framePeaks[frame - 1] = std::max(framePeaks[frame - 1], uint32_t(result.taskCommands.size()));
+
+				if (frame > 0)
+				{
+					// All the words are read, a changed state is an atomic on its word. A word per draw was stored for each draw tested
+					// in the late pass and each draw with commands in the early pass.
+					packedBytes += visibilityWordBytes + uint64_t(result.drawVisibilityChanges) * sizeof(uint32_t);
+					unpackedBytes += (uint64_t(drawCount) + (pass > 0 ? result.drawsTested : result.drawsVisible)) * sizeof(uint32_t);
+					occlusionSkipped += result.drawsOcclusionSkipped;
+				}
+			}
+		}
+
+		if (i == 0)
+		{
+			mesh.cullVisibilityBytes = double(packedBytes) / (2 * HistoryFrames);
+			mesh.cullVisibilityBytesUnpacked = double(unpackedBytes) / (2 * HistoryFrames);
+		}
+		else
+		{
+			mesh.cullHistoryOcclusionSkipped = double(occlusionSkipped) / HistoryFrames;
+		}
+		historyHashes[i] = hash;
+	}
+
+	mesh.bCullHistoryMatches = historyHashes[0] == historyHashes[1];
+
+	// Draw args buffer capacity over the peaks of the frames without history, their stats read back 2 frames later
+	const uint32_t ReadbackLatency = 2;
+	const uint32_t CapacityShrinkFrames = 4;
+	const uint32_t maxCapacity = std::numeric_limits<uint32_t>::max() / sizeof(MeshTaskCommand);
+
+	uint32_t sceneCommandCount = 0;
+	for (const auto& draw : draws)
+		sceneCommandCount += DivideAndRoundUp(geometry.meshes[draw.meshIndex].lods[0].meshletCount, TASK_GROUP_SIZE);
+	mesh.cullCommandPeak = *std::max_element(framePeaks.begin(), framePeaks.end());
+
+	mesh.bCullCapacityFits = true;
+	for (uint32_t i = 0; i < 2; ++i)
+	{
+		DrawCommandCapacity capacity;
+		capacity.Init(i == 0 ? GetDrawCommandCapacity(sceneCommandCount, maxCapacity) : DRAW_COMMAND_MIN_CAPACITY, maxCapacity, CapacityShrinkFrames);
+
+		uint64_t dropped = 0;
+		for (size_t frame = 0; frame < framePeaks.size(); ++frame)
+		{
+			if (frame >= ReadbackLatency)
+				capacity.Update({ framePeaks[frame - ReadbackLatency], 0 });
+			dropped += framePeaks[frame] > capacity.GetCapacity() ? framePeaks[frame] - capacity.GetCapacity() : 0;
+		}
+
+		const uint32_t finalCapacity = capacity.GetCapacity();
+		mesh.bCullCapacityFits = mesh.bCullCapacityFits && finalCapacity >= mesh.cullCommandPeak &&
+			uint64_t(finalCapacity) <= 4ull * GetDrawCommandCapacity(mesh.cullCommandPeak, maxCapacity);
+
+		if (i == 0)
+		{
+			mesh.cullCapacityFromScene = finalCapacity;
+			mesh.cullCapacityShrinks = capacity.GetShrinkCount();
+		}
+		else
+		{
+			mesh.cullCapacityFromMin = finalCapacity;
+			mesh.cullCapacityGrows = capacity.GetGrowCount();
+			mesh.cullCapacityDropped = dropped;
+		}
+	}
+
+	culler.Destroy();
+
+	g_JobSystem.Destroy();
+	g_JobSystem.Init();
+}
+
+// Adds, removes and moves 1% of `drawCount` instances per frame through the instance manager, like a dynamic scene in main.cpp
+static void BenchInstances(BenchMesh& mesh, const Geometry& geometry, uint32_t drawCount)
+{
+	const int Frames = 100;
+	const uint32_t ChangesPerFrame = std::max(1u, drawCount / 100);
+
+	std::srand(42);
+
+	const uint32_t meshCount = static_cast<uint32_t>(geometry.meshes.size());
+	uint32_t maxMeshletCount = 0;
+	for (const auto& m : geometry.meshes)
+		maxMeshletCount = std::max(maxMeshletCount, m.lods[0].meshletCount);
+
+	auto getRandomDesc = [&]()
+	{
+		auto theta = glm::radians(glm::linearRand<float>(0.0f, 180.0));
+		auto axis = glm::sphericalRand(1.0f);
+
+		InstanceDesc desc;
+		desc.position = glm::ballRand<float>(SCENE_RADIUS);
+		desc.orientation = glm::vec4(axis * sinf(theta), cosf(theta));
+		desc.scale = glm::linearRand(1.0f, 2.0f) * 2.0f;
+		desc.meshIndex = glm::linearRand<uint32_t>(0, meshCount - 1);
+		return desc;
+	};
+
+	InstanceManager instances;
+	instances.Init(geometry.meshes, drawCount, drawCount * maxMeshletCount, false);
+
+	std::vector<InstanceHandle> handles(drawCount);
+	for (auto& handle : handles)
+		handle = instances.Add(getRandomDesc());
+
+	// Copy of the draw buffer and of the draw visibilities, only written by the scatters. Visibilities start set, to check the resets.
+	const uint32_t drawStride = instances.GetDrawStride();
+	const uint32_t scatterStride = instances.GetScatterStride();
+	std::vector<uint8_t> gpuDraws;
+	instances.WriteDraws(gpuDraws);
+	gpuDraws.resize(size_t(drawCount) * drawStride);
+	std::vector<uint32_t> drawVisibilities(drawCount, 1);
+
+	mesh.bInstances = true;
+	mesh.instanceChangesPerFrame = ChangesPerFrame;
+	mesh.bInstancesMatch = true;
+
+	std::vector<uint8_t> scatters;
+	std::vector<uint8_t> expectedDraws;
+	uint64_t scatterCount = 0;
+
+	for (int frame = 0; frame < Frames; ++frame)
+	{
+		// Half of the frames shrink the scene, the other half grow it back, to go through the compactions
+		const bool bShrink = frame < Frames / 2;
+
+		double beginTime = GetTimestampMs();
+		for (uint32_t i = 0; i < ChangesPerFrame && !handles.empty(); ++i)
+		{
+			const size_t removeIndex = std::rand() % handles.size();
+			instances.Remove(handles[removeIndex]);
+			handles[removeIndex] = handles.back();
+			handles.pop_back();
+
+			if (!bShrink || (i & 3) == 0)
+				handles.push_back(instances.Add(getRandomDesc()));
+			if (!bShrink && handles.size() < drawCount)
+				handles.push_back(instances.Add(getRandomDesc()));
+
+			InstanceHandle handle = handles[std::rand() % handles.size()];
+			InstanceDesc desc = *instances.GetDesc(handle);
+			desc.position += glm::ballRand(1.0f);
+			if ((i & 7) == 0)
+				desc.meshIndex = glm::linearRand<uint32_t>(0, meshCount - 1);
+			instances.Update(handle, desc);
+		}
+		instances.Compact();
+		double changeEndTime = GetTimestampMs();
+
+		scatters.resize(size_t(std::min(instances.GetPendingScatterCount(), INSTANCE_SCATTERS_PER_FRAME)) * scatterStride);
+		const uint32_t count = instances.GatherScatters(scatters.data(), INSTANCE_SCATTERS_PER_FRAME);
+		double endTime = GetTimestampMs();
+
+		mesh.instanceChangeTime += changeEndTime - beginTime;
+		mesh.instanceGatherTime += endTime - changeEndTime;
+		scatterCount += count;
+
+		// `ScatterDraws.comp`
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			DrawScatter scatter;
+			memcpy(&scatter, scatters.data() + size_t(i) * scatterStride, sizeof(scatter));
+			memcpy(gpuDraws.data() + size_t(scatter.drawIndex) * drawStride, scatters.data() + size_t(i) * scatterStride + sizeof(scatter), drawStride);
+
+			if (scatter.flags & DRAW_SCATTER_RESET_DRAW_VISIBILITY)
+				drawVisibilities[scatter.drawIndex] = 0;
+		}
+
+		if (instances.GetPendingScatterCount() == 0)
+		{
+			instances.WriteDraws(expectedDraws);
+			mesh.bInstancesMatch = mesh.bInstancesMatch && memcmp(expectedDraws.data(), gpuDraws.data(), expectedDraws.size()) == 0;
+		}
+	}
+
+	// Empty draws are never visible, live instances own disjoint meshlet visibility ranges
+	const MeshDraw* pDraws = reinterpret_cast<const MeshDraw*>(gpuDraws.data());
+	for (uint32_t i = 0; i < instances.GetDrawCount(); ++i)
+		mesh.bInstancesMatch = mesh.bInstancesMatch && (pDraws[i].meshIndex != INVALID_MESH_INDEX || drawVisibilities[i] == 0);
+
+	std::vector<uint8_t> meshletOwners(drawCount * maxMeshletCount, 0);
+	for (InstanceHandle handle : handles)
+	{
+		const uint32_t drawIndex = instances.GetDrawIndex(handle);
+		const MeshDraw& draw = pDraws[drawIndex];
+		mesh.bInstancesMatch = mesh.bInstancesMatch && drawIndex < instances.GetDrawCount() && draw.meshIndex == instances.GetDesc(handle)->meshIndex;
+
+		for (uint32_t bit = draw.meshletVisibilityOffset; bit < draw.meshletVisibilityOffset + geometry.meshes[draw.meshIndex].lods[0].meshletCount; ++bit)
+			mesh.bInstancesMatch = mesh.bInstancesMatch && meshletOwners[bit]++ == 0;
+	}
+
+	const auto& stats = instances.GetStats();
+	mesh.instanceDrawCount = instances.GetDrawCount();
+	mesh.instanceChangeTime /= Frames;
+	mesh.instanceGatherTime /= Frames;
+	mesh.instanceScattersPerFrame = double(scatterCount) / Frames;
+	mesh.instanceUploadBytesPerFrame = mesh.instanceScattersPerFrame * scatterStride;
+	mesh.instanceCompactionCount = stats.compactionCount;
+	mesh.instanceMoveCount = stats.moveCount;
+
+	instances.Destroy();
+}
+
+// Packs the meshlet headers of all the lods and checks the decoded bounds against the meshlet vertices and triangles.
+// The cone tests use `ConeCull_BoundingSphere` of `Common.h`, from cameras around each meshlet, half of them behind its cone.
+static void BenchMeshletPacking(BenchMesh& mesh, const Geometry& geometry)
+{
+	const int CamerasPerMeshlet = 16;
+	// Relative to the distances, for the rounding of the float triangle tests
+	const float Tolerance = 1e-4f;
+
+	std::srand(42);
+
+	std::vector<PackedMeshlet> packedMeshlets;
+	double beginTime = GetTimestampMs();
+	PackMeshletHeaders(packedMeshlets, GeometryView(geometry));
+	mesh.meshletPackingTime = GetTimestampMs() - beginTime;
+
+	auto coneCull = [](const glm::vec4& cone, const glm::vec4& sphere, const glm::vec3& cameraPos)
+	{
+		const glm::vec3 sphereToCamera = glm::vec3(sphere) - cameraPos;
+		return glm::dot(glm::vec3(cone), sphereToCamera) >= cone.w * glm::length(sphereToCamera) + sphere.w;
+	};
+
+	double radiusRatioSum = 0.0;
+	size_t meshletCount = 0;
+
+	for (const auto& srcMesh : geometry.meshes)
+	{
+		for (uint32_t lodIndex = 0; lodIndex < srcMesh.lodCount; ++lodIndex)
+		{
+			const auto& lod = srcMesh.lods[lodIndex];
+			for (uint32_t meshletIndex = lod.meshletOffset; meshletIndex < lod.meshletOffset + lod.meshletCount; ++meshletIndex)
+			{
+				const Meshlet& meshlet = geometry.meshlets[meshletIndex];
+				const Meshlet unpacked = UnpackMeshletHeader(packedMeshlets[meshletIndex], srcMesh.boundingSphere);
+				const glm::vec3 center = glm::vec3(unpacked.boundingSphere);
+
+				auto getPosition = [&](uint32_t localIndex)
+				{
+					return geometry.vertices[srcMesh.vertexOffset + geometry.meshletData[meshlet.vertexOffset + localIndex]].p;
+				};
+
+				for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+				{
+					if (glm::length(getPosition(i) - center) > unpacked.boundingSphere.w)
+						++mesh.meshletSphereFailures;
+				}
+
+				if ((packedMeshlets[meshletIndex].radiusCounts & 0xFFFFu) == MESHLET_RADIUS_UNBOUNDED)
+				{
+					++mesh.meshletUnboundedSpheres;
+				}
+				else
+				{
+					radiusRatioSum += unpacked.boundingSphere.w / std::max(meshlet.boundingSphere.w, EPS);
+					++meshletCount;
+				}
+
+				for (int camera = 0; camera < CamerasPerMeshlet; ++camera)
+				{
+					const float distance = meshlet.boundingSphere.w * glm::linearRand(1.5f, 16.0f) + EPS;
+					const glm::vec3 direction = camera % 2 == 0
+						? glm::sphericalRand(1.0f)
+						: -SafeNormalize(glm::vec3(meshlet.cone) + glm::ballRand(0.5f));
+					const glm::vec3 cameraPos = glm::vec3(meshlet.boundingSphere) + direction * distance;
+
+					const bool bCulledFull = coneCull(meshlet.cone, meshlet.boundingSphere, cameraPos);
+					// Normalized like in the shaders
+					const bool bCulledPacked = coneCull(glm::vec4(SafeNormalize(glm::vec3(unpacked.cone)), unpacked.cone.w), unpacked.boundingSphere, cameraPos);
+
+					++mesh.meshletConeTests;
+					mesh.meshletConeCulledFull += bCulledFull ? 1 : 0;
+					mesh.meshletConeCulledPacked += bCulledPacked ? 1 : 0;
+
+					if (!bCulledPacked)
+						continue;
+
+					const uint32_t indexOffset = meshlet.vertexOffset + meshlet.vertexCount;
+					for (uint32_t i = 0; i < meshlet.triangleCount; ++i)
+					{
+						const uint32_t indices = geometry.meshletData[indexOffset + i];
+						const glm::vec3 p0 = getPosition(indices & 0xFF), p1 = getPosition((indices >> 8) & 0xFF), p2 = getPosition((indices >> 16) & 0xFF);
+						const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+						const glm::vec3 view = p0 - cameraPos;
+
+						// Degenerate triangles have no facing
+						if (glm::dot(normal, view) < -Tolerance * glm::length(normal) * glm::length(view))
+						{
+							++mesh.meshletConeFailures;
+							break;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	mesh.bMeshletPacking = true;
+	mesh.meshletPackingRadiusRatio = meshletCount > 0 ? radiusRatioSum / meshletCount : 0.0;
+}
+
+// Packs the vertices of all the meshes with both encoders, the errors are the max ones over the meshes
+static void BenchVertexPacking(BenchMesh& mesh, const Geometry& geometry)
+{
+	std::vector<PackedVertex> scalarVertices(geometry.vertices.size());
+	std::vector<PackedVertex> simdVertices(geometry.vertices.size());
+
+	double beginTime = GetTimestampMs();
+	for (const auto& srcMesh : geometry.meshes)
+		PackVertices(scalarVertices.data() + srcMesh.vertexOffset, geometry.vertices.data() + srcMesh.vertexOffset, srcMesh.vertexCount, srcMesh, false);
+	mesh.vertexPackingScalarTime = GetTimestampMs() - beginTime;
+
+	beginTime = GetTimestampMs();
+	for (const auto& srcMesh : geometry.meshes)
+		PackVertices(simdVertices.data() + srcMesh.vertexOffset, geometry.vertices.data() + srcMesh.vertexOffset, srcMesh.vertexCount, srcMesh, true);
+	mesh.vertexPackingSimdTime = GetTimestampMs() - beginTime;
+
+	mesh.bVertexPackingMatches = memcmp(scalarVertices.data(), simdVertices.data(), sizeof(PackedVertex) * simdVertices.size()) == 0;
+
+	for (const auto& srcMesh : geometry.meshes)
+	{
+		const VertexPackingError error = MeasureVertexPackingError(simdVertices.data() + srcMesh.vertexOffset, geometry.vertices.data() + srcMesh.vertexOffset, srcMesh.vertexCount, srcMesh);
+		mesh.vertexPackingError.position = std::max(mesh.vertexPackingError.position, error.position);
+		mesh.vertexPackingError.normal = std::max(mesh.vertexPackingError.normal, error.normal);
+		mesh.vertexPackingError.uv = std::max(mesh.vertexPackingError.uv, error.uv);
+	}
+
+	mesh.bVertexPacking = true;
+}
+
+static void PrintMesh(FILE* file, const BenchMesh& mesh)
+{
+	const auto& stats = mesh.stats;
+
+	if (!mesh.bLoaded)
+	{
+		fprintf(file, "%s: load failed\n", mesh.name.c_str());
+		return;
+	}
+
+	double simplifyTime = 0.0;
+	for (const auto& round : stats.simplifyRounds)
+		simplifyTime += round.time;
+
+	fprintf(file, "%s: %zu tris, %zu verts, %u lods, %zu meshlets\n", mesh.name.c_str(), stats.triangleCount, stats.vertexCount, mesh.lodCount, stats.meshletCount);
+	if (mesh.targetTriangleCount > 0)
+		fprintf(file, "\tgenerate       %10.2f ms\n", mesh.generateTime);
+	else
+		fprintf(file, "\tparse          %10.2f ms\n", stats.parseTime);
+	fprintf(file, "\tremap          %10.2f ms\n", stats.remapTime);
+	fprintf(file, "\tvertex cache   %10.2f ms\n", stats.vertexCacheTime);
+	fprintf(file, "\tvertex fetch   %10.2f ms\n", stats.vertexFetchTime);
+	for (size_t i = 0; i < stats.simplifyRounds.size(); ++i)
+	{
+		const auto& round = stats.simplifyRounds[i];
+		fprintf(file, "\tsimplify %zu     %10.2f ms (%zu -> %zu tris, error %.3g%s)\n", i, round.time, round.sourceTriangleCount, round.resultTriangleCount, round.error,
+			round.bSloppy ? ", sloppy" : "");
+	}
+	fprintf(file, "\tmeshlet build  %10.2f ms\n", stats.meshletBuildTime);
+	fprintf(file, "\tmeshlet bounds %10.2f ms\n", stats.meshletBoundsTime);
+	fprintf(file, "\ttotal          %10.2f ms, %.2f Mtris/s, peak RSS %.1f MB\n", mesh.totalTime, stats.triangleCount / (mesh.totalTime * 1e3), mesh.peakRssMB);
+
+	if (mesh.bCodec)
+	{
+		fprintf(file, "\tencode         %10.2f ms, %.2f MB -> %.2f MB (%.2fx)\n", mesh.encodeTime, mesh.rawSize / (1024.0 * 1024.0), mesh.compressedSize / (1024.0 * 1024.0),
+			mesh.rawSize / std::max(double(mesh.compressedSize), 1.0));
+		fprintf(file, "\tdecode         %10.2f ms, %.2f GB/s on %u threads, max position error %.2e, lossless streams %s\n", mesh.decodeTime, mesh.rawSize / (mesh.decodeTime * 1e6),
+			mesh.decodeThreadCount, mesh.maxPositionError, mesh.bLosslessStreamsMatch ? "match" : "MISMATCH");
+	}
+
+	if (mesh.bClusterLod)
+	{
+		fprintf(file, "\tcluster lod    %10.2f ms (%zu clusters, %zu groups, %u levels)%s\n", mesh.clusterLodTime, mesh.clusterCount, mesh.clusterGroupCount, mesh.clusterLevelCount,
+			mesh.bClusterLodStored ? "" : " - STORED MISMATCH");
+		for (const auto& selection : mesh.clusterSelections)
+		{
+			fprintf(file, "\t\tdistance %6.1f: %zu clusters, %zu tris%s\n", selection.distance, selection.clusterCount, selection.triangleCount,
+				selection.bTraversalMatches ? "" : " - TRAVERSAL MISMATCH");
+		}
+	}
+
+	if (mesh.bCull)
+	{
+		fprintf(file, "\tcpu culling    %u draws, late pass: %u visible, %zu task commands, %zu meshlets\n", mesh.cullDrawCount, mesh.cullVisibleDrawCount,
+			mesh.cullCommandCount, mesh.cullMeshletCount);
+		for (const auto& run : mesh.cullRuns)
+		{
+			fprintf(file, "\t\t%-6s %3u threads: draws %8.3f ms (%7.1f Mdraws/s), meshlets %8.3f ms (%7.1f Mmeshlets/s)%s\n", GetCullKernelName(run.kernel), run.threadCount,
+				run.drawTime, run.drawsPerSecond * 1e-6, run.meshletTime, run.meshletsPerSecond * 1e-6, run.bMatches ? "" : " - MISMATCH");
+		}
+
+		fprintf(file, "\t\tdraw packing   %zu bytes per draw instead of %zu, %.1f MB less per cull pass, max errors: position %g, rotation %g, scale %g\n",
+			sizeof(PackedMeshDraw), sizeof(MeshDraw), double(sizeof(MeshDraw) - sizeof(PackedMeshDraw)) * mesh.cullDrawCount / (1024.0 * 1024.0),
+			mesh.drawPackingPositionError, mesh.drawPackingRotationError, mesh.drawPackingScaleError);
+		fprintf(file, "\t\tinstance bvh   %zu nodes, %u leaves, depth %u, built in %.3f ms\n", mesh.cullBvhNodeCount, mesh.cullBvhLeafCount, mesh.cullBvhDepth, mesh.cullBvhBuildTime);
+		fprintf(file, "\t\t\tbrute force: draws %8.3f ms, %8u draws tested\n", mesh.cullBruteForce.drawTime, mesh.cullBruteForce.drawsTested);
+		fprintf(file, "\t\t\tbvh:         draws %8.3f ms, %8u draws tested, %u nodes visited%s\n", mesh.cullBvh.drawTime, mesh.cullBvh.drawsTested, mesh.cullBvh.nodesVisited,
+			mesh.bCullBvhMatches ? "" : " - MISMATCH");
+		fprintf(file, "\t\tdraw visibility %.1f KB per cull pass (%.1f KB with a word per draw), history of %u frames: %.0f occlusion tests skipped per late pass%s\n",
+			mesh.cullVisibilityBytes / 1024.0, mesh.cullVisibilityBytesUnpacked / 1024.0, mesh.cullHistoryFrames, mesh.cullHistoryOcclusionSkipped,
+			mesh.bCullHistoryMatches ? "" : " - MISMATCH");
+		fprintf(file, "\t\tcommand capacity peak %u task commands: %u (%.2f MB) after %u shrinks from the scene, %u after %u grows from %u, %llu commands dropped%s\n",
+			mesh.cullCommandPeak, mesh.cullCapacityFromScene, mesh.cullCapacityFromScene * sizeof(MeshTaskCommand) / (1024.0 * 1024.0), mesh.cullCapacityShrinks,
+			mesh.cullCapacityFromMin, mesh.cullCapacityGrows, DRAW_COMMAND_MIN_CAPACITY, static_cast<unsigned long long>(mesh.cullCapacityDropped),
+			mesh.bCullCapacityFits ? "" : " - MISFIT");
+	}
+
+	if (mesh.bInstances)
+	{
+		fprintf(file, "\tinstances      %u changes per frame: changes %.3f ms, gather %.3f ms, %.0f scatters (%.2f MB, full upload %.2f MB), %u compactions moved %llu, %u draws%s\n",
+			mesh.instanceChangesPerFrame, mesh.instanceChangeTime, mesh.instanceGatherTime, mesh.instanceScattersPerFrame, mesh.instanceUploadBytesPerFrame / (1024.0 * 1024.0),
+			double(sizeof(MeshDraw)) * mesh.instanceDrawCount / (1024.0 * 1024.0), mesh.instanceCompactionCount, static_cast<unsigned long long>(mesh.instanceMoveCount),
+			mesh.instanceDrawCount, mesh.bInstancesMatch ? "" : " - MISMATCH");
+	}
+
+	if (mesh.bMeshletPacking)
+	{
+		const bool bConservative = mesh.meshletSphereFailures == 0 && mesh.meshletConeFailures == 0;
+		fprintf(file, "\tmeshlet packing%10.2f ms, %zu bytes per meshlet instead of %zu, radius x%.3f (%llu unbounded), cone culls %.1f%% (full %.1f%%), %s\n",
+			mesh.meshletPackingTime, sizeof(PackedMeshlet), sizeof(Meshlet), mesh.meshletPackingRadiusRatio, static_cast<unsigned long long>(mesh.meshletUnboundedSpheres),
+			100.0 * mesh.meshletConeCulledPacked / std::max(mesh.meshletConeTests, uint64_t(1)), 100.0 * mesh.meshletConeCulledFull / std::max(mesh.meshletConeTests, uint64_t(1)),
+			bConservative ? "conservative" : "NOT CONSERVATIVE");
+		if (!bConservative)
+			fprintf(file, "\t\t%llu vertices out of their sphere, %llu cone culls with front facing triangles\n", static_cast<unsigned long long>(mesh.meshletSphereFailures),
+				static_cast<unsigned long long>(mesh.meshletConeFailures));
+	}
+
+	if (mesh.bVertexPacking)
+	{
+		fprintf(file, "\tvertex packing %9.2f ms scalar, %.2f ms simd, %zu bytes per vertex instead of %zu, max error position %g, normal %.2f deg, uv %g%s\n",
+			mesh.vertexPackingScalarTime, mesh.vertexPackingSimdTime, sizeof(PackedVertex), sizeof(Vertex), mesh.vertexPackingError.position, mesh.vertexPackingError.normal,
+			mesh.vertexPackingError.uv, mesh.bVertexPackingMatches ? "" : " - MISMATCH");
+	}
+}
+
+// Any of the consistency checks of the benchmarks that ran failed
+static bool HasFailedCheck(const BenchMesh& mesh)
+{
+	bool bFailed = false;
+
+	if (mesh.bCodec)
+		bFailed = bFailed || !mesh.bLosslessStreamsMatch;
+
+	if (mesh.bClusterLod)
+	{
+		bFailed = bFailed || !mesh.bClusterLodStored;
+		for (const auto& selection : mesh.clusterSelections)
+			bFailed = bFailed || !selection.bTraversalMatches;
+	}
+
+	if (mesh.bCull)
+	{
+		for (const auto& run : mesh.cullRuns)
+			bFailed = bFailed || !run.bMatches;
+		bFailed = bFailed || !mesh.bCullBvhMatches || !mesh.bCullHistoryMatches || !mesh.bCullCapacityFits;
+	}
+
+	if (mesh.bInstances)
+		bFailed = bFailed || !mesh.bInstancesMatch;
+
+	if (mesh.bMeshletPacking)
+		bFailed = bFailed || mesh.meshletSphereFailures > 0 || mesh.meshletConeFailures > 0;
+
+	if (mesh.bVertexPacking)
+		bFailed = bFailed || !mesh.bVertexPackingMatches;
+
+	return bFailed;
+}
+
+static bool WriteJson(const std::string& path, const std::vector<BenchMesh>& meshes, bool bBuildMeshlets)
+{
+	FILE* file = path == "-" ? stdout : fopen(path.c_str(), "w");
+	if (file == nullptr)
+		return false;
+
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"config\": { \"meshletMaxVertices\": %u, \"meshletMaxPrimitives\": %u, \"meshMaxLods\": %u, \"use8bit16bit\": %d, \"buildMeshlets\": %d },\n",
+		MESHLET_MAX_VERTICES, MESHLET_MAX_PRIMITIVES, MESH_MAX_LODS, USE_DEVICE_8BIT_16BIT_EXTENSIONS, bBuildMeshlets ? 1 : 0);
+	fprintf(file, "\t\"meshes\": [\n");
+
+	for (size_t i = 0; i < meshes.size(); ++i)
+	{
+		const auto& mesh = meshes[i];
+		const auto& stats = mesh.stats;
+
+		fprintf(file, "\t\t{\n");
+		fprintf(file, "\t\t\t\"name\": \"%s\",\n", mesh.name.c_str());
+		fprintf(file, "\t\t\t\"loaded\": %s,\n", mesh.bLoaded ? "true" : "false");
+		fprintf(file, "\t\t\t\"procedural\": %s,\n", mesh.targetTriangleCount > 0 ? "true" : "false");
+		fprintf(file, "\t\t\t\"triangles\": %zu,\n", stats.triangleCount);
+		fprintf(file, "\t\t\t\"vertices\": %zu,\n", stats.vertexCount);
+		fprintf(file, "\t\t\t\"lods\": %u,\n", mesh.lodCount);
+		fprintf(file, "\t\t\t\"meshlets\": %zu,\n", stats.meshletCount);
+		fprintf(file, "\t\t\t\"stagesMs\": { \"generate\": %.3f, \"parse\": %.3f, \"remap\": %.3f, \"vertexCache\": %.3f, \"vertexFetch\": %.3f, \"meshletBuild\": %.3f, \"meshletBounds\": %.3f },\n",
+			mesh.generateTime, stats.parseTime, stats.remapTime, stats.vertexCacheTime, stats.vertexFetchTime, stats.meshletBuildTime, stats.meshletBoundsTime);
+
+		fprintf(file, "\t\t\t\"simplify\": [");
+		for (size_t j = 0; j < stats.simplifyRounds.size(); ++j)
+		{
+			const auto& round = stats.simplifyRounds[j];
+			fprintf(file, "%s{ \"sourceTriangles\": %zu, \"resultTriangles\": %zu, \"error\": %g, \"sloppy\": %s, \"ms\": %.3f }", j > 0 ? ", " : " ", round.sourceTriangleCount, round.resultTriangleCount, round.error,
+				round.bSloppy ? "true" : "false", round.time);
+		}
+		fprintf(file, " ],\n");
+
+		fprintf(file, "\t\t\t\"totalMs\": %.3f,\n", mesh.totalTime);
+		fprintf(file, "\t\t\t\"trianglesPerSecond\": %.1f,\n", mesh.totalTime > 0.0 ? stats.triangleCount / (mesh.totalTime * 1e-3) : 0.0);
+		fprintf(file, "\t\t\t\"peakRssMB\": %.1f", mesh.peakRssMB);
+
+		if (mesh.bCodec)
+		{
+			fprintf(file, ",\n\t\t\t\"codec\": { \"rawBytes\": %zu, \"compressedBytes\": %zu, \"encodeMs\": %.3f, \"decodeMs\": %.3f, \"decodeGBps\": %.3f, \"decodeThreads\": %u, \"maxPositionError\": %g, \"losslessStreamsMatch\": %s }",
+				mesh.rawSize, mesh.compressedSize, mesh.encodeTime, mesh.decodeTime, mesh.rawSize / (mesh.decodeTime * 1e6), mesh.decodeThreadCount,
+				mesh.maxPositionError, mesh.bLosslessStreamsMatch ? "true" : "false");
+		}
+
+		if (mesh.bClusterLod)
+		{
+			fprintf(file, ",\n\t\t\t\"clusterLod\": { \"ms\": %.3f, \"clusters\": %zu, \"groups\": %zu, \"levels\": %u, \"storedMatches\": %s, \"selections\": [",
+				mesh.clusterLodTime, mesh.clusterCount, mesh.clusterGroupCount, mesh.clusterLevelCount, mesh.bClusterLodStored ? "true" : "false");
+			for (size_t j = 0; j < mesh.clusterSelections.size(); ++j)
+			{
+				const auto& selection = mesh.clusterSelections[j];
+				fprintf(file, "%s{ \"distance\": %.1f, \"clusters\": %zu, \"triangles\": %zu, \"traversalMatches\": %s }", j > 0 ? ", " : " ",
+					selection.distance, selection.clusterCount, selection.triangleCount, selection.bTraversalMatches ? "true" : "false");
+			}
+			fprintf(file, " ] }");
+		}
+
+		if (mesh.bCull)
+		{
+			fprintf(file, ",\n\t\t\t\"cpuCulling\": { \"draws\": %u, \"visibleDraws\": %u, \"taskCommands\": %zu, \"meshlets\": %zu, \"runs\": [",
+				mesh.cullDrawCount, mesh.cullVisibleDrawCount, mesh.cullCommandCount, mesh.cullMeshletCount);
+			for (size_t j = 0; j < mesh.cullRuns.size(); ++j)
+			{
+				const auto& run = mesh.cullRuns[j];
+				fprintf(file, "%s{ \"kernel\": \"%s\", \"threads\": %u, \"drawMs\": %.3f, \"meshletMs\": %.3f, \"drawsPerSecond\": %.1f, \"meshletsPerSecond\": %.1f, \"matches\": %s }",
+					j > 0 ? ", " : " ", GetCullKernelName(run.kernel), run.threadCount, run.drawTime, run.meshletTime, run.drawsPerSecond, run.meshletsPerSecond,
+					run.bMatches ? "true" : "false");
+			}
+			fprintf(file, " ],\n\t\t\t\t\"instanceBvh\": { \"nodes\": %zu, \"leaves\": %u, \"depth\": %u, \"buildMs\": %.3f, \"bruteForceDrawMs\": %.3f, \"bruteForceDrawsTested\": %u, "
+				"\"bvhDrawMs\": %.3f, \"bvhDrawsTested\": %u, \"nodesVisited\": %u, \"matches\": %s } }",
+				mesh.cullBvhNodeCount, mesh.cullBvhLeafCount, mesh.cullBvhDepth, mesh.cullBvhBuildTime, mesh.cullBruteForce.drawTime, mesh.cullBruteForce.drawsTested,
+				mesh.cullBvh.drawTime, mesh.cullBvh.drawsTested, mesh.cullBvh.nodesVisited, mesh.bCullBvhMatches ? "true" : "false");
+			fprintf(file, ",\n\t\t\t\"drawVisibility\": { \"bytesPerCullPass\": %.0f, \"unpackedBytesPerCullPass\": %.0f, \"historyFrames\": %u, "
+				"\"occlusionTestsSkippedPerLatePass\": %.1f, \"historyMatches\": %s }",
+				mesh.cullVisibilityBytes, mesh.cullVisibilityBytesUnpacked, mesh.cullHistoryFrames, mesh.cullHistoryOcclusionSkipped, mesh.bCullHistoryMatches ? "true" : "false");
+			fprintf(file, ",\n\t\t\t\"commandCapacity\": { \"peakCommands\": %u, \"fromScene\": %u, \"shrinks\": %u, \"fromMin\": %u, \"grows\": %u, "
+				"\"droppedCommands\": %llu, \"fits\": %s }",
+				mesh.cullCommandPeak, mesh.cullCapacityFromScene, mesh.cullCapacityShrinks, mesh.cullCapacityFromMin, mesh.cullCapacityGrows,
+				static_cast<unsigned long long>(mesh.cullCapacityDropped), mesh.bCullCapacityFits ? "true" : "false");
+			fprintf(file, ",\n\t\t\t\"drawPacking\": { \"drawBytes\": %zu, \"packedDrawBytes\": %zu, \"bytesSavedPerCullPass\": %zu, \"maxPositionError\": %g, \"maxRotationError\": %g, \"maxScaleError\": %g }",
+				sizeof(MeshDraw), sizeof(PackedMeshDraw), (sizeof(MeshDraw) - sizeof(PackedMeshDraw)) * mesh.cullDrawCount, mesh.drawPackingPositionError,
+				mesh.drawPackingRotationError, mesh.drawPackingScaleError);
+		}
+
+		if (mesh.bInstances)
+		{
+			fprintf(file, ",\n\t\t\t\"instances\": { \"changesPerFrame\": %u, \"changeMs\": %.3f, \"gatherMs\": %.3f, \"scattersPerFrame\": %.1f, \"uploadBytesPerFrame\": %.0f, "
+				"\"compactions\": %u, \"moves\": %llu, \"draws\": %u, \"matches\": %s }",
+				mesh.instanceChangesPerFrame, mesh.instanceChangeTime, mesh.instanceGatherTime, mesh.instanceScattersPerFrame, mesh.instanceUploadBytesPerFrame,
+				mesh.instanceCompactionCount, static_cast<unsigned long long>(mesh.instanceMoveCount), mesh.instanceDrawCount, mesh.bInstancesMatch ? "true" : "false");
+		}
+
+		if (mesh.bMeshletPacking)
+		{
+			fprintf(file, ",\n\t\t\t\"meshletPacking\": { \"ms\": %.3f, \"meshletBytes\": %zu, \"packedMeshletBytes\": %zu, \"radiusRatio\": %.4f, \"unboundedSpheres\": %llu, "
+				"\"coneTests\": %llu, \"coneCulledFull\": %llu, \"coneCulledPacked\": %llu, \"sphereFailures\": %llu, \"coneFailures\": %llu }",
+				mesh.meshletPackingTime, sizeof(Meshlet), sizeof(PackedMeshlet), mesh.meshletPackingRadiusRatio, static_cast<unsigned long long>(mesh.meshletUnboundedSpheres),
+				static_cast<unsigned long long>(mesh.meshletConeTests),
+				static_cast<unsigned long long>(mesh.meshletConeCulledFull), static_cast<unsigned long long>(mesh.meshletConeCulledPacked),
+				static_cast<unsigned long long>(mesh.meshletSphereFailures), static_cast<unsigned long long>(mesh.meshletConeFailures));
+		}
+
+		if (mesh.bVertexPacking)
+		{
+			fprintf(file, ",\n\t\t\t\"vertexPacking\": { \"scalarMs\": %.3f, \"simdMs\": %.3f, \"vertexBytes\": %zu, \"packedVertexBytes\": %zu, \"maxPositionError\": %g, "
+				"\"maxNormalErrorDeg\": %g, \"maxUvError\": %g, \"matches\": %s }",
+				mesh.vertexPackingScalarTime, mesh.vertexPackingSimdTime, sizeof(Vertex), sizeof(PackedVertex), mesh.vertexPackingError.position, mesh.vertexPackingError.normal,
+				mesh.vertexPackingError.uv, mesh.bVertexPackingMatches ? "true" : "false");
+		}
+		fprintf(file, "\n\t\t}%s\n", i + 1 < meshes.size() ? "," : "");
+	}
+
+	fprintf(file, "\t]\n");
+	fprintf(file, "}\n");
+
+	if (file != stdout)
+		fclose(file);
+
+	return true;
+}
+
+static std::vector<size_t> ParseCounts(const std::string& arg)
+{
+	std::vector<size_t> counts;
+
+	size_t begin = 0;
+	while (begin < arg.size())
+	{
+		size_t end = arg.find(',', begin);
+		if (end == std::string::npos)
+			end = arg.size();
+
+		size_t count = static_cast<size_t>(strtoull(arg.substr(begin, end - begin).c_str(), nullptr, 10));
+		if (count > 0)
+			counts.push_back(count);
+
+		begin = end + 1;
+	}
+
+	return counts;
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> objPaths;
+	std::vector<size_t> triangleCounts{ 1'000'000, 10'000'000, 50'000'000 };
+	std::string jsonPath = "geobench.json";
+	bool bBuildMeshlets = true;
+	bool bCodec = true;
+	bool bClusterLod = false;
+	bool bCull = false;
+	uint32_t cullDrawCount = 100'000;
+	bool bInstances = false;
+	bool bMeshletPacking = false;
+	bool bVertexPacking = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+
+		if (arg == "--obj" && i + 1 < argc)
+			objPaths.push_back(argv[++i]);
+		else if (arg == "--tris" && i + 1 < argc)
+			triangleCounts = ParseCounts(argv[++i]);
+		else if (arg == "--json" && i + 1 < argc)
+			jsonPath = argv[++i];
+		else if (arg == "--no-meshlets")
+			bBuildMeshlets = false;
+		else if (arg == "--no-codec")
+			bCodec = false;
+		else if (arg == "--cluster-lod")
+			bClusterLod = true;
+		else if (arg == "--cull")
+			bCull = true;
+		else if (arg == "--cull-draws" && i + 1 < argc)
+			cullDrawCount = std::max(1u, static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)));
+		else if (arg == "--instances")
+			bInstances = true;
+		else if (arg == "--meshlet-packing")
+			bMeshletPacking = true;
+		else if (arg == "--vertex-packing")
+			bVertexPacking = true;
+		else
+		{
+			printf("Usage: %s [--obj <path>]... [--tris <count>[,<count>...]] [--json <path>|-] [--no-meshlets] [--no-codec] [--cluster-lod] [--cull] [--cull-draws <count>] [--instances] [--meshlet-packing] [--vertex-packing]\n", argv[0]);
+			return arg == "--help" ? 0 : 1;
+		}
+	}
+
+	if (objPaths.empty())
+		objPaths.push_back(std::string(NIAGARA_RESOURCE_PATH) + "kitten.obj");
+
+	// Keeps the JSON alone on stdout
+	FILE* output = jsonPath == "-" ? stderr : stdout;
+
+	// Only used by the codec and the culling, the build stages run on the main thread to keep their timings comparable
+	g_JobSystem.Init();
+
+	std::vector<BenchMesh> meshes;
+	bool bFailed = false;
+
+	for (const auto& path : objPaths)
+	{
+		BenchMesh mesh{};
+		mesh.name = path.substr(path.find_last_of("/\\") + 1);
+
+		Geometry geometry{};
+		double beginTime = GetTimestampMs();
+		mesh.bLoaded = LoadMesh(geometry, path.c_str(), bBuildMeshlets, false, &mesh.stats);
+		mesh.totalTime = GetTimestampMs() - beginTime;
+		mesh.lodCount = mesh.bLoaded ? geometry.meshes.back().lodCount : 0;
+		if (mesh.bLoaded && bCodec)
+			BenchCodec(mesh, geometry);
+		if (mesh.bLoaded && bClusterLod)
+			BenchClusterLod(mesh, geometry);
+		if (mesh.bLoaded && bBuildMeshlets && bCull)
+			BenchCulling(mesh, geometry, cullDrawCount);
+		if (mesh.bLoaded && bBuildMeshlets && bInstances)
+			BenchInstances(mesh, geometry, cullDrawCount);
+		if (mesh.bLoaded && bBuildMeshlets && bMeshletPacking)
+			BenchMeshletPacking(mesh, geometry);
+		if (mesh.bLoaded && bVertexPacking)
+			BenchVertexPacking(mesh, geometry);
+		mesh.peakRssMB = GetPeakRssMB();
+
+		PrintMesh(output, mesh);
+		bFailed = bFailed || HasFailedCheck(mesh);
+		meshes.push_back(std::move(mesh));
+	}
+
+	for (size_t triangleCount : triangleCounts)
+	{
+		BenchMesh mesh{};
+		mesh.name = "procedural_" + std::to_string(triangleCount);
+		mesh.targetTriangleCount = triangleCount;
+
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		double beginTime = GetTimestampMs();
+		GenerateMesh(vertices, indices, triangleCount);
+		mesh.generateTime = GetTimestampMs() - beginTime;
+
+		Geometry geometry{};
+		beginTime = GetTimestampMs();
+		BuildMesh(geometry, vertices, indices, bBuildMeshlets, &mesh.stats);
+		mesh.totalTime = GetTimestampMs() - beginTime;
+		mesh.bLoaded = true;
+		mesh.lodCount = geometry.meshes.back().lodCount;
+		if (bCodec)
+			BenchCodec(mesh, geometry);
+		if (bClusterLod)
+			BenchClusterLod(mesh, geometry);
+		if (bBuildMeshlets && bMeshletPacking)
+			BenchMeshletPacking(mesh, geometry);
+		if (bVertexPacking)
+			BenchVertexPacking(mesh, geometry);
+		mesh.peakRssMB = GetPeakRssMB();
+
+		PrintMesh(output, mesh);
+		bFailed = bFailed || HasFailedCheck(mesh);
+		meshes.push_back(std::move(mesh));
+	}
+
+	g_JobSystem.Destroy();
+
+	if (!WriteJson(jsonPath, meshes, bBuildMeshlets))
+	{
+		fprintf(stderr, "Failed to write %s\n", jsonPath.c_str());
+		return 1;
+	}
+
+	return bFailed ? 1 : 0;
+}
@@ -0,0 +1,218 @@
+#include "GpuCheck.h"
+
+#include <cstdio>
+
+
+bool InitGpu(GpuContext& gpu, const char* appName)
+{
+	if (volkInitialize() != VK_SUCCESS)
+		return false;
+
+	VkApplicationInfo appInfo{ VK_STRUCTURE_TYPE_APPLICATION_INFO };
+	appInfo.pApplicationName = appName;
+	appInfo.apiVersion = VK_API_VERSION_1_3;
+
+	VkInstanceCreateInfo instanceInfo{ VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO };
+	instanceInfo.pApplicationInfo = &appInfo;
+	if (vkCreateInstance(&instanceInfo, nullptr, &gpu.instance) != VK_SUCCESS)
+		return false;
+	volkLoadInstance(gpu.instance);
+
+	uint32_t physicalDeviceCount = 0;
+	vkEnumeratePhysicalDevices(gpu.instance, &physicalDeviceCount, nullptr);
+	std::vector<VkPhysicalDevice> physicalDevices(physicalDeviceCount);
+	vkEnumeratePhysicalDevices(gpu.instance, &physicalDeviceCount, physicalDevices.data());
+
+	// First 1.3 device with a compute queue
+	for (VkPhysicalDevice physicalDevice : physicalDevices)
+	{
+		VkPhysicalDeviceProperties properties{};
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		if (properties.apiVersion < VK_API_VERSION_1_3)
+			continue;
+
+		uint32_t queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+		for (uint32_t i = 0; i < queueFamilyCount; ++i)
+		{
+			if (queueFamilies[i].queueFlags & VK_QUEUE_COMPUTE_BIT)
+			{
+				gpu.physicalDevice = physicalDevice;
+				gpu.properties = properties;
+				gpu.queueFamily = i;
+				break;
+			}
+		}
+
+		if (gpu.physicalDevice != VK_NULL_HANDLE)
+			break;
+	}
+
+	if (gpu.physicalDevice == VK_NULL_HANDLE)
+		return false;
+
+	vkGetPhysicalDeviceMemoryProperties(gpu.physicalDevice, &gpu.memoryProperties);
+
+	// The shaders declare 8 and 16 bit storage through `MeshCommon.h`, everything the device supports is enabled
+	VkPhysicalDeviceVulkan13Features features13{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES };
+	VkPhysicalDeviceVulkan12Features features12{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+	features12.pNext = &features13;
+	VkPhysicalDeviceVulkan11Features features11{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES };
+	features11.pNext = &features12;
+	VkPhysicalDeviceFeatures2 features{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+	features.pNext = &features11;
+	vkGetPhysicalDeviceFeatures2(gpu.physicalDevice, &features);
+	gpu.bSamplerFilterMinmax = features12.samplerFilterMinmax == VK_TRUE;
+	gpu.bStorageImageWriteWithoutFormat = features.features.shaderStorageImageWriteWithoutFormat == VK_TRUE;
+
+	const float queuePriority = 1.0f;
+	VkDeviceQueueCreateInfo queueInfo{ VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO };
+	queueInfo.queueFamilyIndex = gpu.queueFamily;
+	queueInfo.queueCount = 1;
+	queueInfo.pQueuePriorities = &queuePriority;
+
+	VkDeviceCreateInfo deviceInfo{ VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO };
+	deviceInfo.pNext = &features;
+	deviceInfo.queueCreateInfoCount = 1;
+	deviceInfo.pQueueCreateInfos = &queueInfo;
+	if (vkCreateDevice(gpu.physicalDevice, &deviceInfo, nullptr, &gpu.device) != VK_SUCCESS)
+		return false;
+	volkLoadDevice(gpu.device);
+
+	vkGetDeviceQueue(gpu.device, gpu.queueFamily, 0, &gpu.queue);
+
+	VkCommandPoolCreateInfo poolInfo{ VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = gpu.queueFamily;
+	VK_CHECK(vkCreateCommandPool(gpu.device, &poolInfo, nullptr, &gpu.commandPool));
+
+	VkFenceCreateInfo fenceInfo{ VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+	VK_CHECK(vkCreateFence(gpu.device, &fenceInfo, nullptr, &gpu.fence));
+
+	return true;
+}
+
+void DestroyGpu(GpuContext& gpu)
+{
+	if (gpu.device != VK_NULL_HANDLE)
+	{
+		vkDestroyFence(gpu.device, gpu.fence, nullptr);
+		vkDestroyCommandPool(gpu.device, gpu.commandPool, nullptr);
+		vkDestroyDevice(gpu.device, nullptr);
+	}
+	if (gpu.instance != VK_NULL_HANDLE)
+		vkDestroyInstance(gpu.instance, nullptr);
+}
+
+uint32_t GetMemoryType(const GpuContext& gpu, uint32_t typeBits, VkMemoryPropertyFlags flags)
+{
+	for (uint32_t i = 0; i < gpu.memoryProperties.memoryTypeCount; ++i)
+	{
+		if ((typeBits & (1u << i)) && (gpu.memoryProperties.memoryTypes[i].propertyFlags & flags) == flags)
+			return i;
+	}
+
+	return ~0u;
+}
+
+HostBuffer CreateBuffer(const GpuContext& gpu, VkDeviceSize size, VkBufferUsageFlags usage)
+{
+	HostBuffer buffer;
+	buffer.size = std::max<VkDeviceSize>(size, 16);
+
+	VkBufferCreateInfo createInfo{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+	createInfo.size = buffer.size;
+	createInfo.usage = usage;
+	createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	VK_CHECK(vkCreateBuffer(gpu.device, &createInfo, nullptr, &buffer.buffer));
+
+	VkMemoryRequirements memRequirements{};
+	vkGetBufferMemoryRequirements(gpu.device, buffer.buffer, &memRequirements);
+
+	VkMemoryAllocateInfo allocInfo{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+	allocInfo.allocationSize = memRequirements.size;
+	allocInfo.memoryTypeIndex = GetMemoryType(gpu, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	VK_CHECK(vkAllocateMemory(gpu.device, &allocInfo, nullptr, &buffer.memory));
+	VK_CHECK(vkBindBufferMemory(gpu.device, buffer.buffer, buffer.memory, 0));
+	VK_CHECK(vkMapMemory(gpu.device, buffer.memory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void**>(&buffer.data)));
+
+	memset(buffer.data, 0, buffer.size);
+	return buffer;
+}
+
+HostBuffer CreateBuffer(const GpuContext& gpu, const void* data, VkDeviceSize size, VkBufferUsageFlags usage)
+{
+	HostBuffer buffer = CreateBuffer(gpu, size, usage);
+	memcpy(buffer.data, data, size);
+	return buffer;
+}
+
+void DestroyBuffer(const GpuContext& gpu, HostBuffer& buffer)
+{
+	vkDestroyBuffer(gpu.device, buffer.buffer, nullptr);
+	vkFreeMemory(gpu.device, buffer.memory, nullptr);
+	buffer = {};
+}
+
+VkShaderModule LoadShader(const GpuContext& gpu, const std::string& path)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (file == nullptr)
+		return VK_NULL_HANDLE;
+
+	std::vector<uint32_t> code;
+	uint32_t word = 0;
+	while (fread(&word, sizeof(word), 1, file) == 1)
+		code.push_back(word);
+	fclose(file);
+
+	VkShaderModuleCreateInfo createInfo{ VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
+	createInfo.codeSize = code.size() * sizeof(uint32_t);
+	createInfo.pCode = code.data();
+
+	VkShaderModule shaderModule = VK_NULL_HANDLE;
+	if (code.empty() || vkCreateShaderModule(gpu.device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+		return VK_NULL_HANDLE;
+
+	return shaderModule;
+}
+
+VkPipeline CreatePipeline(const GpuContext& gpu, VkShaderModule shaderModule, VkPipelineLayout layout, const std::vector<std::pair<uint32_t, uint32_t>>& constants)
+{
+	std::vector<VkSpecializationMapEntry> entries;
+	std::vector<uint32_t> values;
+	for (const auto& constant : constants)
+	{
+		entries.push_back({ constant.first, static_cast<uint32_t>(values.size() * sizeof(uint32_t)), sizeof(uint32_t) });
+		values.push_back(constant.second);
+	}
+
+	VkSpecializationInfo specializationInfo{};
+	specializationInfo.mapEntryCount = static_cast<uint32_t>(entries.size());
+	specializationInfo.pMapEntries = entries.data();
+	specializationInfo.dataSize = values.size() * sizeof(uint32_t);
+	specializationInfo.pData = values.data();
+
+	VkComputePipelineCreateInfo createInfo{ VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+	createInfo.stage = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
+	createInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	createInfo.stage.module = shaderModule;
+	createInfo.stage.pName = "main";
+	createInfo.stage.pSpecializationInfo = &specializationInfo;
+	createInfo.layout = layout;
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VK_CHECK(vkCreateComputePipelines(gpu.device, VK_NULL_HANDLE, 1, &createInfo, nullptr, &pipeline));
+	return pipeline;
+}
+
+void ComputeBarrier(VkCommandBuffer cmd, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+	VkMemoryBarrier barrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = dstAccess;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
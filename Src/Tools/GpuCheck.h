@@ -0,0 +1,70 @@
+#pragma once
+
+#include "pch.h"
+#include "Utilities.h"
+
+#include <utility>
+
+// Vulkan helpers of the headless GPU checks (niagara_gpucullcheck, niagara_depthpyramidcheck), on any Vulkan 1.3 device with a
+// compute queue
+
+// Exit code of a check without a suitable device or SPIR-V, skipped by ctest
+constexpr int EXIT_SKIPPED = 77;
+
+struct HostBuffer
+{
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize size = 0;
+	uint8_t* data = nullptr;
+};
+
+struct GpuContext
+{
+	VkInstance instance = VK_NULL_HANDLE;
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties properties{};
+	VkPhysicalDeviceMemoryProperties memoryProperties{};
+	VkDevice device = VK_NULL_HANDLE;
+	uint32_t queueFamily = 0;
+	VkQueue queue = VK_NULL_HANDLE;
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	VkFence fence = VK_NULL_HANDLE;
+	// Min reduction sampling of the depth pyramid
+	bool bSamplerFilterMinmax = false;
+	// Storage image writes without a format qualifier, `HiZBuild.comp`
+	bool bStorageImageWriteWithoutFormat = false;
+};
+
+// First Vulkan 1.3 device with a compute queue, all of its features enabled. False if there's none.
+bool InitGpu(GpuContext& gpu, const char* appName);
+void DestroyGpu(GpuContext& gpu);
+
+// `~0u` if no memory type matches
+uint32_t GetMemoryType(const GpuContext& gpu, uint32_t typeBits, VkMemoryPropertyFlags flags);
+
+// Host visible and coherent, the host only touches them between submits
+HostBuffer CreateBuffer(const GpuContext& gpu, VkDeviceSize size, VkBufferUsageFlags usage);
+HostBuffer CreateBuffer(const GpuContext& gpu, const void* data, VkDeviceSize size, VkBufferUsageFlags usage);
+void DestroyBuffer(const GpuContext& gpu, HostBuffer& buffer);
+
+// `VK_NULL_HANDLE` if the SPIR-V can't be read
+VkShaderModule LoadShader(const GpuContext& gpu, const std::string& path);
+// `constants` - (constant_id, value) pairs
+VkPipeline CreatePipeline(const GpuContext& gpu, VkShaderModule shaderModule, VkPipelineLayout layout, const std::vector<std::pair<uint32_t, uint32_t>>& constants);
+
+// Shader writes visible to `dstStage`
+void ComputeBarrier(VkCommandBuffer cmd, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+// Index of the first differing element, `count` if they match
+template<typename T>
+size_t FindMismatch(const T* a, const T* b, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (memcmp(&a[i], &b[i], sizeof(T)) != 0)
+			return i;
+	}
+
+	return count;
+}
@@ -0,0 +1,803 @@
+// Headless check of the GPU draw culling against the CPU culling, on any Vulkan 1.3 device with a compute queue (lavapipe without a GPU).
+// Culls a scene of instances of the OBJ mesh with `DrawCommand.comp` with STABLE_COMPACTION followed by the two stages of
+// `CompactCommands.comp`, like main.cpp, and compares the command counts, the commands and the draw visibilities byte for byte with
+// `CpuCuller`. Task commands then draw commands, for a few frames of early and late passes with a different field of view each, so
+// the draws go through the frustum culling, the occlusion culling, the lod selection and its hysteresis.
+// The task commands are then culled by `ClusterCull.comp` and compared with `CpuCuller::CullMeshlets()` and `CullTriangles()`: the
+// cluster draws, their triangles and the meshlet visibilities. The shader appends the meshlets and the triangles with atomics, the
+// draws are compared sorted by meshlet and the triangles of each draw sorted.
+// The late passes are occlusion culled against the depth pyramid of a synthetic depth buffer of walls, built on the CPU with
+// `BuildDepthPyramidReference()` (the texels of both GPU builds) and sampled with a min reduction sampler like in main.cpp.
+//
+// Exits with 1 if the results differ, 77 (skipped by ctest) if there's no Vulkan device with min reduction sampling or the SPIR-V
+// can't be read.
+//
+// Usage: niagara_gpucullcheck [--obj <path>] [--draws <count>] [--spirv <dir>]
+
+#include "pch.h"
+#include "Config.h"
+#include "Utilities.h"
+#include "Geometry.h"
+#include "CpuCulling.h"
+#include "DrawCommandCapacity.h"
+#include "DepthPyramid.h"
+#include "GpuCheck.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+
+#include <glm/gtc/random.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#ifndef NIAGARA_RESOURCE_PATH
+#define NIAGARA_RESOURCE_PATH "../Resources/"
+#endif
+#ifndef NIAGARA_SPIRV_PATH
+#define NIAGARA_SPIRV_PATH "../Src/CompiledShaders/"
+#endif
+
+using namespace Niagara;
+
+
+constexpr uint32_t GROUP_SIZE = 64;
+
+// `ViewUniformBufferParameters` of `Common.h`, same as in main.cpp
+struct alignas(16) ViewUniforms
+{
+	glm::mat4 viewProjMatrix;
+	glm::mat4 viewMatrix;
+	glm::mat4 projMatrix;
+	glm::vec4 frustumPlanes[6];
+	glm::vec4 frustumValues;
+	glm::vec4 zNearFar;
+	glm::vec4 viewportRect;
+	glm::vec4 depthPyramidSize;
+	glm::vec4 debugValue;
+	glm::vec3 camPos;
+	uint32_t drawCount;
+	glm::vec4 lodParams;
+	uint32_t commandCapacity;
+};
+
+// `DebugParams` of `MeshCommon.h`
+struct DebugUniforms
+{
+	uint32_t drawFrustumCulling;
+	uint32_t drawOcclusionCulling;
+	uint32_t meshletConeCulling;
+	uint32_t meshletFrustumCulling;
+	uint32_t meshletOcclusionCulling;
+	uint32_t triBackfaceCulling;
+	uint32_t triSmallCulling;
+	uint32_t meshShading;
+	uint32_t toyDraw;
+};
+
+// Bindings of `DrawCommand.comp`, `CompactCommands.comp` uses a subset
+enum Binding : uint32_t
+{
+	MeshBinding = 0,
+	DrawBinding = 1,
+	CommandBinding = 2,
+	CountBinding = 3,
+	DrawVisibilityBinding = 4,
+	DepthPyramidBinding = 5,
+	CommandInfoBinding = 6,
+	ViewBinding = 7,
+	DebugBinding = 8,
+	GroupCountBinding = 9,
+	CullStatsBinding = 13,
+};
+
+// Bindings of `ClusterCull.comp`, the `MeshCommon.h` ones
+enum ClusterBinding : uint32_t
+{
+	ClusterVertexBinding = 0,
+	ClusterMeshletVisibilityBinding = 1,
+	ClusterDrawDataBinding = 2,
+	ClusterTaskCommandBinding = 3,
+	ClusterMeshletBinding = 4,
+	ClusterMeshletDataBinding = 5,
+	ClusterDepthPyramidBinding = 6,
+	ClusterViewBinding = 7,
+	ClusterDebugBinding = 8,
+	ClusterDrawCommandBinding = 9,
+	ClusterIndexBinding = 10,
+	ClusterCountBinding = 11,
+	ClusterMeshBinding = 12,
+	ClusterCullStatsBinding = 13,
+};
+
+// `ClusterCounts` of `ClusterCull.comp`
+struct ClusterCounts
+{
+	uint32_t drawCount;
+	uint32_t indexCount;
+};
+
+// Scene of `drawCount` instances, placed like in GeoBench
+static void GenerateDraws(std::vector<MeshDraw>& draws, const Geometry& geometry, uint32_t drawCount)
+{
+	std::srand(42);
+
+	const uint32_t meshCount = static_cast<uint32_t>(geometry.meshes.size());
+	uint32_t meshletVisibilityCount = 0;
+
+	draws.resize(drawCount);
+	for (auto& draw : draws)
+	{
+		auto t = glm::ballRand<float>(SCENE_RADIUS);
+		auto s = glm::linearRand(1.0f, 2.0f) * 2.0f;
+		auto theta = glm::radians(glm::linearRand<float>(0.0f, 180.0));
+		auto axis = glm::sphericalRand(1.0f);
+
+		auto r = glm::quat(cosf(theta), axis * sinf(theta));
+
+		glm::mat4 worldMat = glm::mat4_cast(r);
+		worldMat[0] = worldMat[0] * s;
+		worldMat[1] = worldMat[1] * s;
+		worldMat[2] = worldMat[2] * s;
+		worldMat[3] = glm::vec4(t.x, t.y, t.z, +1.0f);
+
+		draw.worldMatRow0 = glm::vec4(worldMat[0][0], worldMat[1][0], worldMat[2][0], worldMat[3][0]);
+		draw.worldMatRow1 = glm::vec4(worldMat[0][1], worldMat[1][1], worldMat[2][1], worldMat[3][1]);
+		draw.worldMatRow2 = glm::vec4(worldMat[0][2], worldMat[1][2], worldMat[2][2], worldMat[3][2]);
+
+		draw.meshIndex = glm::linearRand<uint32_t>(0, meshCount - 1);
+		draw.vertexOffset = geometry.meshes[draw.meshIndex].vertexOffset;
+		draw.meshletVisibilityOffset = meshletVisibilityCount;
+
+		meshletVisibilityCount += geometry.meshes[draw.meshIndex].lods[0].meshletCount;
+	}
+}
+
+// Reversed Z depth buffer of walls facing the camera, a 3x2 grid of screen regions, one without a wall
+static void GenerateDepth(std::vector<float>& depth, uint32_t width, uint32_t height, float zNear)
+{
+	const float WallDistances[6] = { SCENE_RADIUS * 0.25f, SCENE_RADIUS * 0.5f, 0.0f, SCENE_RADIUS * 0.75f, SCENE_RADIUS * 0.1f, SCENE_RADIUS * 0.4f };
+
+	depth.resize(size_t(width) * height);
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			const float distance = WallDistances[(y * 2 / height) * 3 + x * 3 / width];
+			// `MakeInfReversedZProjRH`, the far plane is 0
+			depth[size_t(y) * width + x] = distance > 0.0f ? zNear / distance : 0.0f;
+		}
+	}
+}
+
+// A cluster draw with its triangles, `firstIndex` cleared, the triangles sorted
+struct ClusterDraw
+{
+	MeshDrawCommand command;
+	std::vector<std::array<uint32_t, 3>> triangles;
+
+	bool operator<(const ClusterDraw& other) const
+	{
+		return command.drawId != other.command.drawId ? command.drawId < other.command.drawId : command.taskOffset < other.command.taskOffset;
+	}
+	bool operator==(const ClusterDraw& other) const
+	{
+		return memcmp(&command, &other.command, sizeof(command)) == 0 && triangles == other.triangles;
+	}
+};
+
+// The cluster draws sorted by draw and meshlet, the order of the atomics doesn't matter
+static void GetClusterDraws(std::vector<ClusterDraw>& clusterDraws, const MeshDrawCommand* commands, size_t commandCount, const uint32_t* indices)
+{
+	clusterDraws.resize(commandCount);
+	for (size_t i = 0; i < commandCount; ++i)
+	{
+		ClusterDraw& clusterDraw = clusterDraws[i];
+		clusterDraw.command = commands[i];
+		clusterDraw.command.drawIndexedIndirectCommand.firstIndex = 0;
+
+		const uint32_t* first = indices + commands[i].drawIndexedIndirectCommand.firstIndex;
+		clusterDraw.triangles.resize(commands[i].drawIndexedIndirectCommand.indexCount / 3);
+		for (size_t t = 0; t < clusterDraw.triangles.size(); ++t)
+			clusterDraw.triangles[t] = { first[t * 3 + 0], first[t * 3 + 1], first[t * 3 + 2] };
+		std::sort(clusterDraw.triangles.begin(), clusterDraw.triangles.end());
+	}
+
+	std::sort(clusterDraws.begin(), clusterDraws.end());
+}
+
+int main(int argc, char** argv)
+{
+	std::string objPath = std::string(NIAGARA_RESOURCE_PATH) + "kitten.obj";
+	std::string spirvPath = NIAGARA_SPIRV_PATH;
+	uint32_t drawCount = 10'000;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+
+		if (arg == "--obj" && i + 1 < argc)
+			objPath = argv[++i];
+		else if (arg == "--draws" && i + 1 < argc)
+			drawCount = std::max(1u, static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)));
+		else if (arg == "--spirv" && i + 1 < argc)
+			spirvPath = std::string(argv[++i]) + "/";
+		else
+		{
+			printf("Usage: %s [--obj <path>] [--draws <count>] [--spirv <dir>]\n", argv[0]);
+			return arg == "--help" ? 0 : 1;
+		}
+	}
+
+	Geometry geometry{};
+	if (!LoadMesh(geometry, objPath.c_str()))
+	{
+		printf("Failed to load %s\n", objPath.c_str());
+		return 1;
+	}
+
+	std::vector<MeshDraw> draws;
+	GenerateDraws(draws, geometry, drawCount);
+
+	const uint32_t Frames = 4;
+	const float FieldsOfView[Frames] = { 60.0f, 40.0f, 75.0f, 60.0f };
+	const uint32_t Width = 1920, Height = 1080;
+	const float ZNear = 0.01f;
+
+	std::vector<float> depth;
+	GenerateDepth(depth, Width, Height, ZNear);
+
+	CullDepthPyramid depthPyramid;
+	depthPyramid.Build(depth.data(), Width, Height);
+	const uint32_t depthPyramidMipCount = static_cast<uint32_t>(depthPyramid.levels.size());
+
+	GpuContext gpu;
+	if (!InitGpu(gpu, "niagara_gpucullcheck"))
+	{
+		printf("No Vulkan 1.3 device with a compute queue, skipped.\n");
+		DestroyGpu(gpu);
+		return EXIT_SKIPPED;
+	}
+	printf("Device: %s\n", gpu.properties.deviceName);
+
+	if (!gpu.bSamplerFilterMinmax)
+	{
+		printf("No min reduction sampling for the depth pyramid, skipped.\n");
+		DestroyGpu(gpu);
+		return EXIT_SKIPPED;
+	}
+
+	VkShaderModule drawCommandShader = LoadShader(gpu, spirvPath + "DrawCommand.comp.spv");
+	VkShaderModule compactCommandsShader = LoadShader(gpu, spirvPath + "CompactCommands.comp.spv");
+	VkShaderModule clusterCullShader = LoadShader(gpu, spirvPath + "ClusterCull.comp.spv");
+	if (drawCommandShader == VK_NULL_HANDLE || compactCommandsShader == VK_NULL_HANDLE || clusterCullShader == VK_NULL_HANDLE)
+	{
+		printf("Failed to load the SPIR-V from %s, skipped.\n", spirvPath.c_str());
+		vkDestroyShaderModule(gpu.device, drawCommandShader, nullptr);
+		vkDestroyShaderModule(gpu.device, compactCommandsShader, nullptr);
+		vkDestroyShaderModule(gpu.device, clusterCullShader, nullptr);
+		DestroyGpu(gpu);
+		return EXIT_SKIPPED;
+	}
+
+	// One layout for the draw culling and the compaction, one for the cluster culling
+	std::vector<VkDescriptorSetLayoutBinding> bindings;
+	for (uint32_t binding : { MeshBinding, DrawBinding, CommandBinding, CountBinding, DrawVisibilityBinding, CommandInfoBinding, GroupCountBinding, CullStatsBinding })
+		bindings.push_back({ binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr });
+	for (uint32_t binding : { ViewBinding, DebugBinding })
+		bindings.push_back({ binding, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr });
+	bindings.push_back({ DepthPyramidBinding, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr });
+
+	VkDescriptorSetLayoutCreateInfo setLayoutInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+	setLayoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	setLayoutInfo.pBindings = bindings.data();
+	VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+	VK_CHECK(vkCreateDescriptorSetLayout(gpu.device, &setLayoutInfo, nullptr, &setLayout));
+
+	bindings.clear();
+	for (uint32_t binding : { ClusterVertexBinding, ClusterMeshletVisibilityBinding, ClusterDrawDataBinding, ClusterTaskCommandBinding, ClusterMeshletBinding,
+		ClusterMeshletDataBinding, ClusterDrawCommandBinding, ClusterIndexBinding, ClusterCountBinding, ClusterMeshBinding, ClusterCullStatsBinding })
+		bindings.push_back({ binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr });
+	for (uint32_t binding : { ClusterViewBinding, ClusterDebugBinding })
+		bindings.push_back({ binding, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr });
+	bindings.push_back({ ClusterDepthPyramidBinding, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr });
+
+	setLayoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	setLayoutInfo.pBindings = bindings.data();
+	VkDescriptorSetLayout clusterSetLayout = VK_NULL_HANDLE;
+	VK_CHECK(vkCreateDescriptorSetLayout(gpu.device, &setLayoutInfo, nullptr, &clusterSetLayout));
+
+	// `pass` or `stage`
+	VkPushConstantRange pushConstantRange{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t) };
+
+	VkPipelineLayoutCreateInfo layoutInfo{ VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+	layoutInfo.setLayoutCount = 1;
+	layoutInfo.pSetLayouts = &setLayout;
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pPushConstantRanges = &pushConstantRange;
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VK_CHECK(vkCreatePipelineLayout(gpu.device, &layoutInfo, nullptr, &pipelineLayout));
+
+	layoutInfo.pSetLayouts = &clusterSetLayout;
+	VkPipelineLayout clusterPipelineLayout = VK_NULL_HANDLE;
+	VK_CHECK(vkCreatePipelineLayout(gpu.device, &layoutInfo, nullptr, &clusterPipelineLayout));
+
+	VkDescriptorPoolSize poolSizes[] =
+	{
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 8 + 11 },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2 + 2 },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 + 1 },
+	};
+	VkDescriptorPoolCreateInfo descriptorPoolInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+	descriptorPoolInfo.maxSets = 2;
+	descriptorPoolInfo.poolSizeCount = ARRAYSIZE(poolSizes);
+	descriptorPoolInfo.pPoolSizes = poolSizes;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	VK_CHECK(vkCreateDescriptorPool(gpu.device, &descriptorPoolInfo, nullptr, &descriptorPool));
+
+	VkDescriptorSetAllocateInfo setAllocInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+	setAllocInfo.descriptorPool = descriptorPool;
+	setAllocInfo.descriptorSetCount = 1;
+	setAllocInfo.pSetLayouts = &setLayout;
+	VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+	VK_CHECK(vkAllocateDescriptorSets(gpu.device, &setAllocInfo, &descriptorSet));
+
+	setAllocInfo.pSetLayouts = &clusterSetLayout;
+	VkDescriptorSet clusterDescriptorSet = VK_NULL_HANDLE;
+	VK_CHECK(vkAllocateDescriptorSets(gpu.device, &setAllocInfo, &clusterDescriptorSet));
+
+	// Buffers, the command buffer holds all the commands of the draws at lod 0, so that nothing is dropped
+	const uint32_t groupCount = DivideAndRoundUp(drawCount, GROUP_SIZE);
+
+	uint32_t commandCapacity = 0;
+	for (const auto& draw : draws)
+		commandCapacity += DivideAndRoundUp(geometry.meshes[draw.meshIndex].lods[0].meshletCount, TASK_GROUP_SIZE);
+	commandCapacity = std::max(commandCapacity, drawCount);
+
+	const VkBufferUsageFlags storageUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	HostBuffer meshBuffer = CreateBuffer(gpu, geometry.meshes.data(), geometry.meshes.size() * sizeof(Mesh), storageUsage);
+	HostBuffer drawBuffer = CreateBuffer(gpu, draws.data(), draws.size() * sizeof(MeshDraw), storageUsage);
+	HostBuffer commandBuffer = CreateBuffer(gpu, VkDeviceSize(commandCapacity) * std::max(sizeof(MeshDrawCommand), sizeof(MeshTaskCommand)), storageUsage);
+	// Dispatch of the cluster culling
+	HostBuffer countBuffer = CreateBuffer(gpu, sizeof(DrawCommandCounts), storageUsage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+	HostBuffer drawVisibilityBuffer = CreateBuffer(gpu, AlignUp(drawCount, sizeof(uint32_t)), storageUsage);
+	HostBuffer commandInfoBuffer = CreateBuffer(gpu, VkDeviceSize(groupCount) * GROUP_SIZE * sizeof(uint32_t), storageUsage);
+	HostBuffer groupCountBuffer = CreateBuffer(gpu, VkDeviceSize(groupCount) * sizeof(uint32_t), storageUsage);
+	// Not written, CULL_STATS is 0
+	HostBuffer cullStatsBuffer = CreateBuffer(gpu, 4096, storageUsage);
+	HostBuffer viewBuffer = CreateBuffer(gpu, sizeof(ViewUniforms), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+	HostBuffer debugBuffer = CreateBuffer(gpu, sizeof(DebugUniforms), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+
+	// Cluster culling, the cluster buffers hold the meshlets and triangles of the largest lod of every draw, so that nothing is dropped
+	uint32_t clusterDrawCapacity = 0, clusterIndexCapacity = 0;
+	for (const auto& draw : draws)
+	{
+		const Mesh& mesh = geometry.meshes[draw.meshIndex];
+		uint32_t meshletCount = 0, triangleCount = 0;
+		for (uint32_t lodIndex = 0; lodIndex < mesh.lodCount; ++lodIndex)
+		{
+			const MeshLod& lod = mesh.lods[lodIndex];
+			uint32_t lodTriangleCount = 0;
+			for (uint32_t i = 0; i < lod.meshletCount; ++i)
+				lodTriangleCount += geometry.meshlets[lod.meshletOffset + i].triangleCount;
+
+			meshletCount = std::max(meshletCount, lod.meshletCount);
+			triangleCount = std::max(triangleCount, lodTriangleCount);
+		}
+		clusterDrawCapacity += meshletCount;
+		clusterIndexCapacity += triangleCount * 3;
+	}
+
+	HostBuffer vertexBuffer = CreateBuffer(gpu, geometry.vertices.data(), geometry.vertices.size() * sizeof(Vertex), storageUsage);
+	HostBuffer meshletBuffer = CreateBuffer(gpu, geometry.meshlets.data(), geometry.meshlets.size() * sizeof(Meshlet), storageUsage);
+	HostBuffer meshletDataBuffer = CreateBuffer(gpu, geometry.meshletData.data(), geometry.meshletData.size() * sizeof(uint32_t), storageUsage);
+	HostBuffer clusterDrawBuffer = CreateBuffer(gpu, VkDeviceSize(clusterDrawCapacity) * sizeof(MeshDrawCommand), storageUsage);
+	HostBuffer clusterIndexBuffer = CreateBuffer(gpu, VkDeviceSize(clusterIndexCapacity) * sizeof(uint32_t), storageUsage);
+	HostBuffer clusterCountBuffer = CreateBuffer(gpu, sizeof(ClusterCounts), storageUsage);
+
+	uint32_t meshletVisibilityCount = 0;
+	for (const auto& draw : draws)
+		meshletVisibilityCount = std::max(meshletVisibilityCount, draw.meshletVisibilityOffset + geometry.meshes[draw.meshIndex].lods[0].meshletCount);
+	HostBuffer meshletVisibilityBuffer = CreateBuffer(gpu, VkDeviceSize(DivideAndRoundUp(meshletVisibilityCount, 32u)) * sizeof(uint32_t), storageUsage);
+
+	// Depth pyramid, the levels of the CPU reference uploaded through a staging buffer
+	VkImageCreateInfo imageInfo{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = VK_FORMAT_R32_SFLOAT;
+	imageInfo.extent = { depthPyramid.width, depthPyramid.height, 1 };
+	imageInfo.mipLevels = depthPyramidMipCount;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	VkImage depthPyramidImage = VK_NULL_HANDLE;
+	VK_CHECK(vkCreateImage(gpu.device, &imageInfo, nullptr, &depthPyramidImage));
+
+	VkMemoryRequirements imageRequirements{};
+	vkGetImageMemoryRequirements(gpu.device, depthPyramidImage, &imageRequirements);
+	VkMemoryAllocateInfo imageAllocInfo{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+	imageAllocInfo.allocationSize = imageRequirements.size;
+	imageAllocInfo.memoryTypeIndex = GetMemoryType(gpu, imageRequirements.memoryTypeBits, 0);
+	VkDeviceMemory depthPyramidMemory = VK_NULL_HANDLE;
+	VK_CHECK(vkAllocateMemory(gpu.device, &imageAllocInfo, nullptr, &depthPyramidMemory));
+	VK_CHECK(vkBindImageMemory(gpu.device, depthPyramidImage, depthPyramidMemory, 0));
+
+	VkImageViewCreateInfo viewInfo{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+	viewInfo.image = depthPyramidImage;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = VK_FORMAT_R32_SFLOAT;
+	viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, depthPyramidMipCount, 0, 1 };
+	VkImageView depthPyramidView = VK_NULL_HANDLE;
+	VK_CHECK(vkCreateImageView(gpu.device, &viewInfo, nullptr, &depthPyramidView));
+
+	// `minClampSampler` of main.cpp, `CullDepthPyramid::Sample()`
+	VkSamplerReductionModeCreateInfo reductionModeInfo{ VK_STRUCTURE_TYPE_SAMPLER_REDUCTION_MODE_CREATE_INFO };
+	reductionModeInfo.reductionMode = VK_SAMPLER_REDUCTION_MODE_MIN;
+
+	VkSamplerCreateInfo samplerInfo{ VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+	samplerInfo.pNext = &reductionModeInfo;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+	samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
+	samplerInfo.maxLod = 16.0f;
+	VkSampler sampler = VK_NULL_HANDLE;
+	VK_CHECK(vkCreateSampler(gpu.device, &samplerInfo, nullptr, &sampler));
+
+	// Descriptors
+	{
+		const std::pair<uint32_t, const HostBuffer*> bufferBindings[] =
+		{
+			{ MeshBinding, &meshBuffer }, { DrawBinding, &drawBuffer }, { CommandBinding, &commandBuffer }, { CountBinding, &countBuffer },
+			{ DrawVisibilityBinding, &drawVisibilityBuffer }, { CommandInfoBinding, &commandInfoBuffer }, { GroupCountBinding, &groupCountBuffer },
+			{ CullStatsBinding, &cullStatsBuffer }, { ViewBinding, &viewBuffer }, { DebugBinding, &debugBuffer },
+		};
+
+		VkDescriptorBufferInfo bufferInfos[ARRAYSIZE(bufferBindings)];
+		VkWriteDescriptorSet writes[ARRAYSIZE(bufferBindings) + 1];
+		for (uint32_t i = 0; i < ARRAYSIZE(bufferBindings); ++i)
+		{
+			const uint32_t binding = bufferBindings[i].first;
+			bufferInfos[i] = { bufferBindings[i].second->buffer, 0, VK_WHOLE_SIZE };
+
+			writes[i] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+			writes[i].dstSet = descriptorSet;
+			writes[i].dstBinding = binding;
+			writes[i].descriptorCount = 1;
+			writes[i].descriptorType = binding == ViewBinding || binding == DebugBinding ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[i].pBufferInfo = &bufferInfos[i];
+		}
+
+		VkDescriptorImageInfo imageDescInfo{ sampler, depthPyramidView, VK_IMAGE_LAYOUT_GENERAL };
+		VkWriteDescriptorSet& imageWrite = writes[ARRAYSIZE(bufferBindings)];
+		imageWrite = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+		imageWrite.dstSet = descriptorSet;
+		imageWrite.dstBinding = DepthPyramidBinding;
+		imageWrite.descriptorCount = 1;
+		imageWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		imageWrite.pImageInfo = &imageDescInfo;
+
+		vkUpdateDescriptorSets(gpu.device, ARRAYSIZE(writes), writes, 0, nullptr);
+	}
+
+	{
+		const std::pair<uint32_t, const HostBuffer*> bufferBindings[] =
+		{
+			{ ClusterVertexBinding, &vertexBuffer }, { ClusterMeshletVisibilityBinding, &meshletVisibilityBuffer }, { ClusterDrawDataBinding, &drawBuffer },
+			{ ClusterTaskCommandBinding, &commandBuffer }, { ClusterMeshletBinding, &meshletBuffer }, { ClusterMeshletDataBinding, &meshletDataBuffer },
+			{ ClusterDrawCommandBinding, &clusterDrawBuffer }, { ClusterIndexBinding, &clusterIndexBuffer }, { ClusterCountBinding, &clusterCountBuffer },
+			{ ClusterMeshBinding, &meshBuffer }, { ClusterCullStatsBinding, &cullStatsBuffer }, { ClusterViewBinding, &viewBuffer }, { ClusterDebugBinding, &debugBuffer },
+		};
+
+		VkDescriptorBufferInfo bufferInfos[ARRAYSIZE(bufferBindings)];
+		VkWriteDescriptorSet writes[ARRAYSIZE(bufferBindings) + 1];
+		for (uint32_t i = 0; i < ARRAYSIZE(bufferBindings); ++i)
+		{
+			const uint32_t binding = bufferBindings[i].first;
+			bufferInfos[i] = { bufferBindings[i].second->buffer, 0, VK_WHOLE_SIZE };
+
+			writes[i] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+			writes[i].dstSet = clusterDescriptorSet;
+			writes[i].dstBinding = binding;
+			writes[i].descriptorCount = 1;
+			writes[i].descriptorType = binding == ClusterViewBinding || binding == ClusterDebugBinding ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[i].pBufferInfo = &bufferInfos[i];
+		}
+
+		VkDescriptorImageInfo imageDescInfo{ sampler, depthPyramidView, VK_IMAGE_LAYOUT_GENERAL };
+		VkWriteDescriptorSet& imageWrite = writes[ARRAYSIZE(bufferBindings)];
+		imageWrite = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+		imageWrite.dstSet = clusterDescriptorSet;
+		imageWrite.dstBinding = ClusterDepthPyramidBinding;
+		imageWrite.descriptorCount = 1;
+		imageWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		imageWrite.pImageInfo = &imageDescInfo;
+
+		vkUpdateDescriptorSets(gpu.device, ARRAYSIZE(writes), writes, 0, nullptr);
+	}
+
+	VkCommandBufferAllocateInfo cmdAllocInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+	cmdAllocInfo.commandPool = gpu.commandPool;
+	cmdAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	cmdAllocInfo.commandBufferCount = 1;
+	VkCommandBuffer cmd = VK_NULL_HANDLE;
+	VK_CHECK(vkAllocateCommandBuffers(gpu.device, &cmdAllocInfo, &cmd));
+
+	VkCommandBufferBeginInfo beginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	auto submitAndWait = [&]()
+	{
+		VK_CHECK(vkEndCommandBuffer(cmd));
+
+		VkSubmitInfo submitInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &cmd;
+		VK_CHECK(vkQueueSubmit(gpu.queue, 1, &submitInfo, gpu.fence));
+		VK_CHECK(vkWaitForFences(gpu.device, 1, &gpu.fence, VK_TRUE, UINT64_MAX));
+		VK_CHECK(vkResetFences(gpu.device, 1, &gpu.fence));
+	};
+
+	// Depth pyramid upload, in the layout of its descriptor
+	{
+		VkDeviceSize stagingSize = 0;
+		for (const auto& level : depthPyramid.levels)
+			stagingSize += level.size() * sizeof(float);
+		HostBuffer stagingBuffer = CreateBuffer(gpu, stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+
+		std::vector<VkBufferImageCopy> copyRegions(depthPyramidMipCount);
+		VkDeviceSize stagingOffset = 0;
+		for (uint32_t i = 0; i < depthPyramidMipCount; ++i)
+		{
+			const auto& level = depthPyramid.levels[i];
+			memcpy(stagingBuffer.data + stagingOffset, level.data(), level.size() * sizeof(float));
+
+			VkBufferImageCopy& region = copyRegions[i];
+			region = {};
+			region.bufferOffset = stagingOffset;
+			region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 };
+			region.imageExtent = { std::max(1u, depthPyramid.width >> i), std::max(1u, depthPyramid.height >> i), 1 };
+
+			stagingOffset += level.size() * sizeof(float);
+		}
+
+		VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+
+		VkImageMemoryBarrier barrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = depthPyramidImage;
+		barrier.subresourceRange = viewInfo.subresourceRange;
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		vkCmdCopyBufferToImage(cmd, stagingBuffer.buffer, depthPyramidImage, VK_IMAGE_LAYOUT_GENERAL, depthPyramidMipCount, copyRegions.data());
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		submitAndWait();
+		DestroyBuffer(gpu, stagingBuffer);
+	}
+
+	CpuCuller culler;
+	culler.Init(geometry.meshes, geometry.meshlets, draws);
+	culler.SetKernel(GetBestCullKernel());
+
+	CullResult result;
+	std::vector<uint32_t> cpuMeshletVisibilities;
+	std::vector<ClusterDraw> gpuClusterDraws, cpuClusterDraws;
+	bool bFailed = false;
+
+	for (uint32_t task = 0; task < 2 && !bFailed; ++task)
+	{
+		CullSettings settings{};
+		settings.bTaskCommands = task > 0;
+
+		VkPipeline drawCommandPipeline = CreatePipeline(gpu, drawCommandShader, pipelineLayout, { { 0, task }, { 2, 1 } });
+		VkPipeline compactCommandsPipeline = CreatePipeline(gpu, compactCommandsShader, pipelineLayout, { { 0, task } });
+		// Unpacked draws, meshlets and vertices
+		VkPipeline clusterCullPipeline = task ? CreatePipeline(gpu, clusterCullShader, clusterPipelineLayout, {}) : VK_NULL_HANDLE;
+
+		DebugUniforms debugUniforms{};
+		debugUniforms.drawFrustumCulling = settings.bDrawFrustumCulling ? 1 : 0;
+		debugUniforms.drawOcclusionCulling = settings.bDrawOcclusionCulling ? 1 : 0;
+		debugUniforms.meshletConeCulling = settings.bMeshletConeCulling ? 1 : 0;
+		debugUniforms.meshletFrustumCulling = settings.bMeshletFrustumCulling ? 1 : 0;
+		debugUniforms.meshletOcclusionCulling = settings.bMeshletOcclusionCulling ? 1 : 0;
+		debugUniforms.triBackfaceCulling = settings.bTriBackfaceCulling ? 1 : 0;
+		debugUniforms.triSmallCulling = settings.bTriSmallCulling ? 1 : 0;
+		debugUniforms.meshShading = settings.bMeshShading ? 1 : 0;
+		memcpy(debugBuffer.data, &debugUniforms, sizeof(debugUniforms));
+
+		culler.ResetVisibilities();
+		memset(drawVisibilityBuffer.data, 0, drawVisibilityBuffer.size);
+		memset(meshletVisibilityBuffer.data, 0, meshletVisibilityBuffer.size);
+
+		size_t commandCount = 0;
+		size_t clusterDrawCount = 0;
+
+		// The first frame starts with the late pass, nothing is visible yet
+		for (uint32_t frame = 0; frame < Frames && !bFailed; ++frame)
+		{
+			const glm::mat4 projMatrix = MakeInfReversedZProjRH(glm::radians(FieldsOfView[frame]), float(Width) / float(Height), ZNear);
+			const CullView view = CullView::Create(glm::mat4(1.0f), projMatrix, glm::vec3(0.0f), ZNear, MAX_DRAW_DISTANCE, depthPyramid.GetSize(),
+				GetLodSelectionParams(projMatrix, float(Height), LOD_ERROR_THRESHOLD, LOD_HYSTERESIS));
+
+			ViewUniforms viewUniforms{};
+			viewUniforms.viewProjMatrix = view.projMatrix * view.viewMatrix;
+			viewUniforms.viewMatrix = view.viewMatrix;
+			viewUniforms.projMatrix = view.projMatrix;
+			viewUniforms.frustumValues = view.frustumValues;
+			viewUniforms.zNearFar = view.zNearFar;
+			viewUniforms.viewportRect = glm::vec4(0.0f, 0.0f, float(Width), float(Height));
+			viewUniforms.depthPyramidSize = view.depthPyramidSize;
+			viewUniforms.camPos = view.camPos;
+			viewUniforms.drawCount = drawCount;
+			viewUniforms.lodParams = view.lodParams;
+			viewUniforms.commandCapacity = commandCapacity;
+			memcpy(viewBuffer.data, &viewUniforms, sizeof(viewUniforms));
+
+			for (uint32_t pass = frame == 0 ? 1 : 0; pass < 2 && !bFailed; ++pass)
+			{
+				// GPU
+				DrawCommandCounts counts{};
+				counts.dispatchY = counts.dispatchZ = 1;
+				memcpy(countBuffer.data, &counts, sizeof(counts));
+				memset(commandBuffer.data, 0xCD, commandBuffer.size);
+				memset(clusterCountBuffer.data, 0, clusterCountBuffer.size);
+				memset(clusterDrawBuffer.data, 0xCD, clusterDrawBuffer.size);
+
+				VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+
+				vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, drawCommandPipeline);
+				vkCmdPushConstants(cmd, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &pass);
+				vkCmdDispatch(cmd, groupCount, 1, 1);
+
+				vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, compactCommandsPipeline);
+				for (uint32_t stage = 0; stage < 2; ++stage)
+				{
+					ComputeBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+					vkCmdPushConstants(cmd, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &stage);
+					vkCmdDispatch(cmd, stage == 0 ? 1 : groupCount, 1, 1);
+				}
+
+				// Task command count and 1, 1 written by the draw culling, like main.cpp
+				if (clusterCullPipeline != VK_NULL_HANDLE)
+				{
+					ComputeBarrier(cmd, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+
+					vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, clusterPipelineLayout, 0, 1, &clusterDescriptorSet, 0, nullptr);
+					vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, clusterCullPipeline);
+					vkCmdPushConstants(cmd, clusterPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &pass);
+					vkCmdDispatchIndirect(cmd, countBuffer.buffer, 0);
+				}
+
+				ComputeBarrier(cmd, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+				submitAndWait();
+
+				// CPU
+				culler.CullDraws(result, view, settings, pass, &depthPyramid);
+
+				memcpy(&counts, countBuffer.data, sizeof(counts));
+
+				const size_t cpuCount = settings.bTaskCommands ? result.taskCommands.size() : result.drawCommands.size();
+				size_t mismatch = 0;
+				if (counts.commandCount != cpuCount)
+				{
+					printf("Frame %u pass %u, %s commands: %u on the GPU, %zu on the CPU\n", frame, pass, task ? "task" : "draw", counts.commandCount, cpuCount);
+					bFailed = true;
+				}
+				else if ((mismatch = settings.bTaskCommands ?
+					FindMismatch(reinterpret_cast<const MeshTaskCommand*>(commandBuffer.data), result.taskCommands.data(), cpuCount) :
+					FindMismatch(reinterpret_cast<const MeshDrawCommand*>(commandBuffer.data), result.drawCommands.data(), cpuCount)) != cpuCount)
+				{
+					const uint32_t gpuDrawId = *reinterpret_cast<const uint32_t*>(commandBuffer.data + mismatch * (settings.bTaskCommands ? sizeof(MeshTaskCommand) : sizeof(MeshDrawCommand)));
+					const uint32_t cpuDrawId = settings.bTaskCommands ? result.taskCommands[mismatch].drawId : result.drawCommands[mismatch].drawId;
+					printf("Frame %u pass %u, %s command %zu differs: draw %u on the GPU, %u on the CPU\n", frame, pass, task ? "task" : "draw", mismatch, gpuDrawId, cpuDrawId);
+					bFailed = true;
+				}
+
+				const uint8_t* cpuVisibilities = culler.GetDrawVisibilities().data();
+				if ((mismatch = FindMismatch(drawVisibilityBuffer.data, cpuVisibilities, drawCount)) != drawCount)
+				{
+					printf("Frame %u pass %u, visibility of draw %zu differs: 0x%02x on the GPU, 0x%02x on the CPU\n", frame, pass, mismatch,
+						drawVisibilityBuffer.data[mismatch], cpuVisibilities[mismatch]);
+					bFailed = true;
+				}
+
+				// Cluster culling, on the CPU over the CPU commands, they match the GPU ones here
+				if (clusterCullPipeline != VK_NULL_HANDLE && !bFailed)
+				{
+					culler.CullMeshlets(result, view, settings, pass, &depthPyramid);
+					culler.CullTriangles(result, view, settings, glm::vec2(float(Width), float(Height)), geometry.vertices.data(), geometry.meshletData.data());
+
+					ClusterCounts clusterCounts{};
+					memcpy(&clusterCounts, clusterCountBuffer.data, sizeof(clusterCounts));
+
+					if (clusterCounts.drawCount != result.clusterDrawCommands.size() || clusterCounts.indexCount != result.clusterIndices.size())
+					{
+						printf("Frame %u pass %u, clusters: %u draws and %u indices on the GPU, %zu and %zu on the CPU\n", frame, pass, clusterCounts.drawCount,
+							clusterCounts.indexCount, result.clusterDrawCommands.size(), result.clusterIndices.size());
+						bFailed = true;
+					}
+					else
+					{
+						GetClusterDraws(gpuClusterDraws, reinterpret_cast<const MeshDrawCommand*>(clusterDrawBuffer.data), clusterCounts.drawCount,
+							reinterpret_cast<const uint32_t*>(clusterIndexBuffer.data));
+						GetClusterDraws(cpuClusterDraws, result.clusterDrawCommands.data(), result.clusterDrawCommands.size(), result.clusterIndices.data());
+
+						for (size_t i = 0; i < cpuClusterDraws.size(); ++i)
+						{
+							const MeshDrawCommand& gpuCommand = gpuClusterDraws[i].command;
+							const MeshDrawCommand& cpuCommand = cpuClusterDraws[i].command;
+							if (!(gpuClusterDraws[i] == cpuClusterDraws[i]))
+							{
+								printf("Frame %u pass %u, cluster draw %zu differs: draw %u meshlet %u with %u indices on the GPU, draw %u meshlet %u with %u indices on the CPU\n",
+									frame, pass, i, gpuCommand.drawId, gpuCommand.taskOffset, gpuCommand.drawIndexedIndirectCommand.indexCount,
+									cpuCommand.drawId, cpuCommand.taskOffset, cpuCommand.drawIndexedIndirectCommand.indexCount);
+								bFailed = true;
+								break;
+							}
+						}
+					}
+
+					culler.GetMeshletVisibilities(cpuMeshletVisibilities);
+					const size_t wordCount = std::min<size_t>(cpuMeshletVisibilities.size(), DivideAndRoundUp(meshletVisibilityCount, 32u));
+					if ((mismatch = FindMismatch(reinterpret_cast<const uint32_t*>(meshletVisibilityBuffer.data), cpuMeshletVisibilities.data(), wordCount)) != wordCount)
+					{
+						printf("Frame %u pass %u, meshlet visibilities %zu to %zu differ: 0x%08x on the GPU, 0x%08x on the CPU\n", frame, pass, mismatch * 32, mismatch * 32 + 31,
+							reinterpret_cast<const uint32_t*>(meshletVisibilityBuffer.data)[mismatch], cpuMeshletVisibilities[mismatch]);
+						bFailed = true;
+					}
+
+					clusterDrawCount += result.clusterDrawCommands.size();
+				}
+
+				commandCount += cpuCount;
+			}
+		}
+
+		printf("%s commands: %s, %zu commands over %u frames of %u draws.\n", task ? "Task" : "Draw", bFailed ? "FAILED" : "match", commandCount, Frames, drawCount);
+		if (clusterCullPipeline != VK_NULL_HANDLE)
+			printf("Cluster draws: %s, %zu draws.\n", bFailed ? "FAILED" : "match", clusterDrawCount);
+
+		vkDestroyPipeline(gpu.device, drawCommandPipeline, nullptr);
+		vkDestroyPipeline(gpu.device, compactCommandsPipeline, nullptr);
+		vkDestroyPipeline(gpu.device, clusterCullPipeline, nullptr);
+	}
+
+	culler.Destroy();
+
+	// Cleanup
+	vkDestroySampler(gpu.device, sampler, nullptr);
+	vkDestroyImageView(gpu.device, depthPyramidView, nullptr);
+	vkDestroyImage(gpu.device, depthPyramidImage, nullptr);
+	vkFreeMemory(gpu.device, depthPyramidMemory, nullptr);
+
+	for (HostBuffer* buffer : { &meshBuffer, &drawBuffer, &commandBuffer, &countBuffer, &drawVisibilityBuffer, &commandInfoBuffer, &groupCountBuffer,
+		&cullStatsBuffer, &viewBuffer, &debugBuffer, &vertexBuffer, &meshletBuffer, &meshletDataBuffer, &meshletVisibilityBuffer, &clusterDrawBuffer,
+		&clusterIndexBuffer, &clusterCountBuffer })
+		DestroyBuffer(gpu, *buffer);
+
+	vkDestroyDescriptorPool(gpu.device, descriptorPool, nullptr);
+	vkDestroyPipelineLayout(gpu.device, pipelineLayout, nullptr);
+	vkDestroyPipelineLayout(gpu.device, clusterPipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(gpu.device, setLayout, nullptr);
+	vkDestroyDescriptorSetLayout(gpu.device, clusterSetLayout, nullptr);
+	vkDestroyShaderModule(gpu.device, drawCommandShader, nullptr);
+	vkDestroyShaderModule(gpu.device, compactCommandsShader, nullptr);
+	vkDestroyShaderModule(gpu.device, clusterCullShader, nullptr);
+	DestroyGpu(gpu);
+
+	return bFailed ? 1 : 0;
+}
@@ -2,6 +2,13 @@
 #include <fstream>
 #include <chrono>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 namespace Niagara
 {
 	std::vector<char> ReadFile(const std::string& fileName)
@@ -27,6 +34,81 @@ namespace Niagara
 		return buffer;
 	}
 
+	bool MappedFile::Open(const std::string& fileName)
+	{
+		Close();
+
+#ifdef _WIN32
+		m_File = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (m_File == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER fileSize{};
+		if (!GetFileSizeEx(m_File, &fileSize) || fileSize.QuadPart == 0)
+		{
+			Close();
+			return false;
+		}
+
+		m_Mapping = CreateFileMappingA(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m_Mapping == nullptr)
+		{
+			Close();
+			return false;
+		}
+
+		m_Data = reinterpret_cast<const uint8_t*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+		m_Size = static_cast<size_t>(fileSize.QuadPart);
+#else
+		m_File = open(fileName.c_str(), O_RDONLY);
+		if (m_File < 0)
+			return false;
+
+		struct stat fileStat{};
+		if (fstat(m_File, &fileStat) != 0 || fileStat.st_size == 0)
+		{
+			Close();
+			return false;
+		}
+
+		void* data = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, m_File, 0);
+		m_Data = data != MAP_FAILED ? reinterpret_cast<const uint8_t*>(data) : nullptr;
+		m_Size = static_cast<size_t>(fileStat.st_size);
+#endif
+
+		if (m_Data == nullptr)
+		{
+			Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+#ifdef _WIN32
+		if (m_Data != nullptr)
+			UnmapViewOfFile(m_Data);
+		if (m_Mapping != nullptr)
+			CloseHandle(m_Mapping);
+		if (m_File != INVALID_HANDLE_VALUE)
+			CloseHandle(m_File);
+
+		m_Mapping = nullptr;
+		m_File = INVALID_HANDLE_VALUE;
+#else
+		if (m_Data != nullptr)
+			munmap(const_cast<uint8_t*>(m_Data), m_Size);
+		if (m_File >= 0)
+			close(m_File);
+
+		m_File = -1;
+#endif
+		m_Data = nullptr;
+		m_Size = 0;
+	}
+
 	/// Math
 
 	static glm::vec4 NormalizePlane(const glm::vec4& plane)
@@ -67,5 +149,11 @@ namespace Niagara
 		auto duration = now.time_since_epoch();
 		return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count() / 1000.0;
 	}
+
+	double GetTimestampMs()
+	{
+		auto duration = std::chrono::steady_clock::now().time_since_epoch();
+		return std::chrono::duration<double, std::milli>(duration).count();
+	}
 	
 }
@@ -23,6 +23,80 @@ namespace Niagara
 
 	std::vector<char> ReadFile(const std::string& fileName);
 
+	// Read-only memory mapping of a whole file
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		~MappedFile() { Close(); }
+		NON_COPYABLE(MappedFile);
+
+		bool Open(const std::string& fileName);
+		void Close();
+
+		const uint8_t* GetData() const { return m_Data; }
+		size_t GetSize() const { return m_Size; }
+		bool IsOpen() const { return m_Data != nullptr; }
+
+	private:
+#ifdef _WIN32
+		HANDLE m_File{ INVALID_HANDLE_VALUE };
+		HANDLE m_Mapping{ nullptr };
+#else
+		int m_File{ -1 };
+#endif
+		const uint8_t* m_Data{ nullptr };
+		size_t m_Size{ 0 };
+	};
+
+
+	/// Containers
+
+	// Non-owning view of a contiguous array, e.g. a `std::vector` or a range of a mapped file
+	template <typename T>
+	class ArrayView
+	{
+	public:
+		ArrayView() = default;
+		ArrayView(const T* data, size_t count) : m_Data{ data }, m_Count{ count } { }
+		ArrayView(const std::vector<T>& v) : m_Data{ v.data() }, m_Count{ v.size() } { }
+
+		const T* data() const { return m_Data; }
+		size_t size() const { return m_Count; }
+		bool empty() const { return m_Count == 0; }
+
+		const T* begin() const { return m_Data; }
+		const T* end() const { return m_Data + m_Count; }
+		const T& operator[](size_t i) const { assert(i < m_Count); return m_Data[i]; }
+
+	private:
+		const T* m_Data{ nullptr };
+		size_t m_Count{ 0 };
+	};
+
+
+	/// Hash
+
+	// FNV-1a
+	constexpr uint64_t HASH_SEED = 0xcbf29ce484222325ull;
+
+	inline uint64_t HashBytes(const void* data, size_t size, uint64_t hash = HASH_SEED)
+	{
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	template <typename T>
+	inline uint64_t HashValue(const T& value, uint64_t hash = HASH_SEED)
+	{
+		return HashBytes(&value, sizeof(T), hash);
+	}
+
 
 	/// Math
 
@@ -103,11 +177,17 @@ namespace Niagara
 		return dividend / divisor;
 	}
 
+	// `alignment` must be a power of two
+	inline uint64_t AlignUp(uint64_t value, uint64_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
 	inline uint32_t GetMipLevels(uint32_t width, uint32_t height)
 	{
-		uint32_t highBit;
-		_BitScanReverse((unsigned long*)&highBit, width | height);
-		return highBit + 1;
+		unsigned long highBit;
+		_BitScanReverse(&highBit, width | height);
+		return static_cast<uint32_t>(highBit) + 1;
 	}
 
 	inline glm::vec3 SafeNormalize(const glm::vec3 &v)
@@ -137,4 +217,6 @@ namespace Niagara
 	/// Miscs
 
 	double GetSystemTime();
+	// Monotonic high resolution time in milliseconds, for profiling
+	double GetTimestampMs();
 }
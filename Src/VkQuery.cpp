@@ -28,6 +28,7 @@ namespace Niagara
 	{
 		if (queryPool != VK_NULL_HANDLE)
 			vkDestroyQueryPool(device, queryPool, nullptr);
+		queryPool = VK_NULL_HANDLE;
 	}
 
 	void QueryPool::BeginQuery(VkCommandBuffer cmd, uint32_t query)
@@ -58,6 +59,7 @@ namespace Niagara
 
 	void QueryPool::Reset(const Device &device, uint32_t firstQuery, uint32_t queryCount)
 	{
+		queryCount = std::min(queryCount, count);
 		activeQueryCount = 0;
 		vkResetQueryPool(device, queryPool, firstQuery, queryCount);
 	}
@@ -1,4 +1,4 @@
-// Ref: https://vulkan-tutorial.com
+﻿// Ref: https://vulkan-tutorial.com
 // Ref: https://github.com/KhronosGroup/Vulkan-Samples
 // Ref: https://developer.nvidia.com/blog/introduction-turing-mesh-shaders/
 
@@ -15,7 +15,16 @@
 #include "Utilities.h"
 #include "Config.h"
 #include "Geometry.h"
+#include "GeometryCache.h"
 #include "VkQuery.h"
+#include "JobSystem.h"
+#include "StagingUploader.h"
+#include "InstanceManager.h"
+#include "DepthPyramid.h"
+#include "CpuCulling.h"
+#include "DrawCommandCapacity.h"
+#include "CullStats.h"
+#include "Profiler.h"
 
 // #include "RenderGraph/RenderGraphBuilder.h"
 #include "Renderers/Metaballs.h"
@@ -23,6 +32,7 @@
 #include <iostream>
 #include <fstream>
 #include <queue>
+#include <deque>
 
 #include <GLFW/glfw3.h>
 #define GLFW_EXPOSE_NATIVE_WIN32
@@ -35,6 +45,7 @@ using namespace Niagara;
 
 #define DEBUG_SINGLE_DRAWCALL 0
 #define TOY_FOR_FUN 1
+#define COMPARE_SERIAL_MESH_LOADING 0
 const std::string g_ResourcePath = "../Resources/";
 const std::string g_ShaderPath = "./CompiledShaders/";
 
@@ -43,10 +54,36 @@ VkExtent2D g_ViewportSize{};
 double g_DeltaTime = 0.0;
 double g_Time = 0.0;
 bool g_UseTaskSubmit = false;
+bool g_UsePackedDraws = USE_PACKED_DRAWS != 0;
+bool g_UsePackedMeshlets = USE_PACKED_MESHLETS != 0;
+bool g_UsePackedVertices = USE_PACKED_VERTICES != 0;
+bool g_UseSinglePassDepthPyramid = USE_SINGLE_PASS_DEPTH_PYRAMID != 0;
+// Late passes a draw has to be visible in before it skips the occlusion test, 0 - off
+uint32_t g_VisibilityHistoryFrames = DRAW_VISIBILITY_HISTORY_FRAMES;
+// Screen space error of the lods in pixels
+float g_LodErrorThreshold = LOD_ERROR_THRESHOLD;
 bool g_FramebufferResized = false;
 bool g_DrawVisibilityInited = false;
 bool g_MeshletVisibilityInited = false;
 
+// Scene instances, the dirty ones are scattered into the draw buffer at the beginning of the frame
+InstanceManager g_InstanceMgr;
+std::vector<InstanceHandle> g_InstanceHandles;
+uint32_t g_DrawScatterCount = 0;
+uint32_t g_DrawScatterBufferIndex = 0;
+// Capacity of the draw args buffer, from the peak command counts read back per frame in flight
+DrawCommandCapacity g_DrawCommandCapacity;
+// Frame in flight of the readback buffers the recorded frame copies its stats to
+uint32_t g_ReadbackIndex = 0;
+// Culling stats of `CullStats.h` (`--cull-stats`), the last ones read back and their per frame dump (`--cull-stats-dump <path>`)
+bool g_CullStatsEnabled = false;
+std::string g_CullStatsPath;
+CullFrameStats g_CullStats;
+CullStatsWriter g_CullStatsWriter;
+// Per pass CPU and GPU times of `Profiler.h`, printed at exit (`--profile`) and written as a Chrome trace (`--profile-trace <path>`)
+bool g_ProfileStatsEnabled = false;
+std::string g_ProfileTracePath;
+
 enum DebugParam
 {
 	DrawFrustumCulling = 0,
@@ -208,6 +245,15 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 		g_UseTaskSubmit = !g_UseTaskSubmit;
 		printf("Task submit: %d\n", g_UseTaskSubmit);
 		break;
+
+	case GLFW_KEY_LEFT_BRACKET:
+		g_LodErrorThreshold = std::max(g_LodErrorThreshold * 0.5f, 0.125f);
+		printf("Lod error threshold: %.3f px\n", g_LodErrorThreshold);
+		break;
+	case GLFW_KEY_RIGHT_BRACKET:
+		g_LodErrorThreshold = std::min(g_LodErrorThreshold * 2.0f, 64.0f);
+		printf("Lod error threshold: %.3f px\n", g_LodErrorThreshold);
+		break;
 	}
 }
 
@@ -265,21 +311,33 @@ struct ShaderManager
 
 	Niagara::Shader cullComp;
 	Niagara::Shader buildHiZComp;
+	Niagara::Shader buildHiZSinglePassComp;
+	Niagara::Shader scatterDrawsComp;
+	Niagara::Shader clusterCullComp;
+	Niagara::Shader compactCommandsComp;
 
 	Shader toyMesh;
 	Shader toyFullScreenFrag;
 
 	void Init(const Niagara::Device& device)
 	{
+#if !USE_COMPUTE_CLUSTER_CULLING
 		meshTask.Load(device, g_ShaderPath + "SimpleMesh.task.spv");
 		meshMesh.Load(device, g_ShaderPath + "SimpleMesh.mesh.spv");
+#endif
 		meshVert.Load(device, g_ShaderPath + "SimpleMesh.vert.spv");
 		meshFrag.Load(device, g_ShaderPath + "SimpleMesh.frag.spv");
 
 		cullComp.Load(device, g_ShaderPath + "DrawCommand.comp.spv");
 		buildHiZComp.Load(device, g_ShaderPath + "HiZBuild.comp.spv");
+		buildHiZSinglePassComp.Load(device, g_ShaderPath + "HiZBuildSinglePass.comp.spv");
+		scatterDrawsComp.Load(device, g_ShaderPath + "ScatterDraws.comp.spv");
+#if USE_COMPUTE_CLUSTER_CULLING
+		clusterCullComp.Load(device, g_ShaderPath + "ClusterCull.comp.spv");
+#endif
+		compactCommandsComp.Load(device, g_ShaderPath + "CompactCommands.comp.spv");
 
-#if 1
+#if !USE_COMPUTE_CLUSTER_CULLING
 		toyMesh.Load(device, g_ShaderPath + "ToyMesh.mesh.spv");
 		toyFullScreenFrag.Load(device, g_ShaderPath + "ToyFullScreen.frag.spv");
 #endif
@@ -294,6 +352,10 @@ struct ShaderManager
 
 		cullComp.Cleanup(device);
 		buildHiZComp.Cleanup(device);
+		buildHiZSinglePassComp.Cleanup(device);
+		scatterDrawsComp.Cleanup(device);
+		clusterCullComp.Cleanup(device);
+		compactCommandsComp.Cleanup(device);
 
 		toyMesh.Cleanup(device);
 		toyFullScreenFrag.Cleanup(device);
@@ -343,8 +405,6 @@ constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 2;
 // submitting more work.
 // Each frame should have its own command buffer, set of semaphores, and fence.
 
-static const uint32_t g_BufferSize = 128 * 1024 * 1024;
-
 const std::vector<const char*> g_InstanceExtensions =
 {
 	VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME
@@ -354,10 +414,14 @@ const std::vector<const char*> g_DeviceExtensions =
 {
 	VK_KHR_SWAPCHAIN_EXTENSION_NAME,
 	VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME,
+#if USE_FRAGMENT_SHADING_RATE
 	VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME,
+#endif
 	
+#if !USE_COMPUTE_CLUSTER_CULLING
 	// VK_NV_MESH_SHADER_EXTENSION_NAME,
 	VK_EXT_MESH_SHADER_EXTENSION_NAME
+#endif
 };
 
 std::vector<VkDynamicState> g_DynamicStates =
@@ -382,48 +446,21 @@ enum DescriptorBindings : uint32_t
 	// Globals 
 	ViewUniformBuffer	= 7,
 	DebugUniformBuffer,
-};
 
+	// Cluster culling outputs
+	ClusterDrawArgsBuffer	= 9,
+	ClusterIndexBuffer,
+	ClusterCountBuffer,
 
-/// Structures
+	// Mesh bounding spheres of the packed meshlets, binding 1 is taken by the meshlet visibilities
+	MeshBoundsBuffer		= 12,
 
-struct alignas(16) MeshDraw
-{
-	glm::vec4 worldMatRow0;
-	glm::vec4 worldMatRow1;
-	glm::vec4 worldMatRow2;
-	
-	int32_t  vertexOffset; // == meshes[meshIndex].vertexOffset, helps data locality in mesh shader
-	uint32_t meshIndex;
-	uint32_t meshletVisibilityOffset;
+	// Counters of `CullStats.h`, also bound to the draw culling
+	CullStatsBuffer			= 13,
 };
 
-struct MeshDrawCommand
-{
-	uint32_t drawId;
-	VkDrawIndexedIndirectCommand drawIndexedIndirectCommand; // 5 uint32_t
-
-	// Used by mesh shading path
-	uint32_t drawVisibility;
-	uint32_t meshletVisibilityOffset;
-
-	// Switch from MeshShaderNV to MeshShaderEXT
-#if 0
-	VkDrawMeshTasksIndirectCommandNV drawMeshTaskIndirectCommand; // 2 uint32_t
-#else
-	uint32_t taskOffset;
-	uint32_t taskCount;
-	VkDrawMeshTasksIndirectCommandEXT drawMeshTaskIndirectCommand; // 3 uint32_t
-#endif
-};
 
-struct MeshTaskCommand
-{
-	uint32_t drawId;
-	uint32_t taskOffset;
-	uint32_t taskCount;
-	uint32_t meshletVisibilityData; // low bit: draw visibility, higher 31 bit: meshVisibilityOffset
-};
+/// Structures
 
 struct GpuBuffer
 {
@@ -485,10 +522,27 @@ struct GpuBuffer
 		}
 
 		if (pInitialData != nullptr)
-			Update(device, pInitialData, stride, elementCount);
+			UpdateDeferred(device, pInitialData, stride, elementCount);
 	}
 
+	// The data is in the buffer on return
 	void Update(const Niagara::Device &device, const void *pData, uint32_t stride, uint32_t elementCount)
+	{
+		if (buffer == VK_NULL_HANDLE || pData == nullptr) 
+			return;
+
+		if (data == nullptr && Niagara::g_StagingUploader.IsInited())
+		{
+			Niagara::g_StagingUploader.Upload(buffer, 0, pData, stride * elementCount);
+			Niagara::g_StagingUploader.Wait(Niagara::g_StagingUploader.Flush());
+			return;
+		}
+
+		UpdateDeferred(device, pData, stride, elementCount);
+	}
+
+	// Batches the upload of a buffer that isn't in use, the copy is submitted by the next flush of the staging uploader
+	void UpdateDeferred(const Niagara::Device &device, const void *pData, uint32_t stride, uint32_t elementCount)
 	{
 		if (buffer == VK_NULL_HANDLE || pData == nullptr) 
 			return;
@@ -499,6 +553,11 @@ struct GpuBuffer
 		{
 			memcpy_s(data, size, pData, size);
 		}
+		else if (Niagara::g_StagingUploader.IsInited())
+		{
+			// Batched, the copy is submitted by the next flush of the uploader
+			Niagara::g_StagingUploader.Upload(buffer, 0, pData, size);
+		}
 		else
 		{
 			GpuBuffer scratchBuffer{};
@@ -521,6 +580,185 @@ struct GpuBuffer
 	operator VkBuffer() const { return buffer; }
 };
 
+// Inits a device local buffer with a stream of a compressed geometry, chunks are decoded in parallel straight into the mapped staging memory.
+// Returns false if the stream is corrupted, the undecoded staging memory is still copied to the buffer.
+bool InitGeometryStreamBuffer(const Niagara::Device& device, GpuBuffer& buffer, const Niagara::CompressedGeometryView& geometry, Niagara::GeometryStream stream, VkBufferUsageFlags usage)
+{
+	static const char* StreamNames[] = { "vertices", "indices", "meshlet data" };
+
+	const uint32_t stride = static_cast<uint32_t>(Niagara::GetGeometryStreamStride(stream));
+	const uint32_t elementCount = static_cast<uint32_t>(geometry.GetElementCount(stream));
+
+	buffer.Init(device, stride, elementCount, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	uint8_t* pStagingData = Niagara::g_StagingUploader.Allocate(buffer.buffer, 0, buffer.size);
+
+	double decodeBeginTime = glfwGetTime();
+	bool bDecoded = Niagara::DecodeGeometryStream(pStagingData, geometry, stream);
+	double decodeTime = glfwGetTime() - decodeBeginTime;
+
+	if (!bDecoded)
+	{
+		printf("ERROR::Corrupted compressed %s!\n", StreamNames[static_cast<uint32_t>(stream)]);
+		return false;
+	}
+
+	printf("Decoded %s: %.2f MB in %.2f ms (%.2f GB/s).\n", StreamNames[static_cast<uint32_t>(stream)], buffer.size / (1024.0 * 1024.0), decodeTime * 1000.0, buffer.size / std::max(decodeTime, 1e-6) * 1e-9);
+	return true;
+}
+
+// --validate-depth-pyramid: the depth buffer and the pyramid of a frame are copied to a readback buffer by the pyramid build, then
+// compared with the CPU reference
+struct DepthPyramidValidation
+{
+	GpuBuffer readbackBuffer;
+	bool bRequested = false;
+	bool bRecorded = false;
+
+	VkExtent2D depthExtent{};
+	glm::uvec2 pyramidSize{};
+	uint32_t mipCount = 0;
+
+	void Init(const Niagara::Device& device, const Niagara::Image& depthBuffer, const Niagara::Image& depthPyramid)
+	{
+		Destroy(device);
+
+		// Only 32 bit float depths are copied as is
+		if (depthBuffer.format != VK_FORMAT_D32_SFLOAT && depthBuffer.format != VK_FORMAT_D32_SFLOAT_S8_UINT)
+		{
+			printf("Depth pyramid validation skipped, the depth format isn't 32 bit float.\n");
+			bRequested = false;
+			return;
+		}
+
+		depthExtent = { depthBuffer.extent.width, depthBuffer.extent.height };
+		pyramidSize = glm::uvec2(depthPyramid.extent.width, depthPyramid.extent.height);
+		mipCount = depthPyramid.subresource.mipLevel;
+
+		uint32_t texelCount = depthExtent.width * depthExtent.height;
+		for (uint32_t mip = 0; mip < mipCount; ++mip)
+		{
+			glm::uvec2 mipSize = Niagara::GetDepthPyramidMipSize(pyramidSize, mip);
+			texelCount += mipSize.x * mipSize.y;
+		}
+
+		readbackBuffer.Init(device, sizeof(float), texelCount, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	}
+
+	void Destroy(const Niagara::Device& device)
+	{
+		readbackBuffer.Destroy(device);
+		readbackBuffer = {};
+	}
+
+	bool ShouldRecord() const { return bRequested && !bRecorded && readbackBuffer.buffer != VK_NULL_HANDLE; }
+
+	// The depth buffer in `VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL`
+	void RecordDepthCopy(VkCommandBuffer cmd, const Niagara::Image& depthBuffer) const
+	{
+		VkBufferImageCopy region{};
+		region.imageSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, 1 };
+		region.imageExtent = { depthExtent.width, depthExtent.height, 1 };
+
+		vkCmdCopyImageToBuffer(cmd, depthBuffer.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer.buffer, 1, &region);
+	}
+
+	// The pyramid in `VK_IMAGE_LAYOUT_GENERAL`, after the depth buffer
+	void RecordPyramidCopy(VkCommandBuffer cmd, const Niagara::Image& depthPyramid)
+	{
+		std::vector<VkBufferImageCopy> regions(mipCount);
+
+		VkDeviceSize offset = VkDeviceSize(depthExtent.width) * depthExtent.height * sizeof(float);
+		for (uint32_t mip = 0; mip < mipCount; ++mip)
+		{
+			glm::uvec2 mipSize = Niagara::GetDepthPyramidMipSize(pyramidSize, mip);
+
+			regions[mip] = {};
+			regions[mip].bufferOffset = offset;
+			regions[mip].imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip, 0, 1 };
+			regions[mip].imageExtent = { mipSize.x, mipSize.y, 1 };
+
+			offset += VkDeviceSize(mipSize.x) * mipSize.y * sizeof(float);
+		}
+
+		vkCmdCopyImageToBuffer(cmd, depthPyramid.image, VK_IMAGE_LAYOUT_GENERAL, readbackBuffer.buffer, mipCount, regions.data());
+
+		bRecorded = true;
+	}
+
+	// After the frame has completed
+	void Check()
+	{
+		const float* pDepth = static_cast<const float*>(readbackBuffer.data);
+
+		std::vector<std::vector<float>> referenceMips;
+		Niagara::BuildDepthPyramidReference(referenceMips, pDepth, depthExtent.width, depthExtent.height, pyramidSize, mipCount, /* bReversedZ = */ true);
+
+		const float* pMip = pDepth + size_t(depthExtent.width) * depthExtent.height;
+		size_t mismatchCount = 0;
+		uint32_t firstMismatchMip = ~0u;
+		for (uint32_t mip = 0; mip < mipCount; ++mip)
+		{
+			const auto& referenceMip = referenceMips[mip];
+			for (size_t i = 0; i < referenceMip.size(); ++i)
+			{
+				if (pMip[i] != referenceMip[i])
+				{
+					++mismatchCount;
+					firstMismatchMip = std::min(firstMismatchMip, mip);
+				}
+			}
+			pMip += referenceMip.size();
+		}
+
+		if (mismatchCount == 0)
+			printf("Depth pyramid validation: %ux%u, %u mips, matches the CPU reference.\n", pyramidSize.x, pyramidSize.y, mipCount);
+		else
+			printf("ERROR::Depth pyramid validation: %zu texels differ from the CPU reference, first in mip %u!\n", mismatchCount, firstMismatchMip);
+
+		bRequested = false;
+		bRecorded = false;
+	}
+};
+DepthPyramidValidation g_DepthPyramidValidation;
+
+// Random instance in the scene sphere
+InstanceDesc GetRandomInstanceDesc(uint32_t meshCount)
+{
+	InstanceDesc desc;
+
+	// World matrix
+	desc.position = glm::ballRand<float>(SCENE_RADIUS);
+	desc.scale = glm::linearRand(1.0f, 2.0f) * 2.0f;
+
+	auto theta = glm::radians(glm::linearRand<float>(0.0f, 180.0));
+	auto axis = glm::sphericalRand(1.0f);
+	desc.orientation = glm::vec4(axis * sinf(theta), cosf(theta));
+
+	desc.meshIndex = glm::linearRand<uint32_t>(0, meshCount - 1);
+
+	return desc;
+}
+
+// Removes, adds and moves `count` random instances, a dynamic scene for the instance manager
+void ChurnInstances(uint32_t count, uint32_t meshCount)
+{
+	for (uint32_t i = 0; i < count && !g_InstanceHandles.empty(); ++i)
+	{
+		InstanceHandle& handle = g_InstanceHandles[std::rand() % g_InstanceHandles.size()];
+		g_InstanceMgr.Remove(handle);
+		handle = g_InstanceMgr.Add(GetRandomInstanceDesc(meshCount));
+
+		InstanceHandle movedHandle = g_InstanceHandles[std::rand() % g_InstanceHandles.size()];
+		if (const InstanceDesc* pDesc = g_InstanceMgr.GetDesc(movedHandle))
+		{
+			InstanceDesc desc = *pDesc;
+			desc.position += glm::ballRand(0.1f);
+			g_InstanceMgr.Update(movedHandle, desc);
+		}
+	}
+}
+
 struct alignas(16) ViewUniformBufferParameters
 {
 	glm::mat4 viewProjMatrix;
@@ -534,6 +772,8 @@ struct alignas(16) ViewUniformBufferParameters
 	glm::vec4 debugValue;
 	glm::vec3 camPos;
 	uint32_t drawCount;
+	glm::vec4 lodParams; // GetLodSelectionParams()
+	uint32_t commandCapacity; // DrawCommandCapacity::GetCapacity()
 };
 ViewUniformBufferParameters g_ViewUniformBufferParameters;
 
@@ -551,6 +791,26 @@ struct BufferManager
 	GpuBuffer drawArgsBuffer;
 	GpuBuffer drawCountBuffer;
 	GpuBuffer drawVisibilityBuffer;
+	// Stable compaction of the culling commands: per draw command infos and per workgroup command counts
+	GpuBuffer drawCommandInfoBuffer;
+	GpuBuffer groupCommandCountBuffer;
+	// Scatter records of the instance manager, one buffer per frame in flight
+	GpuBuffer drawScatterBuffers[MAX_FRAMES_IN_FLIGHT];
+	// Finished workgroups of the single pass depth pyramid build
+	GpuBuffer depthPyramidCounterBuffer;
+	// Draw args buffers replaced by a resize, the frames in flight may still use them
+	struct RetiredBuffer
+	{
+		GpuBuffer buffer;
+		// Frame that retired it
+		uint64_t frameIndex;
+	};
+	std::deque<RetiredBuffer> retiredDrawArgsBuffers;
+	// `DrawCommandStats` of the frame, one readback buffer per frame in flight
+	GpuBuffer drawCommandStatsBuffers[MAX_FRAMES_IN_FLIGHT];
+	// Counters of `CullStats.h`, always bound, and their readback buffers per frame in flight with `--cull-stats`
+	GpuBuffer cullStatsBuffer;
+	GpuBuffer cullStatsReadbackBuffers[MAX_FRAMES_IN_FLIGHT];
 
 #if USE_MESHLETS
 	GpuBuffer meshletBuffer;
@@ -558,6 +818,13 @@ struct BufferManager
 	GpuBuffer meshletVisibilityBuffer;
 #endif
 
+#if USE_COMPUTE_CLUSTER_CULLING
+	// Outputs of the cluster culling: per meshlet draw commands, their indices and the draw/index counts
+	GpuBuffer clusterDrawArgsBuffer;
+	GpuBuffer clusterIndexBuffer;
+	GpuBuffer clusterCountBuffer;
+#endif
+
 	// View dependent textures
 	Niagara::Image colorBuffer;
 	Niagara::Image depthBuffer;
@@ -581,10 +848,8 @@ struct BufferManager
 			0);
 
 		// Depth pyramid
-		glm::uvec2 hzbSize;
-		hzbSize.x = std::max(1u, Niagara::RoundUpToPowerOfTwo(renderExtent.width >> 1));
-		hzbSize.y = std::max(1u, Niagara::RoundUpToPowerOfTwo(renderExtent.height >> 1));
-		uint32_t numMips = std::max(1u, Niagara::FloorLog2(std::max(hzbSize.x, hzbSize.y)));
+		glm::uvec2 hzbSize = Niagara::GetDepthPyramidSize(renderExtent.width, renderExtent.height);
+		uint32_t numMips = Niagara::GetDepthPyramidMipCount(hzbSize);
 		depthPyramid.Init(device,
 			VkExtent3D{ hzbSize.x, hzbSize.y, 1 },
 			VK_FORMAT_R32_SFLOAT, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
@@ -606,8 +871,21 @@ struct BufferManager
 		meshBuffer.Destroy(device);
 		drawDataBuffer.Destroy(device);
 		drawArgsBuffer.Destroy(device);
+		for (auto& retired : retiredDrawArgsBuffers)
+			retired.buffer.Destroy(device);
+		retiredDrawArgsBuffers.clear();
 		drawCountBuffer.Destroy(device);
 		drawVisibilityBuffer.Destroy(device);
+		drawCommandInfoBuffer.Destroy(device);
+		groupCommandCountBuffer.Destroy(device);
+		for (auto& drawScatterBuffer : drawScatterBuffers)
+			drawScatterBuffer.Destroy(device);
+		for (auto& drawCommandStatsBuffer : drawCommandStatsBuffers)
+			drawCommandStatsBuffer.Destroy(device);
+		cullStatsBuffer.Destroy(device);
+		for (auto& cullStatsReadbackBuffer : cullStatsReadbackBuffers)
+			cullStatsReadbackBuffer.Destroy(device);
+		depthPyramidCounterBuffer.Destroy(device);
 
 #if USE_MESHLETS
 		meshletBuffer.Destroy(device);
@@ -615,6 +893,12 @@ struct BufferManager
 		meshletVisibilityBuffer.Destroy(device);
 #endif
 
+#if USE_COMPUTE_CLUSTER_CULLING
+		clusterDrawArgsBuffer.Destroy(device);
+		clusterIndexBuffer.Destroy(device);
+		clusterCountBuffer.Destroy(device);
+#endif
+
 		// View dependent textures
 		colorBuffer.Destroy(device);
 		depthBuffer.Destroy(device);
@@ -623,6 +907,65 @@ struct BufferManager
 };
 BufferManager g_BufferMgr{};
 
+// Gathers the dirty instances into the scatter buffer of the frame, `RecordCommandBuffer` scatters them into the draw buffer
+void UploadDrawScatters(uint32_t frameIndex)
+{
+	GpuBuffer& drawScatterBuffer = g_BufferMgr.drawScatterBuffers[frameIndex];
+
+	g_DrawScatterCount = std::min(g_InstanceMgr.GetPendingScatterCount(), drawScatterBuffer.elementCount);
+	g_DrawScatterBufferIndex = frameIndex;
+	if (g_DrawScatterCount == 0)
+		return;
+
+	uint8_t* pStagingData = Niagara::g_StagingUploader.Allocate(drawScatterBuffer.buffer, 0, VkDeviceSize(g_DrawScatterCount) * drawScatterBuffer.stride);
+	g_InstanceMgr.GatherScatters(pStagingData, g_DrawScatterCount);
+}
+
+// Task commands for the task shaders or the cluster culling, draw commands for the indirect draws
+uint32_t GetDrawCommandStride()
+{
+	const bool bTaskCommands = USE_COMPUTE_CLUSTER_CULLING || g_UseTaskSubmit;
+	return bTaskCommands ? sizeof(MeshTaskCommand) : sizeof(MeshDrawCommand);
+}
+
+uint32_t GetMaxDrawCommandCapacity(const Niagara::Device& device)
+{
+	uint32_t capacity = device.properties.limits.maxStorageBufferRange / GetDrawCommandStride();
+#if USE_COMPUTE_CLUSTER_CULLING
+	// The command count is the group count X of the cluster culling dispatch
+	capacity = std::min(capacity, device.properties.limits.maxComputeWorkGroupCount[0]);
+#endif
+	return capacity;
+}
+
+// Recreates the draw args buffer with the capacity of `g_DrawCommandCapacity`. The previous one is retired with `frameIndex`, the frame
+// that replaced it, and destroyed by `ReleaseRetiredDrawArgsBuffers()` `MAX_FRAMES_IN_FLIGHT` frames later.
+void InitDrawArgsBuffer(const Niagara::Device& device, uint64_t frameIndex)
+{
+	GpuBuffer& drawArgsBuffer = g_BufferMgr.drawArgsBuffer;
+
+	if (drawArgsBuffer.buffer != VK_NULL_HANDLE)
+		g_BufferMgr.retiredDrawArgsBuffers.push_back({ drawArgsBuffer, frameIndex });
+	drawArgsBuffer = {};
+	drawArgsBuffer.Init(device, GetDrawCommandStride(), g_DrawCommandCapacity.GetCapacity(), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	g_ViewUniformBufferParameters.commandCapacity = g_DrawCommandCapacity.GetCapacity();
+}
+
+// Destroys the retired draw args buffers that no frame in flight can use anymore
+void ReleaseRetiredDrawArgsBuffers(const Niagara::Device& device, uint64_t frameIndex)
+{
+	auto& retiredBuffers = g_BufferMgr.retiredDrawArgsBuffers;
+
+	// The fence of the frame in flight is waited for, so the frames that used a retired buffer are done once as many frames
+	// as there are in flight have been recorded since
+	while (!retiredBuffers.empty() && retiredBuffers.front().frameIndex + MAX_FRAMES_IN_FLIGHT <= frameIndex)
+	{
+		retiredBuffers.front().buffer.Destroy(device);
+		retiredBuffers.pop_front();
+	}
+}
+
 struct PipelineManager
 {
 	Niagara::RenderPass meshDrawPass;
@@ -630,11 +973,18 @@ struct PipelineManager
 	
 	Niagara::ComputePipeline updateDrawArgsPipeline;
 	Niagara::ComputePipeline buildDepthPyramidPipeline;
+	Niagara::ComputePipeline buildDepthPyramidSinglePassPipeline;
+	Niagara::ComputePipeline scatterDrawsPipeline;
+	Niagara::ComputePipeline clusterCullPipeline;
 
 	// Tasks
 	GraphicsPipeline meshTaskPipeline;
 	ComputePipeline updateTaskArgsPipeline;
 
+	// Stable compaction of the draw and task commands
+	ComputePipeline compactDrawArgsPipeline;
+	ComputePipeline compactTaskArgsPipeline;
+
 	GraphicsPipeline toyDrawPipeline;
 
 	void Cleanup(const Niagara::Device &device)
@@ -642,9 +992,14 @@ struct PipelineManager
 		meshDrawPipeline.Destroy(device);
 		updateDrawArgsPipeline.Destroy(device);
 		buildDepthPyramidPipeline.Destroy(device);
+		buildDepthPyramidSinglePassPipeline.Destroy(device);
+		scatterDrawsPipeline.Destroy(device);
+		clusterCullPipeline.Destroy(device);
 
 		meshTaskPipeline.Destroy(device);
 		updateTaskArgsPipeline.Destroy(device);
+		compactDrawArgsPipeline.Destroy(device);
+		compactTaskArgsPipeline.Destroy(device);
 
 		toyDrawPipeline.Destroy(device);
 
@@ -746,7 +1101,7 @@ void GetMeshDrawPipeline(const Device &device, GraphicsPipeline& pipeline, Rende
 #if DRAW_MODE == DRAW_SIMPLE_MESH
 
 	// Pipeline shaders
-#if USE_MESHLETS
+#if USE_MESHLETS && !USE_COMPUTE_CLUSTER_CULLING
 	pipeline.taskShader = &g_ShaderMgr.meshTask;
 	pipeline.meshShader = &g_ShaderMgr.meshMesh;
 #else
@@ -816,6 +1171,14 @@ void GetMeshDrawPipeline(const Device &device, GraphicsPipeline& pipeline, Rende
 	// Set specialization constants
 	if (bUseTaskSubmit)
 		pipeline.SetSpecializationConstant(0, 1);
+	if (g_UsePackedDraws)
+		pipeline.SetSpecializationConstant(1, 1);
+	if (g_UsePackedMeshlets)
+		pipeline.SetSpecializationConstant(3, 1);
+	if (g_UsePackedVertices)
+		pipeline.SetSpecializationConstant(4, 1);
+	if (g_CullStatsEnabled)
+		pipeline.SetSpecializationConstant(6, 1);
 
 	pipeline.Init(device);
 }
@@ -839,14 +1202,12 @@ VkFramebuffer GetFramebuffer(VkDevice device, const std::vector<VkImageView> &at
 	return framebuffer;
 }
 
-void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &framebuffers, const Niagara::Swapchain &swapchain, uint32_t imageIndex, const Niagara::Geometry &geometry)
+void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &framebuffers, const Niagara::Swapchain &swapchain, uint32_t imageIndex, const Niagara::GeometryView &geometry)
 {
 	g_CommandContext.BeginCommandBuffer(cmd);
 
 	// Profiling
-	auto& timestampQueryPool = g_CommonQueryPools.queryPools[0];
-	timestampQueryPool.Reset(cmd);
-	timestampQueryPool.WriteTimestamp(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0);
+	const uint32_t frameScope = g_Profiler.BeginScope(cmd, "Frame");
 
 	auto& pipelineQueryPool = g_CommonQueryPools.queryPools[1];
 
@@ -865,6 +1226,19 @@ void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &
 	Niagara::DescriptorInfo drawArgsDescInfo(drawArgsBuffer.buffer, VkDeviceSize(drawArgsBuffer.offset), VkDeviceSize(drawArgsBuffer.size));
 	DescriptorInfo drawVisibilityInfo(drawVisibilityBuffer.buffer, VkDeviceSize(drawVisibilityBuffer.offset), VkDeviceSize(drawVisibilityBuffer.size));
 
+	const auto& drawCommandInfoBuffer = g_BufferMgr.drawCommandInfoBuffer;
+	const auto& groupCommandCountBuffer = g_BufferMgr.groupCommandCountBuffer;
+	DescriptorInfo drawCommandInfoDescInfo(drawCommandInfoBuffer.buffer, VkDeviceSize(drawCommandInfoBuffer.offset), VkDeviceSize(drawCommandInfoBuffer.size));
+	DescriptorInfo groupCommandCountDescInfo(groupCommandCountBuffer.buffer, VkDeviceSize(groupCommandCountBuffer.offset), VkDeviceSize(groupCommandCountBuffer.size));
+
+	const auto& cullStatsBuffer = g_BufferMgr.cullStatsBuffer;
+	DescriptorInfo cullStatsDescInfo(cullStatsBuffer.buffer, VkDeviceSize(cullStatsBuffer.offset), VkDeviceSize(cullStatsBuffer.size));
+#if USE_COMPUTE_CLUSTER_CULLING
+	const VkPipelineStageFlags2 cullStatsStages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+#else
+	const VkPipelineStageFlags2 cullStatsStages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT | VK_PIPELINE_STAGE_2_MESH_SHADER_BIT_EXT;
+#endif
+
 	uint32_t groupsX = 1, groupsY = 1, groupsZ = 1;
 
 	if (!g_DrawVisibilityInited)
@@ -888,8 +1262,13 @@ void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &
 
 		vkCmdFillBuffer(cmd, meshletVisibilityBuffer.buffer, meshletVisibilityOffset, meshletVisibilitySize, 0);
 
+#if USE_COMPUTE_CLUSTER_CULLING
+		auto meshletCullStage = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+#else
+		auto meshletCullStage = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT;
+#endif
 		g_CommandContext.BufferBarrier2(meshletVisibilityBuffer.buffer, meshletVisibilityOffset, meshletVisibilitySize,
-			VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT,
+			VK_PIPELINE_STAGE_2_TRANSFER_BIT, meshletCullStage,
 			VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
 		g_CommandContext.PipelineBarriers2(cmd);
 
@@ -897,10 +1276,66 @@ void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &
 	}
 #endif
 
+	// Scene changes, the dirty instances are scattered into the draw buffer before the culling
+	if (g_DrawScatterCount > 0)
+	{
+		const auto& drawScatterBuffer = g_BufferMgr.drawScatterBuffers[g_DrawScatterBufferIndex];
+#if USE_MESHLETS
+		const auto& meshletVisibilityBuffer = g_BufferMgr.meshletVisibilityBuffer;
+#else
+		// No meshlet visibility ranges to clear, any buffer does
+		const auto& meshletVisibilityBuffer = drawVisibilityBuffer;
+#endif
+		DescriptorInfo drawScatterInfo(drawScatterBuffer.buffer, VkDeviceSize(drawScatterBuffer.offset), VkDeviceSize(drawScatterBuffer.size));
+		DescriptorInfo meshletVisibilityInfo(meshletVisibilityBuffer.buffer, VkDeviceSize(meshletVisibilityBuffer.offset), VkDeviceSize(meshletVisibilityBuffer.size));
+
+		// The previous frames read the draws and update the visibilities
+		g_CommandContext.BufferBarrier2(drawDataBuffer.buffer, VkDeviceSize(drawDataBuffer.offset), VkDeviceSize(drawDataBuffer.size),
+			VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			VK_ACCESS_2_SHADER_READ_BIT, VK_ACCESS_2_SHADER_WRITE_BIT);
+		g_CommandContext.BufferBarrier2(drawVisibilityBuffer.buffer, VkDeviceSize(drawVisibilityBuffer.offset), VkDeviceSize(drawVisibilityBuffer.size),
+			VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+		g_CommandContext.BufferBarrier2(meshletVisibilityBuffer.buffer, VkDeviceSize(meshletVisibilityBuffer.offset), VkDeviceSize(meshletVisibilityBuffer.size),
+			VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+		g_CommandContext.PipelineBarriers2(cmd);
+
+		g_CommandContext.BindPipeline(cmd, g_PipelineMgr.scatterDrawsPipeline);
+
+		g_CommandContext.SetDescriptor(0, drawScatterInfo);
+		g_CommandContext.SetDescriptor(1, drawBufferDescInfo);
+		g_CommandContext.SetDescriptor(2, drawVisibilityInfo);
+		g_CommandContext.SetDescriptor(3, meshletVisibilityInfo);
+
+		g_CommandContext.PushDescriptorSetWithTemplate(cmd);
+
+		struct States
+		{
+			uint32_t scatterCount;
+		} states = { g_DrawScatterCount };
+		g_CommandContext.PushConstants(cmd, "_States", 0, sizeof(states), &states);
+
+		const uint32_t GroupSize = 64;
+		vkCmdDispatch(cmd, Niagara::DivideAndRoundUp(g_DrawScatterCount, GroupSize), 1, 1);
+
+		g_CommandContext.BufferBarrier2(drawDataBuffer.buffer, VkDeviceSize(drawDataBuffer.offset), VkDeviceSize(drawDataBuffer.size),
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+			VK_ACCESS_2_SHADER_WRITE_BIT, VK_ACCESS_2_SHADER_READ_BIT);
+		g_CommandContext.BufferBarrier2(drawVisibilityBuffer.buffer, VkDeviceSize(drawVisibilityBuffer.offset), VkDeviceSize(drawVisibilityBuffer.size),
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+			VK_ACCESS_2_SHADER_WRITE_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+		g_CommandContext.BufferBarrier2(meshletVisibilityBuffer.buffer, VkDeviceSize(meshletVisibilityBuffer.offset), VkDeviceSize(meshletVisibilityBuffer.size),
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+			VK_ACCESS_2_SHADER_WRITE_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+		g_CommandContext.PipelineBarriers2(cmd);
+	}
+
 	// Init indirect draw count
 	{
 		vkCmdFillBuffer(cmd, drawCountBuffer.buffer, VkDeviceSize(0), VkDeviceSize(4), 0); // draw count / dispatch X groups
 		vkCmdFillBuffer(cmd, drawCountBuffer.buffer, VkDeviceSize(4), VkDeviceSize(8), 1); // dispatch Y/Z groups
+		vkCmdFillBuffer(cmd, drawCountBuffer.buffer, VkDeviceSize(offsetof(DrawCommandCounts, peakCommandCount)), VkDeviceSize(sizeof(DrawCommandStats)), 0); // command counts of the frame
 
 		g_CommandContext.BufferBarrier2(drawCountBuffer.buffer, VkDeviceSize(drawCountBuffer.offset), VkDeviceSize(drawCountBuffer.size),
 			VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
@@ -909,9 +1344,27 @@ void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &
 		g_CommandContext.PipelineBarriers2(cmd);
 	}
 
+	// Culling stats of the frame, after the copy of the previous one
+	if (g_CullStatsEnabled)
+	{
+		g_CommandContext.BufferBarrier2(cullStatsBuffer.buffer, VkDeviceSize(cullStatsBuffer.offset), VkDeviceSize(cullStatsBuffer.size),
+			VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+			VK_ACCESS_2_TRANSFER_READ_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+		g_CommandContext.PipelineBarriers2(cmd);
+
+		vkCmdFillBuffer(cmd, cullStatsBuffer.buffer, VkDeviceSize(cullStatsBuffer.offset), VkDeviceSize(cullStatsBuffer.size), 0);
+
+		g_CommandContext.BufferBarrier2(cullStatsBuffer.buffer, VkDeviceSize(cullStatsBuffer.offset), VkDeviceSize(cullStatsBuffer.size),
+			VK_PIPELINE_STAGE_2_TRANSFER_BIT, cullStatsStages,
+			VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+		g_CommandContext.PipelineBarriers2(cmd);
+	}
+
 	// Update draw args
 	auto cull = [&](uint32_t pass)
 	{
+		ProfileScope scope(cmd, pass == 0 ? "Early Cull" : "Late Cull");
+
 		const uint32_t GroupSize = 64;
 
 		VkDeviceSize drawCountOffset = drawCountBuffer.offset;
@@ -926,6 +1379,7 @@ void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &
 			g_CommandContext.PipelineBarriers2(cmd);
 			
 			vkCmdFillBuffer(cmd, drawCountBuffer.buffer, drawCountOffset, drawCountSize, 0); // draw count or dispatch X groups
+			vkCmdFillBuffer(cmd, drawCountBuffer.buffer, drawCountOffset + offsetof(DrawCommandCounts, requestedCommandCount), drawCountSize, 0); // commands of the pass
 
 			g_CommandContext.BufferBarrier2(drawCountBuffer.buffer, VkDeviceSize(drawCountBuffer.offset), VkDeviceSize(drawCountBuffer.size),
 				VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
@@ -934,12 +1388,21 @@ void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &
 			g_CommandContext.PipelineBarriers2(cmd);
 		}
 
+#if USE_COMPUTE_CLUSTER_CULLING
+		// The task commands are read by the cluster culling
+		auto rasterizationStage = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+#else
 		auto rasterizationStage = VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT;
+#endif
 
 		// Sync
 		g_CommandContext.BufferBarrier2(drawArgsBuffer.buffer, VkDeviceSize(drawArgsBuffer.offset), VkDeviceSize(drawArgsBuffer.size),
 			VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | rasterizationStage, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
 			VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_SHADER_READ_BIT, VK_ACCESS_2_SHADER_WRITE_BIT);
+		// The early pass writes the lods read by the late pass
+		g_CommandContext.BufferBarrier2(drawVisibilityBuffer.buffer, VkDeviceSize(drawVisibilityBuffer.offset), VkDeviceSize(drawVisibilityBuffer.size),
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			VK_ACCESS_2_SHADER_WRITE_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
 
 		const auto& depthPyramid = g_BufferMgr.depthPyramid;
 		VkImageSubresourceRange subresourceRange = { depthPyramid.subresource.aspectMask, 0, depthPyramid.subresource.mipLevel, 0, depthPyramid.subresource.arrayLayer };
@@ -960,8 +1423,21 @@ void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &
 
 		g_CommandContext.PipelineBarriers2(cmd);
 
-		// Update draw args
-		if (g_UseTaskSubmit)
+#if USE_STABLE_COMMAND_COMPACTION
+		// The compaction of the previous pass reads the command infos
+		g_CommandContext.BufferBarrier2(drawCommandInfoBuffer.buffer, VkDeviceSize(drawCommandInfoBuffer.offset), VkDeviceSize(drawCommandInfoBuffer.size),
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			VK_ACCESS_2_SHADER_READ_BIT, VK_ACCESS_2_SHADER_WRITE_BIT);
+		g_CommandContext.BufferBarrier2(groupCommandCountBuffer.buffer, VkDeviceSize(groupCommandCountBuffer.offset), VkDeviceSize(groupCommandCountBuffer.size),
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT, VK_ACCESS_2_SHADER_WRITE_BIT);
+
+		g_CommandContext.PipelineBarriers2(cmd);
+#endif
+
+		// Update draw args, the cluster culling takes task commands
+		const bool bTaskCommands = USE_COMPUTE_CLUSTER_CULLING || g_UseTaskSubmit;
+		if (bTaskCommands)
 			g_CommandContext.BindPipeline(cmd, g_PipelineMgr.updateTaskArgsPipeline);
 		else
 			g_CommandContext.BindPipeline(cmd, g_PipelineMgr.updateDrawArgsPipeline);
@@ -974,7 +1450,8 @@ void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &
 		g_CommandContext.SetDescriptor(1, drawBufferDescInfo);
 		g_CommandContext.SetDescriptor(2, drawArgsDescInfo);
 
-		Niagara::DescriptorInfo drawCountDescInfo(drawCountBuffer.buffer, drawCountOffset, drawCountSize);
+		// The count and the command counts of `DrawCommandCapacity.h`
+		Niagara::DescriptorInfo drawCountDescInfo(drawCountBuffer.buffer, drawCountOffset, VkDeviceSize(sizeof(DrawCommandCounts)));
 		g_CommandContext.SetDescriptor(3, drawCountDescInfo);
 
 		g_CommandContext.SetDescriptor(4, drawVisibilityInfo);
@@ -982,6 +1459,10 @@ void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &
 		DescriptorInfo depthPyramidInfo(g_CommonStates.minClampSampler, depthPyramid.views[0], VK_IMAGE_LAYOUT_GENERAL);
 		g_CommandContext.SetDescriptor(5, depthPyramidInfo);
 
+		g_CommandContext.SetDescriptor(6, drawCommandInfoDescInfo);
+		g_CommandContext.SetDescriptor(9, groupCommandCountDescInfo);
+		g_CommandContext.SetDescriptor(DescriptorBindings::CullStatsBuffer, cullStatsDescInfo);
+
 		g_CommandContext.PushDescriptorSetWithTemplate(cmd);
 
 		struct States
@@ -990,9 +1471,48 @@ void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &
 		} states = { pass };
 		g_CommandContext.PushConstants(cmd, "_States", 0, sizeof(states), &states);
 
-		groupsX = Niagara::DivideAndRoundUp(drawDataBuffer.elementCount, GroupSize);
+		// Slots of the instance manager, the draw buffer can have more
+		groupsX = Niagara::DivideAndRoundUp(g_ViewUniformBufferParameters.drawCount, GroupSize);
 		vkCmdDispatch(cmd, groupsX, groupsY, groupsZ);
 
+#if USE_STABLE_COMMAND_COMPACTION
+		// Scan of the workgroup command counts, then the commands of each workgroup at the scanned offsets
+		g_CommandContext.BindPipeline(cmd, bTaskCommands ? g_PipelineMgr.compactTaskArgsPipeline : g_PipelineMgr.compactDrawArgsPipeline);
+
+		g_CommandContext.SetDescriptor(DescriptorBindings::ViewUniformBuffer, viewUniformBufferInfo);
+		g_CommandContext.SetDescriptor(DescriptorBindings::DebugUniformBuffer, debugUniformBufferInfo);
+
+		g_CommandContext.SetDescriptor(0, meshBufferDescInfo);
+		g_CommandContext.SetDescriptor(1, drawBufferDescInfo);
+		g_CommandContext.SetDescriptor(2, drawArgsDescInfo);
+		g_CommandContext.SetDescriptor(3, drawCountDescInfo);
+		g_CommandContext.SetDescriptor(6, drawCommandInfoDescInfo);
+		g_CommandContext.SetDescriptor(9, groupCommandCountDescInfo);
+
+		g_CommandContext.PushDescriptorSetWithTemplate(cmd);
+
+		for (uint32_t stage = 0; stage < 2; ++stage)
+		{
+			g_CommandContext.BufferBarrier2(drawCommandInfoBuffer.buffer, VkDeviceSize(drawCommandInfoBuffer.offset), VkDeviceSize(drawCommandInfoBuffer.size),
+				VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+				VK_ACCESS_2_SHADER_WRITE_BIT, VK_ACCESS_2_SHADER_READ_BIT);
+			g_CommandContext.BufferBarrier2(groupCommandCountBuffer.buffer, VkDeviceSize(groupCommandCountBuffer.offset), VkDeviceSize(groupCommandCountBuffer.size),
+				VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+				VK_ACCESS_2_SHADER_WRITE_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+
+			g_CommandContext.PipelineBarriers2(cmd);
+
+			struct CompactStates
+			{
+				uint32_t stage;
+			} compactStates = { stage };
+			g_CommandContext.PushConstants(cmd, "_States", 0, sizeof(compactStates), &compactStates);
+
+			// A single workgroup scans, the writes use the workgroups of the culling
+			vkCmdDispatch(cmd, stage == 0 ? 1 : groupsX, 1, 1);
+		}
+#endif
+
 		// Sync
 		g_CommandContext.BufferBarrier2(drawArgsBuffer.buffer, VkDeviceSize(drawArgsBuffer.offset), VkDeviceSize(drawArgsBuffer.size),
 			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
@@ -1004,6 +1524,100 @@ void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &
 		g_CommandContext.PipelineBarriers2(cmd);
 	};
 
+#if USE_COMPUTE_CLUSTER_CULLING
+	const auto& clusterDrawArgsBuffer = g_BufferMgr.clusterDrawArgsBuffer;
+	const auto& clusterIndexBuffer = g_BufferMgr.clusterIndexBuffer;
+	const auto& clusterCountBuffer = g_BufferMgr.clusterCountBuffer;
+
+	// Cull the meshlets and triangles of the task commands into per meshlet draws, one workgroup per task command
+	auto clusterCull = [&](uint32_t pass)
+	{
+		ProfileScope scope(cmd, pass == 0 ? "Early Cluster Cull" : "Late Cluster Cull");
+
+		const auto& meshletBuffer = g_BufferMgr.meshletBuffer;
+		const auto& meshletDataBuffer = g_BufferMgr.meshletDataBuffer;
+		const auto& meshletVisibilityBuffer = g_BufferMgr.meshletVisibilityBuffer;
+		const auto& depthPyramid = g_BufferMgr.depthPyramid;
+		const auto& vb = g_BufferMgr.vertexBuffer;
+
+		// Init cluster counts
+		{
+			g_CommandContext.BufferBarrier2(clusterCountBuffer.buffer, VkDeviceSize(clusterCountBuffer.offset), VkDeviceSize(clusterCountBuffer.size),
+				VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+				VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+
+			g_CommandContext.PipelineBarriers2(cmd);
+
+			vkCmdFillBuffer(cmd, clusterCountBuffer.buffer, VkDeviceSize(clusterCountBuffer.offset), VkDeviceSize(clusterCountBuffer.size), 0);
+
+			g_CommandContext.BufferBarrier2(clusterCountBuffer.buffer, VkDeviceSize(clusterCountBuffer.offset), VkDeviceSize(clusterCountBuffer.size),
+				VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+				VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+		}
+
+		// Sync
+		g_CommandContext.BufferBarrier2(clusterDrawArgsBuffer.buffer, VkDeviceSize(clusterDrawArgsBuffer.offset), VkDeviceSize(clusterDrawArgsBuffer.size),
+			VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_SHADER_READ_BIT, VK_ACCESS_2_SHADER_WRITE_BIT);
+		g_CommandContext.BufferBarrier2(clusterIndexBuffer.buffer, VkDeviceSize(clusterIndexBuffer.offset), VkDeviceSize(clusterIndexBuffer.size),
+			VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			VK_ACCESS_2_INDEX_READ_BIT, VK_ACCESS_2_SHADER_WRITE_BIT);
+		g_CommandContext.BufferBarrier2(drawArgsBuffer.buffer, VkDeviceSize(drawArgsBuffer.offset), VkDeviceSize(drawArgsBuffer.size),
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			VK_ACCESS_2_SHADER_WRITE_BIT, VK_ACCESS_2_SHADER_READ_BIT);
+		// The early pass reads the meshlet visibilities the late pass writes
+		g_CommandContext.BufferBarrier2(meshletVisibilityBuffer.buffer, VkDeviceSize(meshletVisibilityBuffer.offset), VkDeviceSize(meshletVisibilityBuffer.size),
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+
+		g_CommandContext.PipelineBarriers2(cmd);
+
+		g_CommandContext.BindPipeline(cmd, g_PipelineMgr.clusterCullPipeline);
+
+		// Uniforms
+		g_CommandContext.SetDescriptor(DescriptorBindings::ViewUniformBuffer, viewUniformBufferInfo);
+		g_CommandContext.SetDescriptor(DescriptorBindings::DebugUniformBuffer, debugUniformBufferInfo);
+
+		g_CommandContext.SetDescriptor(DescriptorBindings::VertexBuffer, DescriptorInfo(vb.buffer, VkDeviceSize(vb.offset), VkDeviceSize(vb.size)));
+		g_CommandContext.SetDescriptor(DescriptorBindings::MeshDrawBuffer, drawBufferDescInfo);
+		g_CommandContext.SetDescriptor(DescriptorBindings::MeshDrawArgsBuffer, drawArgsDescInfo);
+		g_CommandContext.SetDescriptor(DescriptorBindings::MeshletBuffer, DescriptorInfo(meshletBuffer.buffer, VkDeviceSize(meshletBuffer.offset), VkDeviceSize(meshletBuffer.size)));
+		g_CommandContext.SetDescriptor(DescriptorBindings::MeshBoundsBuffer, meshBufferDescInfo);
+		g_CommandContext.SetDescriptor(DescriptorBindings::MeshletDataBuffer, DescriptorInfo(meshletDataBuffer.buffer, VkDeviceSize(meshletDataBuffer.offset), VkDeviceSize(meshletDataBuffer.size)));
+		g_CommandContext.SetDescriptor(DescriptorBindings::MeshletVisibilityBuffer, DescriptorInfo(meshletVisibilityBuffer.buffer, VkDeviceSize(meshletVisibilityBuffer.offset), VkDeviceSize(meshletVisibilityBuffer.size)));
+		g_CommandContext.SetDescriptor(DescriptorBindings::DepthPyramid, DescriptorInfo(g_CommonStates.minClampSampler, depthPyramid.views[0], VK_IMAGE_LAYOUT_GENERAL));
+
+		g_CommandContext.SetDescriptor(DescriptorBindings::ClusterDrawArgsBuffer, DescriptorInfo(clusterDrawArgsBuffer.buffer, VkDeviceSize(clusterDrawArgsBuffer.offset), VkDeviceSize(clusterDrawArgsBuffer.size)));
+		g_CommandContext.SetDescriptor(DescriptorBindings::ClusterIndexBuffer, DescriptorInfo(clusterIndexBuffer.buffer, VkDeviceSize(clusterIndexBuffer.offset), VkDeviceSize(clusterIndexBuffer.size)));
+		g_CommandContext.SetDescriptor(DescriptorBindings::ClusterCountBuffer, DescriptorInfo(clusterCountBuffer.buffer, VkDeviceSize(clusterCountBuffer.offset), VkDeviceSize(clusterCountBuffer.size)));
+		g_CommandContext.SetDescriptor(DescriptorBindings::CullStatsBuffer, cullStatsDescInfo);
+
+		g_CommandContext.PushDescriptorSetWithTemplate(cmd);
+
+		struct States
+		{
+			uint32_t pass;
+		} states = { pass };
+		g_CommandContext.PushConstants(cmd, "_States", 0, sizeof(states), &states);
+
+		// Task command count and 1, 1 written by the draw culling
+		vkCmdDispatchIndirect(cmd, drawCountBuffer.buffer, VkDeviceSize(drawCountBuffer.offset));
+
+		// Sync
+		g_CommandContext.BufferBarrier2(clusterDrawArgsBuffer.buffer, VkDeviceSize(clusterDrawArgsBuffer.offset), VkDeviceSize(clusterDrawArgsBuffer.size),
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,
+			VK_ACCESS_2_SHADER_WRITE_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_SHADER_READ_BIT);
+		g_CommandContext.BufferBarrier2(clusterIndexBuffer.buffer, VkDeviceSize(clusterIndexBuffer.offset), VkDeviceSize(clusterIndexBuffer.size),
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT,
+			VK_ACCESS_2_SHADER_WRITE_BIT, VK_ACCESS_2_INDEX_READ_BIT);
+		g_CommandContext.BufferBarrier2(clusterCountBuffer.buffer, VkDeviceSize(clusterCountBuffer.offset), VkDeviceSize(clusterCountBuffer.size),
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+			VK_ACCESS_2_SHADER_WRITE_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+
+		g_CommandContext.PipelineBarriers2(cmd);
+	};
+#endif
+
 	// Mesh draw pipeline
 	auto &colorBuffer = g_BufferMgr.colorBuffer;
 	auto &depthBuffer = g_BufferMgr.depthBuffer;
@@ -1020,6 +1634,8 @@ void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &
 
 	auto draw = [&](uint32_t pass, VkClearColorValue clearColor, VkClearDepthStencilValue clearDepth, uint32_t query)
 	{
+		ProfileScope scope(cmd, pass == 0 ? "Early Draw" : "Late Draw");
+
 		pipelineQueryPool.BeginQuery(cmd, query);
 
 		VkDeviceSize drawCountOffset = drawCountBuffer.offset + 0;
@@ -1058,7 +1674,7 @@ void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &
 
 		g_CommandContext.BeginRendering(cmd, viewportRect);
 
-		if (g_UseTaskSubmit)
+		if (!USE_COMPUTE_CLUSTER_CULLING && g_UseTaskSubmit)
 			g_CommandContext.BindPipeline(cmd, g_PipelineMgr.meshTaskPipeline);
 		else
 			g_CommandContext.BindPipeline(cmd, g_PipelineMgr.meshDrawPipeline);
@@ -1076,8 +1692,9 @@ void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &
 #if VERTEX_INPUT_MODE == 1
 		auto vbInfo = Niagara::DescriptorInfo(vb.buffer, VkDeviceSize(vb.offset), VkDeviceSize(vb.size));
 		g_CommandContext.SetDescriptor(DescriptorBindings::VertexBuffer, vbInfo);
+		g_CommandContext.SetDescriptor(DescriptorBindings::MeshBoundsBuffer, meshBufferDescInfo);
 
-#if USE_MESHLETS
+#if USE_MESHLETS && !USE_COMPUTE_CLUSTER_CULLING
 		const auto& meshletBuffer = g_BufferMgr.meshletBuffer;
 		const auto& meshletDataBuffer = g_BufferMgr.meshletDataBuffer;
 		const auto& meshletVisibilityBuffer = g_BufferMgr.meshletVisibilityBuffer;
@@ -1097,12 +1714,18 @@ void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &
 		const auto& depthPyramid = g_BufferMgr.depthPyramid;
 		DescriptorInfo depthPyramidInfo(g_CommonStates.minClampSampler, depthPyramid.views[0], VK_IMAGE_LAYOUT_GENERAL);
 		g_CommandContext.SetDescriptor(DescriptorBindings::DepthPyramid, depthPyramidInfo);
+
+		g_CommandContext.SetDescriptor(DescriptorBindings::CullStatsBuffer, cullStatsDescInfo);
 #endif
 
 		// Indirect draws
 #if USE_MULTI_DRAW_INDIRECT
 		g_CommandContext.SetDescriptor(DescriptorBindings::MeshDrawBuffer, drawBufferDescInfo);
+#if USE_COMPUTE_CLUSTER_CULLING
+		g_CommandContext.SetDescriptor(DescriptorBindings::MeshDrawArgsBuffer, DescriptorInfo(clusterDrawArgsBuffer.buffer, VkDeviceSize(clusterDrawArgsBuffer.offset), VkDeviceSize(clusterDrawArgsBuffer.size)));
+#else
 		g_CommandContext.SetDescriptor(DescriptorBindings::MeshDrawArgsBuffer, drawArgsDescInfo);
+#endif
 #endif // USE_MULTI_DRAW_INDIRECT
 
 #endif
@@ -1118,7 +1741,12 @@ void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &
 		VkDeviceSize offset = 0;
 		vkCmdBindVertexBuffers(cmd, 0, 1, &vb.buffer, &offset);
 
-#if USE_MESHLETS
+#if USE_COMPUTE_CLUSTER_CULLING
+		vkCmdBindIndexBuffer(cmd, clusterIndexBuffer.buffer, VkDeviceSize(clusterIndexBuffer.offset), VK_INDEX_TYPE_UINT32);
+
+		vkCmdDrawIndexedIndirectCount(cmd, clusterDrawArgsBuffer.buffer, offsetof(MeshDrawCommand, drawIndexedIndirectCommand), clusterCountBuffer.buffer, VkDeviceSize(clusterCountBuffer.offset), clusterDrawArgsBuffer.elementCount, sizeof(MeshDrawCommand));
+
+#elif USE_MESHLETS
 
 #if USE_MULTI_DRAW_INDIRECT
 		if (g_UseTaskSubmit)
@@ -1129,7 +1757,7 @@ void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &
 		{
 			// vkCmdDrawMeshTasksIndirectNV(cmd, drawArgsBuffer.buffer, offsetof(MeshDrawCommand, drawMeshTaskIndirectCommand), drawDataBuffer.elementCount, sizeof(MeshDrawCommand));
 			// vkCmdDrawMeshTasksIndirectCountNV(cmd, drawArgsBuffer.buffer, offsetof(MeshDrawCommand, drawMeshTaskIndirectCommand), drawCountBuffer.buffer, drawCountOffset, drawDataBuffer.elementCount, sizeof(MeshDrawCommand));
-			vkCmdDrawMeshTasksIndirectCountEXT(cmd, drawArgsBuffer.buffer, offsetof(MeshDrawCommand, drawMeshTaskIndirectCommand), drawCountBuffer.buffer, drawCountOffset, drawDataBuffer.elementCount, sizeof(MeshDrawCommand));
+			vkCmdDrawMeshTasksIndirectCountEXT(cmd, drawArgsBuffer.buffer, offsetof(MeshDrawCommand, drawMeshTaskIndirectCommand), drawCountBuffer.buffer, drawCountOffset, drawArgsBuffer.elementCount, sizeof(MeshDrawCommand));
 		}
 #else
 		uint32_t nTask = static_cast<uint32_t>(mesh.meshlets.size());
@@ -1142,7 +1770,7 @@ void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &
 
 #if USE_MULTI_DRAW_INDIRECT
 		// vkCmdDrawIndexedIndirect(cmd, drawArgsBuffer.buffer, offsetof(MeshDrawCommand, drawIndexedIndirectCommand), drawDataBuffer.elementCount, sizeof(MeshDrawCommand));
-		vkCmdDrawIndexedIndirectCount(cmd, drawArgsBuffer.buffer, offsetof(MeshDrawCommand, drawIndexedIndirectCommand), drawCountBuffer.buffer, drawCountOffset, drawDataBuffer.elementCount, sizeof(MeshDrawCommand));
+		vkCmdDrawIndexedIndirectCount(cmd, drawArgsBuffer.buffer, offsetof(MeshDrawCommand, drawIndexedIndirectCommand), drawCountBuffer.buffer, drawCountOffset, drawArgsBuffer.elementCount, sizeof(MeshDrawCommand));
 #else
 		vkCmdDrawIndexed(cmd, ib.elementCount, 1, 0, 0, 0);
 #endif
@@ -1157,13 +1785,38 @@ void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &
 	// Generate depth pyramid
 	auto buildDepthPyramid = [&]()
 	{
+		ProfileScope scope(cmd, "Depth Pyramid");
+
 		const auto& depthPyramid = g_BufferMgr.depthPyramid;
 		const uint32_t GroupSize = 8;
 
+		const bool bSinglePass = g_UseSinglePassDepthPyramid && CanBuildDepthPyramidSinglePass(depthPyramid.subresource.mipLevel);
+		const bool bReadback = g_DepthPyramidValidation.ShouldRecord();
+
+		VkImageLayout depthLayout = depthAttachmentLayout;
+		VkPipelineStageFlags2 depthStage = VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+		VkAccessFlags2 depthAccess = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+		if (bReadback)
+		{
+			g_CommandContext.ImageBarrier2(depthBuffer.image, depthAspectFlags,
+				depthAttachmentLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_2_COPY_BIT,
+				VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
+
+			g_CommandContext.PipelineBarriers2(cmd);
+
+			g_DepthPyramidValidation.RecordDepthCopy(cmd, depthBuffer);
+
+			depthLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			depthStage = VK_PIPELINE_STAGE_2_COPY_BIT;
+			depthAccess = VK_ACCESS_2_NONE;
+		}
+
 		g_CommandContext.ImageBarrier2(depthBuffer.image, depthAspectFlags,
-			depthAttachmentLayout, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-			VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
-			VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_2_SHADER_READ_BIT);
+			depthLayout, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			depthStage, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			depthAccess, VK_ACCESS_2_SHADER_READ_BIT);
 
 		VkImageSubresourceRange subresourceRange = { depthPyramid.subresource.aspectMask, 0, depthPyramid.subresource.mipLevel, 0, depthPyramid.subresource.arrayLayer };
 
@@ -1172,62 +1825,117 @@ void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &
 			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
 			VK_ACCESS_2_SHADER_READ_BIT, VK_ACCESS_2_SHADER_WRITE_BIT);
 
+		if (bSinglePass)
+		{
+			// Reset by the last workgroup of the previous build
+			const auto& counterBuffer = g_BufferMgr.depthPyramidCounterBuffer;
+			g_CommandContext.BufferBarrier2(counterBuffer.buffer, VkDeviceSize(counterBuffer.offset), VkDeviceSize(counterBuffer.size),
+				VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+				VK_ACCESS_2_SHADER_WRITE_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+		}
+
 		g_CommandContext.PipelineBarriers2(cmd);
 
-		g_CommandContext.BindPipeline(cmd, g_PipelineMgr.buildDepthPyramidPipeline);
+		if (bSinglePass)
+		{
+			// All the mips in one dispatch, no barrier between them
+			g_CommandContext.BindPipeline(cmd, g_PipelineMgr.buildDepthPyramidSinglePassPipeline);
 
-		VkImageView srcImageView = VK_NULL_HANDLE;
-		uint32_t w = depthPyramid.extent.width, h = depthPyramid.extent.height;
+			const uint32_t mipCount = depthPyramid.subresource.mipLevel;
+			const glm::uvec2 pyramidSize(depthPyramid.extent.width, depthPyramid.extent.height);
+			const glm::uvec2 groupCount = GetDepthPyramidSinglePassGroups(pyramidSize);
 
-		subresourceRange.levelCount = 1;
+			struct
+			{
+				glm::uvec2 depthSize;
+				glm::uvec2 pyramidSize;
+				uint32_t mipCount;
+				uint32_t groupCount;
+			} constants = { glm::uvec2(depthBuffer.extent.width, depthBuffer.extent.height), pyramidSize, mipCount, groupCount.x * groupCount.y };
 
-		struct Constants
-		{
-			glm::vec4 srcSize;
-			glm::vec2 viewportMaxBoundUV;
-		} constants{};
+			g_CommandContext.PushConstants(cmd, "_Constants", 0, sizeof(constants), &constants);
 
-		uint32_t viewIndexOffset = 1;
-		for (uint32_t i = 0; i < depthPyramid.subresource.mipLevel; ++i)
-		{
-			constants.viewportMaxBoundUV = glm::vec2(1.0f, 1.0f);
+			g_CommandContext.SetDescriptor(0, Niagara::DescriptorInfo(g_CommonStates.linearClampSampler.sampler, depthBuffer.views[0].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+			// The bindings past the last mip are never written
+			uint32_t viewIndexOffset = 1;
+			for (uint32_t i = 0; i < DEPTH_PYRAMID_MAX_SINGLE_PASS_MIPS; ++i)
+				g_CommandContext.SetDescriptor(1 + i, Niagara::DescriptorInfo(VK_NULL_HANDLE, depthPyramid.views[std::min(i, mipCount - 1) + viewIndexOffset].view, VK_IMAGE_LAYOUT_GENERAL));
+			const auto& counterBuffer = g_BufferMgr.depthPyramidCounterBuffer;
+			g_CommandContext.SetDescriptor(1 + DEPTH_PYRAMID_MAX_SINGLE_PASS_MIPS, Niagara::DescriptorInfo(counterBuffer.buffer, VkDeviceSize(counterBuffer.offset), VkDeviceSize(counterBuffer.size)));
+
+			g_CommandContext.PushDescriptorSetWithTemplate(cmd, 0);
 
-			VkImageLayout srcLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			vkCmdDispatch(cmd, groupCount.x, groupCount.y, 1);
+		}
+		else
+		{
+			g_CommandContext.BindPipeline(cmd, g_PipelineMgr.buildDepthPyramidPipeline);
 
-			if (i == 0)
-			{
-				srcImageView = depthBuffer.views[0].view;
-				srcLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-				constants.srcSize = Niagara::GetSizeAndInvSize(depthBuffer.extent.width, depthBuffer.extent.height);
-			}
-			else
-			{
-				srcImageView = depthPyramid.views[i - 1 + viewIndexOffset].view;
-				srcLayout = VK_IMAGE_LAYOUT_GENERAL;
-				constants.srcSize = Niagara::GetSizeAndInvSize(w, h);
-				subresourceRange.baseMipLevel = i - 1;
+			VkImageView srcImageView = VK_NULL_HANDLE;
+			uint32_t w = depthPyramid.extent.width, h = depthPyramid.extent.height;
 
-				g_CommandContext.ImageBarrier2(depthPyramid.image, subresourceRange,
-					VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
-					VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
-					VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+			subresourceRange.levelCount = 1;
 
-				g_CommandContext.PipelineBarriers2(cmd);
+			struct Constants
+			{
+				glm::vec4 srcSize;
+			} constants{};
 
-				w = std::max(1u, w >> 1);
-				h = std::max(1u, h >> 1);
+			uint32_t viewIndexOffset = 1;
+			for (uint32_t i = 0; i < depthPyramid.subresource.mipLevel; ++i)
+			{
+				VkImageLayout srcLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+				if (i == 0)
+				{
+					srcImageView = depthBuffer.views[0].view;
+					srcLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+					constants.srcSize = Niagara::GetSizeAndInvSize(depthBuffer.extent.width, depthBuffer.extent.height);
+				}
+				else
+				{
+					srcImageView = depthPyramid.views[i - 1 + viewIndexOffset].view;
+					srcLayout = VK_IMAGE_LAYOUT_GENERAL;
+					constants.srcSize = Niagara::GetSizeAndInvSize(w, h);
+					subresourceRange.baseMipLevel = i - 1;
+
+					g_CommandContext.ImageBarrier2(depthPyramid.image, subresourceRange,
+						VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+						VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+						VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+					g_CommandContext.PipelineBarriers2(cmd);
+
+					w = std::max(1u, w >> 1);
+					h = std::max(1u, h >> 1);
+				}
+
+				g_CommandContext.PushConstants(cmd, "_Constants", 0, sizeof(constants), &constants);
+
+				g_CommandContext.SetDescriptor(0, Niagara::DescriptorInfo(g_CommonStates.linearClampSampler.sampler, srcImageView, srcLayout));
+				g_CommandContext.SetDescriptor(1, Niagara::DescriptorInfo(VK_NULL_HANDLE, depthPyramid.views[i + viewIndexOffset].view, VK_IMAGE_LAYOUT_GENERAL));
+
+				g_CommandContext.PushDescriptorSetWithTemplate(cmd, 0);
+
+				groupsX = Niagara::DivideAndRoundUp(w, GroupSize);
+				groupsY = Niagara::DivideAndRoundUp(h, GroupSize);
+				vkCmdDispatch(cmd, groupsX, groupsY, groupsZ);
 			}
+		}
 
-			g_CommandContext.PushConstants(cmd, "_Constants", 0, sizeof(constants), &constants);
+		if (bReadback)
+		{
+			subresourceRange.baseMipLevel = 0;
+			subresourceRange.levelCount = depthPyramid.subresource.mipLevel;
 
-			g_CommandContext.SetDescriptor(0, Niagara::DescriptorInfo(g_CommonStates.linearClampSampler.sampler, srcImageView, srcLayout));
-			g_CommandContext.SetDescriptor(1, Niagara::DescriptorInfo(VK_NULL_HANDLE, depthPyramid.views[i + viewIndexOffset].view, VK_IMAGE_LAYOUT_GENERAL));
+			g_CommandContext.ImageBarrier2(depthPyramid.image, subresourceRange,
+				VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+				VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_COPY_BIT,
+				VK_ACCESS_2_SHADER_WRITE_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
 
-			g_CommandContext.PushDescriptorSetWithTemplate(cmd, 0);
+			g_CommandContext.PipelineBarriers2(cmd);
 
-			groupsX = Niagara::DivideAndRoundUp(w, GroupSize);
-			groupsY = Niagara::DivideAndRoundUp(h, GroupSize);
-			vkCmdDispatch(cmd, groupsX, groupsY, groupsZ);
+			g_DepthPyramidValidation.RecordPyramidCopy(cmd, depthPyramid);
 		}
 	};
 
@@ -1235,15 +1943,64 @@ void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &
 
 	// Early cull : frustum cull & fill objects that were visible last frame
 	cull(/* pass = */ 0);
+#if USE_COMPUTE_CLUSTER_CULLING
+	clusterCull(/* pass = */ 0);
+#endif
 	// Early draw : render objects that were visible last frame
 	draw(/* pass = */ 0, clearColor, clearDepth, /* query = */ 0);
 
 	buildDepthPyramid();
 	// Late cull : frustum cull & fill objects that were not visible last frame
 	cull(/* pass = */ 1);
+#if USE_COMPUTE_CLUSTER_CULLING
+	clusterCull(/* pass = */ 1);
+#endif
 	// Late draw : render objects that are visible this frame but weren't drawn in the early pass
 	draw(/* pass = */ 1, clearColor, clearDepth, /* query = */ 1);
 
+	// Peak and dropped command counts of the frame, read once its fence is signaled
+	{
+		const auto& drawCommandStatsBuffer = g_BufferMgr.drawCommandStatsBuffers[g_ReadbackIndex];
+
+		g_CommandContext.BufferBarrier2(drawCountBuffer.buffer, VkDeviceSize(drawCountBuffer.offset), VkDeviceSize(drawCountBuffer.size),
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+			VK_ACCESS_2_SHADER_WRITE_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
+		g_CommandContext.PipelineBarriers2(cmd);
+
+		VkBufferCopy copyRegion{};
+		copyRegion.srcOffset = drawCountBuffer.offset + offsetof(DrawCommandCounts, peakCommandCount);
+		copyRegion.dstOffset = 0;
+		copyRegion.size = sizeof(DrawCommandStats);
+		vkCmdCopyBuffer(cmd, drawCountBuffer.buffer, drawCommandStatsBuffer.buffer, 1, &copyRegion);
+
+		g_CommandContext.BufferBarrier2(drawCommandStatsBuffer.buffer, VkDeviceSize(drawCommandStatsBuffer.offset), VkDeviceSize(drawCommandStatsBuffer.size),
+			VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_PIPELINE_STAGE_2_HOST_BIT,
+			VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_ACCESS_2_HOST_READ_BIT);
+		g_CommandContext.PipelineBarriers2(cmd);
+	}
+
+	// Culling stats of the frame, read once its fence is signaled
+	if (g_CullStatsEnabled)
+	{
+		const auto& cullStatsReadbackBuffer = g_BufferMgr.cullStatsReadbackBuffers[g_ReadbackIndex];
+
+		g_CommandContext.BufferBarrier2(cullStatsBuffer.buffer, VkDeviceSize(cullStatsBuffer.offset), VkDeviceSize(cullStatsBuffer.size),
+			cullStatsStages, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+			VK_ACCESS_2_SHADER_WRITE_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
+		g_CommandContext.PipelineBarriers2(cmd);
+
+		VkBufferCopy copyRegion{};
+		copyRegion.srcOffset = cullStatsBuffer.offset;
+		copyRegion.dstOffset = 0;
+		copyRegion.size = cullStatsBuffer.size;
+		vkCmdCopyBuffer(cmd, cullStatsBuffer.buffer, cullStatsReadbackBuffer.buffer, 1, &copyRegion);
+
+		g_CommandContext.BufferBarrier2(cullStatsReadbackBuffer.buffer, VkDeviceSize(cullStatsReadbackBuffer.offset), VkDeviceSize(cullStatsReadbackBuffer.size),
+			VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_PIPELINE_STAGE_2_HOST_BIT,
+			VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_ACCESS_2_HOST_READ_BIT);
+		g_CommandContext.PipelineBarriers2(cmd);
+	}
+
 	// TODO: Update the final depth pyramid
 	// ...
 
@@ -1351,11 +2108,13 @@ void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &
 		g_CommandContext.EndRendering(cmd);
 	};
 
-	if (g_DebugParams.params[DebugParam::ToyDraw])
+	if (!USE_COMPUTE_CLUSTER_CULLING && g_DebugParams.params[DebugParam::ToyDraw])
 		toyDraw(cmd, colorBuffer, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT);
 
 	// Update backbuffer
 	{
+		ProfileScope scope(cmd, "Blit");
+
 		auto swapchainImage = swapchain.images[imageIndex];
 		
 		g_CommandContext.ImageBarrier(swapchainImage, VK_IMAGE_ASPECT_COLOR_BIT,
@@ -1380,7 +2139,7 @@ void RecordCommandBuffer(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &
 		g_CommandContext.PipelineBarriers(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT); // VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT
 	}
 
-	timestampQueryPool.WriteTimestamp(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 1);
+	g_Profiler.EndScope(cmd, frameScope);
 
 	g_CommandContext.EndCommandBuffer(cmd);
 }
@@ -1466,7 +2225,7 @@ void GetFrameResources(const Niagara::Device &device, std::vector<FrameResources
 
 /// Main
 
-void Render(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &framebuffers, const Niagara::Swapchain& swapchain, uint32_t imageIndex, const Niagara::Geometry& geometry, VkQueue graphicsQueue, SyncObjects& syncObjects)
+void Render(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &framebuffers, const Niagara::Swapchain& swapchain, uint32_t imageIndex, const Niagara::GeometryView& geometry, VkQueue graphicsQueue, SyncObjects& syncObjects)
 {
 	vkResetCommandBuffer(cmd, 0);
 
@@ -1494,10 +2253,53 @@ void Render(VkCommandBuffer cmd, const std::vector<VkFramebuffer> &framebuffers,
 }
 
 
-int main()
+int main(int argc, char** argv)
 {
 	std::cout << "Hello, Vulkan!" << std::endl;
 
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg = argv[i];
+		if (arg == "--packed-draws")
+			g_UsePackedDraws = true;
+		else if (arg == "--full-draws")
+			g_UsePackedDraws = false;
+		else if (arg == "--packed-meshlets")
+			g_UsePackedMeshlets = true;
+		else if (arg == "--full-meshlets")
+			g_UsePackedMeshlets = false;
+		else if (arg == "--packed-vertices")
+			g_UsePackedVertices = true;
+		else if (arg == "--full-vertices")
+			g_UsePackedVertices = false;
+		else if (arg == "--single-pass-depth-pyramid")
+			g_UseSinglePassDepthPyramid = true;
+		else if (arg == "--multi-pass-depth-pyramid")
+			g_UseSinglePassDepthPyramid = false;
+		else if (arg == "--validate-depth-pyramid")
+			g_DepthPyramidValidation.bRequested = true;
+		else if (arg == "--cull-stats")
+			g_CullStatsEnabled = true;
+		else if (arg == "--cull-stats-dump" && i + 1 < argc)
+		{
+			g_CullStatsEnabled = true;
+			g_CullStatsPath = argv[++i];
+		}
+		else if (arg == "--profile")
+			g_ProfileStatsEnabled = true;
+		else if (arg == "--profile-trace" && i + 1 < argc)
+			g_ProfileTracePath = argv[++i];
+		else if (arg == "--lod-error" && i + 1 < argc)
+			g_LodErrorThreshold = std::max(strtof(argv[++i], nullptr), 0.0f);
+		else if (arg == "--visibility-history" && i + 1 < argc)
+			g_VisibilityHistoryFrames = std::min(static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)), DRAW_VISIBILITY_HISTORY_MAX - 1);
+	}
+
+#if VERTEX_INPUT_MODE != 1
+	// The vertex input attributes are the ones of `Vertex`
+	g_UsePackedVertices = false;
+#endif
+
 	// Window
 	int rc = glfwInit();
 	if (rc == GLFW_FALSE) 
@@ -1564,6 +2366,8 @@ int main()
 	features12.samplerFilterMinmax = VK_TRUE;
 	features12.scalarBlockLayout = VK_TRUE;
 	features12.bufferDeviceAddress = VK_TRUE;
+	features12.timelineSemaphore = VK_TRUE;
+	features12.hostQueryReset = VK_TRUE;
 
 	features13.pNext = &features12;
 
@@ -1579,6 +2383,7 @@ int main()
 	*pNext = &features13;
 	pNext = &features11.pNext;
 
+#if !USE_COMPUTE_CLUSTER_CULLING
 	VkPhysicalDeviceMeshShaderFeaturesEXT featureMeshShader{};
 	featureMeshShader.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
 	featureMeshShader.meshShader = VK_TRUE;
@@ -1586,6 +2391,7 @@ int main()
 
 	*pNext = &featureMeshShader;
 	pNext = &featureMeshShader.pNext;
+#endif
 
 #if USE_FRAGMENT_SHADING_RATE
 	VkPhysicalDeviceFragmentShadingRateFeaturesKHR featureSR{};
@@ -1598,7 +2404,11 @@ int main()
 #endif
 
 	Niagara::Device device{};
+#if USE_TRANSFER_QUEUE_UPLOADS
+	device.Init(instance, physicalDeviceFeatures, g_DeviceExtensions, pNextChain, true, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT);
+#else
 	device.Init(instance, physicalDeviceFeatures, g_DeviceExtensions, pNextChain);
+#endif
 
 	volkLoadDevice(device);
 
@@ -1611,11 +2421,22 @@ int main()
 
 	g_CommandMgr.Init(device);
 
+	// Uploads
+	g_StagingUploader.Init(device, STAGING_BUFFER_SIZE, USE_TRANSFER_QUEUE_UPLOADS ? EQueueFamily::Transfer : EQueueFamily::Graphics);
+
 	// Common states
 	g_CommonStates.Init(device);
 
 	// Queries
 	g_CommonQueryPools.Init(device);
+	g_Profiler.Init(device, MAX_FRAMES_IN_FLIGHT);
+	if (!g_ProfileTracePath.empty())
+	{
+		if (g_Profiler.OpenTrace(g_ProfileTracePath))
+			printf("Profiler: trace written to %s.\n", g_ProfileTracePath.c_str());
+		else
+			printf("Profiler: failed to open %s.\n", g_ProfileTracePath.c_str());
+	}
 
 	// Shaders
 	g_ShaderMgr.Init(device);
@@ -1628,6 +2449,29 @@ int main()
 	VkFormat depthFormat = device.GetSupportedDepthFormat(false);
 	g_BufferMgr.InitViewDependentBuffers(device, renderExtent, colorFormat, depthFormat);
 
+	// Depth pyramid commands per frame
+	{
+		auto printPassCounts = [](const char* label, uint32_t width, uint32_t height)
+		{
+			const uint32_t mipCount = Niagara::GetDepthPyramidMipCount(Niagara::GetDepthPyramidSize(width, height));
+			const auto multiPass = Niagara::GetDepthPyramidPassCounts(mipCount, false);
+			const auto singlePass = Niagara::GetDepthPyramidPassCounts(mipCount, Niagara::CanBuildDepthPyramidSinglePass(mipCount));
+
+			printf("Depth pyramid %s (%ux%u, %u mips): %u dispatches, %u barriers per frame -> %u, %u (%u, %u saved)\n",
+				label, width, height, mipCount,
+				multiPass.dispatches, multiPass.barriers, singlePass.dispatches, singlePass.barriers,
+				multiPass.dispatches - singlePass.dispatches, multiPass.barriers - singlePass.barriers);
+		};
+
+		printPassCounts("1080p", 1920, 1080);
+		printPassCounts("4K", 3840, 2160);
+		printPassCounts("current", renderExtent.width, renderExtent.height);
+		printf("Depth pyramid built in %s\n", g_UseSinglePassDepthPyramid ? "a single pass" : "one pass per mip");
+	}
+
+	if (g_DepthPyramidValidation.bRequested)
+		g_DepthPyramidValidation.Init(device, g_BufferMgr.depthBuffer, g_BufferMgr.depthPyramid);
+
 #if 1
 	Niagara::RenderPass &meshDrawPass = g_PipelineMgr.meshDrawPass;
 	std::vector<Niagara::Attachment> colorAttachments{ Niagara::Attachment{ colorFormat } };
@@ -1661,12 +2505,22 @@ int main()
 	GraphicsPipeline &meshDrawPipeline = g_PipelineMgr.meshDrawPipeline;
 	GetMeshDrawPipeline(device, meshDrawPipeline, meshDrawPass, 0, { {0, 0}, renderExtent }, colorAttachmentFormats, depthFormat);
 
+#if !USE_COMPUTE_CLUSTER_CULLING
 	GraphicsPipeline& meshTaskPipeline = g_PipelineMgr.meshTaskPipeline;
 	GetMeshDrawPipeline(device, meshTaskPipeline, meshDrawPass, 0, { {0, 0}, renderExtent }, colorAttachmentFormats, depthFormat, true);
+#endif
 
 	ComputePipeline &updateDrawArgsPipeline = g_PipelineMgr.updateDrawArgsPipeline;
 	{
 		updateDrawArgsPipeline.compShader = &g_ShaderMgr.cullComp;
+		if (g_UsePackedDraws)
+			updateDrawArgsPipeline.SetSpecializationConstant(1, 1);
+		if (USE_STABLE_COMMAND_COMPACTION)
+			updateDrawArgsPipeline.SetSpecializationConstant(2, 1);
+		if (g_VisibilityHistoryFrames > 0)
+			updateDrawArgsPipeline.SetSpecializationConstant(5, g_VisibilityHistoryFrames);
+		if (g_CullStatsEnabled)
+			updateDrawArgsPipeline.SetSpecializationConstant(6, 1);
 		updateDrawArgsPipeline.Init(device);
 	}
 
@@ -1674,23 +2528,80 @@ int main()
 	{
 		updateTaskArgsPipeline.compShader = &g_ShaderMgr.cullComp;
 		updateTaskArgsPipeline.SetSpecializationConstant(0, 1);
+		if (g_UsePackedDraws)
+			updateTaskArgsPipeline.SetSpecializationConstant(1, 1);
+		if (USE_STABLE_COMMAND_COMPACTION)
+			updateTaskArgsPipeline.SetSpecializationConstant(2, 1);
+		if (g_VisibilityHistoryFrames > 0)
+			updateTaskArgsPipeline.SetSpecializationConstant(5, g_VisibilityHistoryFrames);
+		if (g_CullStatsEnabled)
+			updateTaskArgsPipeline.SetSpecializationConstant(6, 1);
 		updateTaskArgsPipeline.Init(device);
 	}
 
+	ComputePipeline& compactDrawArgsPipeline = g_PipelineMgr.compactDrawArgsPipeline;
+	{
+		compactDrawArgsPipeline.compShader = &g_ShaderMgr.compactCommandsComp;
+		if (g_UsePackedDraws)
+			compactDrawArgsPipeline.SetSpecializationConstant(1, 1);
+		compactDrawArgsPipeline.Init(device);
+	}
+
+	ComputePipeline& compactTaskArgsPipeline = g_PipelineMgr.compactTaskArgsPipeline;
+	{
+		compactTaskArgsPipeline.compShader = &g_ShaderMgr.compactCommandsComp;
+		compactTaskArgsPipeline.SetSpecializationConstant(0, 1);
+		if (g_UsePackedDraws)
+			compactTaskArgsPipeline.SetSpecializationConstant(1, 1);
+		compactTaskArgsPipeline.Init(device);
+	}
+
 	ComputePipeline& buildDepthPyramidPipeline = g_PipelineMgr.buildDepthPyramidPipeline;
 	{
 		buildDepthPyramidPipeline.compShader = &g_ShaderMgr.buildHiZComp;
 		buildDepthPyramidPipeline.Init(device);
 	}
 
+	ComputePipeline& buildDepthPyramidSinglePassPipeline = g_PipelineMgr.buildDepthPyramidSinglePassPipeline;
+	{
+		buildDepthPyramidSinglePassPipeline.compShader = &g_ShaderMgr.buildHiZSinglePassComp;
+		buildDepthPyramidSinglePassPipeline.Init(device);
+	}
+
+	ComputePipeline& scatterDrawsPipeline = g_PipelineMgr.scatterDrawsPipeline;
+	{
+		scatterDrawsPipeline.compShader = &g_ShaderMgr.scatterDrawsComp;
+		if (g_UsePackedDraws)
+			scatterDrawsPipeline.SetSpecializationConstant(1, 1);
+		scatterDrawsPipeline.Init(device);
+	}
+
+#if USE_COMPUTE_CLUSTER_CULLING
+	ComputePipeline& clusterCullPipeline = g_PipelineMgr.clusterCullPipeline;
+	{
+		clusterCullPipeline.compShader = &g_ShaderMgr.clusterCullComp;
+		if (g_UsePackedDraws)
+			clusterCullPipeline.SetSpecializationConstant(1, 1);
+		if (g_UsePackedMeshlets)
+			clusterCullPipeline.SetSpecializationConstant(3, 1);
+		if (g_UsePackedVertices)
+			clusterCullPipeline.SetSpecializationConstant(4, 1);
+		if (g_CullStatsEnabled)
+			clusterCullPipeline.SetSpecializationConstant(6, 1);
+		clusterCullPipeline.Init(device);
+	}
+#else
 	GraphicsPipeline& toyDrawPipeline = g_PipelineMgr.toyDrawPipeline;
 	{
 		toyDrawPipeline.meshShader = &g_ShaderMgr.toyMesh;
 		toyDrawPipeline.fragShader = &g_ShaderMgr.toyFullScreenFrag;
 		toyDrawPipeline.SetAttachments(colorAttachmentFormats.data(), static_cast<uint32_t>(colorAttachmentFormats.size()));
 		// toyDrawPipeline.SetSpecializationConstant(0, 1); // specialization constant
+		if (g_UsePackedDraws)
+			toyDrawPipeline.SetSpecializationConstant(1, 1);
 		toyDrawPipeline.Init(device);
 	}
+#endif
 
 	// Command buffers
 
@@ -1735,14 +2646,65 @@ int main()
 	debugUniformBuffer.Init(device, sizeof(DebugParams), 1, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, hostVisibleMemPropertyFlags);
 
 	// Geometry
-	Geometry geometry{};
+	Geometry loadedGeometry{};
+	GeometryCache geometryCache{};
+	GeometryView geometry{};
 	
 	const std::vector<std::string> objFileNames{ "kitten.obj", /*"bunny.obj"*/ }; // kitten bunny
+	std::vector<std::string> objFilePaths;
+	std::string geometryCachePath = g_ResourcePath;
 	for (const auto& fileName : objFileNames)
 	{
-		bool bLoaded = LoadMesh(geometry, std::string(g_ResourcePath + fileName).data(), USE_MESHLETS);
-		if (!bLoaded)
-			std::cout << "Load mesh failed: " << fileName << std::endl;
+		objFilePaths.push_back(g_ResourcePath + fileName);
+
+		if (geometryCachePath.size() > g_ResourcePath.size())
+			geometryCachePath += "_";
+		geometryCachePath += fileName.substr(0, fileName.find_last_of('.'));
+	}
+	geometryCachePath += ".ngeo";
+
+	g_JobSystem.Init();
+	{
+		double loadBeginTime = glfwGetTime();
+
+		bool bLoaded = LoadCachedGeometry(geometryCache, loadedGeometry, geometry, geometryCachePath, objFilePaths, USE_MESHLETS, USE_GEOMETRY_COMPRESSION, USE_CLUSTER_LOD);
+
+		double loadTime = (glfwGetTime() - loadBeginTime) * 1000.0;
+		if (bLoaded)
+			printf("Loaded %zu meshes in %.2f ms (%s).\n", geometry.meshes.size(), loadTime, geometryCache.IsCompressed() ? "compressed geometry cache" : geometryCache.IsLoaded() ? "geometry cache" : "built from sources");
+
+#if COMPARE_SERIAL_MESH_LOADING
+		Geometry serialGeometry{};
+
+		loadBeginTime = glfwGetTime();
+		for (const auto& path : objFilePaths)
+			LoadMesh(serialGeometry, path.c_str(), USE_MESHLETS);
+		double serialLoadTime = (glfwGetTime() - loadBeginTime) * 1000.0;
+
+		auto SameMeshlet = [](const Meshlet& a, const Meshlet& b)
+		{
+			return a.boundingSphere == b.boundingSphere && a.coneApex == b.coneApex && a.cone == b.cone &&
+				a.vertexOffset == b.vertexOffset && a.vertexCount == b.vertexCount && a.triangleCount == b.triangleCount;
+		};
+		auto SameMesh = [](const Mesh& a, const Mesh& b)
+		{
+			return a.boundingSphere == b.boundingSphere && a.positionOffset == b.positionOffset && a.positionScale == b.positionScale &&
+				a.vertexOffset == b.vertexOffset && a.vertexCount == b.vertexCount &&
+				a.lodCount == b.lodCount && memcmp(a.lods, b.lods, sizeof(MeshLod) * a.lodCount) == 0;
+		};
+
+		// The streams of a compressed cache are only decoded at upload, and its vertices are lossy
+		bool bIdentical = 
+			!geometryCache.IsCompressed() &&
+			serialGeometry.vertices.size() == geometry.vertices.size() &&
+			memcmp(serialGeometry.vertices.data(), geometry.vertices.data(), sizeof(Vertex) * geometry.vertices.size()) == 0 &&
+			std::equal(serialGeometry.indices.begin(), serialGeometry.indices.end(), geometry.indices.begin(), geometry.indices.end()) &&
+			std::equal(serialGeometry.meshletData.begin(), serialGeometry.meshletData.end(), geometry.meshletData.begin(), geometry.meshletData.end()) &&
+			std::equal(serialGeometry.meshlets.begin(), serialGeometry.meshlets.end(), geometry.meshlets.begin(), geometry.meshlets.end(), SameMeshlet) &&
+			std::equal(serialGeometry.meshes.begin(), serialGeometry.meshes.end(), geometry.meshes.begin(), geometry.meshes.end(), SameMesh);
+
+		printf("Serial mesh loading %.2f ms, speedup %.2fx, identical: %d.\n", serialLoadTime, serialLoadTime / std::max(loadTime, 1e-3), bIdentical);
+#endif
 	}
 
 	if (geometry.meshes.empty())
@@ -1754,16 +2716,116 @@ int main()
 	const uint32_t meshCount = static_cast<uint32_t>(geometry.meshes.size());
 
 	GpuBuffer &vb = g_BufferMgr.vertexBuffer, &ib = g_BufferMgr.indexBuffer;
-	vb.Init(device, sizeof(Vertex), static_cast<uint32_t>(geometry.vertices.size()), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocalMemPropertyFlags, geometry.vertices.data());
 
-	if (!geometry.indices.empty())
+	// Returns false if a stream of a compressed cache is corrupted
+	auto InitGeometryBuffers = [&]() -> bool
 	{
-		ib.Init(device, sizeof(uint32_t), static_cast<uint32_t>(geometry.indices.size()), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocalMemPropertyFlags, geometry.indices.data());
+		const bool bCompressedGeometry = geometryCache.IsCompressed();
+		const CompressedGeometryView& compressedGeometry = geometryCache.GetCompressedView();
+
+		if (g_UsePackedVertices)
+		{
+			// The packed vertices are encoded from the full ones, the ones of a compressed cache are decoded first
+			std::vector<Vertex> decodedVertices;
+			GeometryView vertexGeometry = geometry;
+			if (bCompressedGeometry)
+			{
+				decodedVertices.resize(compressedGeometry.GetElementCount(GeometryStream::Vertices));
+				if (!DecodeGeometryStream(reinterpret_cast<uint8_t*>(decodedVertices.data()), compressedGeometry, GeometryStream::Vertices))
+				{
+					printf("ERROR::Corrupted compressed vertices!\n");
+					return false;
+				}
+				vertexGeometry.vertices = decodedVertices;
+			}
+
+			std::vector<PackedVertex> packedVertices;
+			std::vector<VertexPackingError> packingErrors;
+			double packBeginTime = glfwGetTime();
+			PackMeshVertices(packedVertices, vertexGeometry, &packingErrors);
+			double packTime = (glfwGetTime() - packBeginTime) * 1000.0;
+
+			vb.Init(device, sizeof(PackedVertex), static_cast<uint32_t>(packedVertices.size()), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocalMemPropertyFlags, packedVertices.data());
+
+			printf("Packed vertices: %zu bytes per vertex, %.1f MB, %.1f MB less than full vertices, packed in %.2f ms.\n", sizeof(PackedVertex),
+				double(sizeof(PackedVertex)) * packedVertices.size() / (1024.0 * 1024.0), double(sizeof(Vertex) - sizeof(PackedVertex)) * packedVertices.size() / (1024.0 * 1024.0), packTime);
+			for (size_t i = 0; i < packingErrors.size(); ++i)
+			{
+				const Mesh& mesh = geometry.meshes[i];
+				printf("  Mesh %zu: %u vertices, max error position %.6f (%.4f%% of radius), normal %.2f deg, uv %.6f.\n", i, mesh.vertexCount, packingErrors[i].position,
+					100.0 * packingErrors[i].position / std::max(mesh.boundingSphere.w, 1e-6f), packingErrors[i].normal, packingErrors[i].uv);
+			}
+		}
+		else if (bCompressedGeometry)
+		{
+			if (!InitGeometryStreamBuffer(device, vb, compressedGeometry, GeometryStream::Vertices, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT))
+				return false;
+		}
+		else
+			vb.Init(device, sizeof(Vertex), static_cast<uint32_t>(geometry.vertices.size()), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocalMemPropertyFlags, geometry.vertices.data());
+
+		if (bCompressedGeometry)
+		{
+			if (compressedGeometry.GetElementCount(GeometryStream::Indices) > 0 &&
+				!InitGeometryStreamBuffer(device, ib, compressedGeometry, GeometryStream::Indices, VK_BUFFER_USAGE_INDEX_BUFFER_BIT))
+				return false;
+		}
+		else
+		{
+
+			if (!geometry.indices.empty())
+			{
+				ib.Init(device, sizeof(uint32_t), static_cast<uint32_t>(geometry.indices.size()), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocalMemPropertyFlags, geometry.indices.data());
+			}
+		}
+
+#if USE_MESHLETS
+		GpuBuffer& meshletDataBuffer = g_BufferMgr.meshletDataBuffer;
+		if (bCompressedGeometry)
+		{
+			if (!InitGeometryStreamBuffer(device, meshletDataBuffer, compressedGeometry, GeometryStream::MeshletData, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT))
+				return false;
+		}
+		else
+			meshletDataBuffer.Init(device, sizeof(uint32_t), static_cast<uint32_t>(geometry.meshletData.size()), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocalMemPropertyFlags, geometry.meshletData.data());
+#endif
+
+		return true;
+	};
+
+	if (!InitGeometryBuffers())
+	{
+		// The copies of the undecoded memory are pending, the buffers can only go once they're done
+		g_StagingUploader.Flush();
+		g_StagingUploader.Wait();
+		vb.Destroy(device);
+		vb = {};
+		ib.Destroy(device);
+		ib = {};
+#if USE_MESHLETS
+		g_BufferMgr.meshletDataBuffer.Destroy(device);
+		g_BufferMgr.meshletDataBuffer = {};
+#endif
+
+		printf("ERROR::Corrupted geometry cache, rebuilding %s from the sources.\n", geometryCachePath.c_str());
+		geometryCache.Close();
+		std::remove(geometryCachePath.c_str());
+
+		if (!LoadCachedGeometry(geometryCache, loadedGeometry, geometry, geometryCachePath, objFilePaths, USE_MESHLETS, USE_GEOMETRY_COMPRESSION, USE_CLUSTER_LOD) ||
+			geometry.meshes.size() != meshCount || !InitGeometryBuffers())
+		{
+			std::cout << "ERROR::Geometry rebuild failed!\n";
+			return -1;
+		}
 	}
 
 	GpuBuffer& meshBuffer = g_BufferMgr.meshBuffer;
 	meshBuffer.Init(device, sizeof(Mesh), static_cast<uint32_t>(geometry.meshes.size()), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocalMemPropertyFlags, geometry.meshes.data());
 
+	// Starts at 0, the last workgroup of each build resets it
+	const uint32_t depthPyramidCounter = 0;
+	g_BufferMgr.depthPyramidCounterBuffer.Init(device, sizeof(uint32_t), 1, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocalMemPropertyFlags, &depthPyramidCounter);
+
 	// Indirect draw command buffers
 #if USE_MULTI_DRAW_INDIRECT
 	// Preparing indirect draw commands
@@ -1779,106 +2841,170 @@ int main()
 #else
 	const uint32_t DrawCount = DRAW_COUNT;
 #endif
-	const float SceneRadius = SCENE_RADIUS;
-
 	g_ViewUniformBufferParameters.drawCount = DrawCount;
 
 	std::srand(42);
 
-	std::vector<MeshDraw> meshDraws(DrawCount);
-	uint32_t meshletVisibilityCount = 0;
+	// Room for the instances to change meshes and for the fragmentation of the ranges, twice the bits of the initial scene on average
+	uint64_t meshletCountSum = 0;
+	uint32_t maxMeshletCount = 0;
+	for (const auto& mesh : geometry.meshes)
+	{
+		meshletCountSum += mesh.lods[0].meshletCount;
+		maxMeshletCount = std::max(maxMeshletCount, mesh.lods[0].meshletCount);
+	}
+	const uint32_t meshletVisibilityCount = static_cast<uint32_t>(std::min<uint64_t>(uint64_t(DrawCount) * maxMeshletCount, 2 * DrawCount * meshletCountSum / meshCount + maxMeshletCount));
+
+	g_InstanceMgr.Init(geometry.meshes, DrawCount, meshletVisibilityCount, g_UsePackedDraws);
+	g_InstanceHandles.reserve(DrawCount);
+
 	uint32_t taskGroupCount = 0;
 	for (uint32_t i = 0; i < DrawCount; ++i)
 	{
-		auto& draw = meshDraws[i];
-
-		// World matrix
-		auto t = glm::ballRand<float>(SceneRadius);
-		auto s = glm::linearRand(1.0f, 2.0f);
-		s *= 2.0f;
-		
-		auto theta = glm::radians(glm::linearRand<float>(0.0f, 180.0));
-		auto axis = glm::sphericalRand(1.0f);
-		auto r = glm::quat(cosf(theta), axis * sinf(theta));
+		InstanceDesc desc = GetRandomInstanceDesc(meshCount);
 
 #if DEBUG_SINGLE_DRAWCALL
-		t = positions[i];
-		s = 1.0f;
-		r = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+		desc.position = positions[i];
+		desc.orientation = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		desc.scale = 1.0f;
 #endif
 
-		glm::mat4 worldMat = glm::mat4_cast(r);
-		worldMat[0] = worldMat[0] * s;
-		worldMat[1] = worldMat[1] * s;
-		worldMat[2] = worldMat[2] * s;
-		worldMat[3] = glm::vec4(t.x, t.y, t.z, +1.0f);
+		g_InstanceHandles.push_back(g_InstanceMgr.Add(desc));
 
-		draw.worldMatRow0 = glm::vec4(worldMat[0][0], worldMat[1][0], worldMat[2][0], worldMat[3][0]);
-		draw.worldMatRow1 = glm::vec4(worldMat[0][1], worldMat[1][1], worldMat[2][1], worldMat[3][1]);
-		draw.worldMatRow2 = glm::vec4(worldMat[0][2], worldMat[1][2], worldMat[2][2], worldMat[3][2]);
+		taskGroupCount += DivideAndRoundUp(geometry.meshes[desc.meshIndex].lods[0].meshletCount, TASK_GROUP_SIZE);
+	}
+
+	printf("Total meshlet visibility count: %d (capacity %d), total task group count: %d.\n", g_InstanceMgr.GetMeshletVisibilityCount(), meshletVisibilityCount, taskGroupCount);
 
-		// Draw command data
-		uint32_t meshId = glm::linearRand<uint32_t>(0, meshCount-1);
-		const Mesh& mesh = geometry.meshes[meshId];
+	// Each cull pass reads the whole draw buffer
+	const uint32_t drawStride = g_InstanceMgr.GetDrawStride();
+	printf("%s draws: %u bytes per draw, %.1f MB per cull pass, %.1f MB less than full draws.\n", g_UsePackedDraws ? "Packed" : "Full", drawStride,
+		double(drawStride) * DrawCount / (1024.0 * 1024.0), double(sizeof(MeshDraw) - drawStride) * DrawCount / (1024.0 * 1024.0));
 
-		draw.meshIndex = meshId;
-		draw.vertexOffset = mesh.vertexOffset;
-		draw.meshletVisibilityOffset = meshletVisibilityCount;
+	// Indirect draw command buffer, the following changes of the instances are scattered into it
+	std::vector<uint8_t> drawData;
+	g_InstanceMgr.WriteDraws(drawData);
+
+	GpuBuffer& drawBuffer = g_BufferMgr.drawDataBuffer;
+	drawBuffer.Init(device, drawStride, DrawCount, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		deviceLocalMemPropertyFlags, drawData.data());
+
+	for (auto& drawScatterBuffer : g_BufferMgr.drawScatterBuffers)
+		drawScatterBuffer.Init(device, g_InstanceMgr.GetScatterStride(), INSTANCE_SCATTERS_PER_FRAME, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocalMemPropertyFlags);
+
+	// Room for the commands of all the draws at lod 0, shrunk to the visible ones once their peaks are read back
+	{
+		const uint32_t commandCount = USE_COMPUTE_CLUSTER_CULLING || g_UseTaskSubmit ? taskGroupCount : DrawCount;
+		const uint32_t maxCapacity = GetMaxDrawCommandCapacity(device);
+		g_DrawCommandCapacity.Init(GetDrawCommandCapacity(commandCount, maxCapacity), maxCapacity);
+		InitDrawArgsBuffer(device, 0);
 
-		meshletVisibilityCount += mesh.lods[0].meshletCount;
-		taskGroupCount += DivideAndRoundUp(mesh.lods[0].meshletCount, TASK_GROUP_SIZE);
+		const GpuBuffer& drawArgsBuffer = g_BufferMgr.drawArgsBuffer;
+		printf("Draw args buffer: %u commands, %.2f MB, grown and shrunk with the visible commands.\n", drawArgsBuffer.elementCount, drawArgsBuffer.size / (1024.0 * 1024.0));
 	}
 
-	printf("Total meshlet visibility count: %d, total task group count: %d.\n", meshletVisibilityCount, taskGroupCount);
+	for (auto& drawCommandStatsBuffer : g_BufferMgr.drawCommandStatsBuffers)
+		drawCommandStatsBuffer.Init(device, sizeof(DrawCommandStats), 1, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-	// Indirect draw command buffer
-	GpuBuffer& drawBuffer = g_BufferMgr.drawDataBuffer;
-	drawBuffer.Init(device, sizeof(MeshDraw), DrawCount, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-		deviceLocalMemPropertyFlags, meshDraws.data());
+	// Bound by the culling shaders even when the stats are off
+	const uint32_t cullStatsCount = CULL_STATS_PASS_COUNT * CULL_STATS_COUNTER_COUNT;
+	g_BufferMgr.cullStatsBuffer.Init(device, sizeof(uint32_t), cullStatsCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocalMemPropertyFlags);
+	if (g_CullStatsEnabled)
+	{
+		for (auto& cullStatsReadbackBuffer : g_BufferMgr.cullStatsReadbackBuffers)
+			cullStatsReadbackBuffer.Init(device, sizeof(uint32_t), cullStatsCount, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-	GpuBuffer& drawArgsBuffer = g_BufferMgr.drawArgsBuffer;
-#if 0
-	drawArgsBuffer.Init(device, sizeof(MeshDrawCommand), DrawCount, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, deviceLocalMemPropertyFlags);
-#else
-	drawArgsBuffer.Init(device, 4, g_BufferSize/4, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, deviceLocalMemPropertyFlags);
-#endif
+		if (!g_CullStatsPath.empty())
+		{
+			if (g_CullStatsWriter.Open(g_CullStatsPath))
+				printf("Culling stats: written per frame to %s.\n", g_CullStatsPath.c_str());
+			else
+				printf("Culling stats: failed to open %s.\n", g_CullStatsPath.c_str());
+		}
+	}
 
-	const uint32_t drawCountArgsCount = 3; // draw count or dispatch task X/Y/Z groups
+	// Draw count or dispatch task X/Y/Z groups, then the command counts of `DrawCommandCapacity.h`
+	const uint32_t drawCountArgsCount = sizeof(DrawCommandCounts) / sizeof(uint32_t);
 	GpuBuffer& drawCountBuffer = g_BufferMgr.drawCountBuffer;
-	drawCountBuffer.Init(device, sizeof(uint32_t), drawCountArgsCount, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocalMemPropertyFlags);
+	drawCountBuffer.Init(device, sizeof(uint32_t), drawCountArgsCount, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocalMemPropertyFlags);
 
 	GpuBuffer& drawVisibilityBuffer = g_BufferMgr.drawVisibilityBuffer;
-	drawVisibilityBuffer.Init(device, sizeof(uint32_t), DrawCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocalMemPropertyFlags);
+	// `VisibilityPacking.h` states, 4 draws per word
+	const uint32_t drawVisibilityWordCount = DivideAndRoundUp(DrawCount, DRAW_VISIBILITY_STATES_PER_WORD);
+	drawVisibilityBuffer.Init(device, sizeof(uint32_t), drawVisibilityWordCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocalMemPropertyFlags);
+	printf("Draw visibility: %.2f MB read per cull pass (%.2f MB with a word per draw), visibility history: %u frames.\n",
+		double(drawVisibilityBuffer.size) / (1024.0 * 1024.0), double(DrawCount) * sizeof(uint32_t) / (1024.0 * 1024.0), g_VisibilityHistoryFrames);
+
+	// Written for all the threads of the culling workgroups
+	const uint32_t cullGroupCount = DivideAndRoundUp(DrawCount, 64);
+	g_BufferMgr.drawCommandInfoBuffer.Init(device, sizeof(uint32_t), cullGroupCount * 64, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, deviceLocalMemPropertyFlags);
+	g_BufferMgr.groupCommandCountBuffer.Init(device, sizeof(uint32_t), cullGroupCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, deviceLocalMemPropertyFlags);
 #endif
 
 #if USE_MESHLETS
+	// The task shaders read a meshlet header per thread
 	GpuBuffer& meshletBuffer = g_BufferMgr.meshletBuffer;
-	meshletBuffer.Init(device, sizeof(Meshlet), static_cast<uint32_t>(geometry.meshlets.size()), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocalMemPropertyFlags, geometry.meshlets.data());
+	if (g_UsePackedMeshlets)
+	{
+		std::vector<PackedMeshlet> packedMeshlets;
+		PackMeshletHeaders(packedMeshlets, geometry);
+		meshletBuffer.Init(device, sizeof(PackedMeshlet), static_cast<uint32_t>(packedMeshlets.size()), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocalMemPropertyFlags, packedMeshlets.data());
+	}
+	else
+	{
+		meshletBuffer.Init(device, sizeof(Meshlet), static_cast<uint32_t>(geometry.meshlets.size()), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocalMemPropertyFlags, geometry.meshlets.data());
+	}
 
-	GpuBuffer& meshletDataBuffer = g_BufferMgr.meshletDataBuffer;
-	meshletDataBuffer.Init(device, sizeof(uint32_t), static_cast<uint32_t>(geometry.meshletData.size()), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocalMemPropertyFlags, geometry.meshletData.data());
+	const size_t meshletStride = g_UsePackedMeshlets ? sizeof(PackedMeshlet) : sizeof(Meshlet);
+	printf("%s meshlets: %zu bytes per meshlet, %.1f MB, %.1f MB less than full meshlets.\n", g_UsePackedMeshlets ? "Packed" : "Full", meshletStride,
+		double(meshletStride) * geometry.meshlets.size() / (1024.0 * 1024.0), double(sizeof(Meshlet) - meshletStride) * geometry.meshlets.size() / (1024.0 * 1024.0));
 
 	GpuBuffer& meshletVisibilityBuffer = g_BufferMgr.meshletVisibilityBuffer;
 	uint32_t mvbSize = DivideAndRoundUp(meshletVisibilityCount, 32); // 1 bit per meshlet visibility
 	meshletVisibilityBuffer.Init(device, sizeof(uint32_t), mvbSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocalMemPropertyFlags);
 #endif
 
+#if USE_COMPUTE_CLUSTER_CULLING
+	GpuBuffer& clusterDrawArgsBuffer = g_BufferMgr.clusterDrawArgsBuffer;
+	clusterDrawArgsBuffer.Init(device, sizeof(MeshDrawCommand), CLUSTER_CULL_MAX_DRAWS, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, deviceLocalMemPropertyFlags);
+
+	GpuBuffer& clusterIndexBuffer = g_BufferMgr.clusterIndexBuffer;
+	clusterIndexBuffer.Init(device, sizeof(uint32_t), CLUSTER_CULL_MAX_TRIANGLES * 3, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, deviceLocalMemPropertyFlags);
+
+	const uint32_t clusterCountArgsCount = 2; // draw count, index count
+	GpuBuffer& clusterCountBuffer = g_BufferMgr.clusterCountBuffer;
+	clusterCountBuffer.Init(device, sizeof(uint32_t), clusterCountArgsCount, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, deviceLocalMemPropertyFlags);
+
+	printf("Compute cluster culling: %u draws, %u triangles, %.1f MB.\n", CLUSTER_CULL_MAX_DRAWS, CLUSTER_CULL_MAX_TRIANGLES,
+		double(clusterDrawArgsBuffer.size + clusterIndexBuffer.size) / (1024.0 * 1024.0));
+#endif
+
 	// Renderers
 #if DRAW_METABALLS
 	g_Metaballs.Init(device, colorAttachmentFormats, depthFormat);
 #endif
 
+	// Submit the startup uploads, the first frame is ordered after them on the GPU
+	g_StagingUploader.Flush();
+	{
+		const auto& uploadStats = g_StagingUploader.GetStats();
+		printf("Staging uploads: %.2f MB in %u batches, %u copies, %u stalls.\n", uploadStats.uploadedBytes / (1024.0 * 1024.0), uploadStats.batchCount, uploadStats.copyCount, uploadStats.stallCount);
+	}
+
 	g_Time = 0.0;
 	// Frame time
 	uint32_t currentFrame = 0;
 	double currentFrameTime = glfwGetTime() * 1000.0;
 	double avgCpuFrame = 0.0;
 
-	const double timestampPeriod = device.properties.limits.timestampPeriod * 1e-6;
-	double avgGpuFrame = 0.0;
-
 	// Pipeline statistics
 	uint32_t pipelineQueryResults[4] = {};
+
+	// Frames in flight with `DrawCommandStats` to read
+	bool drawCommandStatsRecorded[MAX_FRAMES_IN_FLIGHT] = {};
+	// Frame recorded in each frame in flight, 0 - none
+	uint64_t frameIndex = 0;
+	uint64_t recordedFrameIndices[MAX_FRAMES_IN_FLIGHT] = {};
 	uint32_t triangleCount = 0;
 
 	// Resize
@@ -1895,6 +3021,9 @@ int main()
 		// recreate view dependent textures
 		g_BufferMgr.InitViewDependentBuffers(device, renderExtent, colorFormat, depthFormat);
 
+		if (g_DepthPyramidValidation.bRequested)
+			g_DepthPyramidValidation.Init(device, g_BufferMgr.depthBuffer, g_BufferMgr.depthPyramid);
+
 		g_ViewUniformBufferParameters.viewportRect = glm::vec4(0.0f, 0.0f, renderExtent.width, renderExtent.height);
 		g_ViewUniformBufferParameters.depthPyramidSize = glm::vec4(renderExtent.width / 2, renderExtent.height / 2, // depth pyramid viewport size
 			depthPyramid.extent.width, depthPyramid.extent.height); // depth pyramid buffer size
@@ -1944,8 +3073,14 @@ int main()
 		// Update camera
 		camera.UpdateAnim();
 
+		// Update instances
+		if (INSTANCE_CHURN_PER_FRAME > 0)
+			ChurnInstances(INSTANCE_CHURN_PER_FRAME, static_cast<uint32_t>(geometry.meshes.size()));
+		g_InstanceMgr.Compact();
+
 		// Update uniforms
 
+		g_ViewUniformBufferParameters.drawCount = g_InstanceMgr.GetDrawCount();
 		g_ViewUniformBufferParameters.viewProjMatrix = camera.GetViewProjMatrix();
 		g_ViewUniformBufferParameters.viewMatrix = camera.GetViewMatrix();
 		g_ViewUniformBufferParameters.projMatrix = camera.GetProjMatrix();
@@ -1957,6 +3092,7 @@ int main()
 			g_ViewUniformBufferParameters.frustumPlanes[2].y,
 			g_ViewUniformBufferParameters.frustumPlanes[2].z);
 		g_ViewUniformBufferParameters.zNearFar = glm::vec4(camera.m_ClipPlanes.x, MAX_DRAW_DISTANCE, 0, 0);
+		g_ViewUniformBufferParameters.lodParams = GetLodSelectionParams(camera.GetProjMatrix(), float(renderExtent.height), g_LodErrorThreshold, LOD_HYSTERESIS);
 		// Max draw distance
 		g_ViewUniformBufferParameters.frustumPlanes[5] = glm::vec4(0, 0, -1, -MAX_DRAW_DISTANCE);
 		viewUniformBuffer.Update(device, &g_ViewUniformBufferParameters, sizeof(g_ViewUniformBufferParameters), 1);
@@ -1980,7 +3116,51 @@ int main()
 
 		// Fetch back buffer
 		vkWaitForFences(device, 1, &currentSyncObjects.inFlightFence, VK_TRUE, UINT64_MAX);
-		
+
+		// Draw args buffer, resized between the frames. The stats of this frame in flight are complete, the others aren't waited for.
+		// A replaced buffer is retired, the other frame in flight may still use it.
+		ReleaseRetiredDrawArgsBuffers(device, frameIndex);
+
+		if (GetDrawCommandStride() != g_BufferMgr.drawArgsBuffer.stride)
+		{
+			// Task submit toggled, same bytes for the other command type
+			const uint32_t maxCapacity = GetMaxDrawCommandCapacity(device);
+			g_DrawCommandCapacity.Init(std::min(std::max(uint32_t(g_BufferMgr.drawArgsBuffer.size / GetDrawCommandStride()), DRAW_COMMAND_MIN_CAPACITY), maxCapacity), maxCapacity);
+			InitDrawArgsBuffer(device, frameIndex);
+			viewUniformBuffer.Update(device, &g_ViewUniformBufferParameters, sizeof(g_ViewUniformBufferParameters), 1);
+
+			for (bool& bRecorded : drawCommandStatsRecorded)
+				bRecorded = false;
+		}
+		else if (drawCommandStatsRecorded[currentFrame])
+		{
+			drawCommandStatsRecorded[currentFrame] = false;
+
+			DrawCommandStats stats;
+			memcpy(&stats, g_BufferMgr.drawCommandStatsBuffers[currentFrame].data, sizeof(stats));
+
+			if (stats.overflowCommandCount > 0)
+				printf("Draw args buffer overflow: %u commands dropped, %u requested for %u.\n", stats.overflowCommandCount, stats.peakCommandCount, g_DrawCommandCapacity.GetCapacity());
+
+			if (g_DrawCommandCapacity.Update(stats))
+			{
+				InitDrawArgsBuffer(device, frameIndex);
+				viewUniformBuffer.Update(device, &g_ViewUniformBufferParameters, sizeof(g_ViewUniformBufferParameters), 1);
+
+				printf("Draw args buffer: %u commands, %.2f MB, peak %u commands.\n", g_BufferMgr.drawArgsBuffer.elementCount, g_BufferMgr.drawArgsBuffer.size / (1024.0 * 1024.0), stats.peakCommandCount);
+			}
+		}
+
+		// Culling stats of the frame last recorded in this frame in flight
+		if (g_CullStatsEnabled && recordedFrameIndices[currentFrame] > 0)
+		{
+			g_CullStats.frameIndex = recordedFrameIndices[currentFrame];
+			memcpy(g_CullStats.counters, g_BufferMgr.cullStatsReadbackBuffers[currentFrame].data, sizeof(g_CullStats.counters));
+			recordedFrameIndices[currentFrame] = 0;
+
+			g_CullStatsWriter.Write(g_CullStats);
+		}
+
 		uint32_t imageIndex = 0;
 		VkResult result = swapchain.AcquireNextImage(device, currentSyncObjects.imageAvailableSemaphore, &imageIndex);
 		if (result == VK_ERROR_OUT_OF_DATE_KHR || g_FramebufferResized)
@@ -1992,7 +3172,22 @@ int main()
 		// Only reset the fence if we are submitting work
 		vkResetFences(device, 1, &currentSyncObjects.inFlightFence);
 
+		// Resolves the frame last recorded in this frame in flight
+		g_Profiler.BeginFrame(currentFrame, frameIndex + 1);
+
+		{
+			ProfileScope scope(VK_NULL_HANDLE, "Upload");
+
+			UploadDrawScatters(currentFrame);
+			g_StagingUploader.Flush();
+		}
+
+		g_ReadbackIndex = currentFrame;
 		Render(currentCommandBuffer, framebuffers, swapchain, imageIndex, geometry, graphicsQueue, currentSyncObjects);
+		drawCommandStatsRecorded[currentFrame] = true;
+		recordedFrameIndices[currentFrame] = ++frameIndex;
+
+		g_Profiler.EndFrame();
 
 		{
 			auto cmd = Niagara::BeginSingleTimeCommands();
@@ -2014,6 +3209,13 @@ int main()
 
 		currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 
+		if (g_DepthPyramidValidation.bRecorded)
+		{
+			vkDeviceWaitIdle(device);
+			g_DepthPyramidValidation.Check();
+			g_DepthPyramidValidation.Destroy(device);
+		}
+
 		// Cpu times
 		{
 			double frameEndTime = glfwGetTime() * 1000.0;
@@ -2024,17 +3226,8 @@ int main()
 			avgCpuFrame = avgCpuFrame * 0.95 + g_DeltaTime * 0.05;
 		}
 
-		// Gpu times
-		{
-			uint64_t timestampResults[2] = {};
-			VK_CHECK(g_CommonQueryPools.queryPools[0].GetResults(device, 0, ARRAYSIZE(timestampResults), sizeof(timestampResults), timestampResults, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT));
-
-			double frameGpuBegin = double(timestampResults[0]) * timestampPeriod;
-			double frameGpuEnd = double(timestampResults[1]) * timestampPeriod;
-			double deltaGpuTime = frameGpuEnd - frameGpuBegin;
-
-			avgGpuFrame = avgGpuFrame * 0.95 + deltaGpuTime * 0.05;
-		}
+		// Gpu times, of the frames resolved by the profiler
+		const double avgGpuFrame = g_Profiler.GetScopeStats("Frame").gpu.avgMs;
 
 		// Pipeline queries
 		double trianglesPerSec = 0;
@@ -2046,6 +3239,14 @@ int main()
 
 		char title[256];
 		sprintf_s(title, "Cpu %.2f ms, Gpu %.2f ms, Tris %.2fM", avgCpuFrame, avgGpuFrame, double(triangleCount) * 1e-6);
+		if (g_CullStatsEnabled)
+		{
+			// Visible draws of the late pass, meshlets emitted by both passes
+			const size_t titleLength = strlen(title);
+			sprintf_s(title + titleLength, sizeof(title) - titleLength, ", Draws %u/%u, Meshlets %u/%u",
+				g_CullStats.Get(1, CULL_STATS_DRAWS_VISIBLE), g_CullStats.Get(1, CULL_STATS_DRAWS_TESTED),
+				g_CullStats.GetTotal(CULL_STATS_MESHLETS_VISIBLE), g_CullStats.GetTotal(CULL_STATS_MESHLETS_TESTED));
+		}
 		glfwSetWindowTitle(window, title);
 	}
 
@@ -2073,7 +3274,13 @@ int main()
 	for (auto &framebuffer : framebuffers)
 		vkDestroyFramebuffer(device, framebuffer, nullptr);
 	
+	g_StagingUploader.Destroy(device);
+
 	g_BufferMgr.Cleanup(device);
+	g_DepthPyramidValidation.Destroy(device);
+	g_CullStatsWriter.Close();
+
+	g_InstanceMgr.Destroy();
 
 	g_CommandMgr.Cleanup(device);
 
@@ -2081,10 +3288,16 @@ int main()
 
 	g_ShaderMgr.Cleanup(device);
 
+	if (g_ProfileStatsEnabled)
+		g_Profiler.PrintStats();
+	g_Profiler.Destroy(device);
 	g_CommonQueryPools.Destroy(device);
 
 	g_CommonStates.Destroy(device);
 
+	geometryCache.Close();
+	g_JobSystem.Destroy();
+
 	swapchain.Destroy(device);
 
 	device.Destroy();
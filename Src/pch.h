@@ -11,9 +11,44 @@
 #include <limits>		// std::numeric_limits
 #include <algorithm>	// std::clamp
 
+#ifdef _WIN32
 #define NOMINMAX
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
+#else
+// MSVC specifics used by the CPU side code, so that the headless tools also build with GCC / Clang
+#include <cmath>
+#include <cstring>
+
+inline unsigned char _BitScanReverse(unsigned long* index, unsigned long mask)
+{
+	if (mask == 0)
+		return 0;
+	*index = 31 - __builtin_clz(static_cast<uint32_t>(mask));
+	return 1;
+}
+
+inline unsigned char _BitScanForward(unsigned long* index, unsigned long mask)
+{
+	if (mask == 0)
+		return 0;
+	*index = __builtin_ctz(static_cast<uint32_t>(mask));
+	return 1;
+}
+
+#define ARRAYSIZE(a) (sizeof(a) / sizeof(a[0]))
+
+inline int _isnan(double a) { return std::isnan(a); }
+inline int _finite(double a) { return std::isfinite(a); }
+
+inline int memcpy_s(void* dest, size_t destSize, const void* src, size_t count)
+{
+	if (count > destSize)
+		return -1;
+	memcpy(dest, src, count);
+	return 0;
+}
+#endif
 
 // Vulkan
 